@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "calclib/calclib.hpp"
+
+/**
+ * Result of one expression evaluated in a batch
+ */
+struct batchResult {
+    calcLib::Status status; //! Status::ok or the error that stopped evaluation
+    unsigned flags; //! calcLib::StatusFlag bits raised by this expression in ieee mode
+    double value; //! Solved value. Valid only if status is Status::ok
+};
+
+/**
+ * Evaluates many independent expressions on a work-stealing thread pool.
+ * Every worker evaluates with its own calcSession and scratch arena, so the shared calcLib is only read.
+ * The arena holds the token list, the syntax tree and the variable slots. Token text longer than the small string
+ * buffer, the lexer's own tokens, symbol names and the compiled bytecode still come from the global heap.
+ * Long sums and products stay on the worker evaluating them, see expressionView::keepLoopsOnThread.
+ * Work is split by expression length and idle workers steal half of the remaining range of busy ones.
+ */
+class calcBatch {
+    struct pool;
+    std::unique_ptr<pool> impl;
+public:
+    /**
+     * Starts the worker threads
+     * @param calc calculator shared by all workers. Must outlive the batch
+     * @param threadCount number of threads including the calling one. 0 uses all hardware threads
+     */
+    explicit calcBatch(const calcLib &calc, unsigned threadCount = 0);
+
+    /**
+     * Stops and joins the worker threads
+     */
+    ~calcBatch();
+
+    calcBatch(const calcBatch&) = delete;
+    calcBatch& operator=(const calcBatch&) = delete;
+
+    /**
+     * Evaluates expressions in parallel. Every expression starts from a copy of session, so ans does not
+     * leak between them. The calling thread takes part in the work. Only one batch runs at a time.
+     * @param expressions expressions to solve
+     * @param count number of expressions
+     * @param outResults array of count results, filled in the order of expressions
+     * @param session variables available to every expression
+     */
+    void evaluate(const std::string_view *expressions, size_t count, batchResult *outResults,
+                  const calcSession &session);
+
+    /**
+     * Evaluates expressions in parallel with a fresh session
+     * @param expressions expressions to solve
+     * @return results in the order of expressions
+     */
+    std::vector<batchResult> evaluate(const std::vector<std::string_view> &expressions);
+
+    /**
+     * @return number of threads including the calling one
+     */
+    unsigned threadCount() const;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "calclib/scalar.hpp"
+
+/**
+ * Arbitrary precision integer for the exact integer mode of calcLib:
+ *
+ *     basicExpression<bigInteger> expression;
+ *     calc.compile("200!+3^5000", expression);
+ *     bigInteger result;
+ *     calc.evaluate(expression, session, result);
+ *     std::string digits = calc.formatResult(result);
+ *
+ * Magnitude is stored in base 10^9 limbs, so formatting writes every limb as nine digits without any division.
+ * Multiplication switches from schoolbook to Karatsuba above karatsubaThreshold limbs, factorials are products
+ * of balanced binary splitting. Like NaN in double, a bigInteger can be invalid: literals and results that are
+ * not integers, invalid operands propagate to the result.
+ */
+class bigInteger {
+public:
+    using limb = uint32_t;
+    static constexpr limb base = 1000000000; //! Value of one limb position
+    static constexpr unsigned limbDigits = 9; //! Decimal digits per limb
+    static constexpr size_t karatsubaThreshold = 64; //! Limbs of the shorter factor from which Karatsuba beats schoolbook
+    static constexpr size_t maxDigits = 2000000; //! Largest result computed, bigger ones are reported instead of exhausting memory
+
+    /**
+     * Zero
+     */
+    bigInteger() = default;
+
+    bigInteger(int64_t value);
+
+    /**
+     * @return integer that is not a number
+     */
+    static bigInteger invalid();
+
+    /**
+     * Converts a number literal, with optional fraction and exponent as lexed by calcLib
+     * @param text such as "12", "1.5e3" or "2.0"
+     * @return value, invalid() if text is not an integer or has more than maxDigits digits
+     */
+    static bigInteger parse(std::string_view text);
+
+    /**
+     * @param value
+     * @param outInteger exact value
+     * @return false if value is not a finite integer
+     */
+    static bool fromDouble(double value, bigInteger &outInteger);
+
+    bool isValid() const {
+        return valid;
+    }
+
+    bool isNegative() const {
+        return negative;
+    }
+
+    bool isZero() const {
+        return valid && limbs.empty();
+    }
+
+    /**
+     * @return number of decimal digits of the magnitude, 1 for zero
+     */
+    size_t digits() const;
+
+    /**
+     * @return value rounded to double, ±inf if it is out of range and NaN if invalid
+     */
+    double toDouble() const;
+
+    /**
+     * @return log10 of the magnitude to about 15 digits, -inf for zero
+     */
+    double log10() const;
+
+    /**
+     * @param outValue exact value
+     * @return false if the value does not fit int64_t or is invalid
+     */
+    bool toInt64(int64_t &outValue) const;
+
+    /**
+     * @return decimal digits with a leading '-' if negative, "nan" if invalid
+     */
+    std::string toString() const;
+
+    bigInteger& operator+=(const bigInteger &rhs);
+    bigInteger& operator-=(const bigInteger &rhs);
+    bigInteger& operator*=(const bigInteger &rhs);
+    bigInteger operator-() const;
+
+    friend bigInteger operator+(bigInteger lhs, const bigInteger &rhs) {
+        return lhs += rhs;
+    }
+
+    friend bigInteger operator-(bigInteger lhs, const bigInteger &rhs) {
+        return lhs -= rhs;
+    }
+
+    friend bigInteger operator*(bigInteger lhs, const bigInteger &rhs) {
+        return lhs *= rhs;
+    }
+
+    /**
+     * Equality of values, invalid integers are not equal to anything
+     */
+    bool operator==(const bigInteger &rhs) const;
+
+    bool operator!=(const bigInteger &rhs) const {
+        return !(*this == rhs);
+    }
+
+    /**
+     * Order of values, false if either is invalid
+     */
+    bool operator<(const bigInteger &rhs) const;
+
+    /**
+     * Division truncated towards zero, remainder has the sign of lhs
+     * @return Status::divisionByZero if rhs is zero
+     */
+    static calcLib::Status divide(const bigInteger &lhs, const bigInteger &rhs, bigInteger &outQuotient,
+                                  bigInteger &outRemainder);
+
+    /**
+     * @return base^exponent by repeated squaring
+     */
+    static bigInteger pow(const bigInteger &base, uint64_t exponent);
+
+    /**
+     * @return n! as the product of a balanced binary split of 1..n
+     */
+    static bigInteger factorial(uint64_t n);
+
+private:
+    std::vector<limb> limbs; //! Magnitude, least significant limb first, no leading zero limbs
+    bool negative = false; //! Sign, never set for zero
+    bool valid = true;
+
+    void normalize();
+};
+
+template<>
+struct scalarTraits<bigInteger> {
+    static constexpr const char *name = "bigInteger";
+
+    static bigInteger nan() {
+        return bigInteger::invalid();
+    }
+
+    static bigInteger parse(const std::string &text) {
+        return bigInteger::parse(text);
+    }
+
+    /**
+     * @param value
+     * @param precision number of zeros after the decimal point
+     * @return digits of value
+     */
+    static std::string format(const bigInteger &value, int precision);
+};
+
+/**
+ * Operations of the integer mode. Arithmetic, %, ^, !, comparisons, min, max and abs are exact. Division and
+ * functions succeed when the result is an integer, such as 12/4, sqrt(16) or log(1000), and fail with
+ * Status::domainError otherwise. Powers and factorials beyond bigInteger::maxDigits digits fail with Status::domainError too.
+ */
+template<>
+calcLib::Status basicExpression<bigInteger>::apply(Opcode op, bigInteger lhs, bigInteger rhs, bigInteger &outResult);
+
+/**
+ * Binds session variables and constants that are integers, fails with Status::domainError on others such as pi.
+ * ans is stored rounded to double.
+ */
+template<>
+calcLib::Status calcLib::evaluate(const basicExpression<bigInteger> &expression, calcSession &session,
+                                  bigInteger &outResult) const;
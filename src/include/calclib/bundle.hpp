@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "calclib/expression.hpp"
+
+/**
+ * Builds an expression bundle file: named compiled expressions and optionally the variables of a session.
+ *
+ * The file is position independent, every reference is an offset from its start, and all records are
+ * 8 byte aligned, so expressionBundle evaluates straight from the mapped file.
+ */
+class bundleWriter {
+    struct namedExpression {
+        std::string name;
+        compiledExpression expression;
+    };
+    std::vector<namedExpression> expressions;
+    std::vector<std::pair<std::string, double>> variables;
+public:
+    /**
+     * Adds expression under name. Names should be unique, lookup returns any of the duplicates.
+     * @param name key used by expressionBundle::find
+     * @param expression compiled by calcLib::compile
+     */
+    void add(std::string name, const compiledExpression &expression);
+
+    /**
+     * Stores all variables of session including ans
+     * @param session
+     */
+    void addSession(const calcSession &session);
+
+    /**
+     * @return bundle file contents
+     */
+    std::string serialize() const;
+
+    /**
+     * Writes the bundle to a temporary file and renames it to path, so readers never map a partial file
+     * @param path file system path of the bundle
+     * @return false on error, errno describes the failure
+     */
+    bool save(const std::string &path) const;
+};
+
+/**
+ * Read-only bundle of compiled expressions mapped from a file written by bundleWriter.
+ * Nothing is copied on open, the file is only checked once so that a damaged file cannot make
+ * evaluation read out of bounds. Const members are safe to call concurrently.
+ */
+class expressionBundle {
+    const char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false; //! data is an mmap of a file and must be unmapped
+public:
+    static constexpr uint32_t version = 1; //! Format version written by bundleWriter
+
+    expressionBundle() = default;
+    ~expressionBundle();
+
+    expressionBundle(const expressionBundle&) = delete;
+    expressionBundle& operator=(const expressionBundle&) = delete;
+
+    /**
+     * Maps bundle file
+     * @param path file system path of the bundle
+     * @return false if the file cannot be mapped or is not a valid bundle of this version
+     */
+    bool open(const std::string &path);
+
+    /**
+     * Uses bundle already in memory, for example embedded in the executable
+     * @param bundle 8 byte aligned contents of a bundle file. Must outlive this object
+     * @param bundleSize size of bundle in bytes
+     * @return false if bundle is not valid
+     */
+    bool open(const void *bundle, size_t bundleSize);
+
+    /**
+     * Unmaps the bundle
+     */
+    void close();
+
+    /**
+     * @return number of expressions
+     */
+    size_t expressionCount() const;
+
+    /**
+     * @param index expression number
+     * @return name of expression index
+     */
+    std::string_view name(size_t index) const;
+
+    /**
+     * Finds expression by name in O(log n)
+     * @param name
+     * @param outIndex expression number
+     * @return false if there is no such expression
+     */
+    bool find(std::string_view name, size_t &outIndex) const;
+
+    /**
+     * Evaluates expression with variables from session. Result is stored to its ans.
+     * @param calc calculator providing constants and ieee mode
+     * @param index expression number
+     * @param session per-caller state
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    calcLib::Status evaluate(const calcLib &calc, size_t index, calcSession &session, double &outResult) const;
+
+    /**
+     * Sets the variables stored by bundleWriter::addSession, including ans
+     * @param session session to restore into
+     */
+    void restoreSession(calcSession &session) const;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "calclib/expression.hpp"
+
+/**
+ * Thread-safe least recently used cache of compiled expressions keyed by expression text.
+ * Expressions that fail to compile are cached too, so repeated invalid input is rejected without lexing.
+ */
+class expressionCache {
+    struct entry {
+        std::string text;
+        calcLib::Status status;
+        std::shared_ptr<const compiledExpression> expression;
+    };
+    const calcLib &calc;
+    size_t capacity;
+    std::list<entry> entries; //! Most recently used first
+    std::unordered_map<std::string_view, std::list<entry>::iterator> index; //! Keys point into entries
+    mutable std::mutex lock;
+    size_t hitCount = 0;
+    size_t missCount = 0;
+public:
+    /**
+     * @param calc compiler of the expressions. Must outlive the cache
+     * @param capacity maximal number of cached expressions
+     */
+    expressionCache(const calcLib &calc, size_t capacity);
+
+    /**
+     * Returns compiled expression, compiling and inserting it on a miss
+     * @param expression string
+     * @param outExpression shared compiled expression, nullptr if compilation failed
+     * @return status of the compilation
+     */
+    calcLib::Status get(std::string_view expression, std::shared_ptr<const compiledExpression> &outExpression);
+
+    /**
+     * @return number of cached expressions
+     */
+    size_t size() const;
+
+    /**
+     * @return number of lookups served from the cache
+     */
+    size_t hits() const;
+
+    /**
+     * @return number of lookups that had to compile
+     */
+    size_t misses() const;
+};
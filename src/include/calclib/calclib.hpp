@@ -1,36 +1,69 @@
 #pragma once
 
-#include <iostream>
-#include <vector>
-#include <lib/lexertk/lexertk.hpp>
-#include <list>
-#include <variant>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
 
-using Token_type = lexertk::token::token_type;
+class compiledExpression;
+struct expressionView;
+template<typename Scalar>
+class basicExpression;
+struct userFunction;
+
+using userFunctions = std::map<std::string, std::shared_ptr<const userFunction>, std::less<>>; //! calcLib::define by name
 
 /**
- * Custom token. Storing value in double for Token_type::e_number and in std::string for everything else.
+ * Per-caller mutable evaluation state: ans, user variables and sticky status flags.
+ * A single calcLib can be used from many threads at once as long as every thread evaluates with its own session.
  */
-class Token{
+class calcSession {
+    friend class calcLib;
+    friend class bundleWriter;
+    std::map<std::string, double, std::less<>> variables; //! ans and user variables that can be used in expression
+    unsigned statusFlags; //! Sticky calcLib::StatusFlag bits raised in ieee mode
+    std::pmr::memory_resource *scratch; //! Allocator for temporary buffers used during evaluation
 public:
-    Token_type type; //! The type of token
-    std::variant<double,std::string> value; //! Storing value in double for number and in std::string for everything else.
     /**
-     * Constructs "Calclib" tokens from lexertk tokens.
-     * @param lexertk_token
-     * @return Token
+     * Creates session with ans set to 0
      */
-    static Token fromLexertk(const lexertk::token &lexertk_token);
+    calcSession();
+
     /**
-     * Almost default comparator but rhs.type can be e_none and still match if value is equal.
-     * @param rhs
-     * @return
+     * Defines or overwrites a variable. User variables shadow the calcLib constants.
+     * @param name symbol used in expression
+     * @param value
+     */
+    void setVariable(const std::string &name, double value);
+
+    /**
+     * @param name symbol used in expression
+     * @param outValue value of the variable
+     * @return true if variable exists
+     */
+    bool getVariable(std::string_view name, double &outValue) const;
+
+    /**
+     * @return calcLib::StatusFlag bits raised since the last clearFlags()
      */
-    inline bool operator==(const Token& rhs) const;
+    unsigned flags() const;
+
+    /**
+     * Clears all sticky status flags
+     */
+    void clearFlags();
+
+    /**
+     * Sets allocator for temporary buffers used during evaluation. A per-thread arena avoids contention
+     * on the global allocator. The resource must outlive every evaluation done with this session.
+     * @param resource scratch memory. nullptr restores the default allocator
+     */
+    void setScratch(std::pmr::memory_resource *resource);
 };
 
 /**
- *  Calculator object storing output format settings and variables
+ *  Calculator object storing output format settings and constants. Const members are safe to call concurrently.
  */
 class calcLib {
 public:
@@ -38,10 +71,45 @@ public:
         fixed,
         variable
     };
+    /**
+     * Result of an evaluation step. Errors are propagated by return value instead of exceptions.
+     */
+    enum class Status{
+        ok,
+        syntaxError, //! Expression could not be lexed or brackets do not match
+        invalidExpression, //! Unexpected token sequence
+        divisionByZero,
+        domainError, //! Argument is outside of the function domain
+        workerFailed //! Process evaluating the expression crashed, see calcProcessPool
+    };
+    /**
+     * Sticky status flags raised in ieee mode. They stay set until clearFlags() is called.
+     */
+    enum StatusFlag : unsigned{
+        flagDivisionByZero = 1u << 0,
+        flagInvalid = 1u << 1
+    };
+    /**
+     * Accuracy tier of pow, root, sqrt, log, sin, cos and tan, recorded in the bytecode by compile().
+     * Other operations do not depend on it. Errors are relative to the exact result and checked by
+     * calclib_accuracy_test. faithful is within 1 ulp, except log within libm's 2 ulp, tan and log(base:num)
+     * within 3 and 5 ulp as they divide two results, and root, which rounds 1/degree before pow.
+     */
+    enum class Accuracy{
+        faithful, //! Default, libm and the fdlibm kernels
+        correctlyRounded, //! Double-double evaluation rounded once, unless closer to a tie than about 2^-100
+        fast //! Short polynomials within 1e-12, still 4 digits more than the default precision shows
+    };
     ResultFormat format; //! Desired output format
     int precision; //! Number of decimal places in output string
+    static constexpr int maxPrecision = 1074; //! Decimal places that show every double exactly
+    bool ieeeMode; //! Continue with ±inf/NaN and raise sticky flags instead of failing on division by zero and domain errors
+    unsigned jitThreshold; //! Evaluations of one compiledExpression after which it runs as native code, 0 disables the JIT tier
+    Accuracy accuracy; //! Tier of the functions in expressions compiled from now on, basicExpression keeps its own precision
 private:
-    std::map<std::string, double> variables; //! Map of variables that can be used in expression
+    std::map<std::string, double, std::less<>> constants; //! Immutable constants that can be used in expression
+    userFunctions functions; //! Functions inlined by compile()
+    calcSession defaultSession; //! Session used by the overloads that do not take one
 public:
     /**
      * Default constructor with user friendly defaults
@@ -61,7 +129,164 @@ public:
      */
     std::string solveEquation(std::string expression);
 
+    /**
+     * Thread-safe variant of solveEquation. ans is read from and stored to session.
+     * @param expression string
+     * @param session per-caller state
+     * @return solved expression string or error message
+     */
+    std::string solveEquation(std::string_view expression, calcSession &session) const;
+
+    /**
+     * Solves expression without formatting the result. On success the result is also stored in ans.
+     * @param expression string
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    Status evaluate(std::string_view expression, double &outResult);
+
+    /**
+     * Thread-safe variant of evaluate. ans and variables are read from session, result is stored to its ans.
+     * @param expression string
+     * @param session per-caller state
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    Status evaluate(std::string_view expression, calcSession &session, double &outResult) const;
+
+    /**
+     * Compiles expression into bytecode that can be evaluated repeatedly without parsing.
+     * Symbols are bound at evaluation time, so the result does not depend on any session.
+     * @param expression string
+     * @param outExpression compiled expression
+     * @return Status::syntaxError or Status::invalidExpression if expression is malformed
+     */
+    Status compile(std::string_view expression, compiledExpression &outExpression) const;
+
+    /**
+     * Defines or replaces a function for the expressions compiled from now on, e.g. "f(x:y) = x^2+y*sin(x)".
+     * compile() inlines every call, so constant arguments are folded into the body. An argument is evaluated
+     * where its parameter is used, not at all if the body does not use it. Other names in the body are
+     * variables of the calling expression.
+     * @param definition name, parameters separated by colons in brackets, = and the body
+     * @return Status::syntaxError if definition cannot be lexed, Status::invalidExpression if it is malformed,
+     *         names a builtin function or calls itself directly or through other functions
+     */
+    Status define(std::string_view definition);
+
+    /**
+     * Evaluates compiled expression with variables from session. Result is stored to its ans.
+     * @param expression compiled by compile()
+     * @param session per-caller state
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    Status evaluate(const compiledExpression &expression, calcSession &session, double &outResult) const;
+
+    /**
+     * Compiles expression for the engine evaluating in Scalar: float, double, long double or __float128
+     * when CALCLIB_HAS_FLOAT128 is defined. Literals and folded constants are rounded to Scalar only once.
+     * @param expression string
+     * @param outExpression compiled expression
+     * @return Status::syntaxError or Status::invalidExpression if expression is malformed
+     */
+    template<typename Scalar>
+    Status compile(std::string_view expression, basicExpression<Scalar> &outExpression) const;
+
+    /**
+     * Evaluates expression in Scalar with variables from session. pi and e have the precision of Scalar
+     * unless session shadows them. Result is stored to ans of session rounded to double.
+     * @param expression compiled by compile()
+     * @param session per-caller state
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    template<typename Scalar>
+    Status evaluate(const basicExpression<Scalar> &expression, calcSession &session, Scalar &outResult) const;
+
+    /**
+     * Looks up value of every symbol of expression in session and then in constants
+     * @param expression compiled by compile()
+     * @param session variables to look up before constants
+     * @param outSlots array of expression.symbols.size() values
+     * @return Status::invalidExpression if a symbol is not defined
+     */
+    Status bindSymbols(const compiledExpression &expression, const calcSession &session, double *outSlots) const;
+
+    /**
+     * Looks up value of a single symbol in session and then in constants
+     * @param name symbol used in expression
+     * @param session variables to look up before constants
+     * @param outValue value of the symbol
+     * @return Status::invalidExpression if the symbol is not defined
+     */
+    Status bindSymbol(std::string_view name, const calcSession &session, double &outValue) const;
+
+    /**
+     * Evaluates bytecode that is not owned by a compiledExpression, such as an expression of a mapped expressionBundle.
+     * Result is stored to ans of session.
+     * @param expression bytecode to run
+     * @param slots values of the symbols of expression
+     * @param session per-caller state
+     * @param outResult solved value
+     * @return Status::ok or the error that stopped evaluation
+     */
+    Status evaluate(const expressionView &expression, const double *slots, calcSession &session, double &outResult) const;
+
+    /**
+     * @return StatusFlag bits raised in the default session since the last clearFlags()
+     */
+    unsigned flags() const;
+
+    /**
+     * Clears all sticky StatusFlag bits of the default session
+     */
+    void clearFlags();
+
+    /**
+     * @return session used by the overloads that do not take one
+     */
+    calcSession& session();
+
+    /**
+     * @param status
+     * @return message shown to the user for status
+     */
+    static const char* statusMessage(Status status);
+
+    /**
+     * Converts double to string based on settings stored in calcLib object
+     * @param result
+     * @return formatted double number
+     */
+    std::string formatResult(double result) const;
+
+    /**
+     * Formats result like formatResult(double) into a caller provided buffer without allocating
+     * @param result
+     * @param first start of the output buffer
+     * @param last end of the output buffer
+     * @return end of the written characters or nullptr if the buffer is too small
+     */
+    char* formatResult(double result, char *first, char *last) const;
+
+    /**
+     * Formats result of a basicExpression like formatResult(double), with all digits of Scalar available
+     * @param result
+     * @return formatted number
+     */
+    template<typename Scalar>
+    std::string formatResult(Scalar result) const;
+
 private:
+    friend class compiledExpression;
+    friend struct expressionView;
+    friend class jitExpression;
+    friend struct correctlyRoundedMath;
+    friend struct fastMath;
+    template<typename Scalar>
+    friend class basicExpression;
+
     /**
      * add lhs and rhs together
      * @param lhs
@@ -87,51 +312,88 @@ private:
     static double mul(double lhs, double rhs);
 
     /**
-     * Divide lhs by rhs. If rhs == 0 throw std::overflow_error
+     * Divide lhs by rhs
      * @param lhs
      * @param rhs
-     * @return
+     * @param outResult lhs / rhs. ±inf or NaN if rhs == 0
+     * @return Status::divisionByZero if rhs == 0
      */
-    static double div(double lhs, double rhs);
+    static Status div(double lhs, double rhs, double &outResult);
 
     /**
      * Calculates the remainder after division. Works on floating point numbers unlike C modulo which works on integers.
+     * Integer operands are reduced exactly in int64_t.
      * @param lhs
      * @param rhs
-     * @return lhs % rhs
+     * @param outResult lhs % rhs. NaN if rhs == 0
+     * @return Status::divisionByZero if rhs == 0
      */
-    static double mod(double lhs, double rhs);
+    static Status mod(double lhs, double rhs, double &outResult);
 
     /**
-     * Calculates the sine of a number in degrees
+     * Calculates the sine of a number in degrees. The angle is reduced modulo 360 without rounding,
+     * so multiples of 30 and 90 give exact results
      * @param num
      * @return sine of num
      */
     static double sin(double num);
 
     /**
-     * Calculates the cosine of a number in degrees
+     * Calculates sine of every value in place, for column evaluation
+     * @param values
+     * @param count number of values
+     */
+    static void sin(double *values, size_t count);
+
+    /**
+     * Calculates the cosine of a number in degrees, exact at multiples of 30 and 90 like sin
      * @param num
      * @return cosine of num
      */
     static double cos(double num);
 
+    /**
+     * Calculates cosine of every value in place, for column evaluation
+     * @param values
+     * @param count number of values
+     */
+    static void cos(double *values, size_t count);
+
     /**
      * Calculates the tangents of a number in degrees
      * @param num
-     * @return tangents of num
+     * @param outResult tangents of num. +inf for 90 and -inf for 270 modulo 360
+     * @return Status::divisionByZero for odd multiples of 90
      */
-    static double tan(double num);
+    static Status tan(double num, double &outResult);
+
+    /**
+     * Calculates tangents of every value in place, for column evaluation. Odd multiples of 90 become ±inf
+     * like in the scalar version, reporting the division by zero is up to the caller
+     * @param values
+     * @param count number of values
+     */
+    static void tan(double *values, size_t count);
 
     /**
      * Calculates the square root of a number
      * @param num
-     * @return square root of num
+     * @param outResult square root of num, +0 for -0 like root(2, num)
+     * @return Status::domainError if num < 0
+     */
+    static Status sqrt(double num, double &outResult);
+
+    /**
+     * Calculates the cube root of a number
+     * @param num
+     * @param outResult cube root of num, +0 for -0 like root(3, num)
+     * @return Status::domainError if num < 0, like root(3, num)
      */
-    static double sqrt(double num);
+    static Status cbrt(double num, double &outResult);
 
     /**
-     * Calculates power
+     * Calculates power. Integer base and non-negative integer exponent are raised exactly in int64_t
+     * by repeated squaring until the result overflows.
      * @param base
      * @param exponent
      * @return base to the power of exponent
@@ -139,114 +401,123 @@ private:
     static double pow(double base, double exponent);
 
     /**
-     * Calculates root of a number
-     * @param degree
-     * @param num
-     * @return degree-root of a number
+     * Calculates power by repeated squaring, rounding after every multiplication. Opcode::powInt evaluates it,
+     * the compiler emits it for the exponents of chainedPower.
+     * @param base
+     * @param exponent integer, 1 / base^-exponent if negative. Exponents that are not integers below 2^31
+     * are raised by pow
+     * @return base to the power of exponent
      */
-    static double root(double degree, double num);
+    static double powInt(double base, double exponent);
 
     /**
-     * Calculates logarithm of num with base base
-     * @param base
-     * @param num
-     * @return logarithm of num with base base
+     * Calculates powInt of every base in place, for column evaluation
+     * @param bases
+     * @param exponents
+     * @param count number of values
      */
-    static double log(double base, double num);
+    static void powInt(double *bases, const double *exponents, size_t count);
 
     /**
-     * Calculates the common base 10 logarithm
-     * @param num
-     * @return logarithm of num with base 10
+     * Smaller of two numbers
+     * @param lhs
+     * @param rhs
+     * @return rhs if the numbers are equal, NaN if either is NaN
      */
-    static double log(double num);
+    static double min(double lhs, double rhs);
 
     /**
-     * Calculates factorial of a number. Works with floating numbers decrementing by 1 until num > 1
-     * @param num
-     * @return num factorial
+     * Calculates min of every pair in place, for column evaluation
+     * @param values first operands, replaced by the results
+     * @param others second operands
+     * @param count number of values
      */
-    static double factorial(double num);
+    static void min(double *values, const double *others, size_t count);
 
     /**
-     * Converts double to string based on settings stored in calcLib object
-     * @param result
-     * @return formatted double number
+     * Larger of two numbers
+     * @param lhs
+     * @param rhs
+     * @return rhs if the numbers are equal, NaN if either is NaN
      */
-    std::string formatResult(double result);
+    static double max(double lhs, double rhs);
 
     /**
-     * Lexes string expression into Tokens
-     * @param expression input mathematical expression
-     * @param outTokens Reference to list where tokens should be stored
-     * @return 0 on success 1 or error
+     * Calculates max of every pair in place, for column evaluation
+     * @param values first operands, replaced by the results
+     * @param others second operands
+     * @param count number of values
      */
-    static int parseEquation(std::string_view expression, std::list<Token> &outTokens);
+    static void max(double *values, const double *others, size_t count);
 
     /**
-     * Picks the correct function to call on lhs and rhs based on operation token
-     * @param lhs
-     * @param rhs
-     * @param operation
-     * @throws std::invalid_argument if operation is not supported
-     * @return result of picked operation
+     * @param exponent
+     * @return true if pow(base, exponent) is powInt(base, exponent) for every base, which holds for -1, 0, 1
+     * and 2, whose chains round at most once
      */
-    static double calculateBinaryOperation(double lhs, double rhs, const Token& operation);
+    static bool chainedPower(double exponent);
 
     /**
-     *  Picks the correct function to call on num based on operation Token
+     * Calculates root of a number. Degrees 2 and 3 are sqrt and cbrt.
+     * @param degree
      * @param num
-     * @param operation
-     * @throws std::invalid_argument if operation is not supported
-     * @return result of picked operation
+     * @param outResult degree-root of a number. NaN if num < 0
+     * @return Status::domainError if num < 0, Status::divisionByZero if degree == 0
      */
-    static double calculateUnaryOperation(double num, const Token& operation);
+    static Status root(double degree, double num, double &outResult);
 
     /**
-     * Picks the correct function to call with parameters stored in vector
-     * @param parameters vector<Token>. Tokens must hold double value.
-     * @param function
-     * @throws std::invalid_argument if function is not supported
-     * @return result of picked function
+     * Calculates logarithm of num with base base
+     * @param base
+     * @param num
+     * @param outResult logarithm of num with base base
+     * @return Status::divisionByZero if base == 1
      */
-    static double calculateFunction(const std::vector<Token> &parameters, const Token &function);
+    static Status log(double base, double num, double &outResult);
 
     /**
-     * Finds all occurrences of operation and solves them. (By replacing one token with solution and deleting the rest)
-     * @param tokens expression tokens
-     * @param operation to be solved
-     * @throws std::invalid_argument if there is something else than number tokens on left or right of operation token
-     * @param reverse find operations from right to left
+     * Calculates the common base 10 logarithm
+     * @param num
+     * @return logarithm of num with base 10
+     */
+    static double log(double num);
+
+    /**
+     * Calculates factorial of a number. Integers up to calclib::maxFactorial are looked up in a table,
+     * other numbers are Γ(num + 1).
+     * @param num
+     * @return num factorial, inf above the double range and NaN for negative integers
      */
-    static void solveBinaryOperation(std::list<Token> &tokens, const Token& operation, bool reverse);
+    static double factorial(double num);
 
     /**
-     * Merges number tokens and sign tokens together. for eg: tokens{-,5} -> tokens{-5}
-     * @param tokens expression tokens
+     * Calculates factorial of every value in place, for column evaluation
+     * @param values
+     * @param count number of values
      */
-    static void solveUnaryPlusMinus(std::list<Token> &tokens);
+    static void factorial(double *values, size_t count);
 
     /**
-     * Solve unary operation that has number token on the left. for eg: factorial
-     * @param tokens expression tokens
-     * @param operation to be solved
+     * Gamma function, Lanczos approximation for small x, Stirling series for large x and reflection below 0.5
+     * @param x
+     * @return Γ(x), relative error below 1e-14 except close to the poles
      */
-    static void solveLeftAssociativeUnary(std::list<Token> &tokens, const Token &operation);
+    static double gamma(double x);
 
     /**
-     * Function is a symbol token followed by left bracket and 0-n numbers delimited
-     * with colon. It is ended with right bracket.
-     * If such function is found it's appropriate C function is called and the result is placed in one of the tokens
-     * all other function tokens are deleted.
-     * @throws std::invalid_arguments if start of function is followed by unexpected token
-     * @param tokens expression tokens
+     * Compiles expression using scratch for temporary buffers
+     * @param expression string
+     * @param outExpression compiled expression
+     * @param scratch allocator for tokens and the syntax tree
+     * @return Status::syntaxError or Status::invalidExpression if expression is malformed
      */
-    static void solveFunctions(std::list<Token> &tokens);
+    Status compile(std::string_view expression, compiledExpression &outExpression, std::pmr::memory_resource *scratch) const;
 
     /**
-     * Finds a token matching variable and replaces it with its corresponding variable.
-     * @param tokens expression tokens
-     * @param variable to be replaced with number
+     * Decides whether evaluation can continue after status.
+     * @param status returned by a math helper
+     * @param ieeeFlags sticky flags to raise in ieee mode. nullptr if ieee mode is off
+     * @return Status::ok if evaluation continues with the IEEE result, status otherwise
      */
-    void solveVariable(std::list<Token> &tokens, const Token &variable);
+    static Status absorbStatus(Status status, unsigned *ieeeFlags);
 };
@@ -0,0 +1,117 @@
+#ifndef CALCLIB_C_H
+#define CALCLIB_C_H
+
+#include <stddef.h>
+
+/**
+ * Stable C interface of calclib, exported by libcalclib.so.
+ *
+ * Expressions are compiled once against a list of variable names. Each variable is then read from
+ * an array of values indexed like the list, or from a column of such arrays for batches, so no text
+ * is formatted or parsed per row.
+ */
+
+#define CALCLIB_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Values mirror calcLib::Status, except CALCLIB_OUT_OF_RESOURCES
+ */
+enum calclib_status {
+    CALCLIB_OK = 0,
+    CALCLIB_SYNTAX_ERROR = 1,
+    CALCLIB_INVALID_EXPRESSION = 2,
+    CALCLIB_DIVISION_BY_ZERO = 3,
+    CALCLIB_DOMAIN_ERROR = 4,
+    CALCLIB_WORKER_FAILED = 5,
+    CALCLIB_OUT_OF_RESOURCES = 6 /* Memory could not be allocated */
+};
+
+/**
+ * Sticky ieee mode flags reported by the evaluation functions, values mirror calcLib::StatusFlag
+ */
+enum calclib_flag {
+    CALCLIB_FLAG_DIVISION_BY_ZERO = 1,
+    CALCLIB_FLAG_INVALID = 2
+};
+
+/**
+ * Most variables a compiled expression may use
+ */
+#define CALCLIB_MAX_VARIABLES 256
+
+typedef struct calclib_context calclib_context;
+typedef struct calclib_expression calclib_expression;
+
+/**
+ * @return new context with default settings, NULL if out of memory
+ */
+CALCLIB_API calclib_context* calclib_create(void);
+
+/**
+ * Destroys context. Expressions compiled by it stay valid.
+ */
+CALCLIB_API void calclib_destroy(calclib_context *context);
+
+/**
+ * Switches ieee mode, division by zero and domain errors then yield inf/nan instead of an error
+ * @param enabled non-zero to enable
+ */
+CALCLIB_API void calclib_set_ieee_mode(calclib_context *context, int enabled);
+
+/**
+ * Compiles expression
+ * @param expression text of the expression, does not need to be NUL terminated
+ * @param length length of expression in bytes
+ * @param variables names of the variables the expression may use, NULL if variableCount is 0
+ * @param variableCount number of variables
+ * @param outExpression compiled expression, free it with calclib_expression_free. NULL on error
+ * @return CALCLIB_OK, CALCLIB_SYNTAX_ERROR, CALCLIB_INVALID_EXPRESSION or CALCLIB_OUT_OF_RESOURCES. Unknown names
+ *         are invalid, so is using more than CALCLIB_MAX_VARIABLES variables
+ */
+CALCLIB_API int calclib_compile(const calclib_context *context, const char *expression, size_t length,
+                                const char *const *variables, size_t variableCount,
+                                calclib_expression **outExpression);
+
+/**
+ * Frees compiled expression, NULL is ignored
+ */
+CALCLIB_API void calclib_expression_free(calclib_expression *expression);
+
+/**
+ * Evaluates expression for one set of variable values
+ * @param values variableCount values in the order given to calclib_compile
+ * @param outResult solved value
+ * @param outFlags calclib_flag bits raised in ieee mode, 0 otherwise. May be NULL
+ * @return CALCLIB_OK or the error that stopped evaluation
+ */
+CALCLIB_API int calclib_evaluate(const calclib_context *context, const calclib_expression *expression,
+                                 const double *values, double *outResult, unsigned *outFlags);
+
+/**
+ * Evaluates expression for rows sets of variable values in one call
+ * @param columns variableCount columns in the order given to calclib_compile, each of rows values
+ * @param rows number of rows
+ * @param outResults rows solved values, NaN for rows that failed
+ * @param outStatus rows calclib_status values, may be NULL
+ * @param outFlags calclib_flag bits raised by any row in ieee mode, 0 otherwise. May be NULL
+ * @return CALCLIB_OK if every row succeeded, otherwise the error of the first failed row. After
+ *         CALCLIB_OUT_OF_RESOURCES the rows are only partly written
+ */
+CALCLIB_API int calclib_evaluate_batch(const calclib_context *context, const calclib_expression *expression,
+                                       const double *const *columns, size_t rows, double *outResults,
+                                       unsigned char *outStatus, unsigned *outFlags);
+
+/**
+ * @return text describing status, the same as the calculator displays
+ */
+CALCLIB_API const char* calclib_status_message(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1399 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <string_view>
+#include "calclib/factorial.hpp"
+#include "calclib/grammar.hpp"
+
+/**
+ * Header-only evaluation of expressions during compilation, for formulas that are fixed in C++ code:
+ *
+ *     constexpr double earthCircumference = calclib::evaluate("2*pi*6371");
+ *     constexpr double sameInCpp20 = calclib::constant<"2*pi*6371">;
+ *
+ * The grammar is the one of calcLib::solveEquation, the operator and function tables come from
+ * calclib/grammar.hpp. pi, e and the indices of sum and prod are the only symbols; there is no ans and no
+ * ieee mode. A product added to or subtracted from a value is rounded once with it, as compile() contracts it
+ * into an fma. The body of a sum or prod is parsed again for every index, so long loops hit the compiler's
+ * limit on constant evaluation. A syntax error,
+ * division by zero or domain error in a constant expression is a compile error that names the failure.
+ *
+ * Math functions are constexpr reimplementations, so results agree with calcLib within a few ulp rather
+ * than bit for bit. Exponentials and logarithms are built from series, which makes pow, log and
+ * non-square roots the least accurate.
+ */
+namespace calclib {
+
+namespace detail {
+
+using Opcode = compiledExpression::Opcode;
+using Status = calcLib::Status;
+
+constexpr double pi = 3.14159265358979323846;
+constexpr double e = 2.7182818284590452354;
+constexpr double infinity = std::numeric_limits<double>::infinity();
+constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+constexpr double ln2High = 6.93147180369123816490e-01; //! ln 2 split so that k * ln2High is exact
+constexpr double ln2Low = 1.90821492927058770002e-10;
+constexpr double pio2High = 1.57079632673412561417e+00; //! pi/2 split in three parts for argument reduction
+constexpr double pio2Middle = 6.07710050630396597660e-11;
+constexpr double pio2Low = 2.02226624879595063154e-21;
+constexpr double exactIntegers = 4503599627370496.0; //! 2^52, every double at least this large is an integer
+
+constexpr bool isNan(double x) {
+    return x != x;
+}
+
+constexpr double abs(double x) {
+    return x < 0 ? -x : x;
+}
+
+/**
+ * @return integral part of x, rounded towards zero
+ */
+constexpr double trunc(double x) {
+    if (isNan(x) || abs(x) >= exactIntegers){
+        return x;
+    }
+    return static_cast<double>(static_cast<int64_t>(x));
+}
+
+/**
+ * @return x * 2^exponent
+ */
+constexpr double scale(double x, int exponent) {
+    for (; exponent > 0; --exponent) {
+        x *= 2;
+    }
+    for (; exponent < 0; ++exponent) {
+        x *= 0.5;
+    }
+    return x;
+}
+
+constexpr double exp(double x) {
+    if (isNan(x)){
+        return x;
+    }
+    if (x > 709.8){
+        return infinity;
+    }
+    if (x < -745.2){
+        return 0;
+    }
+    // x = k ln 2 + r with |r| <= ln 2 / 2
+    double k = trunc(x / (ln2High + ln2Low) + (x < 0 ? -0.5 : 0.5));
+    double r = (x - k * ln2High) - k * ln2Low;
+    double term = 1;
+    double sum = 1;
+    for (int n = 1; n < 30; ++n) {
+        term *= r / n;
+        sum += term;
+    }
+    return scale(sum, static_cast<int>(k));
+}
+
+/**
+ * Natural logarithm
+ */
+constexpr double ln(double x) {
+    if (isNan(x) || x < 0){
+        return nan;
+    }
+    if (x == 0){
+        return -infinity;
+    }
+    if (x == infinity){
+        return x;
+    }
+    // x = m 2^exponent with m in [sqrt(2)/2, sqrt(2))
+    int exponent = 0;
+    while (x >= 2) {
+        x *= 0.5;
+        ++exponent;
+    }
+    while (x < 1) {
+        x *= 2;
+        --exponent;
+    }
+    if (x > 1.4142135623730951){
+        x *= 0.5;
+        ++exponent;
+    }
+    // ln m = 2 atanh((m - 1) / (m + 1))
+    double s = (x - 1) / (x + 1);
+    double term = s;
+    double sum = 0;
+    for (int n = 1; n < 60; n += 2) {
+        sum += term / n;
+        term *= s * s;
+    }
+    return exponent * ln2High + (exponent * ln2Low + 2 * sum);
+}
+
+constexpr double log10(double x) {
+    // Powers of ten are exact, like std::log10
+    double power = 1;
+    for (int exponent = 0; exponent <= 22; ++exponent, power *= 10) {
+        if (x == power){
+            return exponent;
+        }
+    }
+    return ln(x) / 2.30258509299404568402;
+}
+
+constexpr double sqrt(double x) {
+    if (isNan(x) || x < 0){
+        return nan;
+    }
+    if (x == 0 || x == infinity){
+        return x;
+    }
+    // Newton iteration decreases monotonically from any start above the root
+    double root = x > 1 ? x : 1;
+    while (true) {
+        double next = 0.5 * (root + x / root);
+        if (next >= root){
+            return root;
+        }
+        root = next;
+    }
+}
+
+constexpr double pow(double base, double exponent) {
+    if (exponent == 0){
+        return 1;
+    }
+    if (isNan(base) || isNan(exponent)){
+        return nan;
+    }
+    if (exponent == 0.5){
+        return base == -infinity ? infinity : sqrt(base);
+    }
+    bool integral = trunc(exponent) == exponent;
+    // Error of repeated squaring grows with the exponent, the one of exp(y ln x) with the result
+    if (integral && abs(exponent) <= 64){
+        auto remaining = static_cast<int64_t>(abs(exponent));
+        double result = 1;
+        double square = base;
+        while (remaining != 0) {
+            if (remaining & 1){
+                result *= square;
+            }
+            square *= square;
+            remaining >>= 1;
+        }
+        if (exponent > 0){
+            return result;
+        }
+        if (result == 0){
+            return base < 0 && (static_cast<int64_t>(exponent) & 1) ? -infinity : infinity;
+        }
+        return 1 / result;
+    }
+    if (base < 0 && integral){
+        double magnitude = pow(-base, exponent);
+        bool odd = abs(exponent) < exactIntegers && trunc(exponent / 2) * 2 != exponent;
+        return odd ? -magnitude : magnitude;
+    }
+    if (base < 0){
+        return nan;
+    }
+    if (base == 0){
+        return exponent > 0 ? 0 : infinity;
+    }
+    return exp(exponent * ln(base));
+}
+
+/**
+ * sin and cos of x reduced to quadrant
+ */
+constexpr double sinSeries(double r) {
+    double term = r;
+    double sum = r;
+    for (int n = 1; n < 13; ++n) {
+        term *= -r * r / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cosSeries(double r) {
+    double term = 1;
+    double sum = 1;
+    for (int n = 1; n < 13; ++n) {
+        term *= -r * r / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+/**
+ * @param x angle in radians
+ * @param cosine true for cos, false for sin
+ */
+constexpr double sinCos(double x, bool cosine) {
+    if (isNan(x) || abs(x) == infinity){
+        return nan;
+    }
+    double k = trunc(x / (pio2High + pio2Middle) + (x < 0 ? -0.5 : 0.5));
+    double r = ((x - k * pio2High) - k * pio2Middle) - k * pio2Low;
+    auto quadrant = static_cast<int64_t>(k - 4 * trunc(k / 4));
+    quadrant = (quadrant + (cosine ? 1 : 0) + 4) % 4;
+    switch (quadrant) {
+        case 0:
+            return sinSeries(r);
+        case 1:
+            return cosSeries(r);
+        case 2:
+            return -sinSeries(r);
+        default:
+            return -cosSeries(r);
+    }
+}
+
+/**
+ * Degrees to radians rounded like calcLib
+ */
+constexpr double radians(double degrees) {
+    return degrees * pi / 180;
+}
+
+/**
+ * @param degrees angle in degrees, reduced to [-45, 45] and a quadrant without rounding like calcLib
+ * @param cosine true for cos, false for sin
+ */
+constexpr double sinCosDegrees(double degrees, bool cosine) {
+    if (isNan(degrees) || abs(degrees) == infinity){
+        return nan;
+    }
+    // Remainder of 360 by binary long division, each subtraction is exact
+    double angle = abs(degrees);
+    double step = 360;
+    while (step * 2 <= angle) {
+        step *= 2;
+    }
+    for (; step >= 360; step /= 2) {
+        if (angle >= step){
+            angle -= step;
+        }
+    }
+    angle = degrees < 0 ? -angle : angle;
+    int64_t quadrant = 0;
+    while (angle > 45) {
+        angle -= 90;
+        ++quadrant;
+    }
+    while (angle < -45) {
+        angle += 90;
+        --quadrant;
+    }
+    double sinAngle = sinSeries(radians(angle));
+    double cosAngle = cosSeries(radians(angle));
+    if (abs(angle) == 30){
+        sinAngle = angle < 0 ? -0.5 : 0.5;
+    } else if (abs(angle) == 45){
+        cosAngle = cosSeries(pi / 4);
+        sinAngle = angle < 0 ? -cosAngle : cosAngle;
+    }
+    switch ((quadrant + (cosine ? 1 : 0) + 4) % 4) {
+        case 0:
+            return sinAngle;
+        case 1:
+            return cosAngle;
+        case 2:
+            return 0 - sinAngle;
+        default:
+            return 0 - cosAngle;
+    }
+}
+
+/**
+ * Lanczos approximation and Stirling series like calcLib::gamma
+ */
+constexpr double gamma(double x) {
+    if (x < 0.5){
+        double reduced = x - 2 * trunc(x / 2);
+        return pi / (sinCos(pi * reduced, false) * gamma(1 - x));
+    }
+    if (x > gammaMax){
+        return infinity;
+    }
+    double power = 0;
+    double scale = 0;
+    if (x >= stirlingMin){
+        double inverse = 1 / x;
+        double square = inverse * inverse;
+        double series = inverse * (1.0 / 12 - square * (1.0 / 360 - square * (1.0 / 1260 - square * (1.0 / 1680 - square / 1188))));
+        power = pow(x, (x - 0.5) / 2);
+        scale = exp(-x) * exp(series);
+    } else {
+        double sum = lanczosCoefficients[0];
+        for (size_t i = 1; i < sizeof(lanczosCoefficients) / sizeof(lanczosCoefficients[0]); ++i) {
+            sum += lanczosCoefficients[i] / (x - 1 + static_cast<double>(i));
+        }
+        double t = x + lanczosG - 0.5;
+        power = pow(t, (x - 0.5) / 2);
+        scale = exp(-t) * sum;
+    }
+    return sqrt(2 * pi) * power * (power * scale);
+}
+
+constexpr double factorial(double num) {
+    if (isNan(num)){
+        return nan;
+    }
+    if (trunc(num) != num){
+        return gamma(num + 1);
+    }
+    if (num < 0){
+        return nan;
+    }
+    if (num > maxFactorial){
+        return infinity;
+    }
+    return factorials[static_cast<size_t>(num)];
+}
+
+/**
+ * Sum or product of two doubles split into the rounded result and its exact error
+ */
+struct rounded {
+    double value;
+    double error;
+};
+
+constexpr rounded twoSum(double a, double b) {
+    double sum = a + b;
+    double b1 = sum - a;
+    return {sum, (a - (sum - b1)) + (b - b1)};
+}
+
+/**
+ * Dekker's product, exact if a and b are below 2^995 and the error does not fall below the normal range
+ */
+constexpr rounded twoProduct(double a, double b) {
+    constexpr double splitter = 134217729.0; //! 2^27 + 1, splits a double into two 26 bit halves
+    double product = a * b;
+    double aHigh = splitter * a - (splitter * a - a);
+    double aLow = a - aHigh;
+    double bHigh = splitter * b - (splitter * b - b);
+    double bLow = b - bHigh;
+    return {product, ((aHigh * bHigh - product) + aHigh * bLow + aLow * bHigh) + aLow * bLow};
+}
+
+/**
+ * @return a + b rounded to odd: the neighbour with an odd last bit when the sum is not a double
+ */
+constexpr double oddSum(double a, double b) {
+    rounded sum = twoSum(a, b);
+    if (sum.error == 0){
+        return sum.value;
+    }
+    double magnitude = abs(sum.value);
+    double power = 1; //! Power of two with power <= magnitude < 2 power
+    while (power > magnitude) {
+        power *= 0.5;
+    }
+    while (power * 2 <= magnitude) {
+        power *= 2;
+    }
+    double ulp = power * 0x1p-52 < 0x1p-1074 ? 0x1p-1074 : power * 0x1p-52;
+    double units = magnitude / ulp;
+    if (trunc(units / 2) * 2 != units){
+        return sum.value;
+    }
+    // Below a power of two the doubles are twice as dense
+    bool towardZero = (sum.error > 0) != (sum.value > 0);
+    double step = towardZero && magnitude == power && power >= 0x1p-1021 ? ulp / 2 : ulp;
+    return sum.error > 0 ? sum.value + step : sum.value - step;
+}
+
+/**
+ * std::fma, which is not constexpr: a * b + c rounded once, by the rounding to odd of Boldo and Melquiond.
+ * Correctly rounded unless a * b is close to the smallest normal double, see twoProduct.
+ */
+constexpr double fma(double a, double b, double c) {
+    double product = a * b;
+    if (product == 0 || product - product != 0 || c - c != 0){
+        return product + c;
+    }
+    // The product is finite, so the other factor takes 2^100 exactly
+    if (abs(a) > 0x1p995){
+        a *= 0x1p-100;
+        b *= 0x1p100;
+    } else if (abs(b) > 0x1p995){
+        a *= 0x1p100;
+        b *= 0x1p-100;
+    }
+    rounded exact = twoProduct(a, b);
+    rounded high = twoSum(c, exact.value);
+    return high.value + oddSum(high.error, exact.error);
+}
+
+constexpr Status div(double lhs, double rhs, double &outResult) {
+    if (rhs == 0){
+        // Sign of a zero rhs is not observable in a constant expression, it is taken as +0
+        outResult = lhs == 0 || isNan(lhs) ? nan : lhs < 0 ? -infinity : infinity;
+        return Status::divisionByZero;
+    }
+    outResult = lhs / rhs;
+    return Status::ok;
+}
+
+/**
+ * Same operation as compiledExpression::apply
+ */
+constexpr Status apply(Opcode op, double lhs, double rhs, double &outResult) {
+    switch (op) {
+        case Opcode::negate:
+            outResult = -lhs;
+            return Status::ok;
+        case Opcode::factorial:
+            outResult = factorial(lhs);
+            return Status::ok;
+        case Opcode::add:
+            outResult = lhs + rhs;
+            return Status::ok;
+        case Opcode::sub:
+            outResult = lhs - rhs;
+            return Status::ok;
+        case Opcode::mul:
+            outResult = lhs * rhs;
+            return Status::ok;
+        case Opcode::div:
+            return div(lhs, rhs, outResult);
+        case Opcode::mod: {
+            double quotient = 0;
+            if (div(lhs, rhs, quotient) != Status::ok){
+                outResult = nan;
+                return Status::divisionByZero;
+            }
+            // Integers are reduced exactly like the int64_t path of the runtime
+            constexpr double limit = 9223372036854775808.0;
+            if (trunc(lhs) == lhs && trunc(rhs) == rhs && abs(lhs) < limit && abs(rhs) < limit){
+                auto remainder = static_cast<int64_t>(lhs) % static_cast<int64_t>(rhs);
+                outResult = remainder != 0 ? static_cast<double>(remainder) : lhs < 0 ? -0.0 : 0.0;
+                return Status::ok;
+            }
+            outResult = (quotient - trunc(quotient)) * rhs;
+            return Status::ok;
+        }
+        case Opcode::pow:
+            outResult = pow(lhs, rhs);
+            return Status::ok;
+        case Opcode::sin:
+            outResult = sinCosDegrees(lhs, false);
+            return Status::ok;
+        case Opcode::cos:
+            outResult = sinCosDegrees(lhs, true);
+            return Status::ok;
+        case Opcode::tan: {
+            double sine = sinCosDegrees(lhs, false);
+            double cosine = sinCosDegrees(lhs, true);
+            if (cosine == 0){
+                outResult = sine < 0 ? -infinity : infinity;
+                return Status::divisionByZero;
+            }
+            outResult = sine / cosine;
+            return Status::ok;
+        }
+        case Opcode::sqrt:
+            return apply(Opcode::root, 2, lhs, outResult);
+        case Opcode::log10:
+            outResult = log10(lhs);
+            return Status::ok;
+        case Opcode::log:
+            return div(log10(rhs), log10(lhs), outResult);
+        case Opcode::root: {
+            if (rhs < 0){
+                outResult = nan;
+                return Status::domainError;
+            }
+            double exponent = 0;
+            Status status = div(1, lhs, exponent);
+            outResult = pow(rhs, exponent);
+            return status;
+        }
+        case Opcode::less:
+            outResult = lhs < rhs;
+            return Status::ok;
+        case Opcode::lessEqual:
+            outResult = lhs <= rhs;
+            return Status::ok;
+        case Opcode::greater:
+            outResult = lhs > rhs;
+            return Status::ok;
+        case Opcode::greaterEqual:
+            outResult = lhs >= rhs;
+            return Status::ok;
+        case Opcode::equal:
+            outResult = lhs == rhs;
+            return Status::ok;
+        case Opcode::notEqual:
+            outResult = lhs != rhs;
+            return Status::ok;
+        case Opcode::min:
+            outResult = lhs < rhs || isNan(lhs) ? lhs : rhs;
+            return Status::ok;
+        case Opcode::max:
+            outResult = lhs > rhs || isNan(lhs) ? lhs : rhs;
+            return Status::ok;
+        case Opcode::abs:
+            outResult = lhs == 0 ? 0 : abs(lhs);
+            return Status::ok;
+        default:
+            return Status::invalidExpression;
+    }
+}
+
+/**
+ * Decimal number with up to maxDigits digits that is multiplied and divided by powers of two exactly, for
+ * the correctly rounded conversion of literals. This is the simple decimal conversion of Go's strconv.
+ */
+struct decimal {
+    static constexpr int maxDigits = 800; //! More digits only matter through truncated
+    static constexpr int maxShift = 60; //! Largest shift by which 9 << shift stays within uint64_t
+
+    uint8_t digits[maxDigits] = {}; //! Values 0..9, most significant first
+    int count = 0;
+    int point = 0; //! The value is 0.digits * 10^point
+    bool truncated = false; //! Nonzero digits were dropped after the last one kept
+
+    constexpr void push(int digit) {
+        if (count < maxDigits){
+            digits[count++] = static_cast<uint8_t>(digit);
+        } else if (digit != 0){
+            truncated = true;
+        }
+    }
+
+    constexpr void trim() {
+        while (count > 0 && digits[count - 1] == 0) {
+            --count;
+        }
+        if (count == 0){
+            point = 0;
+        }
+    }
+
+    /**
+     * Multiplies by 2^bits, bits up to maxShift
+     */
+    constexpr void leftShift(int bits) {
+        uint8_t shifted[maxDigits + 20] = {};
+        int write = maxDigits + 20;
+        uint64_t carry = 0;
+        for (int read = count - 1; read >= 0; --read) {
+            carry += static_cast<uint64_t>(digits[read]) << bits;
+            shifted[--write] = static_cast<uint8_t>(carry % 10);
+            carry /= 10;
+        }
+        for (; carry > 0; carry /= 10) {
+            shifted[--write] = static_cast<uint8_t>(carry % 10);
+        }
+        int produced = maxDigits + 20 - write;
+        point += produced - count;
+        count = 0;
+        for (int i = write; i < maxDigits + 20; ++i) {
+            push(shifted[i]);
+        }
+        trim();
+    }
+
+    /**
+     * Divides by 2^bits, bits up to maxShift
+     */
+    constexpr void rightShift(int bits) {
+        int read = 0;
+        int write = 0;
+        uint64_t remainder = 0;
+        // Leading digits until the first digit of the quotient
+        for (; remainder >> bits == 0; ++read) {
+            if (read >= count){
+                if (remainder == 0){
+                    count = 0;
+                    return;
+                }
+                for (; remainder >> bits == 0; ++read) {
+                    remainder *= 10;
+                }
+                break;
+            }
+            remainder = remainder * 10 + digits[read];
+        }
+        point -= read - 1;
+        uint64_t mask = (uint64_t(1) << bits) - 1;
+        for (; read < count; ++read) {
+            uint64_t digit = remainder >> bits;
+            remainder &= mask;
+            digits[write++] = static_cast<uint8_t>(digit);
+            remainder = remainder * 10 + digits[read];
+        }
+        for (; remainder > 0; remainder *= 10) {
+            uint64_t digit = remainder >> bits;
+            remainder &= mask;
+            if (write < maxDigits){
+                digits[write++] = static_cast<uint8_t>(digit);
+            } else if (digit > 0){
+                truncated = true;
+            }
+        }
+        count = write;
+        trim();
+    }
+
+    /**
+     * Multiplies by 2^bits, divides for negative bits
+     */
+    constexpr void shift(int bits) {
+        if (count == 0){
+            return;
+        }
+        for (; bits > maxShift; bits -= maxShift) {
+            leftShift(maxShift);
+        }
+        for (; bits < -maxShift; bits += maxShift) {
+            rightShift(maxShift);
+        }
+        if (bits > 0){
+            leftShift(bits);
+        } else if (bits < 0){
+            rightShift(-bits);
+        }
+    }
+
+    /**
+     * @return integral part rounded half to even, the value must be below 2^64
+     */
+    constexpr uint64_t roundedInteger() const {
+        uint64_t integer = 0;
+        int i = 0;
+        for (; i < point && i < count; ++i) {
+            integer = integer * 10 + digits[i];
+        }
+        for (; i < point; ++i) {
+            integer *= 10;
+        }
+        if (point >= 0 && point < count){
+            bool halfway = digits[point] == 5 && point + 1 == count && !truncated;
+            bool odd = point > 0 && digits[point - 1] % 2 == 1;
+            integer += (halfway ? odd : digits[point] >= 5) ? 1 : 0;
+        }
+        return integer;
+    }
+
+    /**
+     * @return the double nearest to the value, ties to even
+     */
+    constexpr double toDouble() {
+        if (count == 0 || point < -330){
+            return 0;
+        }
+        if (point > 310){
+            return infinity;
+        }
+        // Bits that move the decimal point by at most one digit for each count of digits before it
+        constexpr int bitsOfDigits[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+        int exponent = 0;
+        while (point > 0) {
+            int bits = point < 9 ? bitsOfDigits[point] : 27;
+            shift(-bits);
+            exponent += bits;
+        }
+        while (point < 0 || (point == 0 && digits[0] < 5)) {
+            int bits = -point < 9 ? bitsOfDigits[-point] : 27;
+            shift(bits);
+            exponent -= bits;
+        }
+        // Now in [0.5, 1), doubles are 1.m * 2^exponent
+        --exponent;
+        if (exponent < -1022){
+            shift(exponent + 1022);
+            exponent = -1022;
+        }
+        shift(53);
+        uint64_t mantissa = roundedInteger();
+        if (mantissa == uint64_t(1) << 53){
+            mantissa >>= 1;
+            ++exponent;
+        }
+        if (exponent > 1023){
+            return infinity;
+        }
+        return scale(static_cast<double>(mantissa), exponent - 52);
+    }
+};
+
+/**
+ * Token of the compile-time lexer, a subset of what lexertk produces for calcLib
+ */
+struct token {
+    enum class Kind {
+        end,
+        number,
+        symbol,
+        leftBracket,
+        rightBracket,
+        operation, //! Operator, including ':' and '!'
+        error
+    };
+    Kind kind = Kind::end;
+    char symbol = 0; //! Operator or bracket character, 0 for two character operators
+    std::string_view spelling; //! Operator as calcGrammar::comparisons spells it
+    double value = 0;
+    std::string_view name;
+};
+
+/**
+ * Recursive descent parser that evaluates while parsing. Structure follows the runtime compiler, so
+ * failing operations do not stop parsing and a malformed expression is reported as such.
+ */
+class constantParser {
+    struct boundIndex {
+        std::string_view name;
+        double value;
+    };
+    //! Factors of a value that is a product, which a sum of it is contracted with like compile() contracts it
+    struct factors {
+        bool product;
+        double lhs;
+        double rhs;
+    };
+
+    std::string_view text;
+    size_t position = 0;
+    token::Kind previous = token::Kind::end; //! Kind of the last consumed token
+    unsigned nesting = 0;
+    Status evaluation = Status::ok; //! First failed operation
+    boundIndex indices[calcGrammar::maxNesting] = {}; //! Indices of the loops around position, innermost last
+    size_t indexCount = 0;
+    factors last = {}; //! Factors of the value parsed last
+
+public:
+    constexpr explicit constantParser(std::string_view text) : text(text) {}
+
+    /**
+     * @param outResult value of the expression
+     * @return Status::ok or the first error, like calcLib::evaluate
+     */
+    constexpr Status parse(double &outResult) {
+        Status status = checkTokens();
+        if (status != Status::ok){
+            return status;
+        }
+        if (peek().kind == token::Kind::end){
+            // calcLib evaluates an empty expression to ans, which does not exist here
+            return Status::invalidExpression;
+        }
+        status = parseComparison(outResult);
+        if (status != Status::ok || peek().kind != token::Kind::end){
+            return Status::invalidExpression;
+        }
+        return evaluation;
+    }
+
+private:
+    static constexpr bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static constexpr bool isLetter(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static constexpr bool isWhitespace(char c) {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\b' || c == '\v' || c == '\f';
+    }
+
+    static constexpr bool isOperator(char c) {
+        return std::string_view("+-*/^%!:=<>?&|;[]{}()").find(c) != std::string_view::npos;
+    }
+
+    /**
+     * Skips whitespace and #, // and block comments starting at position
+     */
+    constexpr size_t skipIgnored(size_t at) const {
+        while (at < text.size()) {
+            if (isWhitespace(text[at])){
+                ++at;
+            } else if (text[at] == '#' || text.substr(at, 2) == "//"){
+                size_t lineEnd = text.find('\n', at);
+                at = lineEnd == std::string_view::npos ? text.size() : lineEnd + 1;
+            } else if (text.substr(at, 2) == "/*"){
+                size_t commentEnd = text.find("*/", at + 2);
+                at = commentEnd == std::string_view::npos ? text.size() : commentEnd + 2;
+            } else {
+                break;
+            }
+        }
+        return at;
+    }
+
+    /**
+     * Converts decimal digits, an optional fraction and exponent to the nearest double like strtod. Up to
+     * 15 significant digits and exponents within 22 take one exact division or multiplication, other
+     * literals go through detail::decimal.
+     */
+    static constexpr double parseNumber(std::string_view digits) {
+        decimal number;
+        int significant = 0; //! Digits from the first nonzero one, including those beyond decimal::maxDigits
+        bool fraction = false;
+        size_t i = 0;
+        for (; i < digits.size() && (isDigit(digits[i]) || digits[i] == '.' || digits[i] == ','); ++i) {
+            if (!isDigit(digits[i])){
+                fraction = true;
+                number.point = significant;
+            } else if (digits[i] == '0' && significant == 0){
+                // Leading zeros only matter after the point
+                --number.point;
+            } else {
+                number.push(digits[i] - '0');
+                ++significant;
+            }
+        }
+        if (!fraction){
+            number.point = significant;
+        }
+        if (i < digits.size()){
+            bool negative = digits[++i] == '-';
+            if (digits[i] == '-' || digits[i] == '+'){
+                ++i;
+            }
+            int written = 0;
+            for (; i < digits.size(); ++i) {
+                written = written < 100000 ? written * 10 + (digits[i] - '0') : written;
+            }
+            number.point += negative ? -written : written;
+        }
+        number.trim();
+        int exponent = number.point - number.count;
+        if (number.count <= 15 && exponent >= -22 && exponent <= 22){
+            double mantissa = 0;
+            for (int digit = 0; digit < number.count; ++digit) {
+                mantissa = mantissa * 10 + number.digits[digit];
+            }
+            double power = 1;
+            for (int step = exponent < 0 ? -exponent : exponent; step > 0; --step) {
+                power *= 10;
+            }
+            return exponent < 0 ? mantissa / power : mantissa * power;
+        }
+        return number.toDouble();
+    }
+
+    /**
+     * Lexes the token at at without looking at implicit multiplication
+     * @param outEnd position after the token
+     */
+    constexpr token lex(size_t at, size_t &outEnd) const {
+        at = skipIgnored(at);
+        token result;
+        outEnd = at;
+        if (at == text.size()){
+            return result;
+        }
+        char c = text[at];
+        if (isDigit(c) || c == '.' || c == ','){
+            size_t begin = at;
+            bool dot = false;
+            bool exponent = false;
+            bool exponentSign = false;
+            bool exponentDigit = false;
+            for (; at < text.size(); ++at) {
+                char current = text[at];
+                if (current == '.' || current == ','){
+                    if (dot || exponent){
+                        result.kind = token::Kind::error;
+                        return result;
+                    }
+                    dot = true;
+                } else if (current == 'e' || current == 'E'){
+                    char next = at + 1 < text.size() ? text[at + 1] : '\0';
+                    if (exponent || !(next == '+' || next == '-' || isDigit(next))){
+                        result.kind = token::Kind::error;
+                        return result;
+                    }
+                    exponent = true;
+                } else if (exponent && (current == '+' || current == '-') && !exponentDigit && !exponentSign){
+                    exponentSign = true;
+                } else if (isDigit(current)){
+                    exponentDigit = exponentDigit || exponent;
+                } else {
+                    break;
+                }
+            }
+            if (exponent && !exponentDigit){
+                result.kind = token::Kind::error;
+                return result;
+            }
+            result.kind = token::Kind::number;
+            result.value = parseNumber(text.substr(begin, at - begin));
+        } else if (isLetter(c)){
+            size_t begin = at;
+            while (at < text.size() && (isLetter(text[at]) || isDigit(text[at]) || text[at] == '_')) {
+                ++at;
+            }
+            result.kind = token::Kind::symbol;
+            result.name = text.substr(begin, at - begin);
+        } else if (isOperator(c)){
+            // Pairs lexertk scans as one operator, == is read as = and <> as !=
+            constexpr std::string_view pairs[] = {"<=", ">=", "<>", "!=", "==", ":=", "<<", ">>"};
+            std::string_view pair = text.substr(at, 2);
+            for (std::string_view candidate : pairs) {
+                if (pair == candidate){
+                    result.kind = token::Kind::operation;
+                    result.spelling = pair == "<>" ? "!=" : pair == "==" ? "=" : pair;
+                    outEnd = at + 2;
+                    return result;
+                }
+            }
+            result.symbol = c;
+            result.spelling = text.substr(at, 1);
+            result.kind = c == '(' ? token::Kind::leftBracket : c == ')' ? token::Kind::rightBracket : token::Kind::operation;
+            ++at;
+        } else {
+            result.kind = token::Kind::error;
+            return result;
+        }
+        outEnd = at;
+        return result;
+    }
+
+    /**
+     * lexertk helper::commutative_inserter rules for implicit multiplication, e.g. 2pi or (1+2)3
+     */
+    static constexpr bool multiplies(token::Kind before, token::Kind after) {
+        using Kind = token::Kind;
+        return (before == Kind::number && (after == Kind::symbol || after == Kind::leftBracket)) ||
+               (before == Kind::symbol && after == Kind::number) ||
+               (before == Kind::rightBracket && (after == Kind::number || after == Kind::symbol));
+    }
+
+    /**
+     * @param outEnd position after the next token, unchanged for an implicit '*'
+     */
+    constexpr token next(size_t &outEnd) const {
+        token raw = lex(position, outEnd);
+        if (multiplies(previous, raw.kind)){
+            outEnd = position;
+            token multiplication;
+            multiplication.kind = token::Kind::operation;
+            multiplication.symbol = '*';
+            return multiplication;
+        }
+        return raw;
+    }
+
+    constexpr token peek() const {
+        size_t end = 0;
+        return next(end);
+    }
+
+    constexpr token consume() {
+        size_t end = 0;
+        token result = next(end);
+        previous = result.kind;
+        position = end;
+        return result;
+    }
+
+    constexpr bool accept(char symbol) {
+        token upcoming = peek();
+        if (upcoming.kind != token::Kind::end && upcoming.kind != token::Kind::error && upcoming.symbol == symbol){
+            consume();
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Lexes the whole text and matches brackets like lexertk helper::bracket_checker
+     * @return Status::syntaxError if calcLib would reject the text before parsing
+     */
+    constexpr Status checkTokens() const {
+        char open[calcGrammar::maxNesting] = {};
+        size_t depth = 0;
+        size_t at = 0;
+        while (true) {
+            token current = lex(at, at);
+            if (current.kind == token::Kind::end){
+                return depth == 0 ? Status::ok : Status::syntaxError;
+            }
+            if (current.kind == token::Kind::error){
+                return Status::syntaxError;
+            }
+            char c = current.symbol;
+            if (c == '(' || c == '[' || c == '{'){
+                if (depth == calcGrammar::maxNesting){
+                    return Status::syntaxError;
+                }
+                open[depth++] = c == '(' ? ')' : c == '[' ? ']' : '}';
+            } else if (c == ')' || c == ']' || c == '}'){
+                if (depth == 0 || open[--depth] != c){
+                    return Status::syntaxError;
+                }
+            }
+        }
+    }
+
+    /**
+     * Applies op, remembering the first failure and continuing with its IEEE result
+     */
+    constexpr double applied(Opcode op, double lhs, double rhs) {
+        double result = 0;
+        Status status = apply(op, lhs, rhs, result);
+        if (status != Status::ok && evaluation == Status::ok){
+            evaluation = status;
+        }
+        last = {op == Opcode::mul, lhs, rhs};
+        return result;
+    }
+
+    /**
+     * Adds or subtracts like applied, rounding a product operand only once, as Opcode::fma does
+     */
+    constexpr double summed(Opcode op, factors lhsFactors, double lhs, factors rhsFactors, double rhs) {
+        double result = applied(op, lhs, rhs);
+        bool subtract = op == Opcode::sub;
+        if (lhsFactors.product){
+            return fma(lhsFactors.lhs, lhsFactors.rhs, subtract ? -rhs : rhs);
+        }
+        if (rhsFactors.product){
+            return fma(subtract ? -rhsFactors.lhs : rhsFactors.lhs, rhsFactors.rhs, lhs);
+        }
+        return result;
+    }
+
+    /**
+     * @return entry of calcGrammar::comparisons spelled like the next token, nullptr if it is not a comparison
+     */
+    constexpr const calcGrammar::comparison* peekComparison() const {
+        token upcoming = peek();
+        if (upcoming.kind != token::Kind::operation){
+            return nullptr;
+        }
+        for (const auto &comparison : calcGrammar::comparisons) {
+            if (upcoming.spelling == comparison.symbol){
+                return &comparison;
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr Status parseComparison(double &outValue) {
+        Status status = parseLevel(0, outValue);
+        while (status == Status::ok) {
+            const calcGrammar::comparison *comparison = peekComparison();
+            if (comparison == nullptr){
+                break;
+            }
+            consume();
+            double rhs = 0;
+            status = parseLevel(0, rhs);
+            if (status != Status::ok){
+                return status;
+            }
+            outValue = applied(comparison->op, outValue, rhs);
+        }
+        return status;
+    }
+
+    constexpr Status parseLevel(size_t level, double &outValue) {
+        if (level == calcGrammar::binaryLevelCount){
+            return parsePostfix(outValue);
+        }
+        const calcGrammar::binaryLevel &binary = calcGrammar::binaryLevels[level];
+        Status status = parseLevel(level + 1, outValue);
+        while (status == Status::ok && accept(binary.symbol)) {
+            factors lhsFactors = last;
+            double rhs = 0;
+            if (binary.rightAssociative){
+                if (++nesting > calcGrammar::maxNesting){
+                    return Status::invalidExpression;
+                }
+                status = parseLevel(level, rhs);
+                nesting--;
+            } else {
+                status = parseLevel(level + 1, rhs);
+            }
+            if (status != Status::ok){
+                return status;
+            }
+            bool sum = binary.op == Opcode::add || binary.op == Opcode::sub;
+            outValue = sum ? summed(binary.op, lhsFactors, outValue, last, rhs) : applied(binary.op, outValue, rhs);
+        }
+        return status;
+    }
+
+    constexpr Status parsePostfix(double &outValue) {
+        Status status = parseUnary(outValue);
+        while (status == Status::ok && accept(calcGrammar::factorialSymbol)) {
+            outValue = applied(Opcode::factorial, outValue, 0);
+        }
+        return status;
+    }
+
+    constexpr Status parseUnary(double &outValue) {
+        if (peek().kind == token::Kind::end || ++nesting > calcGrammar::maxNesting){
+            return Status::invalidExpression;
+        }
+        Status status = Status::ok;
+        if (accept('-')){
+            status = parseUnary(outValue);
+            outValue = -outValue;
+            last = {};
+        } else if (accept('+')){
+            status = parseUnary(outValue);
+        } else {
+            status = parsePrimary(outValue);
+        }
+        nesting--;
+        return status;
+    }
+
+    constexpr Status parsePrimary(double &outValue) {
+        token current = consume();
+        last = {};
+        switch (current.kind) {
+            case token::Kind::number:
+                outValue = current.value;
+                return Status::ok;
+            case token::Kind::leftBracket: {
+                Status status = parseComparison(outValue);
+                return status == Status::ok && accept(')') ? status : Status::invalidExpression;
+            }
+            case token::Kind::symbol:
+                if (accept('(')){
+                    if ((current.name == calcGrammar::sumFunction || current.name == calcGrammar::productFunction)
+                        && loopAhead()){
+                        return parseLoop(current.name == calcGrammar::productFunction, outValue);
+                    }
+                    return parseCall(current.name, outValue);
+                }
+                for (size_t i = indexCount; i-- > 0;) {
+                    if (indices[i].name == current.name){
+                        outValue = indices[i].value;
+                        return Status::ok;
+                    }
+                }
+                if (current.name == "pi"){
+                    outValue = pi;
+                    return Status::ok;
+                }
+                if (current.name == "e"){
+                    outValue = e;
+                    return Status::ok;
+                }
+                return Status::invalidExpression;
+            default:
+                return Status::invalidExpression;
+        }
+    }
+
+    /**
+     * @return true if a symbol and ':' follow, the start of a sum or prod
+     */
+    constexpr bool loopAhead() const {
+        size_t at = 0;
+        token index = lex(position, at);
+        token separator = lex(at, at);
+        return index.kind == token::Kind::symbol && separator.kind == token::Kind::operation
+               && separator.symbol == calcGrammar::parameterSeparator;
+    }
+
+    /**
+     * Parses index:lo:hi:body) of sum and prod, evaluating body once per index like the runtime evaluates it in
+     * order. Bounds follow compiledExpression::indexRange.
+     */
+    constexpr Status parseLoop(bool product, double &outValue) {
+        std::string_view index = consume().name;
+        consume();
+        double lo = 0;
+        double hi = 0;
+        Status status = parseComparison(lo);
+        if (status != Status::ok || !accept(calcGrammar::parameterSeparator)){
+            return Status::invalidExpression;
+        }
+        status = parseComparison(hi);
+        if (status != Status::ok || !accept(calcGrammar::parameterSeparator) || indexCount == calcGrammar::maxNesting){
+            return Status::invalidExpression;
+        }
+        constexpr double exactLimit = 2 * exactIntegers;
+        bool bounded = abs(lo) < exactLimit && abs(hi) < exactLimit && trunc(lo) == lo && trunc(hi) == hi
+                       && !(hi - lo + 1 > static_cast<double>(compiledExpression::maxTerms));
+        double terms = bounded && !(hi < lo) ? hi - lo + 1 : 0;
+        Status outer = evaluation;
+        Status failure = bounded ? Status::ok : Status::domainError;
+        double result = product ? 1 : 0;
+        size_t bodyStart = position;
+        token::Kind before = previous;
+        indices[indexCount++] = {index, lo};
+        // An empty range still parses body once to find its end
+        double step = 0;
+        do {
+            position = bodyStart;
+            previous = before;
+            indices[indexCount - 1].value = lo + step;
+            evaluation = Status::ok;
+            double value = 0;
+            status = parseComparison(value);
+            if (status != Status::ok){
+                return Status::invalidExpression;
+            }
+            if (step < terms && failure == Status::ok){
+                failure = evaluation;
+                result = product ? result * value : result + value;
+            }
+        } while (++step < terms && failure == Status::ok);
+        indexCount--;
+        if (!accept(')')){
+            return Status::invalidExpression;
+        }
+        evaluation = outer == Status::ok ? failure : outer;
+        outValue = failure == Status::ok ? result : nan;
+        last = {};
+        return Status::ok;
+    }
+
+    /**
+     * Parses parameters delimited with colon up to the right bracket. Failures inside each parameter are kept
+     * apart, so that those of the branch if does not take are dropped.
+     */
+    constexpr Status parseCall(std::string_view name, double &outValue) {
+        double parameters[calcGrammar::maxParameters] = {};
+        Status failures[calcGrammar::maxParameters] = {};
+        factors products[calcGrammar::maxParameters] = {};
+        Status outer = evaluation;
+        unsigned count = 0;
+        do {
+            double parameter = 0;
+            evaluation = Status::ok;
+            Status status = parseComparison(parameter);
+            if (status != Status::ok || count == calcGrammar::maxParameters){
+                return Status::invalidExpression;
+            }
+            failures[count] = evaluation;
+            products[count] = last;
+            parameters[count++] = parameter;
+        } while (accept(calcGrammar::parameterSeparator));
+        if (!accept(')')){
+            return Status::invalidExpression;
+        }
+        evaluation = outer;
+        if (count == 3 && name == calcGrammar::conditionalFunction){
+            unsigned taken = parameters[0] != 0 ? 1 : 2;
+            for (unsigned i : {0u, taken}) {
+                evaluation = evaluation == Status::ok ? failures[i] : evaluation;
+            }
+            outValue = parameters[taken];
+            last = products[taken];
+            return Status::ok;
+        }
+        for (unsigned i = 0; i < count; ++i) {
+            evaluation = evaluation == Status::ok ? failures[i] : evaluation;
+        }
+        if (count == 3 && name == calcGrammar::clampFunction){
+            outValue = applied(Opcode::min, applied(Opcode::max, parameters[0], parameters[1]), parameters[2]);
+            return Status::ok;
+        }
+        for (const auto &function : calcGrammar::builtinFunctions) {
+            if (function.parameters == count && name == function.name){
+                outValue = applied(function.op, parameters[0], parameters[1]);
+                return Status::ok;
+            }
+        }
+        return Status::invalidExpression;
+    }
+};
+
+/**
+ * Not constexpr on purpose: reaching one of these during constant evaluation is the compile error,
+ * and its name tells what is wrong with the expression. At run time they give NaN.
+ */
+inline double syntaxErrorInConstantExpression() {
+    return nan;
+}
+
+inline double divisionByZeroInConstantExpression() {
+    return nan;
+}
+
+inline double domainErrorInConstantExpression() {
+    return nan;
+}
+
+}
+
+/**
+ * Evaluates expression with the grammar of calcLib
+ * @param expression string
+ * @param outResult solved value
+ * @return Status::ok or the error that stopped evaluation
+ */
+constexpr calcLib::Status evaluate(std::string_view expression, double &outResult) {
+    double result = 0;
+    calcLib::Status status = detail::constantParser(expression).parse(result);
+    if (status == calcLib::Status::ok){
+        outResult = result;
+    }
+    return status;
+}
+
+/**
+ * Evaluates expression that is known to be valid. In a constant expression, any error fails the compilation.
+ * @param expression string
+ * @return solved value, NaN if the expression fails at run time
+ */
+constexpr double evaluate(std::string_view expression) {
+    double result = 0;
+    switch (evaluate(expression, result)) {
+        case calcLib::Status::ok:
+            return result;
+        case calcLib::Status::divisionByZero:
+            return detail::divisionByZeroInConstantExpression();
+        case calcLib::Status::domainError:
+            return detail::domainErrorInConstantExpression();
+        default:
+            return detail::syntaxErrorInConstantExpression();
+    }
+}
+
+#if defined(__cpp_consteval)
+/**
+ * evaluate() that is always run by the compiler
+ */
+consteval double fold(std::string_view expression) {
+    return evaluate(expression);
+}
+#endif
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+/**
+ * String literal usable as a template argument
+ */
+template<size_t size>
+struct fixedString {
+    char text[size];
+
+    constexpr fixedString(const char (&literal)[size]) {
+        for (size_t i = 0; i < size; ++i) {
+            text[i] = literal[i];
+        }
+    }
+
+    constexpr std::string_view view() const {
+        return std::string_view(text, size - 1);
+    }
+};
+
+/**
+ * Value of expression folded during compilation, e.g. calclib::constant<"2*pi*6371">
+ */
+template<fixedString expression>
+inline constexpr double constant = evaluate(expression.view());
+#endif
+
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "calclib/scalar.hpp"
+
+/**
+ * Unevaluated sum hi + lo of two doubles with |lo| <= ulp(hi)/2, about 106 bits of precision in the range of double.
+ * Long sums and % on large operands stay exact where double rounds every step:
+ *
+ *     basicExpression<doubleDouble> expression;
+ *     calc.compile("0.1+0.2-0.3", expression); // 0 up to 1e-33
+ *
+ * Operations are built from error-free transformations: twoSum recovers the rounding error of an addition,
+ * twoProd the one of a product with a single fma where the target has fast FMA (FP_FAST_FMA, see CALCLIB_NATIVE)
+ * and with Dekker's split otherwise.
+ */
+class doubleDouble {
+public:
+    double hi; //! Value rounded to double
+    double lo; //! Rounding error of hi
+
+    doubleDouble() = default;
+
+    constexpr doubleDouble(double value) : hi(value), lo(0) {}
+
+    /**
+     * @param hi
+     * @param lo at most half an ulp of hi
+     */
+    constexpr doubleDouble(double hi, double lo) : hi(hi), lo(lo) {}
+
+    /**
+     * Exact for every 64 bit integer
+     */
+    template<typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    constexpr doubleDouble(Integer value) : hi(0), lo(0) {
+        // Both 32 bit halves are exact in double, twoSum rounds their sum without losing the rest
+        double high = 0;
+        double low = 0;
+        if constexpr (std::is_signed_v<Integer>){
+            high = static_cast<double>(static_cast<int64_t>(value) >> 32) * 0x1p32;
+            low = static_cast<double>(static_cast<int64_t>(value) & 0xffffffff);
+        } else {
+            high = static_cast<double>(static_cast<uint64_t>(value) >> 32) * 0x1p32;
+            low = static_cast<double>(static_cast<uint64_t>(value) & 0xffffffff);
+        }
+        *this = twoSum(high, low);
+    }
+
+    explicit operator double() const {
+        return hi;
+    }
+
+    /**
+     * @return value truncated towards zero, exact in (-2^63, 2^63)
+     */
+    explicit operator int64_t() const;
+
+    /**
+     * @return a + b = sum.hi + sum.lo exactly
+     */
+    static constexpr doubleDouble twoSum(double a, double b) {
+        double sum = a + b;
+        double rounded = sum - a;
+        return {sum, (a - (sum - rounded)) + (b - rounded)};
+    }
+
+    /**
+     * twoSum for |a| >= |b|
+     */
+    static constexpr doubleDouble quickTwoSum(double a, double b) {
+        double sum = a + b;
+        return {sum, b - (sum - a)};
+    }
+
+    /**
+     * @return a * b = product.hi + product.lo exactly, unless it overflows or underflows
+     */
+    static doubleDouble twoProd(double a, double b) {
+        double product = a * b;
+        if (!std::isfinite(product)){
+            return {product, 0};
+        }
+#if defined(FP_FAST_FMA)
+        return {product, std::fma(a, b, -product)};
+#else
+        double aHigh;
+        double aLow;
+        double bHigh;
+        double bLow;
+        split(a, aHigh, aLow);
+        split(b, bHigh, bLow);
+        return {product, ((aHigh * bHigh - product) + aHigh * bLow + aLow * bHigh) + aLow * bLow};
+#endif
+    }
+
+    friend doubleDouble operator+(const doubleDouble &a, const doubleDouble &b) {
+        // Sums of both parts with their errors, so cancellation of the high parts keeps the low ones exact
+        doubleDouble sum = twoSum(a.hi, b.hi);
+        doubleDouble tail = twoSum(a.lo, b.lo);
+        sum = quickTwoSum(sum.hi, sum.lo + tail.hi);
+        return finish(sum.hi, sum.lo + tail.lo);
+    }
+
+    friend doubleDouble operator-(const doubleDouble &a, const doubleDouble &b) {
+        return a + -b;
+    }
+
+    friend doubleDouble operator*(const doubleDouble &a, const doubleDouble &b) {
+        doubleDouble product = twoProd(a.hi, b.hi);
+        return finish(product.hi, product.lo + (a.hi * b.lo + a.lo * b.hi));
+    }
+
+    friend doubleDouble operator/(const doubleDouble &a, const doubleDouble &b) {
+        // Long division, every quotient digit removes the 53 bits the previous one left
+        double first = a.hi / b.hi;
+        if (!std::isfinite(first)){
+            return {first, 0};
+        }
+        doubleDouble rest = a - b * first;
+        double second = rest.hi / b.hi;
+        rest = rest - b * second;
+        double third = rest.hi / b.hi;
+        return quickTwoSum(first, second) + third;
+    }
+
+    doubleDouble operator-() const {
+        return {-hi, -lo};
+    }
+
+    doubleDouble& operator+=(const doubleDouble &rhs) {
+        return *this = *this + rhs;
+    }
+
+    doubleDouble& operator-=(const doubleDouble &rhs) {
+        return *this = *this - rhs;
+    }
+
+    doubleDouble& operator*=(const doubleDouble &rhs) {
+        return *this = *this * rhs;
+    }
+
+    doubleDouble& operator/=(const doubleDouble &rhs) {
+        return *this = *this / rhs;
+    }
+
+    friend bool operator==(const doubleDouble &a, const doubleDouble &b) {
+        return a.hi == b.hi && a.lo == b.lo;
+    }
+
+    friend bool operator!=(const doubleDouble &a, const doubleDouble &b) {
+        return !(a == b);
+    }
+
+    friend bool operator<(const doubleDouble &a, const doubleDouble &b) {
+        return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+    }
+
+    friend bool operator>(const doubleDouble &a, const doubleDouble &b) {
+        return b < a;
+    }
+
+    friend bool operator<=(const doubleDouble &a, const doubleDouble &b) {
+        return a.hi < b.hi || (a.hi == b.hi && a.lo <= b.lo);
+    }
+
+    friend bool operator>=(const doubleDouble &a, const doubleDouble &b) {
+        return b <= a;
+    }
+
+private:
+    /**
+     * Normalizes hi + lo, infinity and NaN drop the meaningless error term
+     */
+    static doubleDouble finish(double hi, double lo) {
+        doubleDouble result = quickTwoSum(hi, lo);
+        if (!std::isfinite(result.hi)){
+            return {hi + lo, 0};
+        }
+        return result;
+    }
+
+#if !defined(FP_FAST_FMA)
+    /**
+     * Splits value into two halves of 26 bits, whose products are exact
+     */
+    static void split(double value, double &outHigh, double &outLow) {
+        constexpr double splitter = 134217729.0; // 2^27 + 1
+        // Scales huge values down so splitter * value does not overflow
+        double scale = std::abs(value) > 0x1p996 ? 0x1p28 : 1;
+        double scaled = value / scale;
+        double product = splitter * scaled;
+        outHigh = (product - (product - scaled)) * scale;
+        outLow = value - outHigh;
+    }
+#endif
+};
+
+template<>
+struct scalarTraits<doubleDouble> {
+    static constexpr const char *name = "double-double";
+
+    static doubleDouble pi();
+    static doubleDouble e();
+
+    static doubleDouble infinity() {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    static doubleDouble nan() {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    static doubleDouble sin(const doubleDouble &x);
+    static doubleDouble cos(const doubleDouble &x);
+    static doubleDouble tan(const doubleDouble &x);
+    static doubleDouble exp(const doubleDouble &x);
+    static doubleDouble log(const doubleDouble &x);
+    static doubleDouble pow(const doubleDouble &base, const doubleDouble &exponent);
+    static doubleDouble log10(const doubleDouble &x);
+    static doubleDouble copysign(const doubleDouble &magnitude, const doubleDouble &sign);
+    static doubleDouble modf(const doubleDouble &x, doubleDouble *intpart);
+    static doubleDouble gamma(const doubleDouble &x);
+
+    /**
+     * Remainder with the sign of lhs, exact when both operands are integers below 2^106
+     */
+    static doubleDouble fmod(const doubleDouble &lhs, const doubleDouble &rhs);
+
+    /**
+     * @param text number literal
+     * @return value to about 32 significant digits
+     */
+    static doubleDouble parse(const std::string &text);
+
+    /**
+     * @param value
+     * @param precision digits after the decimal point
+     * @return value in fixed notation, digits past the 32nd significant one are zeros
+     */
+    static std::string format(const doubleDouble &value, int precision);
+};
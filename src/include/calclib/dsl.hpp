@@ -0,0 +1,897 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "calclib/expression.hpp"
+
+/**
+ * Formulas written as C++ expressions instead of strings:
+ *
+ *     const calclib::variable<0> x{"x"};
+ *     const calclib::variable<1> y{"y"};
+ *     auto f = calclib::sin(x) * 2 + calclib::root(3, y);
+ *
+ * The type of f is the syntax tree, so f.run() is evaluated by code the compiler specializes for the formula,
+ * without parsing or dispatch. calclib::compile(f, compiled) emits the bytecode the string compiler emits for
+ * "sin(x)*2+root(3:y)", so compiled expressions built either way are interchangeable with calcLib::evaluate,
+ * runColumns, calcBatch and the JIT tier.
+ *
+ * Operators are +, -, *, / and % with C++ precedence, so unlike in the string grammar % binds like /.
+ * Power is calclib::pow because ^ is the bitwise xor of C++ with the wrong precedence. Comparisons are <, <=, >,
+ * >=, == and !=, and calclib::conditional(c, a, b) is if(c:a:b), evaluating only the branch taken. sum and prod
+ * of the string grammar have no counterpart, a loop over a C++ range does the same at compile time.
+ */
+namespace calclib {
+
+using Opcode = compiledExpression::Opcode;
+
+template<typename T>
+struct isExpression : std::false_type {};
+
+/**
+ * Number in a formula. Arithmetic operands of the operators and functions are converted to it.
+ */
+struct literal {
+    double value;
+
+    static constexpr bool constant = true; //! Subtree has no variables
+    static constexpr bool fallible = false; //! An operation of the subtree can fail
+
+    /**
+     * Evaluates the formula, see compiledExpression::run
+     */
+    calcLib::Status run(const double *, double &outResult, unsigned *) const {
+        outResult = value;
+        return calcLib::Status::ok;
+    }
+
+    /**
+     * Numbers the symbols of the subtree that are not numbered yet, in order of appearance
+     */
+    void declare(std::vector<std::string> &) const {}
+
+    /**
+     * Builds the terms of the subtree like the string compiler, see polynomialTerms
+     * @param outTerms terms of the subtree
+     * @param outSymbol name of its variable, unchanged if it has none
+     * @return false if the subtree is not a polynomial
+     */
+    bool collect(polynomialTerms &outTerms, const char *&) const {
+        outTerms = polynomialTerms::constant(value);
+        return true;
+    }
+
+    void emit(compiledExpression &outExpression, uint32_t &depth) const {
+        outExpression.code.push_back({Opcode::constant, static_cast<uint32_t>(outExpression.constants.size())});
+        outExpression.constants.push_back(value);
+        depth++;
+        outExpression.stackSize = std::max(outExpression.stackSize, depth);
+    }
+};
+
+/**
+ * Symbol read from slots[slot] by run. In compiled expressions it is bound by name, symbols are numbered
+ * in order of first appearance like the string compiler numbers them.
+ */
+template<uint32_t slot>
+struct variable {
+    const char *name;
+
+    static constexpr bool constant = false;
+    static constexpr bool fallible = false;
+
+    calcLib::Status run(const double *slots, double &outResult, unsigned *) const {
+        outResult = slots[slot];
+        return calcLib::Status::ok;
+    }
+
+    void declare(std::vector<std::string> &symbols) const {
+        if (std::find(symbols.begin(), symbols.end(), name) == symbols.end()){
+            symbols.emplace_back(name);
+        }
+    }
+
+    bool collect(polynomialTerms &outTerms, const char *&outSymbol) const {
+        outTerms = polynomialTerms::symbol(slot);
+        outSymbol = name;
+        return true;
+    }
+
+    void emit(compiledExpression &outExpression, uint32_t &depth) const {
+        declare(outExpression.symbols);
+        auto symbol = std::find(outExpression.symbols.begin(), outExpression.symbols.end(), name);
+        outExpression.code.push_back({Opcode::variable, static_cast<uint32_t>(symbol - outExpression.symbols.begin())});
+        depth++;
+        outExpression.stackSize = std::max(outExpression.stackSize, depth);
+    }
+};
+
+namespace detail {
+
+/**
+ * Handles status like calcLib does in ieee mode
+ */
+inline calcLib::Status absorb(calcLib::Status status, unsigned *ieeeFlags) {
+    if (ieeeFlags == nullptr){
+        return status;
+    }
+    switch (status) {
+        case calcLib::Status::divisionByZero:
+            *ieeeFlags |= calcLib::flagDivisionByZero;
+            return calcLib::Status::ok;
+        case calcLib::Status::domainError:
+            *ieeeFlags |= calcLib::flagInvalid;
+            return calcLib::Status::ok;
+        default:
+            return status;
+    }
+}
+
+/**
+ * compiledExpression::apply with op known at compile time, arithmetic is inlined
+ */
+template<Opcode op>
+calcLib::Status apply(double lhs, double rhs, double &outResult) {
+    if constexpr (op == Opcode::negate){
+        outResult = -lhs;
+    } else if constexpr (op == Opcode::add){
+        outResult = lhs + rhs;
+    } else if constexpr (op == Opcode::sub){
+        outResult = lhs - rhs;
+    } else if constexpr (op == Opcode::mul){
+        outResult = lhs * rhs;
+    } else if constexpr (op == Opcode::div){
+        outResult = lhs / rhs;
+        return rhs == 0 ? calcLib::Status::divisionByZero : calcLib::Status::ok;
+    } else {
+        return compiledExpression::apply(op, lhs, rhs, outResult);
+    }
+    return calcLib::Status::ok;
+}
+
+/**
+ * @param outValue value of node if it is a constant subtree that evaluates without error
+ * @return true if the string compiler folds node into a constant
+ */
+template<typename Node>
+bool folded(const Node &node, double &outValue) {
+    if constexpr (Node::constant){
+        return node.run(nullptr, outValue, nullptr) == calcLib::Status::ok;
+    }
+    return false;
+}
+
+/**
+ * Emits a constant subtree as one constant when it evaluates without error, like the string compiler folds
+ * @return true if the subtree was folded
+ */
+template<typename Node>
+bool fold(const Node &node, compiledExpression &outExpression, uint32_t &depth) {
+    double value;
+    if (folded(node, value)){
+        literal{value}.emit(outExpression, depth);
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+struct isProduct : std::false_type {};
+
+/**
+ * What the type of a subtree tells about it being a polynomial, so that formulas that cannot be one
+ * never build polynomialTerms
+ */
+template<typename Node>
+struct polynomialShape {
+    static constexpr int64_t slot = -2; //! Slot of the only variable, -1 without variables, -2 if not a polynomial
+    static constexpr uint32_t degree = 0; //! Upper bound of the degree
+    static constexpr uint32_t terms = 0; //! Upper bound of the number of terms
+    static constexpr bool possible = false; //! The subtree can be collectable
+};
+
+template<int64_t slotOf, uint32_t degreeOf, uint32_t termsOf>
+struct shapeOf {
+    static constexpr int64_t slot = slotOf;
+    static constexpr uint32_t degree = degreeOf;
+    static constexpr uint32_t terms = termsOf;
+    static constexpr bool possible = slot >= 0 && degree >= 2 && terms >= 2;
+};
+
+/**
+ * @param outTerms terms of node
+ * @param outSymbol name of its variable
+ * @return true if the string compiler collects node into Opcode::polynomial, unless a subtree containing it is
+ */
+template<typename Node>
+bool collected(const Node &node, polynomialTerms &outTerms, const char *&outSymbol) {
+    if constexpr (polynomialShape<Node>::possible){
+        return node.collect(outTerms, outSymbol) && outTerms.collectable();
+    }
+    return false;
+}
+
+template<typename Node>
+bool collected(const Node &node) {
+    polynomialTerms terms;
+    const char *symbol = nullptr;
+    return collected(node, terms, symbol);
+}
+
+/**
+ * Evaluates node by compiledExpression::horner if it is collected
+ * @return false if node is evaluated as written
+ */
+template<typename Node>
+bool runPolynomial(const Node &node, const double *slots, double &outResult) {
+    polynomialTerms terms;
+    const char *symbol = nullptr;
+    if (!collected(node, terms, symbol)){
+        return false;
+    }
+    outResult = compiledExpression::horner(terms.coefficients, terms.degree, slots[polynomialShape<Node>::slot]);
+    return true;
+}
+
+/**
+ * Emits node as Opcode::polynomial if it is collected
+ * @return false if node is emitted as written
+ */
+template<typename Node>
+bool emitPolynomial(const Node &node, compiledExpression &outExpression, uint32_t &depth) {
+    polynomialTerms terms;
+    const char *symbol = nullptr;
+    if (!collected(node, terms, symbol)){
+        return false;
+    }
+    variable<static_cast<uint32_t>(polynomialShape<Node>::slot)>{symbol}.emit(outExpression, depth);
+    outExpression.code.push_back({Opcode::polynomial, static_cast<uint32_t>(outExpression.constants.size())});
+    outExpression.constants.push_back(terms.degree);
+    outExpression.constants.insert(outExpression.constants.end(), terms.coefficients, terms.coefficients + terms.degree + 1);
+    return true;
+}
+
+/**
+ * Node::fallible as the string compiler sees it after folding and collecting polynomials
+ */
+template<typename Node>
+bool fallible(const Node &node) {
+    if constexpr (!Node::fallible){
+        return false;
+    } else if constexpr (Node::constant){
+        double value;
+        return !folded(node, value);
+    } else {
+        return !collected(node) && node.fallibleOperation();
+    }
+}
+
+}
+
+template<Opcode op, typename Operand>
+struct unaryExpression {
+    Operand operand;
+
+    static constexpr bool constant = Operand::constant;
+    static constexpr bool fallible = Operand::fallible || compiledExpression::fallible(op);
+
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+        if (detail::runPolynomial(*this, slots, outResult)){
+            return calcLib::Status::ok;
+        }
+        double value;
+        calcLib::Status status = operand.run(slots, value, ieeeFlags);
+        if (status != calcLib::Status::ok){
+            return status;
+        }
+        return detail::absorb(detail::apply<op>(value, 0, outResult), ieeeFlags);
+    }
+
+    void declare(std::vector<std::string> &symbols) const {
+        operand.declare(symbols);
+    }
+
+    bool collect(polynomialTerms &outTerms, const char *&outSymbol) const {
+        if constexpr (constant){
+            double value;
+            if (!detail::folded(*this, value)){
+                return false;
+            }
+            outTerms = polynomialTerms::constant(value);
+            return true;
+        } else if constexpr (op == Opcode::negate){
+            return operand.collect(outTerms, outSymbol) && outTerms.apply(op, outTerms);
+        }
+        return false;
+    }
+
+    /**
+     * @return true if op or a subtree can fail, see detail::fallible
+     */
+    bool fallibleOperation() const {
+        return compiledExpression::fallible(op) || detail::fallible(operand);
+    }
+
+    void emit(compiledExpression &outExpression, uint32_t &depth) const {
+        if (detail::fold(*this, outExpression, depth) || detail::emitPolynomial(*this, outExpression, depth)){
+            return;
+        }
+        operand.emit(outExpression, depth);
+        outExpression.code.push_back({op, 0});
+    }
+
+    /**
+     * Evaluates with values of slots 0, 1, ... in ieee mode
+     * @return solved value, ±inf or NaN where an operation failed
+     */
+    template<typename... Values>
+    double operator()(Values... values) const {
+        const double slots[] = {static_cast<double>(values)..., 0};
+        double result = 0;
+        unsigned flags = 0;
+        run(slots, result, &flags);
+        return result;
+    }
+};
+
+/**
+ * Binary operation, lowered like the string compiler lowers it: a polynomial is evaluated by Horner's scheme and
+ * a product added to or subtracted from another operand is one fma. The other rewrites of lowerNodes leave the
+ * result as it is.
+ */
+template<Opcode op, typename Lhs, typename Rhs>
+struct binaryExpression {
+    Lhs lhs;
+    Rhs rhs;
+
+    static constexpr bool constant = Lhs::constant && Rhs::constant;
+    static constexpr bool fallible = Lhs::fallible || Rhs::fallible || compiledExpression::fallible(op);
+    static constexpr bool sum = op == Opcode::add || op == Opcode::sub;
+    //! fma(a, b, ±rhs) unless the product is collected as a polynomial or folded apart from the sum
+    static constexpr bool contractsLhs = sum && detail::isProduct<Lhs>::value && (constant || !Lhs::constant);
+    //! Otherwise fma(±a, b, lhs), evaluating lhs last, so only if that keeps the first error, see contraction
+    static constexpr bool contractsRhs = sum && detail::isProduct<Rhs>::value && (constant || !Rhs::constant);
+
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+        if (detail::runPolynomial(*this, slots, outResult)){
+            return calcLib::Status::ok;
+        }
+        if constexpr (contractsLhs || contractsRhs){
+            int contracted = contraction();
+            if (contracted != 0){
+                return runFused(contracted, slots, outResult, ieeeFlags);
+            }
+        }
+        double left;
+        double right;
+        calcLib::Status status = lhs.run(slots, left, ieeeFlags);
+        if (status == calcLib::Status::ok){
+            status = rhs.run(slots, right, ieeeFlags);
+        }
+        if (status != calcLib::Status::ok){
+            return status;
+        }
+        return detail::absorb(detail::apply<op>(left, right, outResult), ieeeFlags);
+    }
+
+    void declare(std::vector<std::string> &symbols) const {
+        lhs.declare(symbols);
+        rhs.declare(symbols);
+    }
+
+    bool collect(polynomialTerms &outTerms, const char *&outSymbol) const {
+        if constexpr (constant){
+            double value;
+            if (!detail::folded(*this, value)){
+                return false;
+            }
+            outTerms = polynomialTerms::constant(value);
+            return true;
+        } else if constexpr (detail::polynomialShape<binaryExpression>::slot != -2){
+            polynomialTerms operand;
+            return lhs.collect(outTerms, outSymbol) && rhs.collect(operand, outSymbol) && outTerms.apply(op, operand);
+        }
+        return false;
+    }
+
+    /**
+     * @return true if op or a subtree can fail, see detail::fallible
+     */
+    bool fallibleOperation() const {
+        return compiledExpression::fallible(op) || detail::fallible(lhs) || detail::fallible(rhs);
+    }
+
+    void emit(compiledExpression &outExpression, uint32_t &depth) const {
+        if (detail::fold(*this, outExpression, depth) || detail::emitPolynomial(*this, outExpression, depth)){
+            return;
+        }
+        // A constant sum that does not fold is emitted as written, like lowerNodes leaves it
+        if constexpr ((contractsLhs || contractsRhs) && !constant){
+            int contracted = contraction();
+            if constexpr (contractsLhs){
+                if (contracted == 1){
+                    lhs.lhs.emit(outExpression, depth);
+                    lhs.rhs.emit(outExpression, depth);
+                    emitSigned<op == Opcode::sub>(rhs, outExpression, depth);
+                    outExpression.code.push_back({Opcode::fma, 0});
+                    depth -= 2;
+                    return;
+                }
+            }
+            if constexpr (contractsRhs){
+                if (contracted == 2){
+                    // lhs is emitted last but its symbols come first
+                    lhs.declare(outExpression.symbols);
+                    emitSigned<op == Opcode::sub>(rhs.lhs, outExpression, depth);
+                    rhs.rhs.emit(outExpression, depth);
+                    lhs.emit(outExpression, depth);
+                    outExpression.code.push_back({Opcode::fma, 0});
+                    depth -= 2;
+                    return;
+                }
+            }
+        }
+        double value;
+        Opcode lowered = op;
+        if constexpr (op == Opcode::root){
+            if (detail::folded(lhs, value) && (value == 2 || value == 3)){
+                rhs.emit(outExpression, depth);
+                outExpression.code.push_back({value == 2 ? Opcode::sqrt : Opcode::cbrt, 0});
+                return;
+            }
+        } else if constexpr (op == Opcode::pow){
+            if (detail::folded(rhs, value) && compiledExpression::chainedPower(value, calcLib::Accuracy::faithful)){
+                lowered = Opcode::powInt;
+            }
+        } else if constexpr (op == Opcode::div){
+            double reciprocal;
+            if (detail::folded(rhs, value) && compiledExpression::exactReciprocal(value, reciprocal)){
+                lhs.emit(outExpression, depth);
+                literal{reciprocal}.emit(outExpression, depth);
+                outExpression.code.push_back({Opcode::mul, 0});
+                depth--;
+                return;
+            }
+        }
+        lhs.emit(outExpression, depth);
+        rhs.emit(outExpression, depth);
+        outExpression.code.push_back({lowered, 0});
+        depth--;
+    }
+
+    /**
+     * Evaluates with values of slots 0, 1, ... in ieee mode
+     * @return solved value, ±inf or NaN where an operation failed
+     */
+    template<typename... Values>
+    double operator()(Values... values) const {
+        const double slots[] = {static_cast<double>(values)..., 0};
+        double result = 0;
+        unsigned flags = 0;
+        run(slots, result, &flags);
+        return result;
+    }
+
+private:
+    /**
+     * @return 1 if the product in lhs is contracted, 2 if the one in rhs is, 0 if neither
+     */
+    int contraction() const {
+        if constexpr (contractsLhs){
+            if (!detail::collected(lhs)){
+                return 1;
+            }
+        }
+        if constexpr (contractsRhs){
+            if (!detail::collected(rhs) && (!detail::fallible(lhs) || !detail::fallible(rhs))){
+                return 2;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Evaluates the contraction selected by contraction()
+     */
+    calcLib::Status runFused(int contracted, const double *slots, double &outResult, unsigned *ieeeFlags) const {
+        double a = 0;
+        double b = 0;
+        double c = 0;
+        calcLib::Status status = calcLib::Status::ok;
+        if constexpr (contractsLhs){
+            if (contracted == 1){
+                status = runInOrder(slots, ieeeFlags, lhs.lhs, a, lhs.rhs, b, rhs, c);
+                c = op == Opcode::sub ? -c : c;
+            }
+        }
+        if constexpr (contractsRhs){
+            if (contracted == 2){
+                status = runInOrder(slots, ieeeFlags, lhs, c, rhs.lhs, a, rhs.rhs, b);
+                a = op == Opcode::sub ? -a : a;
+            }
+        }
+        if (status != calcLib::Status::ok){
+            return status;
+        }
+        outResult = std::fma(a, b, c);
+        return calcLib::Status::ok;
+    }
+
+    /**
+     * Runs three operands in order up to the first error
+     */
+    template<typename First, typename Second, typename Third>
+    static calcLib::Status runInOrder(const double *slots, unsigned *ieeeFlags, const First &first, double &outFirst,
+                                      const Second &second, double &outSecond, const Third &third, double &outThird) {
+        calcLib::Status status = first.run(slots, outFirst, ieeeFlags);
+        if (status == calcLib::Status::ok){
+            status = second.run(slots, outSecond, ieeeFlags);
+        }
+        if (status == calcLib::Status::ok){
+            status = third.run(slots, outThird, ieeeFlags);
+        }
+        return status;
+    }
+
+    /**
+     * Emits node, negated if negative, folding the negation of a constant like the string compiler
+     */
+    template<bool negative, typename Node>
+    static void emitSigned(const Node &node, compiledExpression &outExpression, uint32_t &depth) {
+        if constexpr (negative){
+            unaryExpression<Opcode::negate, Node>{node}.emit(outExpression, depth);
+        } else {
+            node.emit(outExpression, depth);
+        }
+    }
+};
+
+/**
+ * if(condition:then:otherwise), emitted as Opcode::branch, Opcode::jump and Opcode::select. Like the string compiler
+ * it is folded only as a whole, when the condition and the branch taken evaluate without error.
+ */
+template<typename Condition, typename Then, typename Otherwise>
+struct conditionalExpression {
+    Condition condition;
+    Then then;
+    Otherwise otherwise;
+
+    static constexpr bool constant = Condition::constant && Then::constant && Otherwise::constant;
+    static constexpr bool fallible = Condition::fallible || Then::fallible || Otherwise::fallible;
+
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+        double value;
+        calcLib::Status status = condition.run(slots, value, ieeeFlags);
+        if (status != calcLib::Status::ok){
+            return status;
+        }
+        return value != 0 ? then.run(slots, outResult, ieeeFlags) : otherwise.run(slots, outResult, ieeeFlags);
+    }
+
+    void declare(std::vector<std::string> &symbols) const {
+        condition.declare(symbols);
+        then.declare(symbols);
+        otherwise.declare(symbols);
+    }
+
+    bool collect(polynomialTerms &outTerms, const char *&) const {
+        double value;
+        if (!detail::folded(*this, value)){
+            return false;
+        }
+        outTerms = polynomialTerms::constant(value);
+        return true;
+    }
+
+    bool fallibleOperation() const {
+        return detail::fallible(condition) || detail::fallible(then) || detail::fallible(otherwise);
+    }
+
+    void emit(compiledExpression &outExpression, uint32_t &depth) const {
+        if (detail::fold(*this, outExpression, depth)){
+            return;
+        }
+        condition.emit(outExpression, depth);
+        size_t branch = outExpression.code.size();
+        outExpression.code.push_back({Opcode::branch, 0});
+        then.emit(outExpression, depth);
+        size_t jump = outExpression.code.size();
+        outExpression.code.push_back({Opcode::jump, 0});
+        outExpression.code[branch].operand = static_cast<uint32_t>(outExpression.code.size());
+        otherwise.emit(outExpression, depth);
+        outExpression.code[jump].operand = static_cast<uint32_t>(outExpression.code.size());
+        outExpression.code.push_back({Opcode::select, 0});
+        depth -= 2;
+    }
+
+    /**
+     * Evaluates with values of slots 0, 1, ... in ieee mode
+     * @return solved value, ±inf or NaN where an operation failed
+     */
+    template<typename... Values>
+    double operator()(Values... values) const {
+        const double slots[] = {static_cast<double>(values)..., 0};
+        double result = 0;
+        unsigned flags = 0;
+        run(slots, result, &flags);
+        return result;
+    }
+};
+
+namespace detail {
+
+template<typename Lhs, typename Rhs>
+struct isProduct<binaryExpression<Opcode::mul, Lhs, Rhs>> : std::true_type {};
+
+template<typename Condition, typename Then, typename Otherwise>
+struct polynomialShape<conditionalExpression<Condition, Then, Otherwise>>
+    : std::conditional_t<conditionalExpression<Condition, Then, Otherwise>::constant, shapeOf<-1, 0, 1>, shapeOf<-2, 0, 0>> {};
+
+template<>
+struct polynomialShape<literal> : shapeOf<-1, 0, 1> {};
+
+template<uint32_t slot>
+struct polynomialShape<variable<slot>> : shapeOf<slot, 1, 1> {};
+
+template<Opcode op, typename Operand>
+struct polynomialShape<unaryExpression<op, Operand>>
+    : std::conditional_t<Operand::constant, shapeOf<-1, 0, 1>,
+                         std::conditional_t<op == Opcode::negate, polynomialShape<Operand>, shapeOf<-2, 0, 0>>> {};
+
+/**
+ * Bounds of polynomialTerms::apply: a sum adds terms, a product has a single term side and so does a power base
+ */
+template<Opcode op, typename Lhs, typename Rhs>
+struct polynomialShape<binaryExpression<op, Lhs, Rhs>> {
+    using left = polynomialShape<Lhs>;
+    using right = polynomialShape<Rhs>;
+    static constexpr bool sum = op == Opcode::add || op == Opcode::sub;
+    static constexpr bool merged = left::slot != -2 && right::slot != -2
+                                   && (left::slot == right::slot || left::slot == -1 || right::slot == -1);
+    static constexpr int64_t slot = Lhs::constant && Rhs::constant ? -1
+                                    : (sum || op == Opcode::mul) && merged ? std::max(left::slot, right::slot)
+                                    : (op == Opcode::div || op == Opcode::pow) && Rhs::constant ? left::slot : -2;
+    static constexpr uint32_t degree = sum ? std::max(left::degree, right::degree)
+                                       : op == Opcode::mul ? left::degree + right::degree
+                                       : op == Opcode::pow ? polynomialTerms::maxDegree : left::degree;
+    static constexpr uint32_t terms = sum ? left::terms + right::terms
+                                      : op == Opcode::mul ? left::terms * right::terms
+                                      : op == Opcode::pow ? 1 : left::terms;
+    static constexpr bool possible = slot >= 0 && degree >= 2 && terms >= 2;
+};
+
+}
+
+template<>
+struct isExpression<literal> : std::true_type {};
+template<uint32_t slot>
+struct isExpression<variable<slot>> : std::true_type {};
+template<Opcode op, typename Operand>
+struct isExpression<unaryExpression<op, Operand>> : std::true_type {};
+template<Opcode op, typename Lhs, typename Rhs>
+struct isExpression<binaryExpression<op, Lhs, Rhs>> : std::true_type {};
+template<typename Condition, typename Then, typename Otherwise>
+struct isExpression<conditionalExpression<Condition, Then, Otherwise>> : std::true_type {};
+
+namespace detail {
+
+template<typename T>
+constexpr bool isOperand = isExpression<T>::value || std::is_arithmetic<T>::value;
+
+/**
+ * Operands of binary operators and functions, at least one of them a formula
+ */
+template<typename Lhs, typename Rhs>
+using enableBinary = std::enable_if_t<isOperand<Lhs> && isOperand<Rhs> && (isExpression<Lhs>::value || isExpression<Rhs>::value)>;
+
+template<typename T>
+using enableUnary = std::enable_if_t<isExpression<T>::value>;
+
+template<typename First, typename Second, typename Third>
+using enableTernary = std::enable_if_t<isOperand<First> && isOperand<Second> && isOperand<Third>
+                                       && (isExpression<First>::value || isExpression<Second>::value || isExpression<Third>::value)>;
+
+template<typename T>
+auto operand(const T &value) {
+    if constexpr (isExpression<T>::value){
+        return value;
+    } else {
+        return literal{static_cast<double>(value)};
+    }
+}
+
+template<Opcode op, typename Lhs, typename Rhs>
+auto binary(const Lhs &lhs, const Rhs &rhs) {
+    using left = decltype(operand(lhs));
+    using right = decltype(operand(rhs));
+    return binaryExpression<op, left, right>{operand(lhs), operand(rhs)};
+}
+
+template<Opcode op, typename Operand>
+auto unary(const Operand &value) {
+    return unaryExpression<op, Operand>{value};
+}
+
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator+(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::add>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator-(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::sub>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator*(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::mul>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator/(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::div>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator%(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::mod>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator<(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::less>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator<=(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::lessEqual>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator>(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::greater>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator>=(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::greaterEqual>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator==(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::equal>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto operator!=(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::notEqual>(lhs, rhs);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto operator-(const Operand &operand) {
+    return detail::unary<Opcode::negate>(operand);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+const Operand& operator+(const Operand &operand) {
+    return operand;
+}
+
+/**
+ * base^exponent
+ */
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto pow(const Lhs &base, const Rhs &exponent) {
+    return detail::binary<Opcode::pow>(base, exponent);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto factorial(const Operand &operand) {
+    return detail::unary<Opcode::factorial>(operand);
+}
+
+/**
+ * Sine of operand in degrees
+ */
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto sin(const Operand &operand) {
+    return detail::unary<Opcode::sin>(operand);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto cos(const Operand &operand) {
+    return detail::unary<Opcode::cos>(operand);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto tan(const Operand &operand) {
+    return detail::unary<Opcode::tan>(operand);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto sqrt(const Operand &operand) {
+    return detail::unary<Opcode::sqrt>(operand);
+}
+
+/**
+ * Square root, like root(x) of the string grammar
+ */
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto root(const Operand &operand) {
+    return detail::unary<Opcode::sqrt>(operand);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto root(const Lhs &degree, const Rhs &num) {
+    return detail::binary<Opcode::root>(degree, num);
+}
+
+/**
+ * Decimal logarithm
+ */
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto log(const Operand &operand) {
+    return detail::unary<Opcode::log10>(operand);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto log(const Lhs &base, const Rhs &num) {
+    return detail::binary<Opcode::log>(base, num);
+}
+
+template<typename Operand, typename = detail::enableUnary<Operand>>
+auto abs(const Operand &operand) {
+    return detail::unary<Opcode::abs>(operand);
+}
+
+/**
+ * Smaller operand, NaN if lhs is NaN, see calcLib::min
+ */
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto min(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::min>(lhs, rhs);
+}
+
+template<typename Lhs, typename Rhs, typename = detail::enableBinary<Lhs, Rhs>>
+auto max(const Lhs &lhs, const Rhs &rhs) {
+    return detail::binary<Opcode::max>(lhs, rhs);
+}
+
+/**
+ * min(max(value, low), high), like clamp(value:low:high) of the string grammar
+ */
+template<typename Value, typename Low, typename High, typename = detail::enableTernary<Value, Low, High>>
+auto clamp(const Value &value, const Low &low, const High &high) {
+    return detail::binary<Opcode::min>(detail::binary<Opcode::max>(value, low), high);
+}
+
+/**
+ * then if condition is not zero, otherwise otherwise, like if(condition:then:otherwise) of the string grammar
+ */
+template<typename Condition, typename Then, typename Otherwise,
+         typename = detail::enableTernary<Condition, Then, Otherwise>>
+auto conditional(const Condition &condition, const Then &then, const Otherwise &otherwise) {
+    using node = conditionalExpression<decltype(detail::operand(condition)), decltype(detail::operand(then)),
+                                           decltype(detail::operand(otherwise))>;
+    return node{detail::operand(condition), detail::operand(then), detail::operand(otherwise)};
+}
+
+/**
+ * Emits bytecode of a formula
+ * @param expression formula built from variables, literals, operators and functions
+ * @param outExpression compiled expression
+ */
+template<typename Expression, typename = detail::enableUnary<Expression>>
+void compile(const Expression &expression, compiledExpression &outExpression) {
+    outExpression = compiledExpression();
+    uint32_t depth = 0;
+    expression.emit(outExpression, depth);
+}
+
+}
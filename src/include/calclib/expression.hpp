@@ -0,0 +1,361 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "calclib/calclib.hpp"
+
+class jitExpression;
+
+/**
+ * Expression compiled by calcLib::compile into bytecode for a stack machine.
+ * It does not depend on the session it was compiled for and is not modified by evaluation,
+ * so one instance can be cached and evaluated from many threads at once.
+ */
+class compiledExpression {
+public:
+    /**
+     * Stack machine operations. Operands are popped from the stack and the result is pushed back.
+     *
+     * if(condition:then:otherwise) is emitted as condition, branch, then, jump, otherwise, select. run pops the
+     * condition at branch and evaluates only the branch taken. runColumns keeps the condition on the stack,
+     * evaluates both branches for every row with the errors of the rows not taking them masked, and select
+     * blends the two results. arity and stackSize follow runColumns. A condition is true unless it is zero.
+     *
+     * sum(i:lo:hi:body) is emitted as lo, hi, sum, body, endLoop. The body is evaluated apart from the code around
+     * it, for a block of indices at a time, with the index in the slot after those of the enclosing code.
+     * stackSize covers the bodies too.
+     */
+    enum class Opcode : uint8_t {
+        constant, //! Push constants[operand]
+        variable, //! Push value bound to symbols[operand]
+        negate,
+        factorial,
+        add,
+        sub,
+        mul,
+        div,
+        mod,
+        pow,
+        sin,
+        cos,
+        tan,
+        sqrt,
+        log10,
+        log, //! log(base:num)
+        root, //! root(degree:num)
+        cbrt, //! root(3:num)
+        powInt, //! lhs^rhs by repeated squaring, see calcLib::powInt
+        fma, //! Fused a*b+c of the three topmost values, rounded once
+        polynomial, //! constants[operand] is the degree n, followed by the n + 1 coefficients from x^0 up, see horner
+        less, //! 1 if lhs < rhs, otherwise 0. Comparisons with NaN are 0 except notEqual
+        lessEqual,
+        greater,
+        greaterEqual,
+        equal,
+        notEqual,
+        min, //! See calcLib::min
+        max,
+        abs,
+        branch, //! Continues at operand, the first instruction of otherwise, if the condition is zero
+        jump, //! Continues at operand, the select ending the conditional
+        select, //! Ends the conditional
+        sum, //! Sum of the body for the indices lo..hi, operand is the index of its endLoop, see indexRange
+        product,
+        endLoop, //! Ends the body of a sum or product, operand is the slot of the index. Never executed.
+        series //! Closed form of a sum or product over lo..hi, see series
+    };
+    static constexpr Opcode lastOpcode = Opcode::series; //! Bytecode from outside is checked against it
+    static constexpr uint64_t maxTerms = uint64_t(1) << 32; //! Most indices a sum or product runs over
+
+    struct Instruction {
+        Opcode op;
+        uint32_t operand; //! Index into constants, symbols or code, calcLib::Accuracy of the tiered functions, otherwise 0
+    };
+
+    std::vector<Instruction> code; //! Instructions in postfix order
+    std::vector<double> constants; //! Literals referenced by Opcode::constant, Opcode::polynomial and Opcode::series
+    std::vector<std::string> symbols; //! Variable names, index is the slot read by Opcode::variable
+    uint32_t stackSize = 0; //! Deepest stack needed by code
+
+    /**
+     * Call counter and native code of the JIT tier. Copies and assigned expressions start interpreted again.
+     */
+    class tierState {
+        friend class compiledExpression;
+        mutable std::atomic<uint32_t> calls{0};
+        mutable std::atomic<const jitExpression*> native{nullptr};
+    public:
+        tierState() = default;
+        tierState(const tierState&) {}
+        tierState& operator=(const tierState&);
+        ~tierState();
+    };
+    tierState tier;
+
+    /**
+     * Evaluates code
+     * @param slots values of symbols, slots[i] belongs to symbols[i]
+     * @param outResult solved value
+     * @param ieeeFlags sticky flags to raise in ieee mode. nullptr if ieee mode is off
+     * @return Status::ok or the error that stopped evaluation
+     */
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const;
+
+    /**
+     * Counts a call and translates code to native code when the count reaches threshold, see calcLib::jitThreshold
+     * @param threshold number of calls before translation, 0 keeps the expression interpreted
+     * @return native code, nullptr while the expression is interpreted
+     */
+    const jitExpression* nativeCode(uint32_t threshold) const;
+
+    /**
+     * @return view of code and constants, valid while this expression is not modified
+     */
+    expressionView view() const;
+
+    /**
+     * Evaluates code for many rows of symbol values. Every instruction is applied to a block of rows
+     * before the next one, so the dispatch cost is paid once per block instead of once per row.
+     * @param columns columns[i] points to rows values of symbols[i]
+     * @param rows number of rows
+     * @param outResults rows solved values, NaN for rows that failed
+     * @param outStatus rows statuses, Status::ok or the first error of the row
+     * @param ieeeFlags sticky flags raised by any row in ieee mode. nullptr if ieee mode is off
+     */
+    void runColumns(const double *const *columns, size_t rows, double *outResults, calcLib::Status *outStatus,
+                    unsigned *ieeeFlags) const;
+
+    /**
+     * @param op
+     * @return number of values op pops from the stack
+     */
+    static unsigned arity(Opcode op);
+
+    /**
+     * Simulates the stack of code in the order runColumns evaluates it, for bytecode that does not come from the compiler
+     * @param code
+     * @param codeSize number of instructions
+     * @param slotCount number of slots the code is run with
+     * @param outStackSize deepest stack needed by code and the bodies of its loops
+     * @return true if code leaves one value, never pops a value it has not pushed, reads only its slots and its
+     *         conditionals are nested, with branches that leave the values below them alone and push exactly one
+     *         value each. Bodies of loops must pass the same checks with the index as one more slot.
+     */
+    static bool simulate(const Instruction *code, size_t codeSize, uint32_t slotCount, uint32_t &outStackSize);
+
+    /**
+     * @param op
+     * @return true if op is a function whose instruction selects a calcLib::Accuracy tier with its operand
+     */
+    static bool tiered(Opcode op);
+
+    /**
+     * @param op
+     * @return true if op can fail with a status other than calcLib::Status::ok
+     */
+    static constexpr bool fallible(Opcode op) {
+        switch (op) {
+            case Opcode::div:
+            case Opcode::mod:
+            case Opcode::tan:
+            case Opcode::sqrt:
+            case Opcode::log:
+            case Opcode::root:
+            case Opcode::cbrt:
+            case Opcode::sum:
+            case Opcode::product:
+            case Opcode::series:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * @param exponent constant exponent of Opcode::pow
+     * @param accuracy tier of the pow
+     * @return true if the compiler lowers pow to Opcode::powInt, which then returns the same bits
+     */
+    static bool chainedPower(double exponent, calcLib::Accuracy accuracy);
+
+    /**
+     * @param divisor constant divisor of Opcode::div
+     * @param outReciprocal 1 / divisor
+     * @return true if divisor is a power of two with a finite reciprocal, so that multiplying by it is exact
+     */
+    static bool exactReciprocal(double divisor, double &outReciprocal);
+
+    /**
+     * Applies a single operation to its operands. Used by run and by constant folding in the compiler.
+     * @param op operation other than Opcode::constant, Opcode::variable, Opcode::fma, Opcode::polynomial and the
+     *           instructions of conditionals
+     * @param lhs first operand
+     * @param rhs second operand, ignored by unary operations
+     * @param outResult IEEE result of the operation even if it fails
+     * @param accuracy tier of the function helpers, see tiered()
+     * @return status of the operation
+     */
+    static calcLib::Status apply(Opcode op, double lhs, double rhs, double &outResult,
+                                 calcLib::Accuracy accuracy = calcLib::Accuracy::faithful);
+
+    /**
+     * Evaluates a polynomial by Horner's scheme, a multiplication and an addition per coefficient, each rounded.
+     * Opcode::polynomial, runColumns, the JIT tier and calclib/dsl.hpp take the same steps.
+     * @param coefficients degree + 1 coefficients, coefficients[k] multiplies x^k
+     * @param degree
+     * @param x
+     * @return value of the polynomial at x
+     */
+    static double horner(const double *coefficients, uint32_t degree, double x);
+
+    /**
+     * horner applied to count values in place, vectorized across the values
+     */
+    static void horner(const double *coefficients, uint32_t degree, double *values, size_t count);
+
+    /**
+     * Checks the bounds of a sum or product
+     * @param lo first index
+     * @param hi last index
+     * @param outTerms number of indices, 0 if hi < lo
+     * @return Status::domainError unless lo and hi are integers below 2^53 in magnitude and there are at most
+     *         maxTerms indices
+     */
+    static calcLib::Status indexRange(double lo, double hi, uint64_t &outTerms);
+
+    /**
+     * Evaluates the closed form the compiler found for a sum or product. terms[0] selects it:
+     * - 0: sum of a polynomial p, terms[1] is the degree of Q and terms[2] on its coefficients from x^0 up, where
+     *   Q(m) - Q(m - 1) = p(m), so the sum is Q(hi) - Q(lo - 1)
+     * - 1: sum of c*r^i, terms[1] is c and terms[2] is r other than 1
+     * - 2: product of the constant terms[1]
+     * @param terms constants of Opcode::series
+     * @param lo first index
+     * @param hi last index
+     * @param outResult value of the sum or product, rounded differently from adding its terms
+     * @return status of indexRange
+     */
+    static calcLib::Status series(const double *terms, double lo, double hi, double &outResult);
+
+private:
+    friend struct expressionView;
+
+    /**
+     * apply with the function helpers of Math: calcLib, correctlyRoundedMath or fastMath
+     */
+    template<typename Math>
+    static calcLib::Status applyTier(Opcode op, double lhs, double rhs, double &outResult);
+
+    /**
+     * Applies sin, cos or tan of Math to a block of values in place
+     */
+    template<typename Math>
+    static void degreesInPlace(Opcode op, double *values, size_t count);
+};
+
+/**
+ * Coefficients of a polynomial in one variable, built bottom-up from a syntax tree by the compiler and
+ * calclib/dsl.hpp to find the subtrees they evaluate as Opcode::polynomial. Terms are combined algebraically,
+ * so x^2-x^2+x is collected as x. A product takes a single term on one side and powers take a single term
+ * base, so factored forms like (x-1)*(x+1), which are often more accurate, are not expanded.
+ */
+struct polynomialTerms {
+    static constexpr uint32_t maxDegree = 32; //! Higher powers are evaluated as written
+
+    int64_t variable = -1; //! Identifier of the variable, -1 if the subtree has none
+    uint32_t degree = 0; //! Highest power with a nonzero coefficient, 0 for constants
+    double coefficients[maxDegree + 1]; //! coefficients[k] multiplies variable^k, valid up to degree
+
+    /**
+     * @param value
+     * @return polynomial of degree 0
+     */
+    static polynomialTerms constant(double value);
+
+    /**
+     * @param variable identifier of the variable
+     * @return polynomial x of degree 1
+     */
+    static polynomialTerms symbol(int64_t variable);
+
+    /**
+     * Replaces this polynomial with op applied to it and operand
+     * @param op Opcode::negate, which ignores operand, Opcode::add, Opcode::sub or Opcode::mul, or Opcode::div and
+     *           Opcode::pow with a constant operand
+     * @param operand second operand
+     * @return false if the result is not a polynomial collected by these rules, this is left unspecified
+     */
+    bool apply(compiledExpression::Opcode op, const polynomialTerms &operand);
+
+    /**
+     * @return true if the subtree is worth evaluating as Opcode::polynomial: it has a variable, degree 2 or
+     *         more and at least two terms
+     */
+    bool collectable() const;
+
+private:
+    /**
+     * @return number of nonzero coefficients
+     */
+    uint32_t terms() const;
+};
+
+/**
+ * Non-owning view of bytecode and its constants. Lets bytecode stored elsewhere, for example in a
+ * mapped expressionBundle, run without being copied into a compiledExpression.
+ */
+struct expressionView {
+    const compiledExpression::Instruction *code;
+    size_t codeSize;
+    const double *constants;
+    uint32_t stackSize; //! Deepest stack needed by code
+
+    static constexpr size_t chunkTerms = 4096; //! Indices of a loop evaluated by one runColumns call
+    static constexpr uint64_t parallelTerms = uint64_t(1) << 18; //! Loops with more indices are split across threads
+
+    /**
+     * Keeps the sums and products evaluated by the calling thread on that thread instead of splitting long ones
+     * across the loop threads, one per core that the process starts on first use and keeps. Set by threads that
+     * are already one of many, like the workers of calcBatch and calcProcessPool, and by calcServer. Loops that
+     * find the loop threads busy with another one run on their own thread too.
+     * @return previous setting
+     */
+    static bool keepLoopsOnThread(bool keep);
+
+    /**
+     * Evaluates code, see compiledExpression::run
+     */
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const;
+
+    /**
+     * Evaluates code for many rows, see compiledExpression::runColumns
+     */
+    void runColumns(const double *const *columns, size_t rows, double *outResults, calcLib::Status *outStatus,
+                    unsigned *ieeeFlags) const;
+
+private:
+    /**
+     * run of the instructions first..last - 1, targets of branches and jumps stay indices into code
+     */
+    calcLib::Status run(size_t first, size_t last, const double *slots, double &outResult, unsigned *ieeeFlags) const;
+
+    void runColumns(size_t first, size_t last, const double *const *columns, size_t rows, double *outResults,
+                    calcLib::Status *outStatus, unsigned *ieeeFlags) const;
+
+    /**
+     * Evaluates the sum or product at code[at]. The body runs through runColumns for up to chunkTerms indices at
+     * a time, its values are added or multiplied in order within a chunk and the chunks in order, so the result
+     * does not depend on how many threads took part.
+     * @param at index of the Opcode::sum or Opcode::product
+     * @param slots values of the slots before the index
+     * @param lo first index
+     * @param hi last index
+     * @param outResult value of the sum or product
+     * @param ieeeFlags sticky flags to raise in ieee mode. nullptr if ieee mode is off
+     * @return Status::ok, the status of indexRange or the first error in order of the indices
+     */
+    calcLib::Status accumulate(size_t at, const double *slots, double lo, double hi, double &outResult,
+                               unsigned *ieeeFlags) const;
+};
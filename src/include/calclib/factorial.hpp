@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/**
+ * Factorials as a table built at compile time, shared by calcLib and the constexpr evaluator,
+ * and the Lanczos coefficients both use for the gamma function of non-integers.
+ */
+namespace calclib {
+
+constexpr size_t maxFactorial = 170; //! Largest n with n! below the double range
+
+namespace detail {
+
+/**
+ * Unevaluated sum hi + lo carrying about 106 bits, enough for every table entry to round correctly
+ */
+struct doubleDouble {
+    double hi;
+    double lo;
+};
+
+/**
+ * @return value * factor with the rounding error of the product kept in lo, factor has at most 26 bits
+ */
+constexpr doubleDouble scaleExact(doubleDouble value, double factor) {
+    // Dekker's product, hi is split so that every partial product is exact
+    constexpr double splitter = 134217729.0; // 2^27 + 1
+    // Splits a power of two smaller near the top of the range, so splitter * hi does not overflow
+    double shift = value.hi > 0x1p900 ? 0x1p100 : 1;
+    double scaled = value.hi / shift;
+    double split = splitter * scaled;
+    double high = (split - (split - scaled)) * shift;
+    double low = value.hi - high;
+    double product = value.hi * factor;
+    double error = (high * factor - product) + low * factor;
+    double tail = value.lo * factor + error;
+    double sum = product + tail;
+    return {sum, tail - (sum - product)};
+}
+
+constexpr std::array<double, maxFactorial + 1> makeFactorials() {
+    std::array<double, maxFactorial + 1> table{};
+    doubleDouble product{1, 0};
+    table[0] = 1;
+    for (size_t n = 1; n <= maxFactorial; ++n) {
+        product = scaleExact(product, static_cast<double>(n));
+        table[n] = product.hi;
+    }
+    return table;
+}
+
+}
+
+/**
+ * n! correctly rounded for n = 0..maxFactorial
+ */
+inline constexpr std::array<double, maxFactorial + 1> factorials = detail::makeFactorials();
+
+/**
+ * Γ(x) ≈ sqrt(2π) t^(x-0.5) e^-t (c0 + c1/x + ... + c8/(x+7)) with t = x + lanczosG - 0.5, for 0.5 <= x < stirlingMin.
+ * Relative error is below 5e-15 there, above it the constant term makes the error grow towards 2e-13.
+ */
+constexpr double lanczosG = 7;
+inline constexpr double lanczosCoefficients[] = {
+        0.99999999999980993, 676.5203681218851, -1259.1392167224028, 771.32342877765313, -176.61502916214059,
+        12.507343278686905, -0.13857109526572012, 9.9843695780195716e-6, 1.5056327351493116e-7
+};
+
+/**
+ * From here Γ(x) ≈ sqrt(2π) x^(x-0.5) e^-x e^(1/12x - 1/360x^3 + 1/1260x^5 - 1/1680x^7 + 1/1188x^9),
+ * the first omitted term of the Stirling series is below 3e-16
+ */
+constexpr double stirlingMin = 15;
+
+/**
+ * Γ(x) overflows double above this
+ */
+constexpr double gammaMax = 171.625;
+
+}
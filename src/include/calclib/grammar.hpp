@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include "calclib/expression.hpp"
+
+/**
+ * Operator and function tables of the expression grammar. Shared by the runtime compiler and the
+ * compile-time evaluator of calclib/constant.hpp, so both accept the same language.
+ */
+namespace calcGrammar {
+
+constexpr unsigned maxNesting = 512; //! Deepest bracket, sign and function nesting accepted before giving up
+
+/**
+ * Binary operator of one precedence level
+ */
+struct binaryLevel {
+    char symbol;
+    compiledExpression::Opcode op;
+    bool rightAssociative;
+};
+
+/**
+ * Binary operators from the loosest to the tightest binding. Every operator has its own level
+ * and modulo binds tighter than power, so for example 2^3%2 is 2.
+ */
+constexpr binaryLevel binaryLevels[] = {
+        {'+', compiledExpression::Opcode::add, false},
+        {'-', compiledExpression::Opcode::sub, false},
+        {'*', compiledExpression::Opcode::mul, false},
+        {'/', compiledExpression::Opcode::div, false},
+        {'^', compiledExpression::Opcode::pow, true},
+        {'%', compiledExpression::Opcode::mod, false},
+};
+constexpr size_t binaryLevelCount = sizeof(binaryLevels) / sizeof(binaryLevels[0]);
+
+/**
+ * Comparison operator, as spelled by lexertk::token::to_str
+ */
+struct comparison {
+    const char *symbol;
+    compiledExpression::Opcode op;
+};
+
+/**
+ * Comparisons share one level, looser than every binary level, and associate to the left. They give 1 if
+ * they hold and 0 otherwise. == and <> are read as = and !=.
+ */
+constexpr comparison comparisons[] = {
+        {"<", compiledExpression::Opcode::less},
+        {"<=", compiledExpression::Opcode::lessEqual},
+        {">", compiledExpression::Opcode::greater},
+        {">=", compiledExpression::Opcode::greaterEqual},
+        {"=", compiledExpression::Opcode::equal},
+        {"!=", compiledExpression::Opcode::notEqual},
+};
+
+constexpr char factorialSymbol = '!'; //! Postfix operator
+constexpr char parameterSeparator = ':';
+constexpr unsigned maxParameters = 3;
+constexpr const char *conditionalFunction = "if"; //! if(condition:then:otherwise) evaluates only the branch taken
+constexpr const char *clampFunction = "clamp"; //! clamp(x:low:high) is min(max(x:low):high)
+constexpr const char *sumFunction = "sum"; //! sum(i:lo:hi:body) adds body for the integers i from lo to hi
+constexpr const char *productFunction = "prod"; //! prod(i:lo:hi:body) multiplies them
+constexpr uint32_t firstIndexSymbol = 0x80000000; //! Symbol of the index of the outermost loop, nested ones follow
+
+/**
+ * Builtin function with fixed number of parameters
+ */
+struct builtinFunction {
+    const char *name;
+    unsigned parameters;
+    compiledExpression::Opcode op;
+};
+
+constexpr builtinFunction builtinFunctions[] = {
+        {"sin", 1, compiledExpression::Opcode::sin},
+        {"cos", 1, compiledExpression::Opcode::cos},
+        {"tan", 1, compiledExpression::Opcode::tan},
+        {"sqrt", 1, compiledExpression::Opcode::sqrt},
+        {"root", 1, compiledExpression::Opcode::sqrt},
+        {"root", 2, compiledExpression::Opcode::root},
+        {"log", 1, compiledExpression::Opcode::log10},
+        {"log", 2, compiledExpression::Opcode::log},
+        {"abs", 1, compiledExpression::Opcode::abs},
+        {"min", 2, compiledExpression::Opcode::min},
+        {"max", 2, compiledExpression::Opcode::max},
+};
+
+/**
+ * @return true if name is a function of the grammar, which calcLib::define cannot replace
+ */
+constexpr bool builtinName(std::string_view name) {
+    for (const auto &function : builtinFunctions) {
+        if (name == function.name){
+            return true;
+        }
+    }
+    return name == conditionalFunction || name == clampFunction || name == sumFunction || name == productFunction;
+}
+
+}
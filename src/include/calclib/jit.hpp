@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include "calclib/expression.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CALCLIB_HAS_JIT 1
+#else
+#define CALCLIB_HAS_JIT 0
+#endif
+
+/**
+ * Native x86-64 machine code of an expression. Bytecode is translated to scalar SSE2 code: the value stack
+ * lives in xmm registers, constants are encoded as immediates, add/sub/mul/div/negate are emitted inline and
+ * the remaining operations call the calcLib helpers directly. Statuses and ieee flags are the same as the ones
+ * of expressionView::run.
+ *
+ * Code is written to a private mapping that is made executable only after it is complete (W^X). With the
+ * environment variable CALCLIB_PERF_MAP set, every function is announced in /tmp/perf-<pid>.map, so perf can
+ * symbolize samples in generated code.
+ * On other platforms compile always fails and expressions stay interpreted.
+ */
+class jitExpression {
+    using entryPoint = int (*)(const double *slots, double *outResult, unsigned *ieeeFlags);
+    void *memory = nullptr; //! Executable mapping
+    size_t mappedSize = 0;
+    size_t usedSize = 0; //! Bytes of code in memory
+    entryPoint entry = nullptr;
+
+    jitExpression() = default;
+public:
+    static constexpr bool supported = CALCLIB_HAS_JIT; //! Native code can be generated on this platform
+
+    /**
+     * Translates bytecode to native code
+     * @param expression bytecode, it is not referenced after compile returns
+     * @return native code, nullptr if the platform is not supported, the bytecode is malformed
+     *         or executable memory could not be mapped
+     */
+    static std::unique_ptr<jitExpression> compile(const expressionView &expression);
+
+    /**
+     * Unmaps the code
+     */
+    ~jitExpression();
+
+    jitExpression(const jitExpression&) = delete;
+    jitExpression& operator=(const jitExpression&) = delete;
+
+    /**
+     * Evaluates the expression, see expressionView::run
+     */
+    calcLib::Status run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+        return static_cast<calcLib::Status>(entry(slots, &outResult, ieeeFlags));
+    }
+
+    /**
+     * @return size of the generated code in bytes
+     */
+    size_t codeSize() const;
+
+    /**
+     * @return address of the first instruction
+     */
+    const void* code() const;
+};
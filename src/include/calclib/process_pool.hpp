@@ -0,0 +1,123 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "calclib/batch.hpp"
+
+/**
+ * Evaluates batches of independent expressions in forked worker processes.
+ *
+ * evaluate copies the expressions into a shared memory job area, workers read them there and write
+ * batchResult entries into a shared result array, which evaluate copies to outResults. A job skips both copies:
+ * the caller writes the expressions into the job area and reads the results where the workers left them. Ranges of the job
+ * are handed out through lock-free single-producer/single-consumer rings, one request and one completion
+ * ring per worker.
+ * Every worker is pinned to its own slice of the allowed cores and runs a calcBatch with one thread
+ * per core of the slice.
+ *
+ * A crashed worker is replaced. The range it was working on is evaluated again one expression at a time,
+ * so only the expression that crashes it again is reported as Status::workerFailed.
+ *
+ * The constructor forks a supervisor process, which forks the workers and their replacements, so evaluate
+ * never forks the calling process. Workers see calc and session as they were when the pool was created.
+ * Create the pool before starting other threads.
+ */
+class calcProcessPool {
+    struct shared;
+    std::unique_ptr<shared> impl;
+public:
+    /**
+     * Forks the supervisor and waits until it started the workers
+     * @param calc calculator used by the workers
+     * @param session variables available to every expression
+     * @param processCount number of worker processes. 0 starts one per allowed core
+     * @param arenaBytes size of the shared text area, larger jobs are evaluated in several rounds
+     */
+    calcProcessPool(const calcLib &calc, const calcSession &session, unsigned processCount = 0,
+                    size_t arenaBytes = 16 << 20);
+
+    /**
+     * Stops the workers and reaps the supervisor
+     */
+    ~calcProcessPool();
+
+    calcProcessPool(const calcProcessPool&) = delete;
+    calcProcessPool& operator=(const calcProcessPool&) = delete;
+
+    /**
+     * Batch built in the shared job area:
+     *
+     *     calcProcessPool::job job{pool};
+     *     while (char *text = job.append(line.size())) {
+     *         line.copy(text, line.size());
+     *     }
+     *     const batchResult *results = job.run();
+     *
+     * The pool runs one batch at a time, evaluate and other jobs wait until the job is destroyed.
+     */
+    class job {
+        shared *pool;
+        std::unique_lock<std::mutex> guard;
+        uint32_t count = 0;
+    public:
+        explicit job(calcProcessPool &pool);
+
+        /**
+         * Adds an expression to the job
+         * @param length size of the expression in bytes
+         * @return where the caller writes the expression, nullptr if the job area is full. Run and clear the job
+         *         then, or evaluate an expression longer than the whole area with calcLib
+         */
+        char* append(size_t length);
+
+        /**
+         * Evaluates the expressions appended since the last clear. Every expression starts from the session given
+         * to the pool.
+         * @return size() results in the order of append, valid until clear or the destruction of the job
+         */
+        const batchResult* run();
+
+        /**
+         * Empties the job for the next batch
+         */
+        void clear();
+
+        /**
+         * @return number of appended expressions
+         */
+        size_t size() const;
+    };
+
+    /**
+     * Evaluates expressions in the worker processes. Every expression starts from the session given
+     * to the constructor. Only one batch runs at a time.
+     * @param expressions expressions to solve
+     * @param count number of expressions
+     * @param outResults array of count results, filled in the order of expressions
+     */
+    void evaluate(const std::string_view *expressions, size_t count, batchResult *outResults);
+
+    /**
+     * @param expressions expressions to solve
+     * @return results in the order of expressions
+     */
+    std::vector<batchResult> evaluate(const std::vector<std::string_view> &expressions);
+
+    /**
+     * @return number of worker processes
+     */
+    unsigned processCount() const;
+
+    /**
+     * @param index worker number
+     * @return process id of the worker
+     */
+    int workerPid(unsigned index) const;
+
+    /**
+     * @return number of workers replaced after a crash
+     */
+    size_t restarts() const;
+};
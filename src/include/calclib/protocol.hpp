@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Binary framing spoken by fitutubies-calcd over its Unix domain socket.
+ *
+ * Every message is a frame: 4 byte little endian length of the rest of the frame, 1 byte message type
+ * and the payload. Clients may pipeline any number of requests, responses come in the same order.
+ *
+ * Requests and their responses:
+ *  - evaluate: expression text -> result
+ *  - evaluateText: expression text -> text, formatted like calcLib::solveEquation
+ *  - setVariable: 8 byte little endian double followed by the variable name -> result echoing the value
+ *
+ * Payload of result is 1 byte calcLib::Status, 1 byte sticky calcLib::StatusFlag bits of the session
+ * and 8 byte little endian double. Payload of text is 1 byte calcLib::Status followed by the text.
+ * ans and variables belong to the connection, compiled expressions are shared by all connections.
+ */
+namespace calcProtocol {
+
+enum class MessageType : uint8_t {
+    evaluate = 0x01,
+    evaluateText = 0x02,
+    setVariable = 0x03,
+    result = 0x81,
+    text = 0x82
+};
+
+constexpr size_t headerSize = 5; //! Length and type
+constexpr uint32_t maxFrameSize = 1 << 20; //! Longest accepted length field, longer frames close the connection
+constexpr size_t resultPayloadSize = 10;
+
+/**
+ * Frame decoded from a buffer. Payload points into the buffer.
+ */
+struct frame {
+    MessageType type;
+    std::string_view payload;
+};
+
+inline void putUint32(char *out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+inline uint32_t getUint32(const char *in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+inline void putDouble(char *out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<char>(bits >> (8 * i));
+    }
+}
+
+inline double getDouble(const char *in) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Appends one frame to out
+ * @param out output buffer
+ * @param type message type
+ * @param payload message body
+ */
+inline void appendFrame(std::string &out, MessageType type, std::string_view payload) {
+    char header[headerSize];
+    putUint32(header, static_cast<uint32_t>(payload.size() + 1));
+    header[4] = static_cast<char>(type);
+    out.append(header, headerSize);
+    out.append(payload.data(), payload.size());
+}
+
+/**
+ * Appends result frame to out
+ */
+inline void appendResult(std::string &out, uint8_t status, uint8_t flags, double value) {
+    char payload[resultPayloadSize];
+    payload[0] = static_cast<char>(status);
+    payload[1] = static_cast<char>(flags);
+    putDouble(payload + 2, value);
+    appendFrame(out, MessageType::result, std::string_view(payload, resultPayloadSize));
+}
+
+/**
+ * Appends setVariable request to out
+ */
+inline void appendSetVariable(std::string &out, std::string_view name, double value) {
+    std::string payload(8, '\0');
+    putDouble(payload.data(), value);
+    payload.append(name.data(), name.size());
+    appendFrame(out, MessageType::setVariable, payload);
+}
+
+/**
+ * Decodes the first frame of data
+ * @param data received bytes
+ * @param size number of received bytes
+ * @param outFrame decoded frame
+ * @param outConsumed size of the frame in bytes
+ * @return 1 if a frame was decoded, 0 if more data is needed, -1 if the stream is malformed
+ */
+inline int parseFrame(const char *data, size_t size, frame &outFrame, size_t &outConsumed) {
+    if (size < headerSize){
+        return 0;
+    }
+    uint32_t length = getUint32(data);
+    if (length == 0 || length > maxFrameSize){
+        return -1;
+    }
+    if (size < 4 + static_cast<size_t>(length)){
+        return 0;
+    }
+    outFrame.type = static_cast<MessageType>(data[4]);
+    outFrame.payload = std::string_view(data + headerSize, length - 1);
+    outConsumed = 4 + static_cast<size_t>(length);
+    return 1;
+}
+
+}
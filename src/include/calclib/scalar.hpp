@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "calclib/expression.hpp"
+#if defined(CALCLIB_HAS_FLOAT128)
+#include <quadmath.h>
+#endif
+
+/**
+ * Math and text conversion of a scalar type the engine can evaluate in. Specialized for float, double,
+ * long double and, where libquadmath is available (CALCLIB_HAS_FLOAT128), __float128.
+ */
+template<typename Scalar>
+struct scalarTraits;
+
+/**
+ * Traits of the types covered by <cmath>
+ */
+template<typename Scalar>
+struct standardScalarTraits {
+    static Scalar pi() {
+        return static_cast<Scalar>(3.14159265358979323846264338327950288L);
+    }
+
+    static Scalar e() {
+        return static_cast<Scalar>(2.71828182845904523536028747135266250L);
+    }
+
+    static Scalar infinity() {
+        return std::numeric_limits<Scalar>::infinity();
+    }
+
+    static Scalar nan() {
+        return std::numeric_limits<Scalar>::quiet_NaN();
+    }
+
+    static Scalar sin(Scalar x) { return std::sin(x); }
+    static Scalar cos(Scalar x) { return std::cos(x); }
+    static Scalar tan(Scalar x) { return std::tan(x); }
+    static Scalar pow(Scalar base, Scalar exponent) { return std::pow(base, exponent); }
+    static Scalar log10(Scalar x) { return std::log10(x); }
+    static Scalar copysign(Scalar magnitude, Scalar sign) { return std::copysign(magnitude, sign); }
+    static Scalar modf(Scalar x, Scalar *intpart) { return std::modf(x, intpart); }
+    static Scalar gamma(Scalar x) { return std::tgamma(x); }
+    static Scalar fmod(Scalar lhs, Scalar rhs) { return std::fmod(lhs, rhs); }
+
+    /**
+     * @param text number literal
+     * @return value rounded to Scalar
+     */
+    static Scalar parse(const std::string &text) {
+        if constexpr (std::is_same_v<Scalar, float>){
+            return std::strtof(text.c_str(), nullptr);
+        } else if constexpr (std::is_same_v<Scalar, double>){
+            return std::strtod(text.c_str(), nullptr);
+        } else {
+            return std::strtold(text.c_str(), nullptr);
+        }
+    }
+
+    /**
+     * @param value
+     * @param precision digits after the decimal point
+     * @return value in fixed notation
+     */
+    static std::string format(Scalar value, int precision);
+};
+
+template<>
+struct scalarTraits<float> : standardScalarTraits<float> {
+    static constexpr const char *name = "float";
+};
+
+template<>
+struct scalarTraits<double> : standardScalarTraits<double> {
+    static constexpr const char *name = "double";
+};
+
+template<>
+struct scalarTraits<long double> : standardScalarTraits<long double> {
+    static constexpr const char *name = "long double";
+};
+
+#if defined(CALCLIB_HAS_FLOAT128)
+template<>
+struct scalarTraits<__float128> {
+    static constexpr const char *name = "float128";
+
+    static __float128 pi() { return M_PIq; }
+    static __float128 e() { return M_Eq; }
+    static __float128 infinity() { return HUGE_VALQ; }
+    static __float128 nan() { return nanq(""); }
+    static __float128 sin(__float128 x) { return sinq(x); }
+    static __float128 cos(__float128 x) { return cosq(x); }
+    static __float128 tan(__float128 x) { return tanq(x); }
+    static __float128 pow(__float128 base, __float128 exponent) { return powq(base, exponent); }
+    static __float128 log10(__float128 x) { return log10q(x); }
+    static __float128 copysign(__float128 magnitude, __float128 sign) { return copysignq(magnitude, sign); }
+    static __float128 modf(__float128 x, __float128 *intpart) { return modfq(x, intpart); }
+    static __float128 gamma(__float128 x) { return tgammaq(x); }
+    static __float128 fmod(__float128 lhs, __float128 rhs) { return fmodq(lhs, rhs); }
+
+    static __float128 parse(const std::string &text) {
+        return strtoflt128(text.c_str(), nullptr);
+    }
+
+    static std::string format(__float128 value, int precision);
+};
+#endif
+
+/**
+ * Bytecode of calcLib::compile evaluated in Scalar instead of double. Literals are converted from their
+ * spelling and constant folding happens in Scalar, so long double and __float128 expressions keep their
+ * precision end to end. compiledExpression stays the double engine with the JIT tier and bundles.
+ */
+template<typename Scalar>
+class basicExpression {
+public:
+    using Opcode = compiledExpression::Opcode;
+    using Instruction = compiledExpression::Instruction;
+
+    std::vector<Instruction> code; //! Instructions in postfix order
+    std::vector<Scalar> constants; //! Literals referenced by Opcode::constant
+    std::vector<std::string> symbols; //! Variable names, index is the slot read by Opcode::variable
+    uint32_t stackSize = 0; //! Deepest stack needed by code
+
+    /**
+     * Evaluates code, see compiledExpression::run
+     */
+    calcLib::Status run(const Scalar *slots, Scalar &outResult, unsigned *ieeeFlags) const;
+
+    /**
+     * Evaluates code for many rows, see compiledExpression::runColumns. Blocks have a fixed size in bytes,
+     * so a float block has twice the rows of a double block and every vector loop twice the lanes.
+     */
+    void runColumns(const Scalar *const *columns, size_t rows, Scalar *outResults, calcLib::Status *outStatus,
+                    unsigned *ieeeFlags) const;
+
+    /**
+     * Applies a single operation, see compiledExpression::apply
+     */
+    static calcLib::Status apply(Opcode op, Scalar lhs, Scalar rhs, Scalar &outResult);
+
+private:
+    /**
+     * run of the instructions first..last - 1, targets of branches and jumps stay indices into code
+     */
+    calcLib::Status run(size_t first, size_t last, const Scalar *slots, Scalar &outResult, unsigned *ieeeFlags) const;
+
+    /**
+     * Evaluates the sum or product at code[at] one index after another, see expressionView::accumulate.
+     * The bounds must be integers, and the index must still change when 1 is added to it.
+     */
+    calcLib::Status accumulate(size_t at, const Scalar *slots, const Scalar &lo, const Scalar &hi, Scalar &outResult,
+                               unsigned *ieeeFlags) const;
+};
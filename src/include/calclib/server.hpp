@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "calclib/cache.hpp"
+
+/**
+ * Evaluation service listening on a Unix domain socket. Single threaded epoll event loop speaking the
+ * calcProtocol framing. Every connection has its own calcSession, compiled expressions are shared
+ * by all connections through an expressionCache.
+ */
+class calcServer {
+    struct connection;
+    const calcLib &calc;
+    expressionCache cache;
+    std::string socketPath;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1; //! eventfd used by stop() to interrupt epoll_wait
+    std::unordered_map<int, std::unique_ptr<connection>> connections;
+public:
+    /**
+     * @param calc calculator used for all connections. Must outlive the server
+     * @param cacheCapacity maximal number of cached compiled expressions
+     */
+    calcServer(const calcLib &calc, size_t cacheCapacity);
+
+    /**
+     * Closes all connections and removes the socket file
+     */
+    ~calcServer();
+
+    calcServer(const calcServer&) = delete;
+    calcServer& operator=(const calcServer&) = delete;
+
+    /**
+     * Binds and listens on path with a socket only its owner may connect to. A stale socket file left at path
+     * is replaced if it belongs to the same user.
+     * @param path file system path of the socket
+     * @return false on error, errno describes the failure
+     */
+    bool listen(const std::string &path);
+
+    /**
+     * Serves connections until stop() is called. Sums and products are evaluated on the calling thread, see
+     * expressionView::keepLoopsOnThread.
+     */
+    void run();
+
+    /**
+     * Makes run() return. Async-signal-safe, so it can be called from a signal handler or another thread.
+     */
+    void stop();
+
+    /**
+     * @return cache shared by all connections
+     */
+    const expressionCache& compiledCache() const;
+
+private:
+    void serve();
+    void acceptConnections();
+    void closeConnection(connection &client);
+    bool readInput(connection &client);
+    void processInput(connection &client);
+    bool writeOutput(connection &client);
+    void updateEvents(connection &client);
+    bool handleFrame(connection &client, std::string_view payload, uint8_t type);
+};
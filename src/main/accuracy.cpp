@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "calclib/double_double.hpp"
+#include "accuracy.hpp"
+#include "degrees.hpp"
+#include "integer.hpp"
+
+using Status = calcLib::Status;
+
+namespace {
+
+constexpr doubleDouble roundedLn2{0.6931471805599453, 2.3190468138462996e-17}; //! ln(2) rounded to 106 bits
+constexpr doubleDouble roundedLn10{2.302585092994046, -2.1707562233822494e-16}; //! ln(10) rounded to 106 bits
+constexpr int atanhTerms = 24; //! Terms of the series of atanh(s) / s on |s| <= 1/5, the next is below 1e-33
+
+constexpr double ln2High = 6.93147180369123816490e-01; //! ln(2) rounded to 32 bits, exact times any exponent
+constexpr double ln2Low = 1.90821492927058770002e-10; //! ln(2) - ln2High
+constexpr double log10OfE = 0.4342944819032518;
+constexpr double expLimit = 708;
+constexpr double maxFastChain = 1024; //! Largest |exponent| fastMath raises by squaring, within (|exponent| + 1) * 2^-53
+constexpr size_t powChunk = 256; //! Values fastMath::pow evaluates before checking them, as many as a runColumns block
+constexpr uint64_t exponentOfOne = UINT64_C(1023) << 52;
+constexpr uint64_t sqrtHalfBits = UINT64_C(0x3fe6a09e667f3bcd); //! Bits of sqrt(2) / 2
+constexpr double integerShift = 0x1p52; //! Adding it to 0 <= n < 2^52 leaves n in the low bits of the mantissa
+constexpr uint64_t integerBits = UINT64_C(0x4330000000000000); //! Bits of integerShift
+// Fit of atanh(s) / s - 1 in z = s^2 on |s| <= 3 - 2 sqrt(2), within 3e-18
+constexpr double atanh1 = 0.33333333333333826;
+constexpr double atanh2 = 0.19999999999650955;
+constexpr double atanh3 = 0.1428571438036914;
+constexpr double atanh4 = 0.11111098523202137;
+constexpr double atanh5 = 0.09091816120808513;
+constexpr double atanh6 = 0.0765625655736915;
+constexpr double atanh7 = 0.07404933786156531;
+// Fit of (exp(r) - 1 - r) / r^2 on |r| <= ln(2) / 2, within 2e-17 of exp(r)
+constexpr double exp2 = 0.5000000000000019;
+constexpr double exp3 = 0.1666666666666668;
+constexpr double exp4 = 0.04166666666648795;
+constexpr double exp5 = 0.008333333333319589;
+constexpr double exp6 = 0.0013888888952352863;
+constexpr double exp7 = 0.00019841269890076403;
+constexpr double exp8 = 2.4801485441561313e-05;
+constexpr double exp9 = 2.755724088722987e-06;
+constexpr double exp10 = 2.763265472252779e-07;
+constexpr double exp11 = 2.5110049204818658e-08;
+
+/**
+ * Divides like calcLib::div
+ */
+Status quotient(double lhs, double rhs, double &outResult) {
+    outResult = lhs / rhs;
+    return rhs == 0 ? Status::divisionByZero : Status::ok;
+}
+
+/**
+ * Natural logarithm to about 1e-32 relative also close to 1, where the double-double logarithm only has an
+ * absolute bound
+ * @param x positive and finite
+ */
+doubleDouble preciseLn(double x) {
+    // x = mantissa * 2^exponent with the mantissa in [0.75, 1.5), then ln(mantissa) = 2 atanh(s)
+    int exponent;
+    double mantissa = std::frexp(x, &exponent);
+    if (mantissa < 0.75){
+        mantissa *= 2;
+        exponent--;
+    }
+    // mantissa - 1 is exact, so s keeps its relative precision however close x is to 1
+    doubleDouble s = doubleDouble(mantissa - 1) / (doubleDouble(mantissa) + 1);
+    doubleDouble square = s * s;
+    doubleDouble series = doubleDouble(1) / (2 * atanhTerms - 1);
+    for (int n = atanhTerms - 2; n >= 0; --n) {
+        series = series * square + doubleDouble(1) / (2 * n + 1);
+    }
+    return roundedLn2 * exponent + s * series * 2;
+}
+
+/**
+ * Branch free and without integer conversions, so loops over it vectorize
+ * @param x positive normal number
+ * @return ln(x) within 3 ulp
+ */
+double fastLn(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    // The exponent field of x * 2 / sqrt(2), so the mantissa lands in [sqrt(2) / 2, sqrt(2))
+    uint64_t shifted = (bits + (exponentOfOne - sqrtHalfBits)) >> 52;
+    uint64_t mantissaBits = bits - (shifted << 52) + exponentOfOne;
+    uint64_t exponentBits = shifted | integerBits;
+    double mantissa;
+    double k;
+    std::memcpy(&mantissa, &mantissaBits, sizeof(mantissa));
+    std::memcpy(&k, &exponentBits, sizeof(k));
+    k -= integerShift + 1023;
+    double s = (mantissa - 1) / (mantissa + 1);
+    double z = s * s;
+    double series = z * (atanh1 + z * (atanh2 + z * (atanh3 + z * (atanh4 + z * (atanh5 + z * (atanh6 + z * atanh7))))));
+    double twice = 2 * s;
+    return k * ln2High + (k * ln2Low + (twice + twice * series));
+}
+
+/**
+ * Branch free like fastLn
+ * @param w |w| < expLimit
+ * @return exp(w) within 2 ulp
+ */
+double fastExp(double w) {
+    double k = calcDegrees::nearest(w * M_LOG2E);
+    double r = (w - k * ln2High) - k * ln2Low;
+    double series = exp2 + r * (exp3 + r * (exp4 + r * (exp5 + r * (exp6 + r * (exp7 + r * (exp8 + r * (exp9
+                    + r * (exp10 + r * exp11))))))));
+    double value = 1 + (r + r * r * series);
+    // The low bits of integerShift + 1023 + k are the biased exponent of 2^k
+    double biased = k + (integerShift + 1023);
+    uint64_t bits;
+    std::memcpy(&bits, &biased, sizeof(bits));
+    bits <<= 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return value * scale;
+}
+
+/**
+ * exp(exponent * ln(base)) without checks, garbage for bases that are not positive normal numbers
+ * @param outProduct exponent * ln(base), the result is valid only if |outProduct| < expLimit
+ */
+double powKernel(double base, double exponent, double &outProduct) {
+    outProduct = exponent * fastLn(base);
+    return fastExp(outProduct);
+}
+
+/**
+ * @return true if num is a positive normal number, the domain of fastLn
+ */
+bool positiveNormal(double num) {
+    return num >= DBL_MIN && num <= DBL_MAX;
+}
+
+}
+
+double correctlyRoundedMath::sin(double num) {
+    // fmod is exact, so the double-double reduction starts from the exact remainder of any double
+    return calcDegrees::sin(doubleDouble(std::fmod(num, 360))).hi;
+}
+
+void correctlyRoundedMath::sin(double *values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = sin(values[i]);
+    }
+}
+
+double correctlyRoundedMath::cos(double num) {
+    return calcDegrees::cos(doubleDouble(std::fmod(num, 360))).hi;
+}
+
+void correctlyRoundedMath::cos(double *values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = cos(values[i]);
+    }
+}
+
+calcLib::Status correctlyRoundedMath::tan(double num, double &outResult) {
+    outResult = calcDegrees::tan(doubleDouble(std::fmod(num, 360))).hi;
+    return std::isinf(outResult) ? Status::divisionByZero : Status::ok;
+}
+
+void correctlyRoundedMath::tan(double *values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        tan(values[i], values[i]);
+    }
+}
+
+calcLib::Status correctlyRoundedMath::cbrt(double num, double &outResult) {
+    return root(3, num, outResult);
+}
+
+calcLib::Status correctlyRoundedMath::sqrt(double num, double &outResult) {
+    return calcLib::sqrt(num, outResult);
+}
+
+double correctlyRoundedMath::pow(double base, double exponent) {
+    double result;
+    if (calcInteger::pow(base, exponent, result)){
+        return result;
+    }
+    if (chainedPower(exponent)){
+        return calcLib::powInt(base, exponent);
+    }
+    result = std::pow(base, exponent);
+    if (!std::isnormal(result)){
+        return result;
+    }
+    // Integer exponents are raised by squaring, which is exact for every result that is a tie in double
+    return scalarTraits<doubleDouble>::pow(base, exponent).hi;
+}
+
+bool correctlyRoundedMath::chainedPower(double exponent) {
+    return calcLib::chainedPower(exponent);
+}
+
+calcLib::Status correctlyRoundedMath::root(double degree, double num, double &outResult) {
+    if (degree == 2){
+        return calcLib::sqrt(num, outResult);
+    }
+    if (num < 0){
+        outResult = NAN;
+        return Status::domainError;
+    }
+    double exponent;
+    Status status = quotient(1, degree, exponent);
+    outResult = std::pow(num, exponent);
+    if (std::isnormal(outResult) && std::isfinite(degree)){
+        outResult = scalarTraits<doubleDouble>::pow(num, doubleDouble(1) / degree).hi;
+    }
+    return status;
+}
+
+calcLib::Status correctlyRoundedMath::log(double base, double num, double &outResult) {
+    if (!(base > 0 && num > 0) || !std::isfinite(base) || !std::isfinite(num)){
+        return quotient(std::log10(num), std::log10(base), outResult);
+    }
+    doubleDouble lnBase = preciseLn(base);
+    outResult = (preciseLn(num) / lnBase).hi;
+    return lnBase.hi == 0 ? Status::divisionByZero : Status::ok;
+}
+
+double correctlyRoundedMath::log(double num) {
+    if (!(num > 0) || !std::isfinite(num)){
+        return std::log10(num);
+    }
+    return (preciseLn(num) / roundedLn10).hi;
+}
+
+double fastMath::sin(double num) {
+    return calcDegrees::sinFast<true>(calcDegrees::wrap(num));
+}
+
+void fastMath::sin(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::sinFast<true>(num); },
+                         [](double num) { return fastMath::sin(num); });
+}
+
+double fastMath::cos(double num) {
+    return calcDegrees::cosFast<true>(calcDegrees::wrap(num));
+}
+
+void fastMath::cos(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::cosFast<true>(num); },
+                         [](double num) { return fastMath::cos(num); });
+}
+
+calcLib::Status fastMath::tan(double num, double &outResult) {
+    outResult = calcDegrees::tanFast<true>(calcDegrees::wrap(num));
+    return std::isinf(outResult) ? Status::divisionByZero : Status::ok;
+}
+
+void fastMath::tan(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::tanFast<true>(num); },
+                         [](double num) { return calcDegrees::tanFast<true>(calcDegrees::wrap(num)); });
+}
+
+calcLib::Status fastMath::cbrt(double num, double &outResult) {
+    return calcLib::cbrt(num, outResult);
+}
+
+calcLib::Status fastMath::sqrt(double num, double &outResult) {
+    return calcLib::sqrt(num, outResult);
+}
+
+double fastMath::pow(double base, double exponent) {
+    if (chainedPower(exponent)){
+        return calcLib::powInt(base, exponent);
+    }
+    double result;
+    if (calcInteger::pow(base, exponent, result)){
+        return result;
+    }
+    double product;
+    double magnitude = powKernel(std::abs(base), exponent, product);
+    if (positiveNormal(std::abs(base)) && std::abs(product) < expLimit){
+        if (base > 0){
+            return magnitude;
+        }
+        if (std::trunc(exponent) == exponent){
+            return std::fmod(exponent, 2) != 0 ? -magnitude : magnitude;
+        }
+    }
+    return std::pow(base, exponent);
+}
+
+void fastMath::pow(double *bases, const double *exponents, size_t count) {
+    double magnitudes[powChunk];
+    double products[powChunk];
+    for (size_t first = 0; first < count; first += powChunk) {
+        size_t size = std::min(powChunk, count - first);
+        double *base = bases + first;
+        const double *exponent = exponents + first;
+        for (size_t i = 0; i < size; ++i) {
+            magnitudes[i] = powKernel(base[i], exponent[i], products[i]);
+        }
+        // Keeps the kernel where the scalar pow would return it and redoes the rest, so both agree bit for bit
+        for (size_t i = 0; i < size; ++i) {
+            double exact;
+            if (chainedPower(exponent[i])){
+                base[i] = calcLib::powInt(base[i], exponent[i]);
+            } else if (calcInteger::pow(base[i], exponent[i], exact)){
+                base[i] = exact;
+            } else if (positiveNormal(base[i]) && std::abs(products[i]) < expLimit){
+                base[i] = magnitudes[i];
+            } else {
+                base[i] = pow(base[i], exponent[i]);
+            }
+        }
+    }
+}
+
+bool fastMath::chainedPower(double exponent) {
+    return std::abs(exponent) <= maxFastChain && std::trunc(exponent) == exponent;
+}
+
+calcLib::Status fastMath::root(double degree, double num, double &outResult) {
+    if (degree == 2){
+        return calcLib::sqrt(num, outResult);
+    }
+    if (degree == 3){
+        return calcLib::cbrt(num, outResult);
+    }
+    if (num < 0){
+        outResult = NAN;
+        return Status::domainError;
+    }
+    double exponent;
+    Status status = quotient(1, degree, exponent);
+    outResult = pow(num, exponent);
+    return status;
+}
+
+calcLib::Status fastMath::log(double base, double num, double &outResult) {
+    if (!positiveNormal(base) || !positiveNormal(num)){
+        return quotient(std::log10(num), std::log10(base), outResult);
+    }
+    return quotient(fastLn(num), fastLn(base), outResult);
+}
+
+double fastMath::log(double num) {
+    if (!positiveNormal(num)){
+        return std::log10(num);
+    }
+    return fastLn(num) * log10OfE;
+}
+
+void fastMath::log(double *values, size_t count) {
+    bool normal = true;
+    for (size_t i = 0; i < count; ++i) {
+        normal &= positiveNormal(values[i]);
+    }
+    if (!normal){
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = log(values[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = fastLn(values[i]) * log10OfE;
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include "calclib/calclib.hpp"
+
+/**
+ * Helpers of the calcLib::Accuracy tiers other than faithful, which are calcLib's own. Each tier has the
+ * names and signatures of the calcLib helpers it replaces, so code generic over the math helpers takes
+ * calcLib, correctlyRoundedMath or fastMath as a template argument. Domain checks and statuses are calcLib's.
+ */
+
+/**
+ * calcLib::Accuracy::correctlyRounded: the result is evaluated in double-double and rounded once. Exact
+ * integer powers, zeros, infinities, NaN and results outside the normal range take the faithful path,
+ * where libm returns them exactly or its rounding of a subnormal is the best available.
+ */
+struct correctlyRoundedMath {
+    static double sin(double num);
+    static void sin(double *values, size_t count);
+    static double cos(double num);
+    static void cos(double *values, size_t count);
+    static calcLib::Status tan(double num, double &outResult);
+    static void tan(double *values, size_t count);
+    static calcLib::Status sqrt(double num, double &outResult);
+    static calcLib::Status cbrt(double num, double &outResult);
+    static double pow(double base, double exponent);
+    static bool chainedPower(double exponent);
+    static calcLib::Status root(double degree, double num, double &outResult);
+    static calcLib::Status log(double base, double num, double &outResult);
+    static double log(double num);
+};
+
+/**
+ * calcLib::Accuracy::fast: short polynomials within 1e-12 relative error. sin, cos and tan use shorter fits
+ * of the degree kernels, pow is exp(exponent * ln(base)) with its own ln and exp, so the error grows with
+ * |exponent * ln(base)| up to 3e-13 before the result overflows. Integer exponents up to 1024 are raised
+ * by calcLib::powInt. The block overloads of pow and log, which
+ * runColumns uses, vectorize their kernels and agree with the scalar ones bit for bit.
+ */
+struct fastMath {
+    static double sin(double num);
+    static void sin(double *values, size_t count);
+    static double cos(double num);
+    static void cos(double *values, size_t count);
+    static calcLib::Status tan(double num, double &outResult);
+    static void tan(double *values, size_t count);
+    static calcLib::Status sqrt(double num, double &outResult);
+    static calcLib::Status cbrt(double num, double &outResult);
+    static double pow(double base, double exponent);
+    static bool chainedPower(double exponent);
+    static void pow(double *bases, const double *exponents, size_t count);
+    static calcLib::Status root(double degree, double num, double &outResult);
+    static calcLib::Status log(double base, double num, double &outResult);
+    static double log(double num);
+    static void log(double *values, size_t count);
+};
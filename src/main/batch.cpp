@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "calclib/batch.hpp"
+#include "calclib/expression.hpp"
+
+namespace {
+    constexpr size_t scratchSize = 64 * 1024; //! Per-worker arena for the token list and syntax tree of long expressions
+    constexpr size_t minChunkBytes = 2048; //! Smallest amount of input a worker takes at once
+}
+
+struct calcBatch::pool {
+    /**
+     * Per-thread state. Aligned to keep the range lock of neighbouring workers on separate cache lines.
+     */
+    struct alignas(64) worker {
+        std::mutex rangeLock; //! Guards begin and end, thieves shrink end
+        size_t begin = 0; //! First expression not taken yet
+        size_t end = 0; //! One past the last expression owned by this worker
+        calcSession session;
+        std::array<std::byte, scratchSize> buffer;
+        std::pmr::monotonic_buffer_resource arena{buffer.data(), buffer.size()};
+    };
+
+    const calcLib &calc;
+    std::vector<std::unique_ptr<worker>> workers; //! workers[0] is the thread calling evaluate
+    std::vector<std::thread> threads;
+
+    std::mutex submitLock; //! Serializes calls to evaluate
+    std::mutex jobLock;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    size_t generation = 0; //! Incremented for every job so sleeping threads notice it
+    unsigned running = 0; //! Threads that have not finished the current job
+    bool stopping = false;
+
+    const std::string_view *expressions = nullptr;
+    batchResult *results = nullptr;
+    double ans = 0; //! ans every expression starts with
+    std::vector<size_t> offsets; //! offsets[i] is the length of expressions before i, each counted one byte longer
+
+    explicit pool(const calcLib &calc) : calc(calc) {}
+
+    /**
+     * @param begin
+     * @param end
+     * @param bytes amount of input wanted
+     * @return index in (begin, end] splitting off about bytes of input from begin
+     */
+    size_t splitPoint(size_t begin, size_t end, size_t bytes) const {
+        auto split = std::lower_bound(offsets.begin() + begin + 1, offsets.begin() + end, offsets[begin] + bytes);
+        return static_cast<size_t>(split - offsets.begin());
+    }
+
+    /**
+     * Takes the next chunk from the front of the worker's range. Chunks shrink as the range shrinks
+     * so the tail stays available for stealing.
+     * @return false if the range is empty
+     */
+    bool takeChunk(worker &self, size_t &outBegin, size_t &outEnd) {
+        std::lock_guard<std::mutex> guard(self.rangeLock);
+        if (self.begin == self.end){
+            return false;
+        }
+        size_t remaining = offsets[self.end] - offsets[self.begin];
+        outBegin = self.begin;
+        outEnd = splitPoint(self.begin, self.end, std::max(minChunkBytes, remaining / 8));
+        self.begin = outEnd;
+        return true;
+    }
+
+    /**
+     * Moves the back half (by input size) of some other worker's range to self
+     * @return false if there was nothing left to steal
+     */
+    bool steal(unsigned selfIndex) {
+        for (size_t i = 1; i < workers.size(); ++i) {
+            worker &victim = *workers[(selfIndex + i) % workers.size()];
+            size_t begin;
+            size_t end;
+            {
+                std::lock_guard<std::mutex> guard(victim.rangeLock);
+                if (victim.end - victim.begin < 2){
+                    continue;
+                }
+                size_t half = (offsets[victim.end] - offsets[victim.begin]) / 2;
+                begin = std::min(splitPoint(victim.begin, victim.end, half), victim.end - 1);
+                end = victim.end;
+                victim.end = begin;
+            }
+            worker &self = *workers[selfIndex];
+            std::lock_guard<std::mutex> guard(self.rangeLock);
+            self.begin = begin;
+            self.end = end;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Evaluates the worker's own range, then steals until no work is left
+     */
+    void run(unsigned selfIndex) {
+        worker &self = *workers[selfIndex];
+        do {
+            size_t begin;
+            size_t end;
+            while (takeChunk(self, begin, end)) {
+                for (size_t i = begin; i < end; ++i) {
+                    batchResult &result = results[i];
+                    self.session.setVariable("ans", ans);
+                    self.session.clearFlags();
+                    result.status = calc.evaluate(expressions[i], self.session, result.value);
+                    result.flags = self.session.flags();
+                    self.arena.release();
+                }
+            }
+        } while (steal(selfIndex));
+    }
+
+    void threadMain(unsigned selfIndex) {
+        expressionView::keepLoopsOnThread(true);
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(jobLock);
+                jobReady.wait(guard, [&](){return stopping || generation != seen;});
+                if (stopping){
+                    return;
+                }
+                seen = generation;
+            }
+            run(selfIndex);
+            std::lock_guard<std::mutex> guard(jobLock);
+            if (--running == 0){
+                jobDone.notify_one();
+            }
+        }
+    }
+};
+
+calcBatch::calcBatch(const calcLib &calc, unsigned threadCount) : impl(std::make_unique<pool>(calc)) {
+    if (threadCount == 0){
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        impl->workers.push_back(std::make_unique<pool::worker>());
+    }
+    for (unsigned i = 1; i < threadCount; ++i) {
+        impl->threads.emplace_back(&pool::threadMain, impl.get(), i);
+    }
+}
+
+calcBatch::~calcBatch() {
+    {
+        std::lock_guard<std::mutex> guard(impl->jobLock);
+        impl->stopping = true;
+    }
+    impl->jobReady.notify_all();
+    for (auto &thread : impl->threads) {
+        thread.join();
+    }
+}
+
+void calcBatch::evaluate(const std::string_view *expressions, size_t count, batchResult *outResults,
+                         const calcSession &session) {
+    std::lock_guard<std::mutex> submitGuard(impl->submitLock);
+    if (count == 0){
+        return;
+    }
+    pool &p = *impl;
+    p.expressions = expressions;
+    p.results = outResults;
+    p.ans = 0;
+    session.getVariable("ans", p.ans);
+    p.offsets.resize(count + 1);
+    p.offsets[0] = 0;
+    for (size_t i = 0; i < count; ++i) {
+        p.offsets[i + 1] = p.offsets[i] + expressions[i].size() + 1;
+    }
+    for (auto &worker : p.workers) {
+        auto *scratch = &worker->arena;
+        worker->session = session;
+        worker->session.setScratch(scratch);
+    }
+
+    // Small batches are not worth waking the pool
+    size_t total = p.offsets[count];
+    size_t workerCount = total <= minChunkBytes ? 1 : p.workers.size();
+    for (size_t i = 0; i < p.workers.size(); ++i) {
+        auto &worker = *p.workers[i];
+        worker.begin = i < workerCount ? p.splitPoint(0, count, total * i / workerCount) : count;
+        worker.end = i + 1 < workerCount ? p.splitPoint(0, count, total * (i + 1) / workerCount) : count;
+        if (i == 0){
+            worker.begin = 0;
+        }
+    }
+
+    if (workerCount == 1){
+        p.run(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(p.jobLock);
+        p.generation++;
+        p.running = static_cast<unsigned>(p.threads.size());
+    }
+    p.jobReady.notify_all();
+    bool kept = expressionView::keepLoopsOnThread(true);
+    p.run(0);
+    expressionView::keepLoopsOnThread(kept);
+    std::unique_lock<std::mutex> guard(p.jobLock);
+    p.jobDone.wait(guard, [&](){return p.running == 0;});
+}
+
+std::vector<batchResult> calcBatch::evaluate(const std::vector<std::string_view> &expressions) {
+    std::vector<batchResult> results(expressions.size());
+    evaluate(expressions.data(), expressions.size(), results.data(), calcSession());
+    return results;
+}
+
+unsigned calcBatch::threadCount() const {
+    return static_cast<unsigned>(impl->workers.size());
+}
@@ -0,0 +1,263 @@
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include "calclib/batch.hpp"
+#include "calclib/calclib_c.h"
+#include "calclib/double_double.hpp"
+#include "calclib/expression.hpp"
+#include "calclib/scalar.hpp"
+
+/**
+ * Replays an expression corpus through the main evaluation paths of calclib. Used as the training
+ * workload of the profile guided build and to compare builds with each other.
+ */
+
+namespace {
+
+using benchClock = std::chrono::steady_clock;
+
+constexpr std::string_view definePrefix = "define "; //! Corpus lines passed to calcLib::define
+
+/**
+ * Runs workload repeats times and prints its duration
+ * @param name printed workload name
+ * @param repeats
+ * @param workload returns a checksum so the work cannot be optimized out
+ */
+template<typename Workload>
+void measure(const char *name, unsigned repeats, Workload workload) {
+    double checksum = 0;
+    auto start = benchClock::now();
+    for (unsigned i = 0; i < repeats; ++i) {
+        checksum += workload();
+    }
+    std::chrono::duration<double, std::milli> elapsed = benchClock::now() - start;
+    std::cout << name << "\t" << elapsed.count() << " ms\tchecksum " << checksum << "\n";
+}
+
+/**
+ * @return sum of the finite values, so every workload of the same corpus has comparable checksums
+ */
+double finiteSum(double sum, double value) {
+    return std::isfinite(value) ? sum + value : sum;
+}
+
+/**
+ * @return session with the variables x and y used by the corpus
+ */
+calcSession corpusSession() {
+    calcSession session;
+    session.setVariable("x", 0.75);
+    session.setVariable("y", -2.5);
+    return session;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned repeats = 20;
+    int option;
+    while ((option = getopt(argc, argv, "n:h")) != -1) {
+        switch (option) {
+            case 'n':
+                repeats = (unsigned)strtoul(optarg, nullptr, 10);
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-n repeats] [corpus]\n";
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    const char *corpusPath = optind < argc ? argv[optind] : CALCLIB_BENCH_CORPUS;
+    std::ifstream corpus(corpusPath);
+    if (!corpus){
+        std::cerr << "Cannot open " << corpusPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    calcLib calc;
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(corpus, line);) {
+        // Functions used by the rest of the corpus
+        if (line.compare(0, definePrefix.size(), definePrefix) == 0){
+            if (calc.define(std::string_view(line).substr(definePrefix.size())) != calcLib::Status::ok){
+                std::cerr << "Cannot define " << line.substr(definePrefix.size()) << "\n";
+                return 1;
+            }
+            continue;
+        }
+        lines.push_back(line);
+    }
+    std::vector<std::string_view> views(lines.begin(), lines.end());
+
+    measure("solve", repeats, [&]() {
+        calcSession session = corpusSession();
+        double sum = 0;
+        for (const auto &line : lines) {
+            sum += static_cast<double>(calc.solveEquation(line, session).size());
+        }
+        return sum;
+    });
+
+    measure("evaluate", repeats, [&]() {
+        calcSession session = corpusSession();
+        double sum = 0;
+        for (const auto &line : views) {
+            double result;
+            if (calc.evaluate(line, session, result) == calcLib::Status::ok){
+                sum = finiteSum(sum, result);
+            }
+        }
+        return sum;
+    });
+
+    std::vector<compiledExpression> compiled(views.size());
+    std::vector<bool> valid(views.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        valid[i] = calc.compile(views[i], compiled[i]) == calcLib::Status::ok;
+    }
+    measure("compiled", repeats, [&]() {
+        calcSession session = corpusSession();
+        double sum = 0;
+        for (size_t i = 0; i < compiled.size(); ++i) {
+            double result;
+            if (valid[i] && calc.evaluate(compiled[i], session, result) == calcLib::Status::ok){
+                sum = finiteSum(sum, result);
+            }
+        }
+        return sum;
+    });
+
+    // Integer arithmetic over a variable, the operands stay integers
+    const char *integerExpressions[] = {"n^3%1009", "(n*31+7)%1009-n^2", "(n%15)!+2^(n%40)"};
+    std::vector<compiledExpression> integerCompiled(std::size(integerExpressions));
+    for (size_t i = 0; i < integerCompiled.size(); ++i) {
+        calc.compile(integerExpressions[i], integerCompiled[i]);
+    }
+    measure("integers", repeats, [&]() {
+        double sum = 0;
+        for (const auto &expression : integerCompiled) {
+            for (double n = 1; n <= 4096; ++n) {
+                double result;
+                if (expression.run(&n, result, nullptr) == calcLib::Status::ok){
+                    sum = finiteSum(sum, result);
+                }
+            }
+        }
+        return sum;
+    });
+
+    calcBatch batch{calc};
+    const calcSession batchSession = corpusSession();
+    std::vector<batchResult> batchResults(views.size());
+    measure("batch", repeats, [&]() {
+        double sum = 0;
+        batch.evaluate(views.data(), views.size(), batchResults.data(), batchSession);
+        for (const auto &result : batchResults) {
+            if (result.status == calcLib::Status::ok){
+                sum = finiteSum(sum, result.value);
+            }
+        }
+        return sum;
+    });
+
+    // Column evaluation through the C interface
+    const size_t rows = 1 << 16;
+    std::vector<double> x(rows);
+    std::vector<double> y(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = static_cast<double>(i % 1000) / 10;
+        y[i] = static_cast<double>(i % 37) - 18;
+    }
+    const double *columns[] = {x.data(), y.data()};
+    const char *variables[] = {"x", "y"};
+    const char *columnExpressions[] = {
+            "x*y+3", "sin(x)^2+cos(y)^2", "root(3:x)/y-log(x+1)", "(x-y)%7*pi",
+            // Polynomials evaluated by Horner's scheme
+            "3*x^4+2*x^3-x+7", "0.5*y^8-2*y^6+y^5-3.25*y^3+y-1",
+            // Both branches evaluated and blended
+            "if(x>y:log(x):y^2)-(x<=50)", "clamp(x*y:-100:100)+abs(y)-max(x:-y)",
+            // Loops run for every row
+            "sum(i:1:8:y^i/(i+x))-prod(j:1:3:x+j)",
+    };
+    calclib_context *context = calclib_create();
+    std::vector<calclib_expression*> columnCompiled;
+    for (const char *expression : columnExpressions) {
+        calclib_expression *handle = nullptr;
+        calclib_compile(context, expression, strlen(expression), variables, 2, &handle);
+        columnCompiled.push_back(handle);
+    }
+    std::vector<double> results(rows);
+    measure("columns", repeats, [&]() {
+        double sum = 0;
+        for (calclib_expression *expression : columnCompiled) {
+            calclib_evaluate_batch(context, expression, columns, rows, results.data(), nullptr, nullptr);
+            for (double value : results) {
+                sum = finiteSum(sum, value);
+            }
+        }
+        return sum;
+    });
+    for (calclib_expression *expression : columnCompiled) {
+        calclib_expression_free(expression);
+    }
+
+    // Same columns in float, twice the lanes per vector instruction
+    std::vector<float> floatX(x.begin(), x.end());
+    std::vector<float> floatY(y.begin(), y.end());
+    std::vector<float> floatPi(rows, scalarTraits<float>::pi());
+    std::vector<basicExpression<float>> floatCompiled(std::size(columnExpressions));
+    std::vector<std::vector<const float*>> floatColumns;
+    for (size_t i = 0; i < floatCompiled.size(); ++i) {
+        calc.compile(columnExpressions[i], floatCompiled[i]);
+        auto &bound = floatColumns.emplace_back();
+        for (const auto &symbol : floatCompiled[i].symbols) {
+            bound.push_back(symbol == "x" ? floatX.data() : symbol == "y" ? floatY.data() : floatPi.data());
+        }
+    }
+    std::vector<float> floatResults(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    measure("columns-float", repeats, [&]() {
+        double sum = 0;
+        for (size_t i = 0; i < floatCompiled.size(); ++i) {
+            floatCompiled[i].runColumns(floatColumns[i].data(), rows, floatResults.data(), statuses.data(), nullptr);
+            for (float value : floatResults) {
+                sum = finiteSum(sum, value);
+            }
+        }
+        return sum;
+    });
+
+    // The same columns in double-double, which pays for the error-free transformations of every operation
+    std::vector<doubleDouble> wideX(x.begin(), x.end());
+    std::vector<doubleDouble> wideY(y.begin(), y.end());
+    std::vector<doubleDouble> widePi(rows, scalarTraits<doubleDouble>::pi());
+    std::vector<basicExpression<doubleDouble>> wideCompiled(std::size(columnExpressions));
+    std::vector<std::vector<const doubleDouble*>> wideColumns;
+    for (size_t i = 0; i < wideCompiled.size(); ++i) {
+        calc.compile(columnExpressions[i], wideCompiled[i]);
+        auto &bound = wideColumns.emplace_back();
+        for (const auto &symbol : wideCompiled[i].symbols) {
+            bound.push_back(symbol == "x" ? wideX.data() : symbol == "y" ? wideY.data() : widePi.data());
+        }
+    }
+    std::vector<doubleDouble> wideResults(rows);
+    measure("columns-double-double", repeats, [&]() {
+        double sum = 0;
+        for (size_t i = 0; i < wideCompiled.size(); ++i) {
+            wideCompiled[i].runColumns(wideColumns[i].data(), rows, wideResults.data(), statuses.data(), nullptr);
+            for (const doubleDouble &value : wideResults) {
+                sum = finiteSum(sum, value.hi);
+            }
+        }
+        return sum;
+    });
+    calclib_destroy(context);
+    return 0;
+}
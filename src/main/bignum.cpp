@@ -0,0 +1,772 @@
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include "calclib/bignum.hpp"
+
+namespace {
+
+using limb = bigInteger::limb;
+using magnitude = std::vector<limb>;
+using Opcode = compiledExpression::Opcode;
+using Status = calcLib::Status;
+
+constexpr limb bigBase = bigInteger::base;
+constexpr uint64_t bigSmallFactorMax = UINT64_C(10000000000); //! Largest factor of multiplySmall, limb * factor + carry stays below 2^64
+constexpr size_t bigLazyRows = 18; //! Rows of limb products whose sum stays below 2^64 with a normalized limb on top
+constexpr uint64_t bigLeafFactors = 32; //! Factors of a factorial multiplied one by one before the range is split
+
+void trimMagnitude(magnitude &value) {
+    while (!value.empty() && value.back() == 0) {
+        value.pop_back();
+    }
+}
+
+/**
+ * @return -1, 0 or 1 as a is less than, equal to or greater than b, both without leading zero limbs
+ */
+int compareMagnitude(const magnitude &a, const magnitude &b) {
+    if (a.size() != b.size()){
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]){
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * outSum += addend * base^offset, outSum grows as needed
+ */
+void addMagnitude(magnitude &outSum, const limb *addend, size_t count, size_t offset = 0) {
+    if (outSum.size() < offset + count){
+        outSum.resize(offset + count, 0);
+    }
+    limb carry = 0;
+    for (size_t i = 0; i < count; ++i) {
+        limb digit = outSum[offset + i] + addend[i] + carry;
+        carry = digit >= bigBase;
+        outSum[offset + i] = carry != 0 ? digit - bigBase : digit;
+    }
+    for (size_t i = offset + count; carry != 0; ++i) {
+        if (i == outSum.size()){
+            outSum.push_back(1);
+            break;
+        }
+        carry = outSum[i] == bigBase - 1;
+        outSum[i] = carry != 0 ? 0 : outSum[i] + 1;
+    }
+}
+
+/**
+ * outDifference -= subtrahend, the difference must not be negative
+ */
+void subtractMagnitude(magnitude &outDifference, const limb *subtrahend, size_t count) {
+    limb borrow = 0;
+    for (size_t i = 0; i < count; ++i) {
+        limb digit = outDifference[i];
+        limb taken = subtrahend[i] + borrow;
+        borrow = digit < taken;
+        outDifference[i] = borrow != 0 ? digit + bigBase - taken : digit - taken;
+    }
+    for (size_t i = count; borrow != 0; ++i) {
+        borrow = outDifference[i] == 0;
+        outDifference[i] = borrow != 0 ? bigBase - 1 : outDifference[i] - 1;
+    }
+    trimMagnitude(outDifference);
+}
+
+/**
+ * value *= factor
+ * @param factor at most bigSmallFactorMax
+ */
+void multiplySmall(magnitude &value, uint64_t factor) {
+    uint64_t carry = 0;
+    for (limb &digit : value) {
+        uint64_t product = digit * factor + carry;
+        digit = static_cast<limb>(product % bigBase);
+        carry = product / bigBase;
+    }
+    for (; carry != 0; carry /= bigBase) {
+        value.push_back(static_cast<limb>(carry % bigBase));
+    }
+}
+
+/**
+ * value /= divisor
+ * @return remainder
+ */
+limb divideSmall(magnitude &value, limb divisor) {
+    uint64_t remainder = 0;
+    for (size_t i = value.size(); i-- > 0;) {
+        uint64_t dividend = remainder * bigBase + value[i];
+        value[i] = static_cast<limb>(dividend / divisor);
+        remainder = dividend % divisor;
+    }
+    trimMagnitude(value);
+    return static_cast<limb>(remainder);
+}
+
+/**
+ * Schoolbook product
+ * @param outProduct an + bn limbs
+ */
+void multiplySchoolbook(const limb *a, size_t an, const limb *b, size_t bn, limb *outProduct) {
+    // Rows are summed without carries, which vectorizes, and normalized every bigLazyRows rows before a sum could overflow
+    std::vector<uint64_t> sums(an + bn, 0);
+    for (size_t first = 0; first < an; first += bigLazyRows) {
+        size_t last = std::min(an, first + bigLazyRows);
+        for (size_t i = first; i < last; ++i) {
+            uint64_t factor = a[i];
+            uint64_t *row = sums.data() + i;
+            for (size_t j = 0; j < bn; ++j) {
+                row[j] += factor * b[j];
+            }
+        }
+        uint64_t carry = 0;
+        for (size_t k = first; k < an + bn; ++k) {
+            uint64_t sum = sums[k] + carry;
+            sums[k] = sum % bigBase;
+            carry = sum / bigBase;
+        }
+    }
+    std::copy(sums.begin(), sums.end(), outProduct);
+}
+
+/**
+ * @return a * b, schoolbook for short factors, Karatsuba for balanced long ones and slices of the longer one otherwise
+ */
+magnitude multiplyMagnitude(const limb *a, size_t an, const limb *b, size_t bn) {
+    while (an > 0 && a[an - 1] == 0) {
+        an--;
+    }
+    while (bn > 0 && b[bn - 1] == 0) {
+        bn--;
+    }
+    if (an < bn){
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+    magnitude product;
+    if (bn == 0){
+        return product;
+    }
+    if (bn < bigInteger::karatsubaThreshold){
+        product.resize(an + bn);
+        multiplySchoolbook(a, an, b, bn, product.data());
+    } else if (an >= 2 * bn){
+        // Karatsuba splits in the middle of a, b would be shorter than that half
+        for (size_t offset = 0; offset < an; offset += bn) {
+            magnitude slice = multiplyMagnitude(a + offset, std::min(bn, an - offset), b, bn);
+            addMagnitude(product, slice.data(), slice.size(), offset);
+        }
+    } else {
+        // (a1 B + a0)(b1 B + b0) = a1 b1 B^2 + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B + a0 b0, three products of half length
+        size_t half = an / 2;
+        magnitude low = multiplyMagnitude(a, half, b, half);
+        magnitude high = multiplyMagnitude(a + half, an - half, b + half, bn - half);
+        magnitude aSum(a, a + half);
+        addMagnitude(aSum, a + half, an - half);
+        magnitude bSum(b, b + half);
+        addMagnitude(bSum, b + half, bn - half);
+        magnitude middle = multiplyMagnitude(aSum.data(), aSum.size(), bSum.data(), bSum.size());
+        subtractMagnitude(middle, low.data(), low.size());
+        subtractMagnitude(middle, high.data(), high.size());
+        product = std::move(low);
+        addMagnitude(product, middle.data(), middle.size(), half);
+        addMagnitude(product, high.data(), high.size(), 2 * half);
+    }
+    trimMagnitude(product);
+    return product;
+}
+
+/**
+ * Knuth's algorithm D: outQuotient = u / v and u becomes the remainder
+ * @param v divisor with at least two limbs, not greater than u
+ */
+void divideMagnitude(magnitude &u, magnitude v, magnitude &outQuotient) {
+    // Scaling makes the top limb of v at least base/2, so every estimated quotient limb is at most 2 too large
+    limb scale = bigBase / (v.back() + 1);
+    multiplySmall(u, scale);
+    multiplySmall(v, scale);
+    u.push_back(0);
+    size_t n = v.size();
+    size_t m = u.size() - n - 1;
+    uint64_t top = v[n - 1];
+    uint64_t second = v[n - 2];
+    outQuotient.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t numerator = u[j + n] * static_cast<uint64_t>(bigBase) + u[j + n - 1];
+        uint64_t estimate = numerator / top;
+        uint64_t rest = numerator % top;
+        while (estimate >= bigBase || estimate * second > rest * bigBase + u[j + n - 2]) {
+            estimate--;
+            rest += top;
+            if (rest >= bigBase){
+                break;
+            }
+        }
+        int64_t borrow = 0;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t product = estimate * v[i] + carry;
+            carry = product / bigBase;
+            int64_t digit = static_cast<int64_t>(u[i + j]) - static_cast<int64_t>(product % bigBase) - borrow;
+            borrow = digit < 0;
+            u[i + j] = static_cast<limb>(digit < 0 ? digit + bigBase : digit);
+        }
+        int64_t topDigit = static_cast<int64_t>(u[j + n]) - static_cast<int64_t>(carry) - borrow;
+        if (topDigit < 0){
+            // Estimate was one too large, add v back
+            estimate--;
+            limb sumCarry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                limb digit = u[i + j] + v[i] + sumCarry;
+                sumCarry = digit >= bigBase;
+                u[i + j] = sumCarry != 0 ? digit - bigBase : digit;
+            }
+            topDigit += sumCarry;
+        }
+        u[j + n] = static_cast<limb>(topDigit);
+        outQuotient[j] = static_cast<limb>(estimate);
+    }
+    trimMagnitude(outQuotient);
+    trimMagnitude(u);
+    divideSmall(u, scale);
+}
+
+/**
+ * @return first * (first + 1) * ... * last, halves of the range are multiplied so factors stay balanced
+ */
+magnitude rangeProduct(uint64_t first, uint64_t last) {
+    if (last - first < bigLeafFactors){
+        magnitude product{1};
+        uint64_t pending = 1;
+        for (uint64_t factor = first; factor <= last; ++factor) {
+            if (pending > bigSmallFactorMax / factor){
+                multiplySmall(product, pending);
+                pending = 1;
+            }
+            pending *= factor;
+        }
+        multiplySmall(product, pending);
+        return product;
+    }
+    uint64_t middle = first + (last - first) / 2;
+    magnitude low = rangeProduct(first, middle);
+    magnitude high = rangeProduct(middle + 1, last);
+    return multiplyMagnitude(low.data(), low.size(), high.data(), high.size());
+}
+
+/**
+ * Floor of the degree-th root by Newton's iteration from above
+ * @param value non-negative
+ * @param degree positive
+ * @return true if the root is an integer
+ */
+bool integerRoot(const bigInteger &value, int64_t degree, bigInteger &outRoot) {
+    if (value.isZero() || degree == 1 || value == 1){
+        outRoot = value;
+        return true;
+    }
+    // Roots between 1 and 2 are not integers, 2^degree > value once degree exceeds 4 digits
+    if (static_cast<uint64_t>(degree) >= 4 * value.digits()){
+        return false;
+    }
+    // Start just above the root estimated in double
+    double rootLog = value.log10() / static_cast<double>(degree);
+    int64_t shift = std::max<int64_t>(static_cast<int64_t>(rootLog) - 15, 0);
+    bigInteger root = static_cast<int64_t>(std::pow(10.0, rootLog - static_cast<double>(shift)) * (1 + 1e-12)) + 2;
+    root *= bigInteger::pow(10, static_cast<uint64_t>(shift));
+    bigInteger quotient;
+    bigInteger remainder;
+    while (true) {
+        bigInteger::divide(value, bigInteger::pow(root, static_cast<uint64_t>(degree - 1)), quotient, remainder);
+        bigInteger next;
+        bigInteger::divide(root * (degree - 1) + quotient, degree, next, remainder);
+        if (!(next < root)){
+            break;
+        }
+        root = std::move(next);
+    }
+    outRoot = root;
+    return bigInteger::pow(root, static_cast<uint64_t>(degree)) == value;
+}
+
+}
+
+bigInteger::bigInteger(int64_t value) {
+    negative = value < 0;
+    uint64_t rest = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    for (; rest != 0; rest /= bigBase) {
+        limbs.push_back(static_cast<limb>(rest % bigBase));
+    }
+}
+
+bigInteger bigInteger::invalid() {
+    bigInteger result;
+    result.valid = false;
+    return result;
+}
+
+bigInteger bigInteger::parse(std::string_view text) {
+    std::string digits;
+    int64_t exponent = 0;
+    size_t position = 0;
+    auto isDigit = [&text, &position]() {
+        return position < text.size() && text[position] >= '0' && text[position] <= '9';
+    };
+    while (isDigit()) {
+        digits += text[position++];
+    }
+    if (position < text.size() && text[position] == '.'){
+        for (position++; isDigit(); exponent--) {
+            digits += text[position++];
+        }
+    }
+    if (position < text.size() && (text[position] == 'e' || text[position] == 'E')){
+        position++;
+        bool negativeExponent = position < text.size() && text[position] == '-';
+        if (position < text.size() && (text[position] == '-' || text[position] == '+')){
+            position++;
+        }
+        int64_t written = 0;
+        while (isDigit()) {
+            // Saturates far above maxDigits
+            written = std::min<int64_t>(written * 10 + (text[position++] - '0'), INT64_C(1) << 40);
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+    if (position != text.size() || digits.empty()){
+        return invalid();
+    }
+    size_t first = digits.find_first_not_of('0');
+    if (first == std::string::npos){
+        return bigInteger();
+    }
+    digits.erase(0, first);
+    if (exponent < 0){
+        // Digits moved behind the decimal point must be zeros
+        size_t kept = static_cast<uint64_t>(-exponent) < digits.size() ? digits.size() - static_cast<size_t>(-exponent) : 0;
+        if (digits.find_last_not_of('0') >= kept){
+            return invalid();
+        }
+        digits.resize(kept);
+        exponent = 0;
+    }
+    if (digits.size() > maxDigits || static_cast<uint64_t>(exponent) > maxDigits - digits.size()){
+        return invalid();
+    }
+    digits.append(static_cast<size_t>(exponent), '0');
+    bigInteger result;
+    result.limbs.reserve(digits.size() / limbDigits + 1);
+    for (size_t end = digits.size(); end > 0;) {
+        size_t begin = end > limbDigits ? end - limbDigits : 0;
+        limb value = 0;
+        std::from_chars(digits.data() + begin, digits.data() + end, value);
+        result.limbs.push_back(value);
+        end = begin;
+    }
+    result.normalize();
+    return result;
+}
+
+bool bigInteger::fromDouble(double value, bigInteger &outInteger) {
+    if (!std::isfinite(value) || std::trunc(value) != value){
+        return false;
+    }
+    if (std::abs(value) < 0x1p63){
+        outInteger = static_cast<int64_t>(value);
+        return true;
+    }
+    // 53 bit mantissa times a power of two, both exact
+    int exponent;
+    double mantissa = std::frexp(std::abs(value), &exponent);
+    bigInteger result = static_cast<int64_t>(std::ldexp(mantissa, 53));
+    result *= pow(2, static_cast<uint64_t>(exponent - 53));
+    result.negative = value < 0;
+    outInteger = std::move(result);
+    return true;
+}
+
+size_t bigInteger::digits() const {
+    if (limbs.empty()){
+        return 1;
+    }
+    size_t count = (limbs.size() - 1) * limbDigits;
+    for (limb top = limbs.back(); top != 0; top /= 10) {
+        count++;
+    }
+    return count;
+}
+
+double bigInteger::toDouble() const {
+    if (!valid){
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (digits() > std::numeric_limits<double>::max_exponent10 + 1){
+        return negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+    }
+    // Correctly rounded by the decimal conversion of the C library
+    return std::strtod(toString().c_str(), nullptr);
+}
+
+double bigInteger::log10() const {
+    if (limbs.empty()){
+        return -std::numeric_limits<double>::infinity();
+    }
+    // Three limbs carry more digits than a double
+    double leading = 0;
+    size_t used = std::min<size_t>(limbs.size(), 3);
+    for (size_t i = 0; i < used; ++i) {
+        leading = leading * bigBase + limbs[limbs.size() - 1 - i];
+    }
+    return std::log10(leading) + static_cast<double>((limbs.size() - used) * limbDigits);
+}
+
+bool bigInteger::toInt64(int64_t &outValue) const {
+    if (!valid || limbs.size() > 3){
+        return false;
+    }
+    unsigned __int128 value = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        value = value * bigBase + limbs[i];
+    }
+    unsigned __int128 limit = static_cast<unsigned __int128>(INT64_MAX) + (negative ? 1 : 0);
+    if (value > limit){
+        return false;
+    }
+    outValue = negative ? static_cast<int64_t>(0 - static_cast<uint64_t>(value)) : static_cast<int64_t>(value);
+    return true;
+}
+
+std::string bigInteger::toString() const {
+    if (!valid){
+        return "nan";
+    }
+    if (limbs.empty()){
+        return "0";
+    }
+    std::string text;
+    text.reserve(limbs.size() * limbDigits + 1);
+    if (negative){
+        text += '-';
+    }
+    char leading[limbDigits + 1];
+    text.append(leading, std::to_chars(leading, leading + sizeof(leading), limbs.back()).ptr);
+    // Every following limb is exactly nine digits with leading zeros
+    for (size_t i = limbs.size() - 1; i-- > 0;) {
+        char digits[limbDigits];
+        limb value = limbs[i];
+        for (size_t k = limbDigits; k-- > 0; value /= 10) {
+            digits[k] = static_cast<char>('0' + value % 10);
+        }
+        text.append(digits, limbDigits);
+    }
+    return text;
+}
+
+void bigInteger::normalize() {
+    trimMagnitude(limbs);
+    if (limbs.empty()){
+        negative = false;
+    }
+}
+
+bigInteger& bigInteger::operator+=(const bigInteger &rhs) {
+    if (!valid || !rhs.valid){
+        return *this = invalid();
+    }
+    if (negative == rhs.negative){
+        addMagnitude(limbs, rhs.limbs.data(), rhs.limbs.size());
+    } else if (compareMagnitude(limbs, rhs.limbs) >= 0){
+        subtractMagnitude(limbs, rhs.limbs.data(), rhs.limbs.size());
+    } else {
+        magnitude difference = rhs.limbs;
+        subtractMagnitude(difference, limbs.data(), limbs.size());
+        limbs = std::move(difference);
+        negative = rhs.negative;
+    }
+    normalize();
+    return *this;
+}
+
+bigInteger& bigInteger::operator-=(const bigInteger &rhs) {
+    return *this += -rhs;
+}
+
+bigInteger& bigInteger::operator*=(const bigInteger &rhs) {
+    if (!valid || !rhs.valid){
+        return *this = invalid();
+    }
+    limbs = multiplyMagnitude(limbs.data(), limbs.size(), rhs.limbs.data(), rhs.limbs.size());
+    negative = negative != rhs.negative;
+    normalize();
+    return *this;
+}
+
+bigInteger bigInteger::operator-() const {
+    bigInteger result = *this;
+    result.negative = !negative && !limbs.empty();
+    return result;
+}
+
+bool bigInteger::operator==(const bigInteger &rhs) const {
+    return valid && rhs.valid && negative == rhs.negative && limbs == rhs.limbs;
+}
+
+bool bigInteger::operator<(const bigInteger &rhs) const {
+    if (!valid || !rhs.valid){
+        return false;
+    }
+    if (negative != rhs.negative){
+        return negative;
+    }
+    int order = compareMagnitude(limbs, rhs.limbs);
+    return negative ? order > 0 : order < 0;
+}
+
+calcLib::Status bigInteger::divide(const bigInteger &lhs, const bigInteger &rhs, bigInteger &outQuotient,
+                                   bigInteger &outRemainder) {
+    if (!lhs.valid || !rhs.valid || rhs.limbs.empty()){
+        outQuotient = invalid();
+        outRemainder = invalid();
+        return lhs.valid && rhs.valid ? calcLib::Status::divisionByZero : calcLib::Status::ok;
+    }
+    bigInteger quotient;
+    bigInteger remainder = lhs;
+    if (compareMagnitude(lhs.limbs, rhs.limbs) < 0){
+        // Quotient is zero
+    } else if (rhs.limbs.size() == 1){
+        quotient.limbs = lhs.limbs;
+        limb rest = divideSmall(quotient.limbs, rhs.limbs[0]);
+        remainder.limbs.assign(rest != 0 ? 1 : 0, rest);
+    } else {
+        divideMagnitude(remainder.limbs, rhs.limbs, quotient.limbs);
+    }
+    quotient.negative = lhs.negative != rhs.negative;
+    quotient.normalize();
+    remainder.normalize();
+    outQuotient = std::move(quotient);
+    outRemainder = std::move(remainder);
+    return calcLib::Status::ok;
+}
+
+bigInteger bigInteger::pow(const bigInteger &base, uint64_t exponent) {
+    bigInteger result = 1;
+    bigInteger square = base;
+    while (true) {
+        if ((exponent & 1) != 0){
+            result *= square;
+        }
+        exponent >>= 1;
+        if (exponent == 0){
+            return result;
+        }
+        square *= square;
+    }
+}
+
+bigInteger bigInteger::factorial(uint64_t n) {
+    bigInteger result = 1;
+    if (n > 1){
+        result.limbs = rangeProduct(2, n);
+    }
+    return result;
+}
+
+std::string scalarTraits<bigInteger>::format(const bigInteger &value, int precision) {
+    std::string text = value.toString();
+    if (value.isValid() && precision > 0){
+        text += '.';
+        text.append(precision, '0');
+    }
+    return text;
+}
+
+template<>
+calcLib::Status basicExpression<bigInteger>::apply(Opcode op, bigInteger lhs, bigInteger rhs, bigInteger &outResult) {
+    if (!lhs.isValid() || !rhs.isValid()){
+        outResult = bigInteger::invalid();
+        return Status::ok;
+    }
+    Status status = Status::ok;
+    bigInteger result = bigInteger::invalid();
+    switch (op) {
+        case Opcode::negate:
+            result = -lhs;
+            break;
+        case Opcode::factorial: {
+            int64_t n;
+            // log10(n!) from lgamma keeps results beyond maxDigits from being computed
+            if (lhs.isNegative() || !lhs.toInt64(n)
+                || std::lgamma(static_cast<double>(n) + 1) / std::log(10.0) > bigInteger::maxDigits){
+                status = Status::domainError;
+                break;
+            }
+            result = bigInteger::factorial(static_cast<uint64_t>(n));
+            break;
+        }
+        case Opcode::add:
+            result = lhs + rhs;
+            break;
+        case Opcode::sub:
+            result = lhs - rhs;
+            break;
+        case Opcode::mul:
+            result = lhs * rhs;
+            break;
+        case Opcode::div:
+        case Opcode::mod: {
+            bigInteger remainder;
+            status = bigInteger::divide(lhs, rhs, result, remainder);
+            if (status != Status::ok){
+                break;
+            }
+            if (op == Opcode::mod){
+                result = std::move(remainder);
+            } else if (!remainder.isZero()){
+                // Quotient is not an integer
+                status = Status::domainError;
+            }
+            break;
+        }
+        case Opcode::pow: {
+            int64_t exponent;
+            bigInteger quotient;
+            bigInteger parity;
+            bigInteger::divide(rhs, 2, quotient, parity);
+            if (lhs == 1 || lhs == -1){
+                result = parity.isZero() ? 1 : lhs;
+            } else if (rhs.isNegative()){
+                status = Status::domainError;
+            } else if (lhs.isZero()){
+                result = rhs.isZero() ? 1 : 0;
+            } else if (!rhs.toInt64(exponent) || lhs.log10() * static_cast<double>(exponent) > bigInteger::maxDigits){
+                status = Status::domainError;
+            } else {
+                result = bigInteger::pow(lhs, static_cast<uint64_t>(exponent));
+            }
+            break;
+        }
+        case Opcode::sin:
+        case Opcode::cos:
+        case Opcode::tan: {
+            // Sines of integer degrees are integers only at multiples of 90, tangents at multiples of 45
+            constexpr int64_t sines[] = {0, 1, 0, -1};
+            bigInteger quotient;
+            bigInteger reduced;
+            bigInteger::divide(lhs, 360, quotient, reduced);
+            int64_t degrees;
+            reduced.toInt64(degrees);
+            degrees = (degrees + 360) % 360;
+            if (op == Opcode::tan && degrees % 90 == 0){
+                result = 0;
+                status = degrees % 180 == 0 ? Status::ok : Status::divisionByZero;
+            } else if (op == Opcode::tan && degrees % 45 == 0){
+                result = degrees / 90 % 2 == 0 ? 1 : -1;
+            } else if (op != Opcode::tan && degrees % 90 == 0){
+                result = sines[(degrees / 90 + (op == Opcode::cos ? 1 : 0)) % 4];
+            } else {
+                status = Status::domainError;
+            }
+            break;
+        }
+        case Opcode::sqrt:
+            return apply(Opcode::root, 2, lhs, outResult);
+        case Opcode::log10:
+            return apply(Opcode::log, 10, lhs, outResult);
+        case Opcode::log: {
+            // log(base:num) is an integer k when base^k == num
+            if (lhs == 1){
+                status = Status::divisionByZero;
+            } else if (lhs.isNegative() || lhs.isZero() || rhs.isNegative() || rhs.isZero()){
+                status = Status::domainError;
+            } else if (rhs == 1){
+                result = 0;
+            } else {
+                auto exponent = static_cast<int64_t>(std::llround(rhs.log10() / lhs.log10()));
+                if (exponent > 0 && bigInteger::pow(lhs, static_cast<uint64_t>(exponent)) == rhs){
+                    result = exponent;
+                } else {
+                    status = Status::domainError;
+                }
+            }
+            break;
+        }
+        case Opcode::root: {
+            int64_t degree;
+            if (lhs.isZero()){
+                status = Status::divisionByZero;
+            } else if (rhs.isNegative()){
+                status = Status::domainError;
+            } else if (!lhs.isNegative() && lhs.toInt64(degree)){
+                status = integerRoot(rhs, degree, result) ? Status::ok : Status::domainError;
+            } else if (rhs == 1){
+                // Negative or huge degrees only have integer roots of 1
+                result = 1;
+            } else {
+                status = Status::domainError;
+            }
+            break;
+        }
+        case Opcode::less:
+            result = lhs < rhs ? 1 : 0;
+            break;
+        case Opcode::lessEqual:
+            result = rhs < lhs ? 0 : 1;
+            break;
+        case Opcode::greater:
+            result = rhs < lhs ? 1 : 0;
+            break;
+        case Opcode::greaterEqual:
+            result = lhs < rhs ? 0 : 1;
+            break;
+        case Opcode::equal:
+            result = lhs == rhs ? 1 : 0;
+            break;
+        case Opcode::notEqual:
+            result = lhs != rhs ? 1 : 0;
+            break;
+        case Opcode::min:
+            result = lhs < rhs ? std::move(lhs) : std::move(rhs);
+            break;
+        case Opcode::max:
+            result = rhs < lhs ? std::move(lhs) : std::move(rhs);
+            break;
+        case Opcode::abs:
+            result = lhs.isNegative() ? -lhs : std::move(lhs);
+            break;
+        default:
+            return Status::invalidExpression;
+    }
+    outResult = status == Status::ok ? std::move(result) : bigInteger::invalid();
+    return status;
+}
+
+template<>
+calcLib::Status calcLib::evaluate(const basicExpression<bigInteger> &expression, calcSession &session,
+                                  bigInteger &outResult) const {
+    std::vector<bigInteger> slots(expression.symbols.size());
+    for (size_t i = 0; i < expression.symbols.size(); ++i) {
+        double value;
+        Status status = bindSymbol(expression.symbols[i], session, value);
+        if (status != Status::ok){
+            return status;
+        }
+        if (!bigInteger::fromDouble(value, slots[i])){
+            return Status::domainError;
+        }
+    }
+    // Integers have no infinity or NaN to continue with, so ieeeMode does not apply
+    Status status = expression.run(slots.data(), outResult, nullptr);
+    if (status != Status::ok){
+        return status;
+    }
+    if (!outResult.isValid()){
+        return Status::domainError;
+    }
+    session.variables.find("ans")->second = outResult.toDouble();
+    return Status::ok;
+}
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "calclib/bundle.hpp"
+
+namespace {
+
+using Opcode = compiledExpression::Opcode;
+using Instruction = compiledExpression::Instruction;
+
+constexpr char bundleMagic[8] = {'F', 'T', 'C', 'A', 'L', 'C', 'B', 'N'};
+constexpr uint32_t byteOrderMark = 0x01020304; //! Reads differently on a machine of the other byte order
+constexpr size_t inlineSlotCount = 16; //! Symbols bound without allocating
+
+/**
+ * Reference to bytes of the string area
+ */
+struct stringRef {
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+/**
+ * Start of every bundle file. All offsets are relative to the start of the file.
+ */
+struct fileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t expressionOffset; //! expressionRecord[expressionCount] sorted by name
+    uint64_t variableOffset; //! variableRecord[variableCount]
+    uint32_t expressionCount;
+    uint32_t variableCount;
+};
+
+struct expressionRecord {
+    stringRef name;
+    uint64_t codeOffset; //! Instruction[codeCount]
+    uint64_t constantOffset; //! double[constantCount]
+    uint64_t symbolOffset; //! stringRef[symbolCount]
+    uint32_t codeCount;
+    uint32_t constantCount;
+    uint32_t symbolCount;
+    uint32_t stackSize;
+};
+
+struct variableRecord {
+    stringRef name;
+    double value;
+};
+
+static_assert(sizeof(Instruction) == 8 && offsetof(Instruction, operand) == 4, "bytecode is stored as is");
+static_assert(std::is_trivially_copyable<Instruction>::value, "bytecode is stored as is");
+static_assert(sizeof(fileHeader) % 8 == 0 && sizeof(expressionRecord) % 8 == 0 && sizeof(variableRecord) % 8 == 0,
+              "records keep 8 byte alignment");
+
+/**
+ * Appends data to out padded to 8 bytes
+ * @return offset of data in out
+ */
+uint64_t appendAligned(std::string &out, const void *data, size_t size) {
+    uint64_t offset = out.size();
+    out.append(static_cast<const char*>(data), size);
+    out.append((8 - out.size() % 8) % 8, '\0');
+    return offset;
+}
+
+stringRef appendString(std::string &out, std::string_view text) {
+    return stringRef{appendAligned(out, text.data(), text.size()), static_cast<uint32_t>(text.size()), 0};
+}
+
+}
+
+void bundleWriter::add(std::string name, const compiledExpression &expression) {
+    expressions.push_back(namedExpression{std::move(name), expression});
+}
+
+void bundleWriter::addSession(const calcSession &session) {
+    for (const auto &variable : session.variables) {
+        variables.emplace_back(variable.first, variable.second);
+    }
+}
+
+std::string bundleWriter::serialize() const {
+    std::vector<size_t> order(expressions.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+        return expressions[lhs].name < expressions[rhs].name;
+    });
+
+    // Records are reserved first and filled in once the offsets of their data are known
+    std::string out(sizeof(fileHeader), '\0');
+    fileHeader header{};
+    std::memcpy(header.magic, bundleMagic, sizeof(bundleMagic));
+    header.version = expressionBundle::version;
+    header.byteOrder = byteOrderMark;
+    header.expressionCount = static_cast<uint32_t>(expressions.size());
+    header.variableCount = static_cast<uint32_t>(variables.size());
+    header.expressionOffset = out.size();
+    out.append(sizeof(expressionRecord) * expressions.size(), '\0');
+    header.variableOffset = out.size();
+    out.append(sizeof(variableRecord) * variables.size(), '\0');
+
+    std::vector<expressionRecord> records;
+    for (size_t index : order) {
+        const auto &named = expressions[index];
+        const compiledExpression &expression = named.expression;
+        expressionRecord record{};
+        record.name = appendString(out, named.name);
+        record.codeCount = static_cast<uint32_t>(expression.code.size());
+        record.codeOffset = appendAligned(out, expression.code.data(), expression.code.size() * sizeof(Instruction));
+        record.constantCount = static_cast<uint32_t>(expression.constants.size());
+        record.constantOffset = appendAligned(out, expression.constants.data(), expression.constants.size() * sizeof(double));
+        std::vector<stringRef> symbols;
+        for (const auto &symbol : expression.symbols) {
+            symbols.push_back(appendString(out, symbol));
+        }
+        record.symbolCount = static_cast<uint32_t>(symbols.size());
+        record.symbolOffset = appendAligned(out, symbols.data(), symbols.size() * sizeof(stringRef));
+        record.stackSize = expression.stackSize;
+        records.push_back(record);
+    }
+    std::vector<variableRecord> variableRecords;
+    for (const auto &variable : variables) {
+        variableRecords.push_back(variableRecord{appendString(out, variable.first), variable.second});
+    }
+
+    header.fileSize = out.size();
+    std::memcpy(&out[0], &header, sizeof(header));
+    if (!records.empty()){
+        std::memcpy(&out[header.expressionOffset], records.data(), records.size() * sizeof(expressionRecord));
+    }
+    if (!variableRecords.empty()){
+        std::memcpy(&out[header.variableOffset], variableRecords.data(), variableRecords.size() * sizeof(variableRecord));
+    }
+    return out;
+}
+
+bool bundleWriter::save(const std::string &path) const {
+    std::string contents = serialize();
+    std::string temporary = path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0){
+        return false;
+    }
+    size_t written = 0;
+    while (written < contents.size()) {
+        ssize_t result = write(fd, contents.data() + written, contents.size() - written);
+        if (result < 0 && errno == EINTR){
+            continue;
+        }
+        if (result <= 0){
+            int error = errno;
+            ::close(fd);
+            unlink(temporary.c_str());
+            errno = error;
+            return false;
+        }
+        written += result;
+    }
+    if (::close(fd) != 0 || rename(temporary.c_str(), path.c_str()) != 0){
+        int error = errno;
+        unlink(temporary.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+/**
+ * Bounds checks of a bundle before it is used
+ */
+class bundleValidator {
+    const char *data;
+    size_t size;
+public:
+    bundleValidator(const char *data, size_t size) : data(data), size(size) {}
+
+    /**
+     * @return true if count elements of elementSize at offset lie inside the bundle and are 8 byte aligned
+     */
+    bool array(uint64_t offset, uint64_t count, size_t elementSize) const {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / elementSize;
+    }
+
+    bool string(const stringRef &text) const {
+        return text.offset <= size && text.length <= size - text.offset;
+    }
+
+    std::string_view view(const stringRef &text) const {
+        return std::string_view(data + text.offset, text.length);
+    }
+
+    /**
+     * Checks operands and simulates the stack so that running the code cannot leave its buffers.
+     * stackSize must match exactly, it decides how much memory evaluation allocates.
+     */
+    static bool code(const Instruction *code, const double *constants, const expressionRecord &record) {
+        for (uint32_t i = 0; i < record.codeCount; ++i) {
+            const Instruction &instruction = code[i];
+            if (instruction.op > compiledExpression::lastOpcode){
+                return false;
+            }
+            if (instruction.op == Opcode::constant && instruction.operand >= record.constantCount){
+                return false;
+            }
+            if (instruction.op == Opcode::polynomial && !polynomial(constants, instruction.operand, record.constantCount)){
+                return false;
+            }
+            if (instruction.op == Opcode::series && !series(constants, instruction.operand, record.constantCount)){
+                return false;
+            }
+            // Slots of variables and targets of branch, jump and loops are checked by simulate
+            bool indexed = instruction.op == Opcode::constant || instruction.op == Opcode::variable
+                           || instruction.op == Opcode::polynomial || instruction.op == Opcode::branch
+                           || instruction.op == Opcode::jump || instruction.op == Opcode::sum
+                           || instruction.op == Opcode::product || instruction.op == Opcode::endLoop
+                           || instruction.op == Opcode::series;
+            if (!indexed && instruction.operand > static_cast<uint32_t>(calcLib::Accuracy::fast)){
+                return false;
+            }
+        }
+        uint32_t deepest;
+        return compiledExpression::simulate(code, record.codeCount, record.symbolCount, deepest)
+               && deepest == record.stackSize;
+    }
+
+    /**
+     * Checks that the degree at constants[first] is an integer polynomialTerms collects and its coefficients follow
+     */
+    static bool polynomial(const double *constants, uint32_t first, uint32_t constantCount) {
+        if (first >= constantCount){
+            return false;
+        }
+        double degree = constants[first];
+        return degree >= 0 && degree <= polynomialTerms::maxDegree && std::trunc(degree) == degree
+               && degree < constantCount - first - 1;
+    }
+
+    /**
+     * Checks that constants[first] selects a closed form of compiledExpression::series and its terms follow
+     */
+    static bool series(const double *constants, uint32_t first, uint32_t constantCount) {
+        if (first >= constantCount){
+            return false;
+        }
+        double kind = constants[first];
+        if (kind == 0){
+            return polynomial(constants, first + 1, constantCount);
+        }
+        return (kind == 1 || kind == 2) && static_cast<uint32_t>(3 - kind) < constantCount - first;
+    }
+
+    bool validate() const {
+        if (reinterpret_cast<uintptr_t>(data) % 8 != 0 || size < sizeof(fileHeader)){
+            return false;
+        }
+        const auto &header = *reinterpret_cast<const fileHeader*>(data);
+        if (std::memcmp(header.magic, bundleMagic, sizeof(bundleMagic)) != 0 || header.version != expressionBundle::version
+            || header.byteOrder != byteOrderMark || header.fileSize != size){
+            return false;
+        }
+        if (!array(header.expressionOffset, header.expressionCount, sizeof(expressionRecord))
+            || !array(header.variableOffset, header.variableCount, sizeof(variableRecord))){
+            return false;
+        }
+        const auto *records = reinterpret_cast<const expressionRecord*>(data + header.expressionOffset);
+        for (uint32_t i = 0; i < header.expressionCount; ++i) {
+            const expressionRecord &record = records[i];
+            if (!string(record.name) || (i > 0 && view(records[i - 1].name) > view(record.name))){
+                return false;
+            }
+            if (!array(record.codeOffset, record.codeCount, sizeof(Instruction))
+                || !array(record.constantOffset, record.constantCount, sizeof(double))
+                || !array(record.symbolOffset, record.symbolCount, sizeof(stringRef))){
+                return false;
+            }
+            const auto *symbols = reinterpret_cast<const stringRef*>(data + record.symbolOffset);
+            if (!std::all_of(symbols, symbols + record.symbolCount, [this](const stringRef &symbol){return string(symbol);})){
+                return false;
+            }
+            if (!code(reinterpret_cast<const Instruction*>(data + record.codeOffset),
+                      reinterpret_cast<const double*>(data + record.constantOffset), record)){
+                return false;
+            }
+        }
+        const auto *variables = reinterpret_cast<const variableRecord*>(data + header.variableOffset);
+        return std::all_of(variables, variables + header.variableCount,
+                           [this](const variableRecord &variable){return string(variable.name);});
+    }
+};
+
+const fileHeader& headerOf(const char *data) {
+    return *reinterpret_cast<const fileHeader*>(data);
+}
+
+const expressionRecord& recordOf(const char *data, size_t index) {
+    return reinterpret_cast<const expressionRecord*>(data + headerOf(data).expressionOffset)[index];
+}
+
+std::string_view stringOf(const char *data, const stringRef &text) {
+    return std::string_view(data + text.offset, text.length);
+}
+
+}
+
+expressionBundle::~expressionBundle() {
+    close();
+}
+
+bool expressionBundle::open(const std::string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        return false;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size <= 0){
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED){
+        return false;
+    }
+    if (!open(mapping, info.st_size)){
+        munmap(mapping, info.st_size);
+        return false;
+    }
+    mapped = true;
+    return true;
+}
+
+bool expressionBundle::open(const void *bundle, size_t bundleSize) {
+    close();
+    if (!bundleValidator(static_cast<const char*>(bundle), bundleSize).validate()){
+        return false;
+    }
+    data = static_cast<const char*>(bundle);
+    size = bundleSize;
+    return true;
+}
+
+void expressionBundle::close() {
+    if (mapped){
+        munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+size_t expressionBundle::expressionCount() const {
+    return data == nullptr ? 0 : headerOf(data).expressionCount;
+}
+
+std::string_view expressionBundle::name(size_t index) const {
+    return stringOf(data, recordOf(data, index).name);
+}
+
+bool expressionBundle::find(std::string_view name, size_t &outIndex) const {
+    size_t begin = 0;
+    size_t end = expressionCount();
+    while (begin < end) {
+        size_t middle = begin + (end - begin) / 2;
+        if (this->name(middle) < name){
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    if (begin == expressionCount() || this->name(begin) != name){
+        return false;
+    }
+    outIndex = begin;
+    return true;
+}
+
+calcLib::Status expressionBundle::evaluate(const calcLib &calc, size_t index, calcSession &session, double &outResult) const {
+    const expressionRecord &record = recordOf(data, index);
+    double inlineSlots[inlineSlotCount];
+    std::vector<double> heapSlots;
+    double *slots = inlineSlots;
+    if (record.symbolCount > inlineSlotCount){
+        heapSlots.resize(record.symbolCount);
+        slots = heapSlots.data();
+    }
+    const auto *symbols = reinterpret_cast<const stringRef*>(data + record.symbolOffset);
+    for (uint32_t i = 0; i < record.symbolCount; ++i) {
+        calcLib::Status status = calc.bindSymbol(stringOf(data, symbols[i]), session, slots[i]);
+        if (status != calcLib::Status::ok){
+            return status;
+        }
+    }
+    expressionView view{reinterpret_cast<const Instruction*>(data + record.codeOffset), record.codeCount,
+                        reinterpret_cast<const double*>(data + record.constantOffset), record.stackSize};
+    return calc.evaluate(view, slots, session, outResult);
+}
+
+void expressionBundle::restoreSession(calcSession &session) const {
+    if (data == nullptr){
+        return;
+    }
+    const fileHeader &header = headerOf(data);
+    const auto *variables = reinterpret_cast<const variableRecord*>(data + header.variableOffset);
+    for (uint32_t i = 0; i < header.variableCount; ++i) {
+        session.setVariable(std::string(stringOf(data, variables[i].name)), variables[i].value);
+    }
+}
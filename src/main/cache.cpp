@@ -0,0 +1,55 @@
+#include "calclib/cache.hpp"
+
+expressionCache::expressionCache(const calcLib &calc, size_t capacity) : calc(calc), capacity(capacity) {}
+
+calcLib::Status expressionCache::get(std::string_view expression, std::shared_ptr<const compiledExpression> &outExpression) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = index.find(expression);
+        if (found != index.end()){
+            entries.splice(entries.begin(), entries, found->second);
+            hitCount++;
+            outExpression = found->second->expression;
+            return found->second->status;
+        }
+        missCount++;
+    }
+
+    // Compile without holding the lock, a concurrent miss of the same text only wastes work
+    auto compiled = std::make_shared<compiledExpression>();
+    calcLib::Status status = calc.compile(expression, *compiled);
+    if (status != calcLib::Status::ok){
+        compiled.reset();
+    }
+    outExpression = compiled;
+    if (capacity == 0){
+        return status;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (index.find(expression) != index.end()){
+        return status;
+    }
+    if (entries.size() >= capacity){
+        index.erase(entries.back().text);
+        entries.pop_back();
+    }
+    entries.push_front(entry{std::string(expression), status, std::move(compiled)});
+    index.emplace(entries.front().text, entries.begin());
+    return status;
+}
+
+size_t expressionCache::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return entries.size();
+}
+
+size_t expressionCache::hits() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return hitCount;
+}
+
+size_t expressionCache::misses() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return missCount;
+}
@@ -0,0 +1,505 @@
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "calclib/batch.hpp"
+#include "calclib/bignum.hpp"
+#include "calclib/double_double.hpp"
+#include "calclib/process_pool.hpp"
+
+namespace {
+
+constexpr size_t linesPerWindow = 1 << 16; //! Lines evaluated per batch, bounds memory and latency of the output
+constexpr size_t readBlockSize = 16 << 20; //! Size of one read from a non-mappable input
+constexpr size_t writeBufferSize = 1 << 20;
+constexpr unsigned long maxWorkers = 1024; //! Most threads of -j and processes of -P
+
+enum class OutputFormat{
+    text,
+    csv,
+    ndjson
+};
+
+/**
+ * Collects output in a large buffer and writes it to a file descriptor in few system calls
+ */
+class bufferedWriter {
+    int fd;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool failed = false;
+public:
+    explicit bufferedWriter(int fd) : fd(fd), buffer(writeBufferSize) {}
+
+    ~bufferedWriter() {
+        flush();
+    }
+
+    /**
+     * Makes sure at least size bytes can be written at cursor()
+     */
+    void reserve(size_t size) {
+        if (buffer.size() - used < size){
+            flush();
+            if (buffer.size() < size){
+                buffer.resize(size);
+            }
+        }
+    }
+
+    char* cursor() {
+        return buffer.data() + used;
+    }
+
+    char* end() {
+        return buffer.data() + buffer.size();
+    }
+
+    void advance(char *position) {
+        used = position - buffer.data();
+    }
+
+    void put(char c) {
+        reserve(1);
+        buffer[used++] = c;
+    }
+
+    void put(std::string_view text) {
+        reserve(text.size());
+        std::memcpy(buffer.data() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    void flush() {
+        size_t written = 0;
+        while (!failed && written < used) {
+            ssize_t result = ::write(fd, buffer.data() + written, used - written);
+            if (result < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                failed = true;
+                break;
+            }
+            written += result;
+        }
+        used = 0;
+    }
+
+    /**
+     * @return true if any write failed
+     */
+    bool error() const {
+        return failed;
+    }
+};
+
+/**
+ * Input text either mapped from a regular file or read from a pipe block by block
+ */
+class lineReader {
+    int fd;
+    const char *mapped = nullptr;
+    size_t mappedSize = 0;
+    size_t position = 0;
+    std::vector<char> block;
+    size_t blockUsed = 0;
+    bool eof = false;
+public:
+    explicit lineReader(int fd) : fd(fd) {
+        struct stat info{};
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+            void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED){
+                madvise(map, info.st_size, MADV_SEQUENTIAL);
+                mapped = static_cast<const char*>(map);
+                mappedSize = info.st_size;
+            }
+        }
+    }
+
+    ~lineReader() {
+        if (mapped != nullptr){
+            munmap(const_cast<char*>(mapped), mappedSize);
+        }
+    }
+
+    /**
+     * Appends up to maxLines lines to outLines. Views stay valid until the next call.
+     * @return false if input is exhausted and no line was read
+     */
+    bool nextLines(std::vector<std::string_view> &outLines, size_t maxLines) {
+        outLines.clear();
+        if (mapped != nullptr){
+            splitLines(mapped, mappedSize, position, outLines, maxLines, true);
+            return !outLines.empty();
+        }
+        // Move the unfinished line to the front and refill the block
+        std::memmove(block.data(), block.data() + position, blockUsed - position);
+        blockUsed -= position;
+        position = 0;
+        while (outLines.empty()) {
+            if (!eof){
+                if (block.size() - blockUsed < readBlockSize){
+                    block.resize(blockUsed + readBlockSize);
+                }
+                ssize_t result = ::read(fd, block.data() + blockUsed, block.size() - blockUsed);
+                if (result < 0 && errno == EINTR){
+                    continue;
+                }
+                if (result <= 0){
+                    eof = true;
+                } else {
+                    blockUsed += result;
+                }
+            }
+            splitLines(block.data(), blockUsed, position, outLines, maxLines, eof);
+            if (eof){
+                break;
+            }
+        }
+        return !outLines.empty();
+    }
+
+private:
+    /**
+     * Splits complete lines of data starting at position. The last line without a newline is taken only if final.
+     */
+    static void splitLines(const char *data, size_t size, size_t &position, std::vector<std::string_view> &outLines,
+                           size_t maxLines, bool final) {
+        while (position < size && outLines.size() < maxLines) {
+            auto *begin = data + position;
+            auto *newline = static_cast<const char*>(std::memchr(begin, '\n', size - position));
+            if (newline == nullptr && !final){
+                break;
+            }
+            size_t length = newline != nullptr ? newline - begin : size - position;
+            position += length + (newline != nullptr ? 1 : 0);
+            if (length > 0 && begin[length - 1] == '\r'){
+                length--;
+            }
+            outLines.emplace_back(begin, length);
+        }
+    }
+};
+
+/**
+ * Writes text quoted by CSV rules if it contains separator, quote or newline
+ */
+void writeCsvField(bufferedWriter &out, std::string_view text) {
+    if (text.find_first_of(",\"\n") == std::string_view::npos){
+        out.put(text);
+        return;
+    }
+    out.put('"');
+    for (char c : text) {
+        if (c == '"'){
+            out.put('"');
+        }
+        out.put(c);
+    }
+    out.put('"');
+}
+
+/**
+ * Writes text as a JSON string literal
+ */
+void writeJsonString(bufferedWriter &out, std::string_view text) {
+    static const char hex[] = "0123456789abcdef";
+    out.put('"');
+    for (char c : text) {
+        auto byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\'){
+            out.put('\\');
+            out.put(c);
+        } else if (byte < 0x20){
+            out.put("\\u00");
+            out.put(hex[byte >> 4]);
+            out.put(hex[byte & 0xf]);
+        } else {
+            out.put(c);
+        }
+    }
+    out.put('"');
+}
+
+/**
+ * Writes formatted number of result
+ */
+void writeValue(bufferedWriter &out, const calcLib &calc, double value) {
+    for (size_t size = 512;; size *= 2) {
+        out.reserve(size);
+        if (char *end = calc.formatResult(value, out.cursor(), out.end())){
+            out.advance(end);
+            return;
+        }
+    }
+}
+
+/**
+ * Writes result of an expression in format
+ * @param finite false if the result is inf or nan, which JSON only takes as a string
+ * @param writeNumber writes the formatted result, called only if status is ok
+ */
+template<typename NumberWriter>
+void writeResult(bufferedWriter &out, OutputFormat format, std::string_view expression, calcLib::Status status,
+                 bool finite, NumberWriter writeNumber) {
+    bool ok = status == calcLib::Status::ok;
+    switch (format) {
+        case OutputFormat::text:
+            if (ok){
+                writeNumber();
+            } else {
+                out.put(calcLib::statusMessage(status));
+            }
+            break;
+        case OutputFormat::csv:
+            writeCsvField(out, expression);
+            out.put(',');
+            if (ok){
+                writeNumber();
+                out.put(',');
+            } else {
+                out.put(',');
+                writeCsvField(out, calcLib::statusMessage(status));
+            }
+            break;
+        case OutputFormat::ndjson:
+            out.put("{\"expression\":");
+            writeJsonString(out, expression);
+            if (ok && finite){
+                out.put(",\"result\":");
+                writeNumber();
+            } else if (ok){
+                out.put(",\"result\":\"");
+                writeNumber();
+                out.put('"');
+            } else {
+                out.put(",\"error\":");
+                writeJsonString(out, calcLib::statusMessage(status));
+            }
+            out.put('}');
+            break;
+    }
+    out.put('\n');
+}
+
+void writeResult(bufferedWriter &out, const calcLib &calc, OutputFormat format, std::string_view expression,
+                 const batchResult &result) {
+    writeResult(out, format, expression, result.status, std::isfinite(result.value), [&]() {
+        writeValue(out, calc, result.value);
+    });
+}
+
+/**
+ * @return false for values ndjson has to quote, like inf and nan of double
+ */
+bool finiteValue(const bigInteger &value) {
+    return value.isValid();
+}
+
+bool finiteValue(const doubleDouble &value) {
+    return std::isfinite(value.hi);
+}
+
+/**
+ * Evaluates lines one by one in Scalar instead of the double batch. Every line starts from session like in
+ * the batch, so ans does not carry over from the previous line.
+ */
+template<typename Scalar>
+void writeScalarResults(bufferedWriter &out, const calcLib &calc, OutputFormat format,
+                        const std::vector<std::string_view> &lines, const calcSession &session) {
+    basicExpression<Scalar> expression;
+    Scalar value;
+    for (std::string_view line : lines) {
+        calcSession single = session;
+        calcLib::Status status = calc.compile(line, expression);
+        if (status == calcLib::Status::ok){
+            status = calc.evaluate(expression, single, value);
+        }
+        std::string text = status == calcLib::Status::ok ? calc.formatResult(value) : std::string();
+        bool finite = status == calcLib::Status::ok && finiteValue(value);
+        writeResult(out, format, line, status, finite, [&]() {
+            out.put(text);
+        });
+    }
+}
+
+/**
+ * @param text option argument
+ * @param max largest accepted value
+ * @param outValue value of text
+ * @return false unless text is a decimal number up to max
+ */
+bool parseNumber(const char *text, unsigned long max, unsigned long &outValue) {
+    if (!std::isdigit(static_cast<unsigned char>(*text))){
+        return false;
+    }
+    char *end;
+    errno = 0;
+    outValue = strtoul(text, &end, 10);
+    return *end == '\0' && errno == 0 && outValue <= max;
+}
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " [options] [file]\n"
+              << "Evaluates one expression per line of file or stdin.\n"
+              << "  -f text|csv|ndjson  output format (default text)\n"
+              << "  -p <digits>         number of decimal places (default 8)\n"
+              << "  -F                  keep trailing zeros\n"
+              << "  -b                  exact integers of any size, fails on results that are not integers\n"
+              << "  -d                  double-double precision, about 32 significant digits\n"
+              << "  -i                  ieee mode, division by zero yields inf/nan\n"
+              << "  -a faithful|correct|fast  accuracy of pow, root, sqrt, log and trigonometry (default faithful)\n"
+              << "  -j <threads>        worker threads, at most " << maxWorkers << " (default all cores)\n"
+              << "  -P <processes>      evaluate in worker processes pinned to cores instead of threads, 0 for one per core\n"
+              << "  -D 'f(x:y)=body'    define a function usable in the expressions, may be repeated\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    calcLib calc;
+    OutputFormat format = OutputFormat::text;
+    unsigned threads = 0;
+    bool useProcesses = false;
+    unsigned processes = 0;
+    bool integers = false;
+    bool doublePrecision = false;
+    int option;
+    unsigned long value;
+    while ((option = getopt(argc, argv, "f:p:Fbdia:j:P:D:h")) != -1) {
+        switch (option) {
+            case 'f':
+                if (strcmp(optarg, "text") == 0){
+                    format = OutputFormat::text;
+                } else if (strcmp(optarg, "csv") == 0){
+                    format = OutputFormat::csv;
+                } else if (strcmp(optarg, "ndjson") == 0){
+                    format = OutputFormat::ndjson;
+                } else {
+                    std::cerr << "Unknown output format " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (!parseNumber(optarg, calcLib::maxPrecision, value)){
+                    std::cerr << "Invalid precision " << optarg << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                calc.precision = static_cast<int>(value);
+                break;
+            case 'F':
+                calc.format = calcLib::ResultFormat::fixed;
+                break;
+            case 'b':
+                integers = true;
+                break;
+            case 'd':
+                doublePrecision = true;
+                break;
+            case 'i':
+                calc.ieeeMode = true;
+                break;
+            case 'a':
+                if (strcmp(optarg, "faithful") == 0){
+                    calc.accuracy = calcLib::Accuracy::faithful;
+                } else if (strcmp(optarg, "correct") == 0){
+                    calc.accuracy = calcLib::Accuracy::correctlyRounded;
+                } else if (strcmp(optarg, "fast") == 0){
+                    calc.accuracy = calcLib::Accuracy::fast;
+                } else {
+                    std::cerr << "Unknown accuracy " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'j':
+                if (!parseNumber(optarg, maxWorkers, value)){
+                    std::cerr << "Invalid thread count " << optarg << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                threads = static_cast<unsigned>(value);
+                break;
+            case 'P':
+                if (!parseNumber(optarg, maxWorkers, value)){
+                    std::cerr << "Invalid process count " << optarg << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                useProcesses = true;
+                processes = static_cast<unsigned>(value);
+                break;
+            case 'D':
+                if (calc.define(optarg) != calcLib::Status::ok){
+                    std::cerr << "Invalid function definition " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind > 1){
+        printUsage(argv[0]);
+        return 1;
+    }
+    int fd = STDIN_FILENO;
+    if (optind < argc && strcmp(argv[optind], "-") != 0){
+        fd = open(argv[optind], O_RDONLY);
+        if (fd < 0){
+            std::cerr << "Cannot open " << argv[optind] << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+    }
+
+    calcSession session;
+    std::unique_ptr<calcProcessPool> processPool;
+    std::unique_ptr<calcBatch> batch;
+    // -b and -d evaluate in order on this thread
+    if (useProcesses && !integers && !doublePrecision){
+        processPool = std::make_unique<calcProcessPool>(calc, session, processes);
+    } else if (!integers && !doublePrecision){
+        batch = std::make_unique<calcBatch>(calc, threads);
+    }
+    lineReader reader{fd};
+    bufferedWriter out{STDOUT_FILENO};
+    std::vector<std::string_view> lines;
+    std::vector<batchResult> results;
+    if (format == OutputFormat::csv){
+        out.put("expression,result,error\n");
+    }
+    while (reader.nextLines(lines, linesPerWindow)) {
+        if (integers){
+            writeScalarResults<bigInteger>(out, calc, format, lines, session);
+            continue;
+        }
+        if (doublePrecision){
+            writeScalarResults<doubleDouble>(out, calc, format, lines, session);
+            continue;
+        }
+        results.resize(lines.size());
+        if (processPool){
+            processPool->evaluate(lines.data(), lines.size(), results.data());
+        } else {
+            batch->evaluate(lines.data(), lines.size(), results.data(), session);
+        }
+        for (size_t i = 0; i < lines.size(); ++i) {
+            writeResult(out, calc, format, lines[i], results[i]);
+        }
+    }
+    out.flush();
+    if (fd != STDIN_FILENO){
+        close(fd);
+    }
+    return out.error() ? 1 : 0;
+}
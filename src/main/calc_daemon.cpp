@@ -0,0 +1,111 @@
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "calclib/server.hpp"
+
+namespace {
+
+constexpr unsigned long maxCapacity = 1ul << 24; //! Far above any working set, bounds the memory a typo can claim
+
+calcServer *runningServer = nullptr;
+
+void handleSignal(int) {
+    if (runningServer != nullptr){
+        runningServer->stop();
+    }
+}
+
+/**
+ * @return $XDG_RUNTIME_DIR/fitutubies-calc.sock or a per-user socket in /tmp
+ */
+std::string defaultSocketPath() {
+    if (const char *runtimeDir = getenv("XDG_RUNTIME_DIR")){
+        return std::string(runtimeDir) + "/fitutubies-calc.sock";
+    }
+    return "/tmp/fitutubies-calc-" + std::to_string(getuid()) + ".sock";
+}
+
+/**
+ * @param text option argument
+ * @param max largest accepted value
+ * @param outValue value of text
+ * @return false unless text is a decimal number up to max
+ */
+bool parseNumber(const char *text, unsigned long max, unsigned long &outValue) {
+    if (!std::isdigit(static_cast<unsigned char>(*text))){
+        return false;
+    }
+    char *end;
+    errno = 0;
+    outValue = strtoul(text, &end, 10);
+    return *end == '\0' && errno == 0 && outValue <= max;
+}
+
+void printUsage(const char *name) {
+    std::cerr << "Usage: " << name << " [options]\n"
+              << "Serves calculations over a Unix domain socket.\n"
+              << "  -s <path>    socket path (default " << defaultSocketPath() << ")\n"
+              << "  -c <count>   compiled expression cache capacity, at most " << maxCapacity << " (default 65536)\n"
+              << "  -p <digits>  number of decimal places of text results (default 8)\n"
+              << "  -F           keep trailing zeros in text results\n"
+              << "  -i           ieee mode, division by zero yields inf/nan\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    calcLib calc;
+    std::string path = defaultSocketPath();
+    size_t capacity = 65536;
+    int option;
+    unsigned long value;
+    while ((option = getopt(argc, argv, "s:c:p:Fih")) != -1) {
+        switch (option) {
+            case 's':
+                path = optarg;
+                break;
+            case 'c':
+                if (!parseNumber(optarg, maxCapacity, value)){
+                    std::cerr << "Invalid cache capacity " << optarg << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                capacity = value;
+                break;
+            case 'p':
+                if (!parseNumber(optarg, calcLib::maxPrecision, value)){
+                    std::cerr << "Invalid precision " << optarg << "\n";
+                    printUsage(argv[0]);
+                    return 1;
+                }
+                calc.precision = static_cast<int>(value);
+                break;
+            case 'F':
+                calc.format = calcLib::ResultFormat::fixed;
+                break;
+            case 'i':
+                calc.ieeeMode = true;
+                break;
+            default:
+                printUsage(argv[0]);
+                return option == 'h' ? 0 : 1;
+        }
+    }
+
+    calcServer server{calc, capacity};
+    if (!server.listen(path)){
+        std::cerr << "Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    runningServer = &server;
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    server.run();
+    runningServer = nullptr;
+    return 0;
+}
@@ -1,13 +1,23 @@
+#include <algorithm>
 #include <list>
 #include <vector>
 #include <iterator>
-#include <stdexcept>
 #include <cmath>
-#include <sstream>
-#include "calclib/calclib.hpp"
+#include <cstdlib>
+#include <charconv>
+#include "calclib/expression.hpp"
+#include "calclib/factorial.hpp"
+#include "calclib/jit.hpp"
+#include "degrees.hpp"
+#include "integer.hpp"
+#include "token.hpp"
 
 using namespace std::string_literals;
 
+namespace {
+    constexpr unsigned defaultJitThreshold = 1000; //! Evaluations that pay for translating an expression
+}
+
 bool Token::operator==(const Token &rhs) const {
     return (this->type == rhs.type || rhs.type == Token_type::e_none) && this->value == rhs.value;
 }
@@ -16,7 +26,8 @@ Token Token::fromLexertk(const lexertk::token& lexertk_token) {
     Token token;
     token.type = lexertk_token.type;
     if (lexertk_token.type == Token_type::e_number){
-        token.value = std::stod(lexertk_token.value);
+        token.value = std::strtod(lexertk_token.value.c_str(), nullptr);
+        token.spelling = lexertk_token.value;
     } else {
         token.value = lexertk_token.value;
     }
@@ -35,49 +46,94 @@ double calcLib::mul(double lhs, double rhs) {
     return lhs * rhs;
 }
 
-double calcLib::div(double lhs, double rhs) {
+calcLib::Status calcLib::div(double lhs, double rhs, double &outResult) {
+    outResult = lhs / rhs;
     if (rhs == 0){
-        throw std::overflow_error("Division by zero");
+        return Status::divisionByZero;
     }
-    return lhs / rhs;
+    return Status::ok;
 }
 
-#define M_DEGREE M_PI/180
 double calcLib::sin(double num) {
-    return std::sin(num*M_DEGREE);
+    return calcDegrees::sin(num);
 }
 
 double calcLib::cos(double num) {
-    return std::cos(num*M_DEGREE);
+    return calcDegrees::cos(num);
 }
 
-double calcLib::tan(double num) {
-    if (num == 90 || num == -90){
-        throw std::overflow_error("Division by zero");
+calcLib::Status calcLib::tan(double num, double &outResult) {
+    outResult = calcDegrees::tan(num);
+    return std::isinf(outResult) ? Status::divisionByZero : Status::ok;
+}
+
+void calcLib::sin(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::sinFast(num); },
+                         [](double num) { return calcDegrees::sin(num); });
+}
+
+void calcLib::cos(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::cosFast(num); },
+                         [](double num) { return calcDegrees::cos(num); });
+}
+
+void calcLib::tan(double *values, size_t count) {
+    calcDegrees::inPlace(values, count, [](double num) { return calcDegrees::tanFast(num); },
+                         [](double num) { return calcDegrees::tan(num); });
+}
+
+calcLib::Status calcLib::sqrt(double num, double &outResult) {
+    if (num < 0){
+        outResult = NAN;
+        return Status::domainError;
     }
-    return std::tan(num*M_DEGREE);
+    outResult = num == 0 ? 0 : std::sqrt(num);
+    return Status::ok;
 }
 
-double calcLib::sqrt(double num) {
-    return root(2, num);
+calcLib::Status calcLib::cbrt(double num, double &outResult) {
+    if (num < 0){
+        outResult = NAN;
+        return Status::domainError;
+    }
+    outResult = num == 0 ? 0 : std::cbrt(num);
+    return Status::ok;
 }
 
-double calcLib::mod(double lhs, double rhs) {
-    double div = calcLib::div(lhs, rhs);
+calcLib::Status calcLib::mod(double lhs, double rhs, double &outResult) {
+    if (calcInteger::mod(lhs, rhs, outResult)){
+        return Status::ok;
+    }
+    double div;
+    if (calcLib::div(lhs, rhs, div) != Status::ok){
+        outResult = NAN;
+        return Status::divisionByZero;
+    }
     double intpart;
     modf(div, &intpart);
-    return (div-intpart) * rhs;
+    outResult = (div-intpart) * rhs;
+    return Status::ok;
 }
 
-double calcLib::root(double degree, double num) {
+calcLib::Status calcLib::root(double degree, double num, double &outResult) {
+    if (degree == 2){
+        return sqrt(num, outResult);
+    }
+    if (degree == 3){
+        return cbrt(num, outResult);
+    }
     if (num < 0){
-        throw std::overflow_error("root: Undefined for argument domain");
+        outResult = NAN;
+        return Status::domainError;
     }
-    return pow(num, calcLib::div(1,degree));
+    double exponent;
+    Status status = calcLib::div(1, degree, exponent);
+    outResult = pow(num, exponent);
+    return status;
 }
 
-double calcLib::log(double base, double num) {
-    return calcLib::div(log(num),log(base));
+calcLib::Status calcLib::log(double base, double num, double &outResult) {
+    return calcLib::div(log(num), log(base), outResult);
 }
 
 double calcLib::log(double num) {
@@ -85,30 +141,166 @@ double calcLib::log(double num) {
 }
 
 double calcLib::pow(double base, double exponent) {
+    double result;
+    if (calcInteger::pow(base, exponent, result)){
+        return result;
+    }
+    if (chainedPower(exponent)){
+        return powInt(base, exponent);
+    }
     return std::pow(base, exponent);
 }
 
+double calcLib::powInt(double base, double exponent) {
+    if (!(std::abs(exponent) < 0x1p31) || std::trunc(exponent) != exponent){
+        return pow(base, exponent);
+    }
+    double result = 1;
+    double square = base;
+    for (auto bits = static_cast<uint32_t>(std::abs(exponent)); bits != 0; bits >>= 1) {
+        if ((bits & 1) != 0){
+            result *= square;
+        }
+        if (bits > 1){
+            square *= square;
+        }
+    }
+    return exponent < 0 ? 1 / result : result;
+}
+
+void calcLib::powInt(double *bases, const double *exponents, size_t count) {
+    // Compiled code raises a whole block to one constant, then the chain is applied to all values a step at a time
+    bool uniform = count > 0 && std::abs(exponents[0]) < 0x1p31 && std::trunc(exponents[0]) == exponents[0];
+    for (size_t i = 1; i < count && uniform; ++i) {
+        uniform = exponents[i] == exponents[0];
+    }
+    if (!uniform){
+        for (size_t i = 0; i < count; ++i) {
+            bases[i] = powInt(bases[i], exponents[i]);
+        }
+        return;
+    }
+    constexpr size_t chunk = 256;
+    double squares[chunk];
+    for (size_t first = 0; first < count; first += chunk) {
+        size_t size = std::min(chunk, count - first);
+        double *values = bases + first;
+        std::copy(values, values + size, squares);
+        std::fill(values, values + size, 1.0);
+        for (auto bits = static_cast<uint32_t>(std::abs(exponents[0])); bits != 0; bits >>= 1) {
+            if ((bits & 1) != 0){
+                for (size_t i = 0; i < size; ++i) {
+                    values[i] *= squares[i];
+                }
+            }
+            if (bits > 1){
+                for (size_t i = 0; i < size; ++i) {
+                    squares[i] *= squares[i];
+                }
+            }
+        }
+        if (exponents[0] < 0){
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = 1 / values[i];
+            }
+        }
+    }
+}
+
+double calcLib::min(double lhs, double rhs) {
+    // Written as a select of both operands so the loops below vectorize to compares and blends
+    return lhs < rhs || lhs != lhs ? lhs : rhs;
+}
+
+void calcLib::min(double *values, const double *others, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = min(values[i], others[i]);
+    }
+}
+
+double calcLib::max(double lhs, double rhs) {
+    return lhs > rhs || lhs != lhs ? lhs : rhs;
+}
+
+void calcLib::max(double *values, const double *others, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = max(values[i], others[i]);
+    }
+}
+
+bool calcLib::chainedPower(double exponent) {
+    return exponent == -1 || exponent == 0 || exponent == 1 || exponent == 2;
+}
+
 double calcLib::factorial(double num) {
     double intpart;
-    if (num < 0 || modf(num, &intpart) != 0.0){
+    if (modf(num, &intpart) != 0.0){
+        return gamma(num + 1);
+    }
+    if (num < 0 || std::isnan(num)){
         return NAN;
     }
-    if (num > 100){
+    if (num > calclib::maxFactorial){
+        return INFINITY;
+    }
+    return calclib::factorials[static_cast<size_t>(num)];
+}
+
+void calcLib::factorial(double *values, size_t count) {
+    // Both loops are free of branches on the values, so they vectorize
+    bool integers = true;
+    for (size_t i = 0; i < count; ++i) {
+        double num = values[i];
+        auto index = static_cast<size_t>(num >= 0 && num <= calclib::maxFactorial ? num : 0);
+        integers &= static_cast<double>(index) == num;
+    }
+    if (!integers){
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = factorial(values[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = calclib::factorials[static_cast<size_t>(values[i])];
+    }
+}
+
+double calcLib::gamma(double x) {
+    if (x < 0.5){
+        // Reflection, sin(pi*x) is taken of x reduced to [-1, 1] where pi*x rounds once
+        double reduced = x - 2 * std::round(x / 2);
+        return M_PI / (std::sin(M_PI * reduced) * gamma(1 - x));
+    }
+    if (x > calclib::gammaMax){
         return INFINITY;
     }
-    if (num <= 1){
-        return 1;
+    double power;
+    double scale;
+    // x^(x-0.5) or t^(x-0.5) is split in halves, so it does not overflow before e^-x scales it back
+    if (x >= calclib::stirlingMin){
+        double inverse = 1 / x;
+        double square = inverse * inverse;
+        double series = inverse * (1.0 / 12 - square * (1.0 / 360 - square * (1.0 / 1260 - square * (1.0 / 1680 - square / 1188))));
+        power = std::pow(x, (x - 0.5) / 2);
+        scale = std::exp(-x) * std::exp(series);
+    } else {
+        double sum = calclib::lanczosCoefficients[0];
+        for (size_t i = 1; i < std::size(calclib::lanczosCoefficients); ++i) {
+            sum += calclib::lanczosCoefficients[i] / (x - 1 + static_cast<double>(i));
+        }
+        double t = x + calclib::lanczosG - 0.5;
+        power = std::pow(t, (x - 0.5) / 2);
+        scale = std::exp(-t) * sum;
     }
-    return num * factorial(num - 1);
+    return std::sqrt(2 * M_PI) * power * (power * scale);
 }
 
-int calcLib::parseEquation(std::string_view expression, std::list<Token> &outTokens){
+calcLib::Status parseEquation(std::string_view expression, TokenList &outTokens){
     lexertk::generator generator;
 
-    if (!generator.process(expression.data()))
+    if (!generator.process(std::string(expression)))
     {
-        std::cout << "Failed to lex: " << expression << std::endl;
-        return 1;
+        return calcLib::Status::syntaxError;
     }
 
     lexertk::helper::bracket_checker bc;
@@ -116,8 +308,7 @@ int calcLib::parseEquation(std::string_view expression, std::list<Token> &outTok
 
     if (!bc.result())
     {
-        std::cout << "Failed Bracket Checker!" << std::endl;
-        return 1;
+        return calcLib::Status::syntaxError;
     }
 
     lexertk::helper::commutative_inserter ci;
@@ -130,221 +321,197 @@ int calcLib::parseEquation(std::string_view expression, std::list<Token> &outTok
         outTokens.push_back(Token::fromLexertk(t));
     }
 
-    return 0;
+    return calcLib::Status::ok;
 }
 
-double calcLib::calculateBinaryOperation(double lhs, double rhs, const Token& operation){
-    switch(operation.type){
-        case Token_type::e_add:
-            return calcLib::add(lhs, rhs);
-        case Token_type::e_sub:
-            return calcLib::sub(lhs, rhs);
-        case Token_type::e_mul:
-            return calcLib::mul(lhs, rhs);
-        case Token_type::e_div:
-            return calcLib::div(lhs, rhs);
-        case Token_type::e_pow:
-            return calcLib::pow(lhs, rhs);
+calcLib::Status calcLib::absorbStatus(Status status, unsigned *ieeeFlags) {
+    if (ieeeFlags == nullptr){
+        return status;
+    }
+    switch(status){
+        case Status::divisionByZero:
+            *ieeeFlags |= flagDivisionByZero;
+            return Status::ok;
+        case Status::domainError:
+            *ieeeFlags |= flagInvalid;
+            return Status::ok;
         default:
-            if (std::get<std::string>(operation.value) == "%"){
-                return mod(lhs,rhs);
-            }
+            return status;
     }
-    throw std::invalid_argument(std::string("Invalid operation: " + std::get<std::string>(operation.value)));
 }
 
-double calcLib::calculateUnaryOperation(double num, const Token& operation){
-    switch(operation.type){
-        case Token_type::e_add:
-            return num;
-        case Token_type::e_sub:
-            return -num;
-        default:
-            if (std::get<std::string>(operation.value) == "!"){
-                return factorial(num);
-            }
+char* calcLib::formatResult(double result, char *first, char *last) const {
+    auto [end, error] = std::to_chars(first, last, result, std::chars_format::fixed, precision);
+    if (error != std::errc()){
+        return nullptr;
+    }
+    if (format == ResultFormat::variable && std::find(first, end, '.') != end){
+        while(*(end-1) == '0'){
+            end--;
+        }
+        if(*(end-1) == '.'){
+            end--;
+        }
     }
-    throw std::invalid_argument(std::string("Invalid operation: " + std::get<std::string>(operation.value)));
+    return end;
 }
 
-void calcLib::solveBinaryOperation(std::list<Token> &tokens, const Token& operation, bool reverse){
-    while(true){
-        std::list<Token>::iterator token;
-        if (reverse){
-            auto reverse_token = std::find_if(tokens.rbegin(), tokens.rend(), [&](const Token &token){return token == operation;});
-            if (reverse_token == tokens.rend()){break;}
-            token = std::prev(reverse_token.base()); //Get as forward iterator
-        } else {
-            token = std::find_if(tokens.begin(), tokens.end(), [&](const Token &token){return token == operation;});
-            if (token == tokens.end()){break;}
-        }
+std::string calcLib::formatResult(double result) const {
+    std::string string_num(512, '\0');
+    char *end;
+    while ((end = formatResult(result, string_num.data(), string_num.data() + string_num.size())) == nullptr){
+        string_num.resize(string_num.size() * 2);
+    }
+    string_num.resize(end - string_num.data());
+    return string_num;
+}
 
-        auto previous = std::prev(token);
-        auto next = std::next(token);
-        if (previous->type == Token_type::e_number && next->type == Token_type::e_number){
-            previous->value = calculateBinaryOperation(std::get<double>(previous->value),
-                                                       std::get<double>(next->value), operation);
-            tokens.erase(token, std::next(next));
-        } else {
-            throw std::invalid_argument("Non number tokens around operators");
-        }
+const char* calcLib::statusMessage(Status status) {
+    switch(status){
+        case Status::ok:
+            return "";
+        case Status::syntaxError:
+            return "Syntax error";
+        case Status::divisionByZero:
+            return "Division by zero";
+        case Status::domainError:
+            return "Undefined for argument domain";
+        default:
+            return "Err";
     }
 }
 
-void calcLib::solveUnaryPlusMinus(std::list<Token> &tokens){
-    for(auto token = tokens.begin(); token != tokens.end(); token++){
-        if (token->type == Token_type::e_sub || token->type == Token_type::e_add){
-            auto previous = std::prev(token);
-            auto next = std::next(token);
-            if ((previous->type != Token_type::e_number && previous->type != Token_type::e_rbracket
-            && !(*previous == Token{Token_type::e_none, "!"})) && next->type == Token_type::e_number){
-                next->value = calculateUnaryOperation(std::get<double>(next->value), *token);
-                tokens.erase(token++);
-            }
-        }
+calcLib::Status calcLib::evaluate(std::string_view expression, calcSession &session, double &outResult) const {
+    compiledExpression compiled;
+    Status status = compile(expression, compiled, session.scratch);
+    if (status != Status::ok){
+        return status;
     }
+    return evaluate(compiled, session, outResult);
 }
 
-void calcLib::solveVariable(std::list<Token> &tokens, const Token& variable){
-    for(auto &token : tokens) {
-        if (token == variable){
-            token = Token{Token_type::e_number, variables.at(std::get<std::string>(token.value))};
-        }
+calcLib::Status calcLib::evaluate(const compiledExpression &expression, calcSession &session, double &outResult) const {
+    std::pmr::vector<double> slots(expression.symbols.size(), session.scratch);
+    Status status = bindSymbols(expression, session, slots.data());
+    if (status != Status::ok){
+        return status;
+    }
+    const jitExpression *native = expression.nativeCode(jitThreshold);
+    if (native == nullptr){
+        return evaluate(expression.view(), slots.data(), session, outResult);
     }
+    status = native->run(slots.data(), outResult, ieeeMode ? &session.statusFlags : nullptr);
+    if (status != Status::ok){
+        return status;
+    }
+    session.variables.find("ans")->second = outResult;
+    return Status::ok;
 }
 
-std::string calcLib::formatResult(double result){
-    std::ostringstream ostringstream;
-    ostringstream.precision(precision);
-    ostringstream << std::fixed;
-    ostringstream << result;
-    std::string string_num = ostringstream.str();
-    if (format == ResultFormat::variable){
-        if (string_num.find('.')){
-            while(*(string_num.end()-1) == '0'){
-                string_num.erase(string_num.end()-1, string_num.end());
-            }
-        }
-        if(*(string_num.end()-1) == '.'){
-            string_num.erase(string_num.end()-1, string_num.end());
-        }
+calcLib::Status calcLib::evaluate(const expressionView &expression, const double *slots, calcSession &session,
+                                  double &outResult) const {
+    Status status = expression.run(slots, outResult, ieeeMode ? &session.statusFlags : nullptr);
+    if (status != Status::ok){
+        return status;
     }
-    return string_num;
+    session.variables.find("ans")->second = outResult;
+    return Status::ok;
 }
 
-std::string calcLib::solveEquation(std::string expression) {
-    try {
-        std::replace(expression.begin(), expression.end(), ',', '.');
-        std::list<Token> tokens;
-        int result = parseEquation(expression, tokens);
-        if (result == 1){
-            return "Syntax error";
-        }
-        if (tokens.empty()){
-            return formatResult(variables.at("ans"));
-        }
-        solveVariable(tokens, Token{Token_type::e_symbol, "e"});
-        solveVariable(tokens, Token{Token_type::e_symbol, "pi"});
-        solveVariable(tokens, Token{Token_type::e_symbol, "ans"});
-        solveUnaryPlusMinus(tokens);
-        solveFunctions(tokens);
-        solveUnaryPlusMinus(tokens); // To solve 2*-sin(-2) we need to run twice.
-        solveLeftAssociativeUnary(tokens, Token{Token_type::e_none, "!"});
-        solveBinaryOperation(tokens, Token{Token_type::e_none, "%"}, false);
-        solveBinaryOperation(tokens, Token{Token_type::e_pow, "^"}, true);
-        solveBinaryOperation(tokens, Token{Token_type::e_div, "/"}, false);
-        solveBinaryOperation(tokens, Token{Token_type::e_mul, "*"}, false);
-        solveBinaryOperation(tokens, Token{Token_type::e_sub, "-"},false);
-        solveBinaryOperation(tokens, Token{Token_type::e_add, "+"},false);
-        if (tokens.begin()->type != Token_type::e_number || tokens.empty() || tokens.size() > 1){
-            return "Err";
-        }
-        variables.at("ans") = std::get<double>(tokens.begin()->value);
-        return formatResult(std::get<double>(tokens.begin()->value));
-    } catch(std::invalid_argument &err) {
-        return "Err";
-    } catch(std::overflow_error &err) {
-        return err.what();
-    } catch(...) {
-        return "Unhandled error in library";
-    }
-}
-
-void calcLib::solveLeftAssociativeUnary(std::list<Token>& tokens, const Token& operation) {
-    while(true){
-        auto token = std::find_if(tokens.begin(), tokens.end(), [&](const Token &token){return token == operation;});
-        if (token == tokens.end() || token == tokens.begin()){break;}
-        auto previous = std::prev(token);
-        if (previous->type == Token_type::e_number){
-            previous->value = calculateUnaryOperation(std::get<double>(previous->value), *token);
-            tokens.erase(token);
+calcLib::Status calcLib::bindSymbols(const compiledExpression &expression, const calcSession &session, double *outSlots) const {
+    for (size_t i = 0; i < expression.symbols.size(); ++i) {
+        Status status = bindSymbol(expression.symbols[i], session, outSlots[i]);
+        if (status != Status::ok){
+            return status;
         }
     }
+    return Status::ok;
 }
 
-double calcLib::calculateFunction(const std::vector<Token>& parameters, const Token& function) {
-    if (parameters.size() == 1){
-        Token param = parameters.at(0);
-        double num = std::get<double>(param.value);
-        if(std::get<std::string>(function.value) == "sin") {
-            return calcLib::sin(num);
-        } else if(std::get<std::string>(function.value) == "cos") {
-            return calcLib::cos(num);
-        } else if(std::get<std::string>(function.value) == "tan") {
-            return calcLib::tan(num);
-        } else if(std::get<std::string>(function.value) == "sqrt") {
-            return calcLib::sqrt(num);
-        } else if(std::get<std::string>(function.value) == "root") {
-            return calcLib::sqrt(num);
-        } else if(std::get<std::string>(function.value) == "log") {
-            return calcLib::log(num);
-        }
-    } else if (parameters.size() == 2){
-        Token param = parameters.at(0);
-        Token param2 = parameters.at(1);
-        if(std::get<std::string>(function.value) == "root") {
-            return calcLib::root(std::get<double>(param.value), std::get<double>(param2.value));
-        } else if(std::get<std::string>(function.value) == "log") {
-            return calcLib::log(std::get<double>(param.value), std::get<double>(param2.value));
-        }
+calcLib::Status calcLib::bindSymbol(std::string_view name, const calcSession &session, double &outValue) const {
+    if (session.getVariable(name, outValue)){
+        return Status::ok;
     }
-    throw std::invalid_argument("Invalid function");
-}
-
-void calcLib::solveFunctions(std::list<Token>& tokens){
-    for(auto token = std::next(tokens.begin()); token != tokens.end(); token++) {
-        auto functionName = std::prev(token);
-        if (functionName->type == Token_type::e_symbol && token->type == Token_type::e_lbracket){
-            auto next = std::next(token);
-            auto rbrace = std::next(next);
-            std::vector<Token> parameters;
-            if (next->type == Token_type::e_number && (rbrace->type == Token_type::e_rbracket || rbrace->type == Token_type::e_colon)){
-                while (next->type != Token_type::e_rbracket){
-                parameters.push_back(*next);
-                    next++;
-                    if (next->type == Token_type::e_colon){
-                        next++;
-                    }
-                }
-                rbrace = next;
-                tokens.erase(token, std::next(rbrace));
-                *functionName = Token{Token_type::e_number, calculateFunction(parameters, *functionName)};
-                token = tokens.begin();
-            } else {
-                throw std::invalid_argument("Function end not found");
-            }
-        }
+    auto constant = constants.find(name);
+    if (constant == constants.end()){
+        return Status::invalidExpression;
+    }
+    outValue = constant->second;
+    return Status::ok;
+}
+
+calcLib::Status calcLib::evaluate(std::string_view expression, double &outResult) {
+    return evaluate(expression, defaultSession, outResult);
+}
+
+std::string calcLib::solveEquation(std::string_view expression, calcSession &session) const {
+    double result;
+    Status status = evaluate(expression, session, result);
+    if (status != Status::ok){
+        return statusMessage(status);
+    }
+    return formatResult(result);
+}
+
+std::string calcLib::solveEquation(std::string expression) {
+    return solveEquation(expression, defaultSession);
+}
+
+unsigned calcLib::flags() const {
+    return defaultSession.flags();
+}
+
+void calcLib::clearFlags() {
+    defaultSession.clearFlags();
+}
+
+calcSession& calcLib::session() {
+    return defaultSession;
+}
+
+calcSession::calcSession() {
+    variables = std::map<std::string, double, std::less<>>{
+            {"ans", 0}
+    };
+    statusFlags = 0;
+    scratch = std::pmr::get_default_resource();
+}
+
+void calcSession::setVariable(const std::string &name, double value) {
+    variables[name] = value;
+}
+
+bool calcSession::getVariable(std::string_view name, double &outValue) const {
+    auto variable = variables.find(name);
+    if (variable == variables.end()){
+        return false;
     }
+    outValue = variable->second;
+    return true;
+}
+
+unsigned calcSession::flags() const {
+    return statusFlags;
+}
+
+void calcSession::clearFlags() {
+    statusFlags = 0;
+}
+
+void calcSession::setScratch(std::pmr::memory_resource *resource) {
+    scratch = resource != nullptr ? resource : std::pmr::get_default_resource();
 }
 
 calcLib::calcLib(ResultFormat format, size_t precision){
-    variables = std::map<std::string, double>{
+    constants = std::map<std::string, double, std::less<>>{
             {"pi", M_PI},
-            {"e", M_E},
-            {"ans", 0}
+            {"e", M_E}
     };
     this->format = format;
     this->precision = precision;
+    this->ieeeMode = false;
+    this->jitThreshold = defaultJitThreshold;
+    this->accuracy = Accuracy::faithful;
 }
 
 calcLib::calcLib() : calcLib(ResultFormat::variable, 8){
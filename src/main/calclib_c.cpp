@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "calclib/calclib_c.h"
+#include "calclib/expression.hpp"
+
+namespace {
+    constexpr size_t statusBlockRows = 4096; //! Rows per runColumns call of calclib_evaluate_batch
+
+    /**
+     * Runs body of a C entry point, exceptions must not cross the C interface
+     * @return result of body, CALCLIB_OUT_OF_RESOURCES if it threw
+     */
+    template<typename Body>
+    int guardedCall(Body body) noexcept {
+        try {
+            return body();
+        } catch (...) {
+            return CALCLIB_OUT_OF_RESOURCES;
+        }
+    }
+}
+
+struct calclib_context {
+    calcLib calc;
+};
+
+struct calclib_expression {
+    compiledExpression code; //! Constants such as pi are folded into code, only listed variables remain symbols
+    std::vector<int> variableOfSymbol; //! Index into the variables given to calclib_compile
+};
+
+calclib_context* calclib_create(void) {
+    try {
+        return new calclib_context();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void calclib_destroy(calclib_context *context) {
+    delete context;
+}
+
+void calclib_set_ieee_mode(calclib_context *context, int enabled) {
+    context->calc.ieeeMode = enabled != 0;
+}
+
+int calclib_compile(const calclib_context *context, const char *expression, size_t length,
+                    const char *const *variables, size_t variableCount, calclib_expression **outExpression) {
+    *outExpression = nullptr;
+    return guardedCall([&]() -> int {
+        auto compiled = std::make_unique<calclib_expression>();
+        auto status = context->calc.compile(std::string_view(expression, length), compiled->code);
+        if (status != calcLib::Status::ok){
+            return static_cast<int>(status);
+        }
+
+        // Listed variables shadow constants, like session variables do
+        calcSession session;
+        for (size_t i = 0; i < variableCount; ++i) {
+            session.setVariable(variables[i], 0);
+        }
+        const auto &symbols = compiled->code.symbols;
+        std::vector<double> values(symbols.size());
+        status = context->calc.bindSymbols(compiled->code, session, values.data());
+        if (status != calcLib::Status::ok){
+            return static_cast<int>(status);
+        }
+        std::vector<int> variableOfSymbol(symbols.size(), -1);
+        for (size_t symbol = 0; symbol < symbols.size(); ++symbol) {
+            auto found = std::find(variables, variables + variableCount, symbols[symbol]);
+            if (found != variables + variableCount){
+                variableOfSymbol[symbol] = static_cast<int>(found - variables);
+            }
+        }
+
+        // Fold the other symbols into constants and renumber the remaining ones
+        std::vector<uint32_t> renumbered(symbols.size());
+        std::vector<std::string> kept;
+        for (size_t symbol = 0; symbol < symbols.size(); ++symbol) {
+            if (variableOfSymbol[symbol] >= 0){
+                renumbered[symbol] = static_cast<uint32_t>(kept.size());
+                kept.push_back(symbols[symbol]);
+                compiled->variableOfSymbol.push_back(variableOfSymbol[symbol]);
+            }
+        }
+        // Evaluation binds the variables in a fixed buffer
+        if (kept.size() > CALCLIB_MAX_VARIABLES){
+            return CALCLIB_INVALID_EXPRESSION;
+        }
+        // Loop indices take the slots after the symbols, so they move down with them
+        auto indexSlot = [&symbols, &kept](uint32_t slot) {
+            return static_cast<uint32_t>(kept.size() + (slot - symbols.size()));
+        };
+        for (auto &instruction : compiled->code.code) {
+            if (instruction.op == compiledExpression::Opcode::endLoop){
+                instruction.operand = indexSlot(instruction.operand);
+                continue;
+            }
+            if (instruction.op != compiledExpression::Opcode::variable){
+                continue;
+            }
+            if (instruction.operand >= symbols.size()){
+                instruction.operand = indexSlot(instruction.operand);
+            } else if (variableOfSymbol[instruction.operand] >= 0){
+                instruction.operand = renumbered[instruction.operand];
+            } else {
+                instruction.op = compiledExpression::Opcode::constant;
+                compiled->code.constants.push_back(values[instruction.operand]);
+                instruction.operand = static_cast<uint32_t>(compiled->code.constants.size() - 1);
+            }
+        }
+        compiled->code.symbols = std::move(kept);
+        *outExpression = compiled.release();
+        return CALCLIB_OK;
+    });
+}
+
+void calclib_expression_free(calclib_expression *expression) {
+    delete expression;
+}
+
+int calclib_evaluate(const calclib_context *context, const calclib_expression *expression,
+                     const double *values, double *outResult, unsigned *outFlags) {
+    return guardedCall([&]() -> int {
+        double slots[CALCLIB_MAX_VARIABLES];
+        for (size_t symbol = 0; symbol < expression->variableOfSymbol.size(); ++symbol) {
+            slots[symbol] = values[expression->variableOfSymbol[symbol]];
+        }
+        unsigned flags = 0;
+        auto status = expression->code.run(slots, *outResult, context->calc.ieeeMode ? &flags : nullptr);
+        if (outFlags != nullptr){
+            *outFlags = flags;
+        }
+        return static_cast<int>(status);
+    });
+}
+
+int calclib_evaluate_batch(const calclib_context *context, const calclib_expression *expression,
+                           const double *const *columns, size_t rows, double *outResults,
+                           unsigned char *outStatus, unsigned *outFlags) {
+    return guardedCall([&]() -> int {
+        const size_t symbolCount = expression->variableOfSymbol.size();
+        const double *symbolColumns[CALCLIB_MAX_VARIABLES];
+        calcLib::Status status[statusBlockRows];
+        unsigned flags = 0;
+        int firstError = CALCLIB_OK;
+        for (size_t first = 0; first < rows; first += statusBlockRows) {
+            size_t count = std::min(statusBlockRows, rows - first);
+            for (size_t symbol = 0; symbol < symbolCount; ++symbol) {
+                symbolColumns[symbol] = columns[expression->variableOfSymbol[symbol]] + first;
+            }
+            expression->code.runColumns(symbolColumns, count, outResults + first, status,
+                                        context->calc.ieeeMode ? &flags : nullptr);
+            for (size_t i = 0; i < count; ++i) {
+                int rowStatus = static_cast<int>(status[i]);
+                if (outStatus != nullptr){
+                    outStatus[first + i] = static_cast<unsigned char>(rowStatus);
+                }
+                if (firstError == CALCLIB_OK){
+                    firstError = rowStatus;
+                }
+            }
+        }
+        if (outFlags != nullptr){
+            *outFlags = flags;
+        }
+        return firstError;
+    });
+}
+
+const char* calclib_status_message(int status) {
+    if (status == CALCLIB_OUT_OF_RESOURCES){
+        return "Out of memory";
+    }
+    return calcLib::statusMessage(static_cast<calcLib::Status>(status));
+}
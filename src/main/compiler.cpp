@@ -0,0 +1,977 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <tuple>
+#include "calclib/bignum.hpp"
+#include "calclib/double_double.hpp"
+#include "calclib/grammar.hpp"
+#include "calclib/scalar.hpp"
+#include "token.hpp"
+
+namespace {
+
+using Opcode = compiledExpression::Opcode;
+using Status = calcLib::Status;
+
+using calcGrammar::maxNesting;
+using calcGrammar::firstIndexSymbol;
+
+constexpr uint32_t maxSeriesDegree = 10; //! Sums of higher powers of the index are evaluated term by term
+constexpr size_t maxInlinedNodes = size_t(1) << 20; //! Bound on the tree grown by functions calling others more than once
+
+/**
+ * Folds an operation on constants of the double engine, with the functions of the accuracy tier
+ */
+Status foldOperation(Opcode op, double lhs, double rhs, double &outResult, calcLib::Accuracy accuracy) {
+    return compiledExpression::apply(op, lhs, rhs, outResult, accuracy);
+}
+
+/**
+ * Folds an operation on constants of a basicExpression engine, in its own precision
+ */
+template<typename Scalar>
+Status foldOperation(Opcode op, Scalar lhs, Scalar rhs, Scalar &outResult, calcLib::Accuracy) {
+    return basicExpression<Scalar>::apply(op, lhs, rhs, outResult);
+}
+
+/**
+ * @return value of a number token, converted from its spelling unless Scalar is double
+ */
+template<typename Scalar>
+Scalar numberValue(const Token &token) {
+    if constexpr (std::is_same_v<Scalar, double>){
+        return std::get<double>(token.value);
+    } else {
+        return scalarTraits<Scalar>::parse(token.spelling);
+    }
+}
+
+/**
+ * @return entry of calcGrammar::comparisons lexed as token, nullptr if token is not a comparison
+ */
+const calcGrammar::comparison* comparisonOf(const Token &token) {
+    switch (token.type) {
+        case Token_type::e_lt:
+        case Token_type::e_lte:
+        case Token_type::e_gt:
+        case Token_type::e_gte:
+        case Token_type::e_eq:
+        case Token_type::e_ne:
+            break;
+        default:
+            return nullptr;
+    }
+    std::string symbol = lexertk::token::to_str(token.type);
+    for (const auto &comparison : calcGrammar::comparisons) {
+        if (symbol == comparison.symbol){
+            return &comparison;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Node of the syntax tree. Children are indices into the node array, -1 if unused.
+ */
+template<typename Scalar>
+struct syntaxNode {
+    Opcode op;
+    Scalar value; //! Value of Opcode::constant
+    //! Symbol index of Opcode::variable or firstIndexSymbol plus the level of the loop, degree of Opcode::polynomial,
+    //! nesting level of Opcode::sum and Opcode::product counted from 0, number of constants of Opcode::series
+    uint32_t symbol;
+    int32_t lhs;
+    int32_t rhs;
+    int32_t addend = -1; //! Third operand of Opcode::fma and Opcode::select, body of Opcode::sum and Opcode::product
+    //! First of the degree + 1 constant nodes of Opcode::polynomial, from x^0 up, first constant node of Opcode::series,
+    //! first of the two factors of an Opcode::constant folded from a product that is contracted, see expressionParser
+    int32_t coefficients = -1;
+};
+
+/**
+ * Recursive descent parser building a constant folded syntax tree from tokens. Calls of functions of
+ * calcLib::define are parsed from their body with the parameters bound to the argument subtrees.
+ */
+template<typename Scalar>
+class expressionParser {
+    using syntaxNode = ::syntaxNode<Scalar>;
+
+    struct boundIndex {
+        const std::string *name; //! nullptr hides the indices below it from an inlined body
+        uint32_t level;
+    };
+    struct inlinedCall {
+        const std::string *name;
+        const userFunction *function;
+        std::vector<int32_t> arguments; //! Subtree of each parameter
+    };
+
+    TokenList::const_iterator current;
+    TokenList::const_iterator end;
+    std::pmr::vector<syntaxNode> &nodes;
+    std::vector<std::string> &symbols;
+    calcLib::Accuracy accuracy;
+    const userFunctions &functions;
+    unsigned nesting = 0;
+    std::vector<boundIndex> indices; //! Indices of the loops around the current token
+    uint32_t loopLevel = 0; //! Number of loops around the current token
+    std::vector<inlinedCall> calls; //! Functions whose bodies are being parsed, innermost last
+    bool contract; //! Fold sums of products like lowerNodes contracts them
+public:
+    /**
+     * @param contract true for a compiledExpression, whose sums of products lowerNodes contracts. Sums of constants
+     *                 are then folded with the same single rounding, so a literal gives the bits of a variable.
+     */
+    expressionParser(const TokenList &tokens, std::pmr::vector<syntaxNode> &nodes, std::vector<std::string> &symbols,
+                     calcLib::Accuracy accuracy, const userFunctions &functions, bool contract)
+        : current(tokens.begin()), end(tokens.end()), nodes(nodes), symbols(symbols), accuracy(accuracy),
+          functions(functions), contract(contract) {}
+
+    /**
+     * @return index of the root node or -1 if tokens do not form an expression
+     */
+    int32_t parse() {
+        int32_t root = parseComparison();
+        if (root < 0 || current != end){
+            return -1;
+        }
+        return root;
+    }
+
+    /**
+     * Parses the body of a function being defined, with its parameters read as variables
+     * @param name of the function, a call of it in the body is recursion
+     * @param function
+     * @return index of the root node or -1 if the body is malformed or recursive
+     */
+    int32_t parseDefinition(const std::string &name, const userFunction &function) {
+        std::vector<int32_t> arguments;
+        for (const auto &parameter : function.parameters) {
+            arguments.push_back(makeVariable(parameter));
+        }
+        return inlineBody(name, function, std::move(arguments));
+    }
+
+private:
+    bool accept(Token_type type) {
+        if (current != end && current->type == type){
+            ++current;
+            return true;
+        }
+        return false;
+    }
+
+    int32_t parseComparison() {
+        int32_t lhs = parseLevel(0);
+        while (lhs >= 0 && current != end) {
+            const calcGrammar::comparison *comparison = comparisonOf(*current);
+            if (comparison == nullptr){
+                break;
+            }
+            ++current;
+            int32_t rhs = parseLevel(0);
+            if (rhs < 0){
+                return -1;
+            }
+            lhs = makeNode(comparison->op, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    int32_t parseLevel(size_t level) {
+        if (level == calcGrammar::binaryLevelCount){
+            return parsePostfix();
+        }
+        const calcGrammar::binaryLevel &binary = calcGrammar::binaryLevels[level];
+        int32_t lhs = parseLevel(level + 1);
+        while (lhs >= 0 && accept(static_cast<Token_type>(binary.symbol))) {
+            int32_t rhs;
+            if (binary.rightAssociative){
+                if (++nesting > maxNesting){
+                    return -1;
+                }
+                rhs = parseLevel(level);
+                nesting--;
+            } else {
+                rhs = parseLevel(level + 1);
+            }
+            if (rhs < 0){
+                return -1;
+            }
+            lhs = makeNode(binary.op, lhs, rhs);
+        }
+        return lhs;
+    }
+
+    int32_t parsePostfix() {
+        int32_t operand = parseUnary();
+        while (operand >= 0 && accept(static_cast<Token_type>(calcGrammar::factorialSymbol))) {
+            operand = makeNode(Opcode::factorial, operand, -1);
+        }
+        return operand;
+    }
+
+    int32_t parseUnary() {
+        if (current == end || ++nesting > maxNesting){
+            return -1;
+        }
+        int32_t operand;
+        if (accept(Token_type::e_sub)){
+            operand = parseUnary();
+            operand = operand < 0 ? -1 : makeNode(Opcode::negate, operand, -1);
+        } else if (accept(Token_type::e_add)){
+            operand = parseUnary();
+        } else {
+            operand = parsePrimary();
+        }
+        nesting--;
+        return operand;
+    }
+
+    int32_t parsePrimary() {
+        const Token &token = *current++;
+        switch (token.type) {
+            case Token_type::e_number:
+                return makeConstant(numberValue<Scalar>(token));
+            case Token_type::e_lbracket: {
+                int32_t inner = parseComparison();
+                return accept(Token_type::e_rbracket) ? inner : -1;
+            }
+            case Token_type::e_symbol: {
+                const auto &name = std::get<std::string>(token.value);
+                if (accept(Token_type::e_lbracket)){
+                    bool loop = (name == calcGrammar::sumFunction || name == calcGrammar::productFunction)
+                                && std::distance(current, end) >= 2 && current->type == Token_type::e_symbol
+                                && std::next(current)->type == static_cast<Token_type>(calcGrammar::parameterSeparator);
+                    if (loop){
+                        return parseLoop(name == calcGrammar::sumFunction ? Opcode::sum : Opcode::product);
+                    }
+                    auto function = functions.find(name);
+                    if (function != functions.end()){
+                        return parseUserCall(name, *function->second);
+                    }
+                    return parseCall(name);
+                }
+                for (size_t i = indices.size(); i-- > 0 && indices[i].name != nullptr;) {
+                    if (*indices[i].name == name){
+                        nodes.push_back(syntaxNode{Opcode::variable, 0, firstIndexSymbol + indices[i].level, -1, -1});
+                        return static_cast<int32_t>(nodes.size() - 1);
+                    }
+                }
+                if (!calls.empty()){
+                    const inlinedCall &call = calls.back();
+                    auto parameter = std::find(call.function->parameters.begin(), call.function->parameters.end(), name);
+                    if (parameter != call.function->parameters.end()){
+                        return cloneTree(call.arguments[parameter - call.function->parameters.begin()]);
+                    }
+                }
+                return makeVariable(name);
+            }
+            default:
+                return -1;
+        }
+    }
+
+    /**
+     * Parses parameters delimited with colon up to the right bracket
+     */
+    int32_t parseCall(const std::string &name) {
+        int32_t parameters[calcGrammar::maxParameters];
+        unsigned count = 0;
+        do {
+            int32_t parameter = parseComparison();
+            if (parameter < 0 || count == calcGrammar::maxParameters){
+                return -1;
+            }
+            parameters[count++] = parameter;
+        } while (accept(static_cast<Token_type>(calcGrammar::parameterSeparator)));
+        if (!accept(Token_type::e_rbracket)){
+            return -1;
+        }
+        if (count == 3 && name == calcGrammar::conditionalFunction){
+            return makeConditional(parameters[0], parameters[1], parameters[2]);
+        }
+        if (count == 3 && name == calcGrammar::clampFunction){
+            return makeNode(Opcode::min, makeNode(Opcode::max, parameters[0], parameters[1]), parameters[2]);
+        }
+        for (const auto &function : calcGrammar::builtinFunctions) {
+            if (function.parameters == count && name == function.name){
+                return makeNode(function.op, parameters[0], count == 2 ? parameters[1] : -1);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Parses index:lo:hi:body) of a sum or product. The index hides a variable of the same name only within body.
+     */
+    int32_t parseLoop(Opcode op) {
+        const auto &index = std::get<std::string>(current->value);
+        std::advance(current, 2);
+        int32_t lo = parseComparison();
+        if (lo < 0 || !accept(static_cast<Token_type>(calcGrammar::parameterSeparator))){
+            return -1;
+        }
+        int32_t hi = parseComparison();
+        if (hi < 0 || !accept(static_cast<Token_type>(calcGrammar::parameterSeparator))){
+            return -1;
+        }
+        uint32_t level = loopLevel++;
+        indices.push_back({&index, level});
+        int32_t body = parseComparison();
+        indices.pop_back();
+        loopLevel--;
+        if (body < 0 || !accept(Token_type::e_rbracket)){
+            return -1;
+        }
+        nodes.push_back(syntaxNode{op, 0, level, lo, hi, body});
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * Parses the arguments of a function of calcLib::define up to the right bracket and inlines its body
+     */
+    int32_t parseUserCall(const std::string &name, const userFunction &function) {
+        std::vector<int32_t> arguments;
+        do {
+            int32_t argument = parseComparison();
+            if (argument < 0){
+                return -1;
+            }
+            arguments.push_back(argument);
+        } while (accept(static_cast<Token_type>(calcGrammar::parameterSeparator)));
+        if (!accept(Token_type::e_rbracket) || arguments.size() != function.parameters.size()){
+            return -1;
+        }
+        return inlineBody(name, function, std::move(arguments));
+    }
+
+    /**
+     * Parses the body of function in place of a call. Indices of the loops around the call are hidden, so only
+     * the parameters and variables of the caller are visible.
+     * @param arguments subtree bound to each parameter
+     * @return root of the inlined body, -1 if it is malformed or function is already being inlined
+     */
+    int32_t inlineBody(const std::string &name, const userFunction &function, std::vector<int32_t> arguments) {
+        bool recursive = std::any_of(calls.begin(), calls.end(), [&name](const inlinedCall &call) { return *call.name == name; });
+        if (recursive || nodes.size() > maxInlinedNodes){
+            return -1;
+        }
+        auto caller = std::make_pair(current, end);
+        current = function.body.begin();
+        end = function.body.end();
+        calls.push_back({&name, &function, std::move(arguments)});
+        indices.push_back({nullptr, 0});
+        int32_t root = parseComparison();
+        bool complete = root >= 0 && current == end;
+        indices.pop_back();
+        calls.pop_back();
+        std::tie(current, end) = caller;
+        return complete ? root : -1;
+    }
+
+    /**
+     * Copies the subtree at root for a use of an argument, so that the syntax tree stays a tree whose nodes
+     * later passes may rewrite in place
+     */
+    int32_t cloneTree(int32_t root) {
+        // Operands precede their operation, so copying in index order finds the copies of the operands made
+        std::vector<int32_t> subtree{root};
+        for (size_t i = 0; i < subtree.size(); ++i) {
+            const syntaxNode &node = nodes[subtree[i]];
+            for (int32_t child : {node.lhs, node.rhs, node.addend}) {
+                if (child >= 0){
+                    subtree.push_back(child);
+                }
+            }
+        }
+        std::sort(subtree.begin(), subtree.end());
+        auto first = static_cast<int32_t>(nodes.size());
+        auto copied = [&subtree, first](int32_t child) {
+            if (child < 0){
+                return -1;
+            }
+            return first + static_cast<int32_t>(std::lower_bound(subtree.begin(), subtree.end(), child) - subtree.begin());
+        };
+        for (int32_t index : subtree) {
+            syntaxNode node = nodes[index];
+            node.lhs = copied(node.lhs);
+            node.rhs = copied(node.rhs);
+            node.addend = copied(node.addend);
+            nodes.push_back(node);
+        }
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    int32_t makeConstant(Scalar value) {
+        nodes.push_back(syntaxNode{Opcode::constant, value, 0, -1, -1});
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    int32_t makeVariable(const std::string &name) {
+        auto symbol = std::find(symbols.begin(), symbols.end(), name);
+        if (symbol == symbols.end()){
+            symbol = symbols.insert(symbols.end(), name);
+        }
+        nodes.push_back(syntaxNode{Opcode::variable, 0, static_cast<uint32_t>(symbol - symbols.begin()), -1, -1});
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * Creates operation node. Operations on constants that succeed are folded into a constant,
+     * failing ones are kept so the error is reported when the expression is evaluated. With contract, a folded
+     * product keeps copies of its factors, and a sum of it is folded into their fma.
+     */
+    int32_t makeNode(Opcode op, int32_t lhs, int32_t rhs) {
+        bool foldable = nodes[lhs].op == Opcode::constant && (rhs < 0 || nodes[rhs].op == Opcode::constant);
+        if (foldable){
+            Scalar result;
+            if (foldOperation(op, nodes[lhs].value, rhs < 0 ? Scalar(0) : nodes[rhs].value, result, accuracy) == Status::ok){
+                if (!contract){
+                    return makeConstant(result);
+                }
+                if (op == Opcode::add || op == Opcode::sub){
+                    result = contracted(op, lhs, rhs, result);
+                }
+                auto factors = static_cast<int32_t>(nodes.size());
+                if (op == Opcode::mul){
+                    makeConstant(nodes[lhs].value);
+                    makeConstant(nodes[rhs].value);
+                }
+                int32_t folded = makeConstant(result);
+                nodes[folded].coefficients = op == Opcode::mul ? factors : -1;
+                return folded;
+            }
+        }
+        nodes.push_back(syntaxNode{op, 0, 0, lhs, rhs});
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * @param sum lhs op rhs rounded twice
+     * @return sum of the constants lhs and rhs rounded once if one of them is a folded product, as lowerNodes
+     *         rounds the fma it makes when the product has variables
+     */
+    Scalar contracted(Opcode op, int32_t lhs, int32_t rhs, Scalar sum) const {
+        if constexpr (std::is_same_v<Scalar, double>){
+            bool subtract = op == Opcode::sub;
+            if (nodes[lhs].coefficients >= 0){
+                const syntaxNode *product = &nodes[nodes[lhs].coefficients];
+                return std::fma(product[0].value, product[1].value, subtract ? -nodes[rhs].value : nodes[rhs].value);
+            }
+            if (nodes[rhs].coefficients >= 0){
+                const syntaxNode *product = &nodes[nodes[rhs].coefficients];
+                return std::fma(subtract ? -product[0].value : product[0].value, product[1].value, nodes[lhs].value);
+            }
+        }
+        return sum;
+    }
+
+    /**
+     * Creates Opcode::select node. With a constant condition it is folded into the branch taken if that branch is
+     * a constant and the other one has no variables, which is when calclib/dsl.hpp folds it.
+     */
+    int32_t makeConditional(int32_t condition, int32_t then, int32_t otherwise) {
+        if (nodes[condition].op == Opcode::constant){
+            bool taken = nodes[condition].value != Scalar(0);
+            if (nodes[taken ? then : otherwise].op == Opcode::constant && !hasVariables(taken ? otherwise : then)){
+                return taken ? then : otherwise;
+            }
+        }
+        nodes.push_back(syntaxNode{Opcode::select, 0, 0, condition, then, otherwise});
+        return static_cast<int32_t>(nodes.size() - 1);
+    }
+
+    /**
+     * @return true if the subtree at root reads a variable
+     */
+    bool hasVariables(int32_t root) const {
+        std::pmr::vector<int32_t> work(1, root, nodes.get_allocator());
+        while (!work.empty()) {
+            const syntaxNode &node = nodes[work.back()];
+            work.pop_back();
+            if (node.op == Opcode::variable){
+                return true;
+            }
+            for (int32_t child : {node.lhs, node.rhs, node.addend}) {
+                if (child >= 0){
+                    work.push_back(child);
+                }
+            }
+        }
+        return false;
+    }
+};
+
+/**
+ * @return terms of Q with Q(0) = 0 and Q(m) - Q(m - 1) = p(m) for the polynomial p, from Faulhaber's formula for
+ *         the sum of i^k over i = 1..m
+ */
+polynomialTerms summedTerms(const polynomialTerms &terms) {
+    constexpr uint32_t size = maxSeriesDegree + 2;
+    long double binomial[size][size] = {};
+    for (uint32_t n = 0; n < size; ++n) {
+        binomial[n][0] = 1;
+        for (uint32_t j = 1; j <= n; ++j) {
+            binomial[n][j] = binomial[n - 1][j - 1] + binomial[n - 1][j];
+        }
+    }
+    long double bernoulli[size] = {1};
+    for (uint32_t m = 1; m < size; ++m) {
+        for (uint32_t j = 0; j < m; ++j) {
+            bernoulli[m] -= binomial[m + 1][j] * bernoulli[j] / (m + 1);
+        }
+    }
+    // The formula wants B1 = +1/2
+    bernoulli[1] = -bernoulli[1];
+    long double summed[size] = {};
+    for (uint32_t k = 0; k <= terms.degree; ++k) {
+        for (uint32_t j = 0; j <= k; ++j) {
+            summed[k + 1 - j] += terms.coefficients[k] * binomial[k + 1][j] * bernoulli[j] / (k + 1);
+        }
+    }
+    polynomialTerms result;
+    result.variable = terms.variable;
+    result.degree = terms.degree + 1;
+    std::copy(summed, summed + result.degree + 1, result.coefficients);
+    return result;
+}
+
+/**
+ * Replaces the sum or product at index with Opcode::series if compiledExpression::series has a closed form for
+ * its body: a polynomial of degree up to maxSeriesDegree in the index, c*r^i or, for a product, a constant.
+ * With constant bounds the closed form is folded.
+ * @param body terms of the body, valid if it is a polynomial in a single variable or a constant
+ * @return true if the body is no longer needed
+ */
+bool closedForm(std::pmr::vector<syntaxNode<double>> &nodes, int32_t index, bool valid, const polynomialTerms &body) {
+    const syntaxNode<double> node = nodes[index];
+    int64_t indexSymbol = firstIndexSymbol + node.symbol;
+    auto indexNode = [&nodes, indexSymbol](int32_t child) {
+        return nodes[child].op == Opcode::variable && nodes[child].symbol == indexSymbol;
+    };
+    std::vector<double> terms;
+    valid = valid && (body.variable < 0 || body.variable == indexSymbol);
+    if (node.op == Opcode::product){
+        if (valid && body.degree == 0){
+            terms = {2, body.coefficients[0]};
+        }
+    } else if (valid && body.degree <= maxSeriesDegree){
+        polynomialTerms summed = summedTerms(body);
+        // Sized once and filled by index, GCC cannot bound a range insert from the fixed array with LTO
+        terms.resize(summed.degree + 3);
+        terms[0] = 0;
+        terms[1] = summed.degree;
+        for (uint32_t k = 0; k <= summed.degree; ++k) {
+            terms[k + 2] = summed.coefficients[k];
+        }
+    } else {
+        // c*r^i, r^i*c or r^i with constants c and r
+        int32_t power = nodes[node.addend].op == Opcode::mul ? nodes[node.addend].rhs : node.addend;
+        int32_t factor = nodes[node.addend].op == Opcode::mul ? nodes[node.addend].lhs : -1;
+        if (factor >= 0 && nodes[power].op != Opcode::pow){
+            std::swap(power, factor);
+        }
+        bool geometric = nodes[power].op == Opcode::pow && nodes[nodes[power].lhs].op == Opcode::constant
+                         && indexNode(nodes[power].rhs) && (factor < 0 || nodes[factor].op == Opcode::constant);
+        if (geometric){
+            double ratio = nodes[nodes[power].lhs].value;
+            double coefficient = factor < 0 ? 1 : nodes[factor].value;
+            // A ratio of 1 would divide by zero, its sum is polynomial
+            terms = ratio == 1 ? std::vector<double>{0, 1, 0, coefficient} : std::vector<double>{1, coefficient, ratio};
+        }
+    }
+    // Overflowed terms would give NaN where adding the terms gives inf
+    if (terms.empty() || !std::all_of(terms.begin(), terms.end(), [](double term) { return std::isfinite(term); })){
+        return false;
+    }
+    double folded;
+    if (nodes[node.lhs].op == Opcode::constant && nodes[node.rhs].op == Opcode::constant
+        && compiledExpression::series(terms.data(), nodes[node.lhs].value, nodes[node.rhs].value, folded) == Status::ok){
+        nodes[index] = {Opcode::constant, folded, 0, -1, -1};
+        return true;
+    }
+    auto first = static_cast<int32_t>(nodes.size());
+    for (double term : terms) {
+        nodes.push_back(syntaxNode<double>{Opcode::constant, term, 0, -1, -1});
+    }
+    nodes[index] = {Opcode::series, 0, static_cast<uint32_t>(terms.size()), node.lhs, node.rhs, -1, first};
+    return true;
+}
+
+/**
+ * Replaces the largest subtrees of a compiledExpression that are polynomials in one variable, such as
+ * 3*x^4+2*x^3-x+7, with Opcode::polynomial, see polynomialTerms. A subtree is collected if it is collectable and
+ * none of the subtrees containing it is, calclib/dsl.hpp checks the same from the root down. Sums and products
+ * with a closed form become Opcode::series, see closedForm.
+ * Iterative like generateCode, the values of the children are kept on a stack in postfix order.
+ */
+void collectPolynomials(std::pmr::vector<syntaxNode<double>> &nodes, int32_t root) {
+    struct collected {
+        int32_t node;
+        bool valid; //! terms hold the subtree
+        int32_t variable; //! A variable node of the subtree, -1 if it has none
+        polynomialTerms terms;
+    };
+    auto rewrite = [&nodes](const collected &polynomial) {
+        auto coefficients = static_cast<int32_t>(nodes.size());
+        for (uint32_t k = 0; k <= polynomial.terms.degree; ++k) {
+            nodes.push_back(syntaxNode<double>{Opcode::constant, polynomial.terms.coefficients[k], 0, -1, -1});
+        }
+        nodes[polynomial.node] = {Opcode::polynomial, 0, polynomial.terms.degree, polynomial.variable, -1, -1, coefficients};
+    };
+    struct pending {
+        int32_t node;
+        bool expanded;
+    };
+    std::pmr::vector<pending> work(nodes.get_allocator());
+    std::pmr::vector<collected> values(nodes.get_allocator());
+    work.push_back({root, false});
+    while (!work.empty()) {
+        pending item = work.back();
+        work.pop_back();
+        const syntaxNode<double> node = nodes[item.node];
+        if (!item.expanded && node.lhs >= 0){
+            work.push_back({item.node, true});
+            if (node.addend >= 0){
+                work.push_back({node.addend, false});
+            }
+            if (node.rhs >= 0){
+                work.push_back({node.rhs, false});
+            }
+            work.push_back({node.lhs, false});
+            continue;
+        }
+        collected result{item.node, true, -1, {}};
+        if (node.op == Opcode::constant){
+            result.terms = polynomialTerms::constant(node.value);
+        } else if (node.op == Opcode::variable){
+            result.variable = item.node;
+            result.terms = polynomialTerms::symbol(node.symbol);
+        } else {
+            size_t operands = 1 + (node.rhs >= 0 ? 1 : 0) + (node.addend >= 0 ? 1 : 0);
+            const collected &lhs = values[values.size() - operands];
+            const collected &rhs = values.back();
+            result.variable = std::max(lhs.variable, rhs.variable);
+            result.terms = lhs.terms;
+            result.valid = lhs.valid && rhs.valid && result.terms.apply(node.op, rhs.terms);
+            // The body is the last operand, it is not emitted once replaced
+            bool closed = (node.op == Opcode::sum || node.op == Opcode::product)
+                          && closedForm(nodes, item.node, rhs.valid, rhs.terms);
+            if (!result.valid || !result.terms.collectable()){
+                for (size_t i = values.size() - operands; i < values.size() - (closed ? 1 : 0); ++i) {
+                    if (values[i].valid && values[i].terms.collectable()){
+                        rewrite(values[i]);
+                    }
+                }
+            }
+            values.resize(values.size() - operands);
+            if (closed && nodes[item.node].op == Opcode::constant){
+                result = {item.node, true, -1, polynomialTerms::constant(nodes[item.node].value)};
+            }
+        }
+        values.push_back(result);
+    }
+    if (values.back().valid && values.back().terms.collectable()){
+        rewrite(values.back());
+    }
+}
+
+/**
+ * Rewrites the folded tree of a compiledExpression into cheaper operations:
+ * - a*b+c, a*b-c, c+a*b and c-a*b become Opcode::fma, rounded once
+ * - root(2:x) and root(3:x) become Opcode::sqrt and Opcode::cbrt
+ * - x^n becomes Opcode::powInt for the exponents of compiledExpression::chainedPower
+ * - division by a power of two becomes multiplication by its exact reciprocal
+ * Apart from the contraction every rewrite returns the bits of the operation it replaces, because the helpers
+ * take the same paths for these operands. c±a*b evaluates c last, so it is contracted only if c or the
+ * product cannot fail and the first error stays the same. calclib/dsl.hpp applies the same rules, and
+ * expressionParser folds sums of constant products with the same single rounding.
+ */
+void lowerNodes(std::pmr::vector<syntaxNode<double>> &nodes, calcLib::Accuracy accuracy) {
+    struct subtree {
+        bool constant; //! Without variables, a failed fold
+        bool fallible; //! An operation can fail
+    };
+    std::pmr::vector<subtree> subtrees(nodes.get_allocator());
+    auto product = [&nodes, &subtrees](int32_t index) {
+        return nodes[index].op == Opcode::mul && !subtrees[index].constant;
+    };
+    auto negated = [&nodes](int32_t index) {
+        if (nodes[index].op == Opcode::constant){
+            nodes.push_back(syntaxNode<double>{Opcode::constant, -nodes[index].value, 0, -1, -1});
+        } else {
+            nodes.push_back(syntaxNode<double>{Opcode::negate, 0, 0, index, -1});
+        }
+        return static_cast<int32_t>(nodes.size() - 1);
+    };
+    // Operands precede the operation, so a pass in order has their flags. Nodes appended by negated are visited too.
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        syntaxNode<double> node = nodes[i];
+        subtrees.resize(nodes.size());
+        subtree flags{node.op != Opcode::variable, compiledExpression::fallible(node.op)};
+        for (int32_t child : {node.lhs, node.rhs, node.addend}) {
+            if (child >= 0){
+                flags.constant &= subtrees[child].constant;
+                flags.fallible |= subtrees[child].fallible;
+            }
+        }
+        subtrees[i] = flags;
+        bool constantRhs = node.rhs >= 0 && nodes[node.rhs].op == Opcode::constant;
+        bool subtract = node.op == Opcode::sub;
+        if (node.op == Opcode::root && nodes[node.lhs].op == Opcode::constant
+            && (nodes[node.lhs].value == 2 || nodes[node.lhs].value == 3)){
+            nodes[i] = {nodes[node.lhs].value == 2 ? Opcode::sqrt : Opcode::cbrt, 0, 0, node.rhs, -1};
+        } else if (node.op == Opcode::pow && constantRhs && compiledExpression::chainedPower(nodes[node.rhs].value, accuracy)){
+            nodes[i].op = Opcode::powInt;
+        } else if ((node.op == Opcode::add || subtract) && product(node.lhs)){
+            int32_t addend = subtract ? negated(node.rhs) : node.rhs;
+            nodes[i] = {Opcode::fma, 0, 0, nodes[node.lhs].lhs, nodes[node.lhs].rhs, addend};
+        } else if ((node.op == Opcode::add || subtract) && product(node.rhs)
+                   && (!subtrees[node.lhs].fallible || !subtrees[node.rhs].fallible)){
+            int32_t factor = subtract ? negated(nodes[node.rhs].lhs) : nodes[node.rhs].lhs;
+            nodes[i] = {Opcode::fma, 0, 0, factor, nodes[node.rhs].rhs, node.lhs};
+        }
+    }
+    // After the contraction, which only takes products written as such
+    for (auto &node : nodes) {
+        double reciprocal;
+        if (node.op == Opcode::div && nodes[node.rhs].op == Opcode::constant
+            && compiledExpression::exactReciprocal(nodes[node.rhs].value, reciprocal)){
+            node.op = Opcode::mul;
+            nodes[node.rhs].value = reciprocal;
+        }
+    }
+}
+
+/**
+ * Emits instructions of the tree in postfix order. Iterative, so long sums do not exhaust the call stack.
+ * Tiered functions carry accuracy in their operand. Opcode::select emits a branch after its condition and a jump
+ * after its then operand, whose targets are filled in once they are emitted. Opcode::sum and Opcode::product are
+ * emitted after their bounds, followed by the body and Opcode::endLoop, see compiledExpression::Opcode. Indices
+ * take the slots after the symbols.
+ */
+template<typename Scalar, typename Target>
+void generateCode(const std::pmr::vector<syntaxNode<Scalar>> &nodes, int32_t root, calcLib::Accuracy accuracy,
+                  Target &outExpression) {
+    enum class step : uint8_t {
+        expand,
+        emit,
+        branch,
+        jump,
+        loop
+    };
+    struct pending {
+        int32_t node;
+        step next;
+    };
+    std::pmr::vector<pending> work(nodes.get_allocator());
+    std::pmr::vector<size_t> unpatched(nodes.get_allocator()); // Branch or jump of every open conditional, opener of every loop
+    std::pmr::vector<uint32_t> loopDepths(nodes.get_allocator()); // Depth around every open loop body
+    work.push_back({root, step::expand});
+    uint32_t depth = 0;
+    while (!work.empty()) {
+        pending item = work.back();
+        work.pop_back();
+        const syntaxNode<Scalar> &node = nodes[item.node];
+        if (item.next == step::expand && node.lhs >= 0){
+            work.push_back({item.node, step::emit});
+            if (node.op == Opcode::select){
+                work.push_back({node.addend, step::expand});
+                work.push_back({item.node, step::jump});
+                work.push_back({node.rhs, step::expand});
+                work.push_back({item.node, step::branch});
+            } else if (node.op == Opcode::sum || node.op == Opcode::product){
+                work.push_back({node.addend, step::expand});
+                work.push_back({item.node, step::loop});
+                work.push_back({node.rhs, step::expand});
+            } else {
+                if (node.addend >= 0){
+                    work.push_back({node.addend, step::expand});
+                }
+                if (node.rhs >= 0){
+                    work.push_back({node.rhs, step::expand});
+                }
+            }
+            work.push_back({node.lhs, step::expand});
+            continue;
+        }
+        if (item.next == step::branch || item.next == step::jump){
+            if (item.next == step::jump){
+                // The branch continues after this jump when the condition is zero
+                outExpression.code[unpatched.back()].operand = static_cast<uint32_t>(outExpression.code.size() + 1);
+                unpatched.pop_back();
+            }
+            unpatched.push_back(outExpression.code.size());
+            outExpression.code.push_back({item.next == step::branch ? Opcode::branch : Opcode::jump, 0});
+            continue;
+        }
+        if (item.next == step::loop){
+            // The body starts on a stack of its own
+            unpatched.push_back(outExpression.code.size());
+            outExpression.code.push_back({node.op, 0});
+            loopDepths.push_back(depth);
+            depth = 0;
+            continue;
+        }
+        switch (node.op) {
+            case Opcode::constant:
+                outExpression.code.push_back({node.op, static_cast<uint32_t>(outExpression.constants.size())});
+                outExpression.constants.push_back(node.value);
+                depth++;
+                break;
+            case Opcode::variable: {
+                auto symbolCount = static_cast<uint32_t>(outExpression.symbols.size());
+                outExpression.code.push_back({node.op, node.symbol >= firstIndexSymbol ? symbolCount + node.symbol - firstIndexSymbol : node.symbol});
+                depth++;
+                break;
+            }
+            case Opcode::polynomial:
+                // Only the double engine collects polynomials
+                if constexpr (std::is_same_v<Target, compiledExpression>){
+                    outExpression.code.push_back({node.op, static_cast<uint32_t>(outExpression.constants.size())});
+                    outExpression.constants.push_back(node.symbol);
+                    for (uint32_t k = 0; k <= node.symbol; ++k) {
+                        outExpression.constants.push_back(nodes[node.coefficients + k].value);
+                    }
+                }
+                break;
+            case Opcode::series:
+                if constexpr (std::is_same_v<Target, compiledExpression>){
+                    outExpression.code.push_back({node.op, static_cast<uint32_t>(outExpression.constants.size())});
+                    for (uint32_t k = 0; k < node.symbol; ++k) {
+                        outExpression.constants.push_back(nodes[node.coefficients + k].value);
+                    }
+                }
+                depth--;
+                break;
+            case Opcode::sum:
+            case Opcode::product:
+                outExpression.code[unpatched.back()].operand = static_cast<uint32_t>(outExpression.code.size());
+                unpatched.pop_back();
+                outExpression.code.push_back({Opcode::endLoop, static_cast<uint32_t>(outExpression.symbols.size()) + node.symbol});
+                depth = loopDepths.back() - 1;
+                loopDepths.pop_back();
+                break;
+            case Opcode::select:
+                outExpression.code[unpatched.back()].operand = static_cast<uint32_t>(outExpression.code.size());
+                unpatched.pop_back();
+                outExpression.code.push_back({node.op, 0});
+                depth -= 2;
+                break;
+            default:
+                outExpression.code.push_back({node.op, compiledExpression::tiered(node.op) ? static_cast<uint32_t>(accuracy) : 0});
+                depth -= compiledExpression::arity(node.op) - 1;
+        }
+        outExpression.stackSize = std::max(outExpression.stackSize, depth);
+    }
+}
+
+/**
+ * Compiles expression into compiledExpression or a basicExpression, which ignores accuracy and is not lowered
+ */
+template<typename Target>
+Status compileExpression(std::string_view expression, Target &outExpression, std::pmr::memory_resource *scratch,
+                         calcLib::Accuracy accuracy, const userFunctions &functions) {
+    using Scalar = typename decltype(outExpression.constants)::value_type;
+    outExpression = Target();
+    std::pmr::string normalized(expression, scratch);
+    std::replace(normalized.begin(), normalized.end(), ',', '.');
+    TokenList tokens(scratch);
+    Status status = parseEquation(normalized, tokens);
+    if (status != Status::ok){
+        return status;
+    }
+    std::pmr::vector<syntaxNode<Scalar>> nodes(scratch);
+    int32_t root;
+    if (tokens.empty()){
+        root = 0;
+        nodes.push_back(syntaxNode<Scalar>{Opcode::variable, 0, 0, -1, -1});
+        outExpression.symbols.emplace_back("ans");
+    } else {
+        root = expressionParser<Scalar>(tokens, nodes, outExpression.symbols, accuracy, functions,
+                                        std::is_same_v<Target, compiledExpression>).parse();
+        if (root < 0){
+            outExpression = Target();
+            return Status::invalidExpression;
+        }
+    }
+    if constexpr (std::is_same_v<Target, compiledExpression>){
+        collectPolynomials(nodes, root);
+        lowerNodes(nodes, accuracy);
+    }
+    generateCode(nodes, root, accuracy, outExpression);
+    return Status::ok;
+}
+
+}
+
+calcLib::Status calcLib::compile(std::string_view expression, compiledExpression &outExpression) const {
+    return compile(expression, outExpression, std::pmr::get_default_resource());
+}
+
+calcLib::Status calcLib::compile(std::string_view expression, compiledExpression &outExpression,
+                                 std::pmr::memory_resource *scratch) const {
+    return compileExpression(expression, outExpression, scratch, accuracy, functions);
+}
+
+template<typename Scalar>
+calcLib::Status calcLib::compile(std::string_view expression, basicExpression<Scalar> &outExpression) const {
+    return compileExpression(expression, outExpression, std::pmr::get_default_resource(), Accuracy::faithful, functions);
+}
+
+calcLib::Status calcLib::define(std::string_view definition) {
+    std::string normalized(definition);
+    std::replace(normalized.begin(), normalized.end(), ',', '.');
+    TokenList tokens;
+    Status status = parseEquation(normalized, tokens);
+    if (status != Status::ok){
+        return status;
+    }
+    // name(parameter:...) = body
+    auto token = tokens.cbegin();
+    auto accept = [&token, &tokens](Token_type type) {
+        if (token != tokens.cend() && token->type == type){
+            ++token;
+            return true;
+        }
+        return false;
+    };
+    auto symbol = [&token, &accept]() {
+        return accept(Token_type::e_symbol) ? std::get<std::string>(std::prev(token)->value) : std::string();
+    };
+    auto function = std::make_shared<userFunction>();
+    std::string name = symbol();
+    if (name.empty() || calcGrammar::builtinName(name) || !accept(Token_type::e_lbracket)){
+        return Status::invalidExpression;
+    }
+    do {
+        std::string parameter = symbol();
+        if (parameter.empty() || std::count(function->parameters.begin(), function->parameters.end(), parameter) != 0){
+            return Status::invalidExpression;
+        }
+        function->parameters.push_back(std::move(parameter));
+    } while (accept(static_cast<Token_type>(calcGrammar::parameterSeparator)));
+    if (!accept(Token_type::e_rbracket) || !accept(Token_type::e_eq) || token == tokens.cend()){
+        return Status::invalidExpression;
+    }
+    function->body.splice(function->body.end(), tokens, token, tokens.cend());
+    // Parsing the body once rejects malformed and recursive definitions before anything calls them
+    std::pmr::vector<syntaxNode<double>> nodes;
+    std::vector<std::string> symbols;
+    expressionParser<double> parser(function->body, nodes, symbols, accuracy, functions, false);
+    if (parser.parseDefinition(name, *function) < 0){
+        return Status::invalidExpression;
+    }
+    functions[name] = std::move(function);
+    return Status::ok;
+}
+
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<float> &) const;
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<double> &) const;
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<long double> &) const;
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<doubleDouble> &) const;
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<bigInteger> &) const;
+#if defined(CALCLIB_HAS_FLOAT128)
+template calcLib::Status calcLib::compile(std::string_view, basicExpression<__float128> &) const;
+#endif
@@ -0,0 +1,382 @@
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * Writes the expression corpus replayed by calclib_bench, the training workload of the profile guided
+ * build. "make corpus" regenerates src/bench/corpus.txt. Every section covers one part of the grammar,
+ * so the profile sees each of them as hot. Syntax added to calcLib gets a section here.
+ */
+
+namespace {
+
+constexpr unsigned defaultSeed = 2020;
+
+/**
+ * Draws random expressions. std::mt19937 produces the same sequence with every standard library,
+ * the standard distributions do not, so only its raw output is used. Every draw is a statement of its own
+ * because the operands of + are evaluated in unspecified order.
+ */
+class corpusGenerator {
+    std::mt19937 random;
+public:
+    explicit corpusGenerator(unsigned seed) : random(seed) {}
+
+    /**
+     * @return integer in [low, high]
+     */
+    unsigned between(unsigned low, unsigned high) {
+        return low + random() % (high - low + 1);
+    }
+
+    /**
+     * @return true with the given probability
+     */
+    bool chance(unsigned percent) {
+        return between(1, 100) <= percent;
+    }
+
+    /**
+     * @return one of names
+     */
+    template<size_t count>
+    const char* pick(const char *const (&names)[count]) {
+        return names[between(0, count - 1)];
+    }
+
+    /**
+     * Shuffles lines in place (Fisher-Yates), std::shuffle is not portable either
+     */
+    void shuffle(std::vector<std::string> &lines) {
+        for (size_t i = lines.size(); i > 1; --i) {
+            std::swap(lines[i - 1], lines[random() % i]);
+        }
+    }
+
+    /**
+     * @return integer or decimal literal, sometimes with the decimal comma
+     */
+    std::string number() {
+        std::string text = std::to_string(between(0, 999));
+        unsigned kind = between(1, 100);
+        if (kind <= 40){
+            return text;
+        }
+        std::string digits = std::to_string(between(0, 9999));
+        digits.resize(between(1, 4), '0');
+        if (kind <= 85){
+            return text + "." + digits;
+        }
+        return std::to_string(between(0, 9)) + "," + digits;
+    }
+
+    /**
+     * @return literal, constant, ans or one of the bench variables x and y
+     */
+    std::string operand() {
+        unsigned kind = between(1, 100);
+        if (kind <= 78){
+            return number();
+        }
+        if (kind <= 88){
+            static const char *const constants[] = {"pi", "e", "ans"};
+            return pick(constants);
+        }
+        if (kind <= 94){
+            static const char *const variables[] = {"x", "y"};
+            return pick(variables);
+        }
+        return std::to_string(between(0, 12)) + "!";
+    }
+
+    /**
+     * @param depth remaining nesting
+     * @return random arithmetic expression using every builtin of the base grammar
+     */
+    std::string expression(unsigned depth) {
+        if (depth == 0 || chance(25)){
+            std::string sign = chance(10) ? "-" : "";
+            return sign + operand();
+        }
+        unsigned kind = between(1, 100);
+        if (kind <= 50){
+            static const char *const operators[] = {"+", "-", "*", "/", "+", "-", "*", "/", "%", "^"};
+            std::string op = pick(operators);
+            std::string lhs = expression(depth - 1);
+            std::string rhs = op == "^" && chance(70) ? std::to_string(between(0, 6)) : expression(depth - 1);
+            return lhs + op + rhs;
+        }
+        if (kind <= 85){
+            static const char *const functions[] = {"sin", "cos", "tan", "sqrt", "log"};
+            std::string argument = expression(depth - 1);
+            if (chance(30)){
+                std::string name = chance(50) ? "root(" : "log(";
+                return name + std::to_string(between(2, 5)) + ":" + argument + ")";
+            }
+            return std::string(pick(functions)) + "(" + argument + ")";
+        }
+        return "(" + expression(depth - 1) + ")";
+    }
+
+    /**
+     * @return integer arithmetic that the engine evaluates exactly
+     */
+    std::string integers() {
+        std::string a = std::to_string(between(1, 5000));
+        std::string b = std::to_string(between(2, 40));
+        std::string m = std::to_string(between(2, 1009));
+        switch (between(0, 3)) {
+            case 0:
+                return a + "^" + std::to_string(between(2, 4)) + "%" + m;
+            case 1:
+                return "(" + a + "*" + b + "+" + m + ")%" + b + "-" + a;
+            case 2:
+                return std::to_string(between(0, 20)) + "!%" + m + "+2^" + b;
+            default:
+                return a + "%" + b + "*" + m + "-" + b + "^2";
+        }
+    }
+
+    /**
+     * @return polynomial in x or y written out term by term, highest power first, as the compiler collects them
+     */
+    std::string polynomial() {
+        std::string variable = chance(75) ? "x" : "y";
+        unsigned degree = chance(80) ? between(2, 12) : between(13, 32);
+        std::string text;
+        for (unsigned k = 0; k <= degree; ++k) {
+            unsigned power = degree - k;
+            if (k != 0 && chance(25)){
+                continue;
+            }
+            std::string sign = chance(30) ? "-" : "+";
+            std::string term;
+            if (power == 0){
+                term = number();
+            } else {
+                std::string coefficient = chance(20) ? "" : number() + "*";
+                term = coefficient + (power == 1 ? variable : variable + "^" + std::to_string(power));
+            }
+            text += (text.empty() && sign == "+" ? "" : sign) + term;
+        }
+        return text;
+    }
+
+    /**
+     * @return comparison of two expressions
+     */
+    std::string comparison() {
+        static const char *const operators[] = {"<", "<=", ">", ">=", "=", "==", "!=", "<>"};
+        std::string lhs = expression(2);
+        std::string op = pick(operators);
+        return lhs + op + expression(2);
+    }
+
+    /**
+     * @return piecewise formula built from comparisons, if, min, max, clamp and abs
+     */
+    std::string conditional() {
+        switch (between(0, 4)) {
+            case 0:
+                return comparison();
+            case 1: {
+                std::string condition = comparison();
+                std::string then = expression(2);
+                std::string otherwise = chance(30) ? conditional() : expression(2);
+                return "if(" + condition + ":" + then + ":" + otherwise + ")";
+            }
+            case 2: {
+                std::string name = chance(50) ? "min(" : "max(";
+                std::string lhs = expression(2);
+                return name + lhs + ":" + expression(2) + ")";
+            }
+            case 3: {
+                std::string value = expression(2);
+                std::string low = "-" + number();
+                return "clamp(" + value + ":" + low + ":" + number() + ")";
+            }
+            default:
+                return "abs(" + expression(3) + ")";
+        }
+    }
+
+    /**
+     * @return polynomial in the index i of degree up to maxDegree
+     */
+    std::string indexPolynomial(unsigned maxDegree) {
+        std::string text = number();
+        unsigned degree = between(1, maxDegree);
+        for (unsigned power = 1; power <= degree; ++power) {
+            std::string sign = chance(30) ? "-" : "+";
+            text += sign + number() + "*i^" + std::to_string(power);
+        }
+        return text;
+    }
+
+    /**
+     * @return sum or product over an index range. Closed forms are evaluated in O(1), other bodies run the
+     * blocked loop, and a few ranges are long enough to be split across threads.
+     */
+    std::string series() {
+        std::string upper = std::to_string(chance(10) ? between(100000, 400000) : between(10, 3000));
+        std::string body;
+        switch (between(0, 6)) {
+            case 0:
+                body = indexPolynomial(10);
+                break;
+            case 1:
+                body = number() + "*0." + std::to_string(between(1, 99)) + "^i";
+                break;
+            case 2:
+                body = "if(i%3=0:i*0.5:sin(i))";
+                break;
+            case 3:
+                body = "1/(" + indexPolynomial(4) + ")";
+                break;
+            case 4:
+                body = expression(2) + "/i";
+                break;
+            case 5: {
+                std::string inner = std::to_string(between(2, 20));
+                body = "sum(j:1:" + inner + ":x^j/(i+j))";
+                upper = std::to_string(between(10, 1000));
+                break;
+            }
+            default:
+                return "prod(i:1:" + upper + ":1+1/i^2)";
+        }
+        return "sum(i:1:" + upper + ":" + body + ")";
+    }
+
+    /**
+     * @return call of one of the functions of definitions, with constant or variable arguments
+     */
+    std::string call() {
+        static const char *const names[] = {"hyp", "f", "lerp", "sigmoid", "cube", "norm3", "ramp", "smooth"};
+        static const unsigned arities[] = {2, 2, 3, 1, 1, 3, 1, 1};
+        unsigned function = between(0, std::size(names) - 1);
+        std::string text = std::string(names[function]) + "(";
+        for (unsigned i = 0; i < arities[function]; ++i) {
+            std::string argument = chance(20) ? call() : expression(2);
+            text += (i == 0 ? "" : ":") + argument;
+        }
+        return text + ")";
+    }
+
+    /**
+     * @return terms operands added up, as users type out series by hand
+     */
+    std::string longSum(unsigned terms) {
+        std::string text = operand();
+        for (unsigned i = 1; i < terms; ++i) {
+            text += "+" + operand();
+        }
+        return text;
+    }
+
+    /**
+     * @return line that fails with a syntax, domain or division error
+     */
+    std::string error() {
+        switch (between(0, 6)) {
+            case 0:
+                return expression(2) + "+";
+            case 1:
+                return "(" + expression(2);
+            case 2:
+                return expression(2) + "/0";
+            case 3:
+                return number() + "%0";
+            case 4: {
+                std::string name = chance(50) ? "log(-" : "root(2:-";
+                return name + number() + ")";
+            }
+            case 5:
+                return "foo(" + number() + ")";
+            default: {
+                std::string lhs = expression(1);
+                return lhs + "**" + number();
+            }
+        }
+    }
+};
+
+/**
+ * Functions defined by the corpus, calclib_bench passes the lines that start with "define " to calcLib::define.
+ * Later definitions may call earlier ones.
+ */
+const char *const definitions[] = {
+        "hyp(a:b)=sqrt(a^2+b^2)",
+        "f(x:y)=x^2+y*sin(x)",
+        "lerp(a:b:t)=a+(b-a)*t",
+        "sigmoid(x)=1/(1+e^(-x))",
+        "cube(x)=x*x*x",
+        "norm3(a:b:c)=hyp(hyp(a:b):c)",
+        "ramp(x)=if(x<0:0:x)",
+        "smooth(x)=clamp(3*x^2-2*x^3:0:1)",
+};
+
+/**
+ * @return definitions followed by the corpus lines in random order
+ */
+std::vector<std::string> generateCorpus(unsigned seed) {
+    corpusGenerator generator(seed);
+    std::vector<std::string> lines;
+    auto section = [&](unsigned count, auto line) {
+        for (unsigned i = 0; i < count; ++i) {
+            lines.push_back(line());
+        }
+    };
+    section(600, [&]() { return generator.operand(); });
+    section(1750, [&]() { return generator.expression(generator.between(1, 4)); });
+    section(250, [&]() { return generator.integers(); });
+    section(150, [&]() { return generator.longSum(generator.between(50, 250)); });
+    section(150, [&]() { return generator.error(); });
+    section(200, [&]() { return generator.polynomial(); });
+    section(300, [&]() { return generator.conditional(); });
+    section(150, [&]() { return generator.series(); });
+    section(150, [&]() { return generator.call(); });
+    generator.shuffle(lines);
+    std::vector<std::string> corpus;
+    for (const char *definition : definitions) {
+        corpus.push_back(std::string("define ") + definition);
+    }
+    corpus.insert(corpus.end(), lines.begin(), lines.end());
+    return corpus;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    unsigned seed = defaultSeed;
+    int option;
+    while ((option = getopt(argc, argv, "s:h")) != -1) {
+        switch (option) {
+            case 's': {
+                char *end;
+                errno = 0;
+                unsigned long value = strtoul(optarg, &end, 10);
+                if (!std::isdigit(static_cast<unsigned char>(*optarg)) || *end != '\0' || errno != 0 || value > UINT_MAX){
+                    std::cerr << "Invalid seed " << optarg << "\n";
+                    return 1;
+                }
+                seed = static_cast<unsigned>(value);
+                break;
+            }
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-s seed] > corpus.txt\n";
+                return option == 'h' ? 0 : 1;
+        }
+    }
+    for (const auto &line : generateCorpus(seed)) {
+        std::cout << line << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include "calclib/scalar.hpp"
+
+/**
+ * sin, cos and tan of angles in degrees, shared by the double helpers of calcLib and basicExpression.
+ * The angle is reduced to [-45, 45] degrees and a quadrant without rounding, because 90 and 360 are integers:
+ * sin(180) is 0, sin(30) is 0.5, tan(45) is 1 and every odd multiple of 90 is a pole of tan.
+ *
+ * The double kernels are minimax polynomials (fdlibm's) and branch free up to fastReductionLimit, so loops
+ * over blocks of them vectorize, calcLib::Accuracy::fast swaps in shorter fits. Other scalar types evaluate their
+ * own sin and cos of the reduced angle.
+ */
+namespace calcDegrees {
+
+constexpr double fastReductionLimit = 0x1p45; //! Largest magnitude reduced without fmod, every step below it stays exact
+constexpr double roundingShift = 0x1.8p52; //! Adding and subtracting it rounds a double below 2^51 to an integer
+constexpr double radiansPerDegree = M_PI / 180;
+constexpr double radiansPerDegreeTail = 2.9486522708701687e-19; //! pi / 180 - radiansPerDegree
+constexpr double radiansPerDegreeHigh = 0.01745329238474369; //! radiansPerDegree split into halves of 26 bits
+constexpr double radiansPerDegreeLow = 1.3519960498364902e-10;
+
+constexpr double sin1 = -1.66666666666666324348e-01; //! Minimax sin on [-pi/4, pi/4], t + t^3 * (sin1 + ...)
+constexpr double sin2 = 8.33333333332248946124e-03;
+constexpr double sin3 = -1.98412698298579493134e-04;
+constexpr double sin4 = 2.75573137070700676789e-06;
+constexpr double sin5 = -2.50507602534068634195e-08;
+constexpr double sin6 = 1.58969099521155010221e-10;
+constexpr double cos1 = 4.16666666666666019037e-02; //! Minimax cos on [-pi/4, pi/4], 1 - t^2/2 + t^4 * (cos1 + ...)
+constexpr double cos2 = -1.38888888888741095749e-03;
+constexpr double cos3 = 2.48015872894767294178e-05;
+constexpr double cos4 = -2.75573143513906633035e-07;
+constexpr double cos5 = 2.08757232129817482790e-09;
+constexpr double cos6 = -1.13596475577881948265e-11;
+// Shorter fits in degrees of calcLib::Accuracy::fast, sin within 5e-15 and cos within 8e-14 relative on [-45, 45]
+constexpr double shortSin0 = 0.017453292519943223; //! angle * (shortSin0 + z * (shortSin1 + ...)), z = angle^2
+constexpr double shortSin1 = -8.860961556986407e-07;
+constexpr double shortSin2 = 1.3496016216319672e-11;
+constexpr double shortSin3 = -9.788381633788988e-17;
+constexpr double shortSin4 = 4.14095974787116e-22;
+constexpr double shortSin5 = -1.1332906871267094e-27;
+constexpr double shortCos0 = 0.9999999999999444; //! shortCos0 + z * (shortCos1 + ...), z = angle^2
+constexpr double shortCos1 = -0.00015230870989137768;
+constexpr double shortCos2 = 3.866323840172296e-09;
+constexpr double shortCos3 = -3.9258295845154296e-14;
+constexpr double shortCos4 = 2.135265394439584e-19;
+constexpr double shortCos5 = -7.127186685441879e-25;
+
+/**
+ * @return x rounded to the nearest integer, ties to even, for |x| < 2^51
+ */
+inline double nearest(double x) {
+    return (x + roundingShift) - roundingShift;
+}
+
+/**
+ * Splits degrees into 90 * turns + outAngle, exact for |degrees| < fastReductionLimit
+ * @param degrees
+ * @param outAngle remainder, in [-45, 45] up to the rounding of degrees / 90 at the boundaries
+ * @param outQuadrant turns modulo 4 as -2..2, where ±2 are the same quadrant
+ */
+inline void reduce(double degrees, double &outAngle, double &outQuadrant) {
+    double turns = nearest(degrees * (1.0 / 90));
+    outAngle = degrees - turns * 90;
+    outQuadrant = turns - 4 * nearest(turns * 0.25);
+}
+
+/**
+ * Converts degrees to radians t + outTail, where the tail keeps the rounding errors of the product and of
+ * radiansPerDegree, so the kernels below stay within 1 ulp instead of adding a rounding of their argument
+ * @param angle degrees in about [-45, 45]
+ * @param outTail correction of t
+ * @return angle in radians rounded to double
+ */
+inline double toRadians(double angle, double &outTail) {
+    double t = angle * radiansPerDegree;
+#if defined(FP_FAST_FMA)
+    double error = std::fma(angle, radiansPerDegree, -t);
+#else
+    // Dekker's product, the halves of angle times the halves of radiansPerDegree are exact
+    double split = 134217729.0 * angle;
+    double high = split - (split - angle);
+    double low = angle - high;
+    double error = ((high * radiansPerDegreeHigh - t) + high * radiansPerDegreeLow + low * radiansPerDegreeHigh)
+                   + low * radiansPerDegreeLow;
+#endif
+    outTail = error + angle * radiansPerDegreeTail;
+    return t;
+}
+
+/**
+ * @tparam shortSeries evaluates the polynomial of calcLib::Accuracy::fast
+ * @param angle degrees in about [-45, 45]
+ */
+template<bool shortSeries = false>
+inline double sinReduced(double angle) {
+    double value;
+    if constexpr (shortSeries){
+        double z = angle * angle;
+        value = angle * (shortSin0 + z * (shortSin1 + z * (shortSin2 + z * (shortSin3 + z * (shortSin4 + z * shortSin5)))));
+    } else {
+        double tail;
+        double t = toRadians(angle, tail);
+        double z = t * t;
+        double w = z * z;
+        double v = z * t;
+        double r = sin2 + z * (sin3 + z * sin4) + z * w * (sin5 + z * sin6);
+        value = t - ((z * (0.5 * tail - v * r) - tail) - v * sin1);
+    }
+    value = std::abs(angle) == 30 ? std::copysign(0.5, angle) : value;
+    return std::abs(angle) == 45 ? std::copysign(M_SQRT1_2, angle) : value;
+}
+
+/**
+ * @tparam shortSeries evaluates the polynomial of calcLib::Accuracy::fast
+ * @param angle degrees in about [-45, 45]
+ */
+template<bool shortSeries = false>
+inline double cosReduced(double angle) {
+    double value;
+    if constexpr (shortSeries){
+        double z = angle * angle;
+        value = shortCos0 + z * (shortCos1 + z * (shortCos2 + z * (shortCos3 + z * (shortCos4 + z * shortCos5))));
+    } else {
+        double tail;
+        double t = toRadians(angle, tail);
+        double z = t * t;
+        double w = z * z;
+        double r = z * (cos1 + z * (cos2 + z * cos3)) + w * w * (cos4 + z * (cos5 + z * cos6));
+        double half = 0.5 * z;
+        double rest = 1 - half;
+        value = rest + (((1 - rest) - half) + (z * r - t * tail));
+    }
+    return std::abs(angle) == 45 ? M_SQRT1_2 : value;
+}
+
+// The quadrant functions only compare with ==, which does not raise on NaN, so with -fno-trapping-math their
+// selections become blends in vector loops. They negate as 0 - x, which keeps sin(180) and cos(90) +0 like
+// the other zeros.
+
+/**
+ * @param value sin or cos of the reduced angle, whichever gives sin in quadrant
+ */
+inline double sinQuadrant(double value, double quadrant) {
+    return (quadrant == -1) | (std::abs(quadrant) == 2) ? 0 - value : value;
+}
+
+/**
+ * @param value sin or cos of the reduced angle, whichever gives cos in quadrant
+ */
+inline double cosQuadrant(double value, double quadrant) {
+    return (quadrant == 1) | (std::abs(quadrant) == 2) ? 0 - value : value;
+}
+
+/**
+ * @return sin(degrees) for |degrees| < fastReductionLimit, branch free for vector loops
+ */
+template<bool shortSeries = false>
+inline double sinFast(double degrees) {
+    double angle;
+    double quadrant;
+    reduce(degrees, angle, quadrant);
+    double sine = sinReduced<shortSeries>(angle);
+    double cosine = cosReduced<shortSeries>(angle);
+    return sinQuadrant(std::abs(quadrant) == 1 ? cosine : sine, quadrant);
+}
+
+/**
+ * @return cos(degrees) for |degrees| < fastReductionLimit, branch free for vector loops
+ */
+template<bool shortSeries = false>
+inline double cosFast(double degrees) {
+    double angle;
+    double quadrant;
+    reduce(degrees, angle, quadrant);
+    double sine = sinReduced<shortSeries>(angle);
+    double cosine = cosReduced<shortSeries>(angle);
+    return cosQuadrant(std::abs(quadrant) == 1 ? sine : cosine, quadrant);
+}
+
+/**
+ * @return tan(degrees) for |degrees| < fastReductionLimit, +inf at 90 and -inf at 270 modulo 360
+ */
+template<bool shortSeries = false>
+inline double tanFast(double degrees) {
+    double angle;
+    double quadrant;
+    reduce(degrees, angle, quadrant);
+    double sine = sinReduced<shortSeries>(angle);
+    double cosine = cosReduced<shortSeries>(angle);
+    bool odd = std::abs(quadrant) == 1;
+    // Both signs cancel in even quadrants, odd ones are -cot
+    double value = (odd ? 0 - cosine : sine) / (odd ? sine : cosine);
+    return odd & (sine == 0) ? std::copysign(INFINITY, quadrant) : value;
+}
+
+/**
+ * @return degrees itself where the fast reduction is exact, otherwise its exact remainder of 360
+ */
+inline double wrap(double degrees) {
+    return std::abs(degrees) < fastReductionLimit ? degrees : std::fmod(degrees, 360);
+}
+
+/**
+ * Applies the fast kernel to every value if all of them are below fastReductionLimit, otherwise the complete one
+ */
+template<typename Fast, typename Complete>
+void inPlace(double *values, size_t count, Fast fast, Complete complete) {
+    bool reducible = true;
+    for (size_t i = 0; i < count; ++i) {
+        reducible &= std::abs(values[i]) < fastReductionLimit;
+    }
+    if (!reducible){
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = complete(values[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = fast(values[i]);
+    }
+}
+
+// Scalar versions evaluate only the polynomial they need, with the same operations as the fast ones
+
+inline double sin(double degrees) {
+    double angle;
+    double quadrant;
+    reduce(wrap(degrees), angle, quadrant);
+    if (std::abs(quadrant) == 1){
+        return sinQuadrant(cosReduced(angle), quadrant);
+    }
+    return sinQuadrant(sinReduced(angle), quadrant);
+}
+
+inline double cos(double degrees) {
+    double angle;
+    double quadrant;
+    reduce(wrap(degrees), angle, quadrant);
+    if (std::abs(quadrant) == 1){
+        return cosQuadrant(sinReduced(angle), quadrant);
+    }
+    return cosQuadrant(cosReduced(angle), quadrant);
+}
+
+inline double tan(double degrees) {
+    return tanFast(wrap(degrees));
+}
+
+/**
+ * Splits degrees into 90 * quadrant + outAngle with outAngle in [-45, 45], exact in every binary type
+ */
+template<typename Scalar>
+void reduce(const Scalar &degrees, Scalar &outAngle, unsigned &outQuadrant) {
+    // fmod is exact, then every step subtracts 90 from a value below 360 and stays exact as well
+    Scalar angle = scalarTraits<Scalar>::fmod(degrees, 360);
+    unsigned quadrant = 0;
+    while (angle > 45) {
+        angle -= 90;
+        ++quadrant;
+    }
+    while (angle < -45) {
+        angle += 90;
+        --quadrant;
+    }
+    outAngle = angle;
+    outQuadrant = quadrant & 3;
+}
+
+/**
+ * sin and cos of an angle in [-45, 45] degrees, exact at 0, ±30 and equal at ±45
+ */
+template<typename Scalar>
+void sinCosReduced(const Scalar &angle, Scalar &outSin, Scalar &outCos) {
+    using traits = scalarTraits<Scalar>;
+    Scalar magnitude = angle < 0 ? -angle : angle;
+    if (magnitude == 45){
+        Scalar half = traits::cos(traits::pi() / 4);
+        outSin = angle < 0 ? -half : half;
+        outCos = half;
+        return;
+    }
+    Scalar radians = angle * traits::pi() / 180;
+    outSin = magnitude == 30 ? traits::copysign(Scalar(0.5), angle) : traits::sin(radians);
+    outCos = angle == 0 ? Scalar(1) : traits::cos(radians);
+}
+
+template<typename Scalar>
+Scalar sin(const Scalar &degrees) {
+    Scalar angle;
+    unsigned quadrant;
+    reduce(degrees, angle, quadrant);
+    Scalar sine;
+    Scalar cosine;
+    sinCosReduced(angle, sine, cosine);
+    Scalar value = quadrant % 2 ? cosine : sine;
+    return quadrant >= 2 ? Scalar(0) - value : value;
+}
+
+template<typename Scalar>
+Scalar cos(const Scalar &degrees) {
+    Scalar angle;
+    unsigned quadrant;
+    reduce(degrees, angle, quadrant);
+    Scalar sine;
+    Scalar cosine;
+    sinCosReduced(angle, sine, cosine);
+    Scalar value = quadrant % 2 ? sine : cosine;
+    return quadrant == 1 || quadrant == 2 ? Scalar(0) - value : value;
+}
+
+/**
+ * @return tan(degrees), +inf at 90 and -inf at 270 modulo 360
+ */
+template<typename Scalar>
+Scalar tan(const Scalar &degrees) {
+    Scalar angle;
+    unsigned quadrant;
+    reduce(degrees, angle, quadrant);
+    Scalar sine;
+    Scalar cosine;
+    sinCosReduced(angle, sine, cosine);
+    if (quadrant % 2 == 0){
+        return sine / cosine;
+    }
+    if (sine == 0){
+        return quadrant == 1 ? scalarTraits<Scalar>::infinity() : -scalarTraits<Scalar>::infinity();
+    }
+    return -cosine / sine;
+}
+
+}
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <array>
+#include "calclib/double_double.hpp"
+
+namespace {
+
+// Constants rounded to 106 bits
+constexpr doubleDouble ddPi{3.141592653589793, 1.2246467991473532e-16};
+constexpr doubleDouble ddHalfPi{1.5707963267948966, 6.123233995736766e-17};
+constexpr doubleDouble ddE{2.718281828459045, 1.4456468917292502e-16};
+constexpr doubleDouble ddLn2{0.6931471805599453, 2.3190468138462996e-17};
+constexpr doubleDouble ddLn10{2.302585092994046, -2.1707562233822494e-16};
+constexpr doubleDouble ddHalfLog2Pi{0.9189385332046728, -3.8782941580672414e-17}; //! log(2π) / 2
+
+constexpr int ddExpHalvings = 10; //! exp evaluates its series at x / 2^ddExpHalvings and squares the result back
+constexpr int ddExpTerms = 9; //! Terms of the series of expm1 on |x| <= ln(2) / 2^(ddExpHalvings + 1), the next is below 1e-33
+constexpr int ddSinCosTerms = 14; //! Terms of the series of sin and cos on |x| <= π/4, the next is below 1e-33
+constexpr int ddSignificantDigits = 32; //! Decimal digits that format writes, the rest are zeros
+constexpr double ddStirlingMin = 25; //! From here the Stirling series below is accurate to 1e-32
+
+/**
+ * B(2k) / (2k (2k - 1)) as numerator and denominator, coefficients of the Stirling series of log Γ(x)
+ */
+constexpr double ddStirlingCoefficients[][2] = {
+        {1.0, 12.0}, {-1.0, 360.0}, {1.0, 1260.0}, {-1.0, 1680.0}, {1.0, 1188.0}, {-691.0, 360360.0},
+        {1.0, 156.0}, {-3617.0, 122400.0}, {43867.0, 244188.0}, {-174611.0, 125400.0}, {77683.0, 5796.0},
+        {-236364091.0, 1506960.0}, {657931.0, 300.0}, {-3392780147.0, 93960.0}
+};
+
+doubleDouble scaleByTwo(const doubleDouble &value, int exponent) {
+    return {std::ldexp(value.hi, exponent), std::ldexp(value.lo, exponent)};
+}
+
+doubleDouble absolute(const doubleDouble &value) {
+    return value.hi < 0 ? -value : value;
+}
+
+/**
+ * @return value truncated towards zero
+ */
+doubleDouble truncate(const doubleDouble &value) {
+    double high = std::trunc(value.hi);
+    if (high != value.hi){
+        // hi is the value rounded to nearest, so an integer between hi and the value would be hi itself
+        return high;
+    }
+    double low = value.hi > 0 ? std::floor(value.lo) : std::ceil(value.lo);
+    return doubleDouble::quickTwoSum(high, low);
+}
+
+/**
+ * @return 10^exponent by repeated squaring, exact up to 10^45
+ */
+doubleDouble powerOfTen(int exponent) {
+    doubleDouble result = 1;
+    doubleDouble square = 10;
+    for (unsigned rest = static_cast<unsigned>(std::abs(exponent)); rest != 0; rest >>= 1) {
+        if ((rest & 1) != 0){
+            result *= square;
+        }
+        square *= square;
+    }
+    return exponent < 0 ? 1 / result : result;
+}
+
+/**
+ * @return value * 10^exponent, in two steps where 10^exponent alone would overflow
+ */
+doubleDouble scaleByTen(doubleDouble value, int exponent) {
+    while (exponent < -300 || exponent > 300) {
+        int step = exponent < 0 ? -300 : 300;
+        value = step < 0 ? value / powerOfTen(-step) : value * powerOfTen(step);
+        exponent -= step;
+    }
+    return exponent < 0 ? value / powerOfTen(-exponent) : value * powerOfTen(exponent);
+}
+
+/**
+ * @return 1/n! for n = 0..2 ddSinCosTerms + 1, computed on first use
+ */
+const doubleDouble* inverseFactorials() {
+    static const auto table = []() {
+        std::array<doubleDouble, 2 * ddSinCosTerms + 2> values;
+        doubleDouble factorial = 1;
+        for (size_t n = 0; n < values.size(); ++n) {
+            factorial *= std::max<double>(static_cast<double>(n), 1);
+            values[n] = 1 / factorial;
+        }
+        return values;
+    }();
+    return table.data();
+}
+
+/**
+ * Sine and cosine of x in radians by their Taylor series on x reduced to [-π/4, π/4]
+ */
+void sinCos(const doubleDouble &x, doubleDouble &outSin, doubleDouble &outCos) {
+    if (!std::isfinite(x.hi)){
+        outSin = outCos = std::numeric_limits<double>::quiet_NaN();
+        return;
+    }
+    double quadrant = std::nearbyint((x / ddHalfPi).hi);
+    doubleDouble reduced = x - ddHalfPi * quadrant;
+    // Horner's scheme in r^2: sin(r) = r (1 - r^2/3! + ...), cos(r) = 1 - r^2/2! + ...
+    const doubleDouble *inverse = inverseFactorials();
+    doubleDouble square = reduced * reduced;
+    doubleDouble sine = inverse[2 * ddSinCosTerms + 1];
+    doubleDouble cosine = inverse[2 * ddSinCosTerms];
+    for (int k = ddSinCosTerms - 1; k >= 0; --k) {
+        sine = inverse[2 * k + 1] - sine * square;
+        cosine = inverse[2 * k] - cosine * square;
+    }
+    // sin(r + kπ/2) cycles through sin, cos, -sin, -cos
+    sine *= reduced;
+    switch (static_cast<int64_t>(std::fmod(quadrant, 4) + 4) % 4) {
+        case 0:
+            outSin = sine;
+            outCos = cosine;
+            break;
+        case 1:
+            outSin = cosine;
+            outCos = -sine;
+            break;
+        case 2:
+            outSin = -sine;
+            outCos = -cosine;
+            break;
+        default:
+            outSin = -cosine;
+            outCos = sine;
+    }
+}
+
+/**
+ * log Γ(x) by the Stirling series, x >= ddStirlingMin
+ */
+doubleDouble logGammaStirling(const doubleDouble &x) {
+    doubleDouble inverse = 1 / x;
+    doubleDouble inverseSquare = inverse * inverse;
+    doubleDouble power = inverse;
+    doubleDouble series = 0;
+    for (const auto &coefficient : ddStirlingCoefficients) {
+        series += power * (doubleDouble(coefficient[0]) / coefficient[1]);
+        power *= inverseSquare;
+    }
+    return (x - 0.5) * scalarTraits<doubleDouble>::log(x) - x + ddHalfLog2Pi + series;
+}
+
+}
+
+doubleDouble::operator int64_t() const {
+    doubleDouble integer = truncate(*this);
+    if (std::abs(integer.hi) < 0x1p62){
+        return static_cast<int64_t>(integer.hi) + static_cast<int64_t>(integer.lo);
+    }
+    // hi is even up here and half of it fits, the sum wraps like the two's complement result
+    uint64_t high = static_cast<uint64_t>(static_cast<int64_t>(integer.hi / 2)) * 2;
+    return static_cast<int64_t>(high + static_cast<uint64_t>(static_cast<int64_t>(integer.lo)));
+}
+
+doubleDouble scalarTraits<doubleDouble>::pi() {
+    return ddPi;
+}
+
+doubleDouble scalarTraits<doubleDouble>::e() {
+    return ddE;
+}
+
+doubleDouble scalarTraits<doubleDouble>::sin(const doubleDouble &x) {
+    doubleDouble sine;
+    doubleDouble cosine;
+    sinCos(x, sine, cosine);
+    return sine;
+}
+
+doubleDouble scalarTraits<doubleDouble>::cos(const doubleDouble &x) {
+    doubleDouble sine;
+    doubleDouble cosine;
+    sinCos(x, sine, cosine);
+    return cosine;
+}
+
+doubleDouble scalarTraits<doubleDouble>::tan(const doubleDouble &x) {
+    doubleDouble sine;
+    doubleDouble cosine;
+    sinCos(x, sine, cosine);
+    return sine / cosine;
+}
+
+doubleDouble scalarTraits<doubleDouble>::exp(const doubleDouble &x) {
+    if (x.hi > 709.8){
+        return infinity();
+    }
+    if (x.hi < -745.2){
+        return 0;
+    }
+    if (std::isnan(x.hi)){
+        return nan();
+    }
+    // exp(x) = 2^k exp(r), r is made small enough for a short series and squared back as expm1
+    double k = std::nearbyint(x.hi / ddLn2.hi);
+    doubleDouble reduced = scaleByTwo(x - ddLn2 * k, -ddExpHalvings);
+    const doubleDouble *inverse = inverseFactorials();
+    doubleDouble expm1 = inverse[ddExpTerms];
+    for (int n = ddExpTerms - 1; n >= 1; --n) {
+        expm1 = expm1 * reduced + inverse[n];
+    }
+    expm1 *= reduced;
+    for (int i = 0; i < ddExpHalvings; ++i) {
+        // (1 + m)^2 - 1 = m (m + 2), keeps the small m exact instead of rounding 1 + m
+        expm1 = expm1 * (expm1 + 2);
+    }
+    return scaleByTwo(expm1 + 1, static_cast<int>(k));
+}
+
+doubleDouble scalarTraits<doubleDouble>::log(const doubleDouble &x) {
+    if (!(x.hi > 0) || !std::isfinite(x.hi)){
+        return std::log(x.hi);
+    }
+    // One Newton step on exp(y) = x doubles the 53 correct bits of the double logarithm
+    doubleDouble estimate = std::log(x.hi);
+    return estimate + x * exp(-estimate) - 1;
+}
+
+doubleDouble scalarTraits<doubleDouble>::pow(const doubleDouble &base, const doubleDouble &exponent) {
+    if (base.hi == 0 || !std::isfinite(base.hi) || !std::isfinite(exponent.hi)){
+        return std::pow(base.hi, exponent.hi);
+    }
+    doubleDouble integer = truncate(exponent);
+    if (integer == exponent && std::abs(exponent.hi) < 0x1p30){
+        // Integer powers by squaring round once per step instead of going through log and exp
+        doubleDouble result = 1;
+        doubleDouble square = base;
+        for (auto rest = static_cast<uint64_t>(std::abs(exponent.hi)); rest != 0; rest >>= 1) {
+            if ((rest & 1) != 0){
+                result *= square;
+            }
+            square *= square;
+        }
+        return exponent.hi < 0 ? 1 / result : result;
+    }
+    if (base.hi < 0){
+        return nan();
+    }
+    return exp(exponent * log(base));
+}
+
+doubleDouble scalarTraits<doubleDouble>::log10(const doubleDouble &x) {
+    return log(x) / ddLn10;
+}
+
+doubleDouble scalarTraits<doubleDouble>::copysign(const doubleDouble &magnitude, const doubleDouble &sign) {
+    return std::signbit(magnitude.hi) != std::signbit(sign.hi) ? -magnitude : magnitude;
+}
+
+doubleDouble scalarTraits<doubleDouble>::modf(const doubleDouble &x, doubleDouble *intpart) {
+    *intpart = truncate(x);
+    return std::isinf(x.hi) ? copysign(0, x) : x - *intpart;
+}
+
+doubleDouble scalarTraits<doubleDouble>::gamma(const doubleDouble &x) {
+    if (!std::isfinite(x.hi)){
+        return x.hi > 0 ? x : nan();
+    }
+    if (x.hi < 0.5){
+        // Reflection Γ(x) Γ(1 - x) = π / sin(πx)
+        return ddPi / (sin(ddPi * x) * gamma(1 - x));
+    }
+    if (x.hi > 171.7){
+        return infinity();
+    }
+    // Γ(x) = Γ(x + n) / (x (x + 1) ... (x + n - 1)) moves x into the range of the Stirling series
+    doubleDouble shifted = x;
+    doubleDouble product = 1;
+    while (shifted.hi < ddStirlingMin) {
+        product *= shifted;
+        shifted += 1;
+    }
+    return exp(logGammaStirling(shifted)) / product;
+}
+
+doubleDouble scalarTraits<doubleDouble>::fmod(const doubleDouble &lhs, const doubleDouble &rhs) {
+    doubleDouble dividend = truncate(lhs);
+    doubleDouble divisor = truncate(rhs);
+    if (dividend == lhs && divisor == rhs && std::abs(lhs.hi) < 0x1p106 && std::abs(rhs.hi) < 0x1p106){
+        // Both are integers that fit __int128 exactly
+        auto toInt128 = [](const doubleDouble &value) {
+            return static_cast<__int128>(value.hi) + static_cast<__int128>(value.lo);
+        };
+        __int128 remainder = toInt128(lhs) % toInt128(rhs);
+        auto high = static_cast<double>(remainder);
+        doubleDouble result{high, static_cast<double>(remainder - static_cast<__int128>(high))};
+        return remainder == 0 ? copysign(0, lhs) : result;
+    }
+    doubleDouble intpart;
+    modf(lhs / rhs, &intpart);
+    return lhs - intpart * rhs;
+}
+
+doubleDouble scalarTraits<doubleDouble>::parse(const std::string &text) {
+    doubleDouble value = 0;
+    int exponent = 0;
+    int digits = 0;
+    size_t position = 0;
+    bool fraction = false;
+    for (; position < text.size(); ++position) {
+        char c = text[position];
+        if (c == '.'){
+            fraction = true;
+            continue;
+        }
+        if (c < '0' || c > '9'){
+            break;
+        }
+        // Digits past the precision only move the decimal point
+        if (digits < ddSignificantDigits + 2){
+            value = value * 10 + (c - '0');
+            digits += value.hi != 0 ? 1 : 0;
+            exponent -= fraction ? 1 : 0;
+        } else {
+            exponent += fraction ? 0 : 1;
+        }
+    }
+    if (position < text.size() && (text[position] == 'e' || text[position] == 'E')){
+        exponent += static_cast<int>(std::clamp(std::strtol(text.c_str() + position + 1, nullptr, 10), -100000L, 100000L));
+    }
+    return scaleByTen(value, exponent);
+}
+
+std::string scalarTraits<doubleDouble>::format(const doubleDouble &value, int precision) {
+    if (!std::isfinite(value.hi)){
+        return std::isnan(value.hi) ? "nan" : value.hi < 0 ? "-inf" : "inf";
+    }
+    precision = std::max(precision, 0);
+    // Significant digits from 10^top down to the last decimal place asked for
+    std::string digits;
+    int top = 0;
+    if (value.hi != 0){
+        top = static_cast<int>(std::floor(std::log10(std::abs(value.hi))));
+        doubleDouble scaled = scaleByTen(absolute(value), -top);
+        if (scaled >= 10){
+            scaled /= 10;
+            top++;
+        } else if (scaled < 1){
+            scaled *= 10;
+            top--;
+        }
+        int count = std::min(top + 1 + precision, ddSignificantDigits);
+        // One digit more decides the rounding
+        for (int i = 0; i <= count && count >= 0; ++i) {
+            doubleDouble digit = truncate(scaled);
+            int whole = std::clamp(static_cast<int>(digit.hi), 0, 9);
+            digits += static_cast<char>('0' + whole);
+            scaled = (scaled - whole) * 10;
+        }
+        bool roundUp = !digits.empty() && digits.back() >= '5';
+        if (!digits.empty()){
+            digits.pop_back();
+        }
+        for (size_t i = digits.size(); roundUp && i-- > 0;) {
+            roundUp = digits[i] == '9';
+            digits[i] = roundUp ? '0' : static_cast<char>(digits[i] + 1);
+        }
+        if (roundUp){
+            digits.insert(digits.begin(), '1');
+            top++;
+        }
+    }
+    auto digitAt = [&digits, top](int position) {
+        int index = top - position;
+        return index >= 0 && index < static_cast<int>(digits.size()) ? digits[index] : '0';
+    };
+    std::string text = std::signbit(value.hi) ? "-" : "";
+    for (int position = std::max(top, 0); position >= 0; --position) {
+        text += digitAt(position);
+    }
+    if (precision > 0){
+        text += '.';
+        for (int position = -1; position >= -precision; --position) {
+            text += digitAt(position);
+        }
+    }
+    return text;
+}
@@ -0,0 +1,995 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include "calclib/expression.hpp"
+#include "calclib/jit.hpp"
+#include "accuracy.hpp"
+
+namespace {
+    constexpr uint32_t inlineStackSize = 64; //! Stack depth served without allocating, one slot is spare for unary operations
+    constexpr size_t blockRows = 256; //! Rows runColumns evaluates per instruction, a stack entry fits in L1
+    thread_local bool loopsOnThread = false; //! See expressionView::keepLoopsOnThread
+
+    /**
+     * Threads that split long sums and products, started on first use and kept for the life of the process.
+     * One loop uses them at a time. A loop that finds them busy, or runs in a process forked after they started,
+     * is evaluated by its own thread alone.
+     */
+    class loopThreads {
+        std::mutex useLock; //! Held by the loop using the threads
+        std::mutex jobLock;
+        std::condition_variable jobReady;
+        std::condition_variable jobDone;
+        unsigned helpers = 0; //! Threads besides the caller
+        size_t generation = 0; //! Incremented for every job so sleeping threads notice it
+        unsigned running = 0; //! Helpers that have not finished the current job
+        unsigned parts = 0;
+        const std::function<void(unsigned)> *job = nullptr;
+        std::exception_ptr failure; //! First exception thrown by a helper
+        pid_t owner = getpid();
+
+        loopThreads() {
+            unsigned wanted = std::max(1u, std::thread::hardware_concurrency()) - 1;
+            try {
+                for (; helpers < wanted; ++helpers) {
+                    std::thread(&loopThreads::threadMain, this, helpers + 1).detach();
+                }
+            } catch (const std::system_error &) {
+                // Fewer threads than cores, loops are split across those that started
+            }
+        }
+
+        void threadMain(unsigned part) {
+            loopsOnThread = true;
+            size_t seen = 0;
+            while (true) {
+                const std::function<void(unsigned)> *current;
+                {
+                    std::unique_lock<std::mutex> guard(jobLock);
+                    jobReady.wait(guard, [&]() { return generation != seen; });
+                    seen = generation;
+                    current = part < parts ? job : nullptr;
+                }
+                std::exception_ptr thrown;
+                if (current != nullptr){
+                    try {
+                        (*current)(part);
+                    } catch (...) {
+                        thrown = std::current_exception();
+                    }
+                }
+                std::lock_guard<std::mutex> guard(jobLock);
+                if (thrown && !failure){
+                    failure = thrown;
+                }
+                if (--running == 0){
+                    jobDone.notify_one();
+                }
+            }
+        }
+
+    public:
+        /**
+         * @return the threads of the process. Never destroyed, detached helpers still wait on it at exit.
+         */
+        static loopThreads& instance() {
+            static loopThreads *threads = new loopThreads();
+            return *threads;
+        }
+
+        /**
+         * @return number of parts a job can be split into, the caller included
+         */
+        unsigned size() const {
+            return helpers + 1;
+        }
+
+        /**
+         * Runs part(0) to part(count - 1) in parallel, part(0) on the calling thread. Exceptions are rethrown after
+         * every part finished.
+         * @param count number of parts, at most size()
+         * @param part body run once for every index
+         * @return false if the threads are in use or belong to another process, nothing ran then
+         */
+        bool run(unsigned count, const std::function<void(unsigned)> &part) {
+            std::unique_lock<std::mutex> use(useLock, std::try_to_lock);
+            if (!use.owns_lock() || getpid() != owner){
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex> guard(jobLock);
+                job = &part;
+                parts = count;
+                running = helpers;
+                failure = nullptr;
+                generation++;
+            }
+            jobReady.notify_all();
+            std::exception_ptr thrown;
+            bool kept = loopsOnThread;
+            loopsOnThread = true;
+            try {
+                part(0);
+            } catch (...) {
+                thrown = std::current_exception();
+            }
+            loopsOnThread = kept;
+            std::unique_lock<std::mutex> guard(jobLock);
+            jobDone.wait(guard, [&]() { return running == 0; });
+            if (!thrown){
+                thrown = failure;
+            }
+            if (thrown){
+                std::rethrow_exception(thrown);
+            }
+            return true;
+        }
+    };
+}
+
+bool expressionView::keepLoopsOnThread(bool keep) {
+    bool previous = loopsOnThread;
+    loopsOnThread = keep;
+    return previous;
+}
+
+unsigned compiledExpression::arity(Opcode op) {
+    switch (op) {
+        case Opcode::constant:
+        case Opcode::variable:
+        case Opcode::branch:
+        case Opcode::jump:
+        case Opcode::endLoop:
+            return 0;
+        case Opcode::negate:
+        case Opcode::factorial:
+        case Opcode::sin:
+        case Opcode::cos:
+        case Opcode::tan:
+        case Opcode::sqrt:
+        case Opcode::log10:
+        case Opcode::cbrt:
+        case Opcode::polynomial:
+        case Opcode::abs:
+            return 1;
+        case Opcode::fma:
+        case Opcode::select:
+            return 3;
+        default:
+            return 2;
+    }
+}
+
+bool compiledExpression::tiered(Opcode op) {
+    switch (op) {
+        case Opcode::pow:
+        case Opcode::sin:
+        case Opcode::cos:
+        case Opcode::tan:
+        case Opcode::sqrt:
+        case Opcode::log10:
+        case Opcode::log:
+        case Opcode::root:
+        case Opcode::cbrt:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool compiledExpression::chainedPower(double exponent, calcLib::Accuracy accuracy) {
+    switch (accuracy) {
+        case calcLib::Accuracy::correctlyRounded:
+            return correctlyRoundedMath::chainedPower(exponent);
+        case calcLib::Accuracy::fast:
+            return fastMath::chainedPower(exponent);
+        default:
+            return calcLib::chainedPower(exponent);
+    }
+}
+
+bool compiledExpression::exactReciprocal(double divisor, double &outReciprocal) {
+    int exponent;
+    outReciprocal = 1 / divisor;
+    return std::abs(std::frexp(divisor, &exponent)) == 0.5 && std::isfinite(outReciprocal);
+}
+
+namespace {
+    /**
+     * compiledExpression::simulate of the instructions first..last - 1, the deepest stack is merged into outStackSize
+     */
+    bool simulateInstructions(const compiledExpression::Instruction *code, size_t first, size_t last,
+                              uint32_t slotCount, uint32_t &outStackSize) {
+        using Opcode = compiledExpression::Opcode;
+        struct conditional {
+            uint32_t depth; //! Depth with the condition on top
+            size_t otherwise; //! First instruction of the else branch
+            size_t end; //! Index of the select, 0 until the jump is reached
+        };
+        std::vector<conditional> open;
+        uint32_t depth = 0;
+        for (size_t i = first; i < last; ++i) {
+            const compiledExpression::Instruction &instruction = code[i];
+            // Values below the innermost branch belong to the conditional, the branch must leave them alone
+            uint32_t floor = 0;
+            if (!open.empty()){
+                const conditional &inner = open.back();
+                if (inner.end == 0 && i >= inner.otherwise){
+                    return false;
+                }
+                floor = inner.depth + (inner.end != 0 ? 1 : 0);
+            }
+            switch (instruction.op) {
+                case Opcode::branch:
+                    if (depth <= floor || instruction.operand <= i + 1 || instruction.operand >= last){
+                        return false;
+                    }
+                    open.push_back({depth, instruction.operand, 0});
+                    break;
+                case Opcode::jump:
+                    if (open.empty() || open.back().end != 0 || open.back().otherwise != i + 1
+                        || depth != open.back().depth + 1 || instruction.operand <= i + 1 || instruction.operand >= last
+                        || code[instruction.operand].op != Opcode::select){
+                        return false;
+                    }
+                    open.back().end = instruction.operand;
+                    break;
+                case Opcode::select:
+                    if (open.empty() || open.back().end != i || depth != open.back().depth + 2){
+                        return false;
+                    }
+                    open.pop_back();
+                    depth -= 2;
+                    break;
+                case Opcode::sum:
+                case Opcode::product: {
+                    // The body sees the index in the slot after those of the code around it
+                    size_t end = instruction.operand;
+                    if (depth < floor + 2 || end <= i + 1 || end >= last || code[end].op != Opcode::endLoop
+                        || code[end].operand != slotCount || slotCount == UINT32_MAX
+                        || !simulateInstructions(code, i + 1, end, slotCount + 1, outStackSize)){
+                        return false;
+                    }
+                    depth--;
+                    i = end;
+                    break;
+                }
+                case Opcode::endLoop:
+                    return false;
+                default: {
+                    unsigned popped = compiledExpression::arity(instruction.op);
+                    if (depth < floor + popped
+                        || (instruction.op == Opcode::variable && instruction.operand >= slotCount)){
+                        return false;
+                    }
+                    depth = depth - popped + 1;
+                    outStackSize = std::max(outStackSize, depth);
+                }
+            }
+        }
+        return open.empty() && depth == 1;
+    }
+}
+
+bool compiledExpression::simulate(const Instruction *code, size_t codeSize, uint32_t slotCount, uint32_t &outStackSize) {
+    outStackSize = 0;
+    return simulateInstructions(code, 0, codeSize, slotCount, outStackSize);
+}
+
+calcLib::Status compiledExpression::apply(Opcode op, double lhs, double rhs, double &outResult, calcLib::Accuracy accuracy) {
+    switch (accuracy) {
+        case calcLib::Accuracy::correctlyRounded:
+            return applyTier<correctlyRoundedMath>(op, lhs, rhs, outResult);
+        case calcLib::Accuracy::fast:
+            return applyTier<fastMath>(op, lhs, rhs, outResult);
+        default:
+            return applyTier<calcLib>(op, lhs, rhs, outResult);
+    }
+}
+
+template<typename Math>
+calcLib::Status compiledExpression::applyTier(Opcode op, double lhs, double rhs, double &outResult) {
+    switch (op) {
+        case Opcode::negate:
+            outResult = -lhs;
+            break;
+        case Opcode::factorial:
+            outResult = calcLib::factorial(lhs);
+            break;
+        case Opcode::add:
+            outResult = calcLib::add(lhs, rhs);
+            break;
+        case Opcode::sub:
+            outResult = calcLib::sub(lhs, rhs);
+            break;
+        case Opcode::mul:
+            outResult = calcLib::mul(lhs, rhs);
+            break;
+        case Opcode::div:
+            return calcLib::div(lhs, rhs, outResult);
+        case Opcode::mod:
+            return calcLib::mod(lhs, rhs, outResult);
+        case Opcode::pow:
+            outResult = Math::pow(lhs, rhs);
+            break;
+        case Opcode::sin:
+            outResult = Math::sin(lhs);
+            break;
+        case Opcode::cos:
+            outResult = Math::cos(lhs);
+            break;
+        case Opcode::tan:
+            return Math::tan(lhs, outResult);
+        case Opcode::sqrt:
+            return Math::sqrt(lhs, outResult);
+        case Opcode::log10:
+            outResult = Math::log(lhs);
+            break;
+        case Opcode::log:
+            return Math::log(lhs, rhs, outResult);
+        case Opcode::root:
+            return Math::root(lhs, rhs, outResult);
+        case Opcode::cbrt:
+            return Math::cbrt(lhs, outResult);
+        case Opcode::powInt:
+            outResult = calcLib::powInt(lhs, rhs);
+            break;
+        case Opcode::less:
+            outResult = lhs < rhs;
+            break;
+        case Opcode::lessEqual:
+            outResult = lhs <= rhs;
+            break;
+        case Opcode::greater:
+            outResult = lhs > rhs;
+            break;
+        case Opcode::greaterEqual:
+            outResult = lhs >= rhs;
+            break;
+        case Opcode::equal:
+            outResult = lhs == rhs;
+            break;
+        case Opcode::notEqual:
+            outResult = lhs != rhs;
+            break;
+        case Opcode::min:
+            outResult = calcLib::min(lhs, rhs);
+            break;
+        case Opcode::max:
+            outResult = calcLib::max(lhs, rhs);
+            break;
+        case Opcode::abs:
+            outResult = std::abs(lhs);
+            break;
+        default:
+            return calcLib::Status::invalidExpression;
+    }
+    return calcLib::Status::ok;
+}
+
+double compiledExpression::horner(const double *coefficients, uint32_t degree, double x) {
+    double sum = coefficients[degree];
+    for (uint32_t k = degree; k-- > 0;) {
+        sum = sum * x + coefficients[k];
+    }
+    return sum;
+}
+
+void compiledExpression::horner(const double *coefficients, uint32_t degree, double *values, size_t count) {
+    double sums[blockRows];
+    for (size_t first = 0; first < count; first += blockRows) {
+        size_t rows = std::min(blockRows, count - first);
+        double *x = values + first;
+        std::fill(sums, sums + rows, coefficients[degree]);
+        // One pass per coefficient keeps the rows in SIMD lanes, unlike running horner per row
+        for (uint32_t k = degree; k-- > 0;) {
+            for (size_t i = 0; i < rows; ++i) {
+                sums[i] = sums[i] * x[i] + coefficients[k];
+            }
+        }
+        std::copy(sums, sums + rows, x);
+    }
+}
+
+calcLib::Status compiledExpression::indexRange(double lo, double hi, uint64_t &outTerms) {
+    constexpr double exactLimit = 9007199254740992.0; // 2^53, every integer below it is a double
+    outTerms = 0;
+    if (!(std::abs(lo) < exactLimit && std::abs(hi) < exactLimit) || std::trunc(lo) != lo || std::trunc(hi) != hi){
+        return calcLib::Status::domainError;
+    }
+    if (hi < lo){
+        return calcLib::Status::ok;
+    }
+    // Rounding of hi - lo cannot cross maxTerms, integers around it are exact
+    double terms = hi - lo + 1;
+    if (terms > static_cast<double>(maxTerms)){
+        return calcLib::Status::domainError;
+    }
+    outTerms = static_cast<uint64_t>(terms);
+    return calcLib::Status::ok;
+}
+
+calcLib::Status compiledExpression::series(const double *terms, double lo, double hi, double &outResult) {
+    uint64_t count;
+    calcLib::Status status = indexRange(lo, hi, count);
+    if (status != calcLib::Status::ok){
+        outResult = NAN;
+        return status;
+    }
+    switch (static_cast<int>(terms[0])) {
+        case 0:
+            outResult = count == 0 ? 0 : horner(terms + 2, static_cast<uint32_t>(terms[1]), hi)
+                                         - horner(terms + 2, static_cast<uint32_t>(terms[1]), lo - 1);
+            break;
+        case 1:
+            outResult = count == 0 ? 0 : terms[1] * std::pow(terms[2], lo) * (std::pow(terms[2], static_cast<double>(count)) - 1)
+                                         / (terms[2] - 1);
+            break;
+        default:
+            outResult = std::pow(terms[1], static_cast<double>(count));
+    }
+    return calcLib::Status::ok;
+}
+
+polynomialTerms polynomialTerms::constant(double value) {
+    polynomialTerms result;
+    result.coefficients[0] = value;
+    return result;
+}
+
+polynomialTerms polynomialTerms::symbol(int64_t variable) {
+    polynomialTerms result;
+    result.variable = variable;
+    result.degree = 1;
+    result.coefficients[0] = 0;
+    result.coefficients[1] = 1;
+    return result;
+}
+
+bool polynomialTerms::apply(compiledExpression::Opcode op, const polynomialTerms &operand) {
+    using Opcode = compiledExpression::Opcode;
+    if (op == Opcode::negate){
+        std::transform(coefficients, coefficients + degree + 1, coefficients, std::negate<>());
+        return true;
+    }
+    if (variable >= 0 && operand.variable >= 0 && variable != operand.variable){
+        return false;
+    }
+    bool constantOperand = operand.variable < 0;
+    variable = std::max(variable, operand.variable);
+    switch (op) {
+        case Opcode::add:
+        case Opcode::sub: {
+            double sign = op == Opcode::sub ? -1 : 1;
+            std::fill(coefficients + degree + 1, coefficients + std::max(degree, operand.degree) + 1, 0.0);
+            degree = std::max(degree, operand.degree);
+            for (uint32_t k = 0; k <= operand.degree; ++k) {
+                coefficients[k] += sign * operand.coefficients[k];
+            }
+            break;
+        }
+        case Opcode::mul: {
+            if ((terms() > 1 && operand.terms() > 1) || degree + operand.degree > maxDegree){
+                return false;
+            }
+            double product[maxDegree + 1] = {};
+            // One side has a single nonzero term, so no coefficient of the product is a sum
+            for (uint32_t i = 0; i <= degree; ++i) {
+                for (uint32_t j = 0; j <= operand.degree; ++j) {
+                    if (coefficients[i] != 0 && operand.coefficients[j] != 0){
+                        product[i + j] = coefficients[i] * operand.coefficients[j];
+                    }
+                }
+            }
+            degree += operand.degree;
+            std::copy(product, product + degree + 1, coefficients);
+            break;
+        }
+        case Opcode::div:
+            if (!constantOperand || operand.coefficients[0] == 0){
+                return false;
+            }
+            for (uint32_t k = 0; k <= degree; ++k) {
+                coefficients[k] /= operand.coefficients[0];
+            }
+            break;
+        case Opcode::pow: {
+            double exponent = operand.coefficients[0];
+            if (!constantOperand || terms() > 1 || !(exponent >= 0 && exponent <= maxDegree)
+                || std::trunc(exponent) != exponent || degree * exponent > maxDegree){
+                return false;
+            }
+            auto power = static_cast<uint32_t>(exponent);
+            double coefficient = 1;
+            for (uint32_t i = 0; i < power; ++i) {
+                coefficient *= coefficients[degree];
+            }
+            // x^0 is 1 even where the base is zero, NaN or infinite
+            std::fill(coefficients, coefficients + degree * power, 0.0);
+            degree *= power;
+            coefficients[degree] = coefficient;
+            break;
+        }
+        default:
+            return false;
+    }
+    while (degree > 0 && coefficients[degree] == 0) {
+        degree--;
+    }
+    return true;
+}
+
+bool polynomialTerms::collectable() const {
+    return variable >= 0 && degree >= 2 && terms() >= 2;
+}
+
+uint32_t polynomialTerms::terms() const {
+    return static_cast<uint32_t>(std::count_if(coefficients, coefficients + degree + 1,
+                                               [](double coefficient) { return coefficient != 0; }));
+}
+
+template<typename Math>
+void compiledExpression::degreesInPlace(Opcode op, double *values, size_t count) {
+    switch (op) {
+        case Opcode::sin:
+            Math::sin(values, count);
+            break;
+        case Opcode::cos:
+            Math::cos(values, count);
+            break;
+        default:
+            Math::tan(values, count);
+    }
+}
+
+calcLib::Status compiledExpression::run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+    return view().run(slots, outResult, ieeeFlags);
+}
+
+void compiledExpression::runColumns(const double *const *columns, size_t rows, double *outResults,
+                                    calcLib::Status *outStatus, unsigned *ieeeFlags) const {
+    view().runColumns(columns, rows, outResults, outStatus, ieeeFlags);
+}
+
+compiledExpression::tierState& compiledExpression::tierState::operator=(const tierState&) {
+    delete native.exchange(nullptr);
+    calls = 0;
+    return *this;
+}
+
+compiledExpression::tierState::~tierState() {
+    delete native.load();
+}
+
+const jitExpression* compiledExpression::nativeCode(uint32_t threshold) const {
+    const jitExpression *native = tier.native.load(std::memory_order_acquire);
+    if (native != nullptr || threshold == 0 || !jitExpression::supported){
+        return native;
+    }
+    // Exactly one caller sees the count reach threshold, a failed translation is not retried
+    if (tier.calls.fetch_add(1, std::memory_order_relaxed) + 1 != threshold){
+        return nullptr;
+    }
+    native = jitExpression::compile(view()).release();
+    tier.native.store(native, std::memory_order_release);
+    return native;
+}
+
+expressionView compiledExpression::view() const {
+    return expressionView{code.data(), code.size(), constants.data(), stackSize};
+}
+
+calcLib::Status expressionView::run(const double *slots, double &outResult, unsigned *ieeeFlags) const {
+    return run(0, codeSize, slots, outResult, ieeeFlags);
+}
+
+calcLib::Status expressionView::run(size_t first, size_t last, const double *slots, double &outResult,
+                                    unsigned *ieeeFlags) const {
+    using Opcode = compiledExpression::Opcode;
+    double inlineStack[inlineStackSize];
+    std::unique_ptr<double[]> heapStack;
+    double *stack = inlineStack;
+    if (stackSize >= inlineStackSize){
+        heapStack = std::make_unique<double[]>(stackSize + 1);
+        stack = heapStack.get();
+    }
+    double *top = stack; // One past the topmost value
+    for (const auto *instruction = code + first; instruction != code + last; ++instruction) {
+        switch (instruction->op) {
+            case Opcode::constant:
+                *top++ = constants[instruction->operand];
+                break;
+            case Opcode::variable:
+                *top++ = slots[instruction->operand];
+                break;
+            case Opcode::add:
+                top--;
+                top[-1] += top[0];
+                break;
+            case Opcode::sub:
+                top--;
+                top[-1] -= top[0];
+                break;
+            case Opcode::mul:
+                top--;
+                top[-1] *= top[0];
+                break;
+            case Opcode::fma:
+                top -= 2;
+                top[-1] = std::fma(top[-1], top[0], top[1]);
+                break;
+            case Opcode::polynomial:
+                top[-1] = compiledExpression::horner(constants + instruction->operand + 1,
+                                                     static_cast<uint32_t>(constants[instruction->operand]), top[-1]);
+                break;
+            case Opcode::branch:
+                // The branch not taken is skipped, so its errors are never raised
+                if (*--top == 0){
+                    instruction = code + instruction->operand - 1;
+                }
+                break;
+            case Opcode::jump:
+                instruction = code + instruction->operand - 1;
+                break;
+            case Opcode::select:
+                break;
+            case Opcode::sum:
+            case Opcode::product:
+            case Opcode::series: {
+                top--;
+                calcLib::Status status = instruction->op == Opcode::series
+                        ? compiledExpression::series(constants + instruction->operand, top[-1], top[0], top[-1])
+                        : accumulate(instruction - code, slots, top[-1], top[0], top[-1], ieeeFlags);
+                status = calcLib::absorbStatus(status, ieeeFlags);
+                if (status != calcLib::Status::ok){
+                    return status;
+                }
+                if (instruction->op != Opcode::series){
+                    instruction = code + instruction->operand;
+                }
+                break;
+            }
+            default: {
+                top -= compiledExpression::arity(instruction->op);
+                auto accuracy = static_cast<calcLib::Accuracy>(instruction->operand);
+                calcLib::Status status = calcLib::absorbStatus(compiledExpression::apply(instruction->op, top[0], top[1], top[0], accuracy),
+                                                               ieeeFlags);
+                if (status != calcLib::Status::ok){
+                    return status;
+                }
+                top++;
+            }
+        }
+    }
+    if (top != stack + 1){
+        return calcLib::Status::invalidExpression;
+    }
+    outResult = stack[0];
+    return calcLib::Status::ok;
+}
+
+void expressionView::runColumns(const double *const *columns, size_t rows, double *outResults,
+                                calcLib::Status *outStatus, unsigned *ieeeFlags) const {
+    if (codeSize == 0){
+        std::fill(outResults, outResults + rows, NAN);
+        std::fill(outStatus, outStatus + rows, calcLib::Status::invalidExpression);
+        return;
+    }
+    runColumns(0, codeSize, columns, rows, outResults, outStatus, ieeeFlags);
+}
+
+void expressionView::runColumns(size_t first, size_t last, const double *const *columns, size_t rows,
+                                double *outResults, calcLib::Status *outStatus, unsigned *ieeeFlags) const {
+    using Opcode = compiledExpression::Opcode;
+    // One block of rows per stack entry
+    std::vector<double> storage((stackSize + 1) * blockRows);
+    // One block of flags per open conditional, a row reports errors only in the branches it takes
+    size_t nesting = 0;
+    size_t open = 0;
+    for (size_t at = first; at < last; ++at) {
+        if (code[at].op == Opcode::branch){
+            nesting = std::max(nesting, ++open);
+        } else if (code[at].op == Opcode::select){
+            open--;
+        }
+    }
+    std::vector<uint8_t> masks((nesting + 1) * blockRows);
+    std::fill(masks.begin(), masks.begin() + blockRows, 1);
+    // Slots of one row, for the bodies of loops
+    std::vector<double> rowSlots;
+    for (size_t row = 0; row < rows; row += blockRows) {
+        size_t count = std::min(blockRows, rows - row);
+        calcLib::Status *status = outStatus + row;
+        std::fill(status, status + count, calcLib::Status::ok);
+        double *top = storage.data(); // One past the topmost block
+        uint8_t *active = masks.data(); // Rows taking every open branch
+        auto report = [&](size_t i, calcLib::Status result) {
+            if (active[i]){
+                result = calcLib::absorbStatus(result, ieeeFlags);
+                if (result != calcLib::Status::ok && status[i] == calcLib::Status::ok){
+                    status[i] = result;
+                }
+            }
+        };
+        for (size_t at = first; at < last; ++at) {
+            const compiledExpression::Instruction &instruction = code[at];
+            unsigned popped = compiledExpression::arity(instruction.op);
+            double *lhs = top - popped * blockRows; // First operand, receives the result
+            double *rhs = top - std::min(popped, 1u) * blockRows;
+            switch (instruction.op) {
+                case Opcode::constant:
+                    std::fill(top, top + count, constants[instruction.operand]);
+                    top += blockRows;
+                    break;
+                case Opcode::variable:
+                    std::copy(columns[instruction.operand] + row, columns[instruction.operand] + row + count, top);
+                    top += blockRows;
+                    break;
+                case Opcode::negate:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = -lhs[i];
+                    }
+                    break;
+                case Opcode::factorial:
+                    calcLib::factorial(lhs, count);
+                    break;
+                case Opcode::sin:
+                case Opcode::cos:
+                case Opcode::tan:
+                    switch (static_cast<calcLib::Accuracy>(instruction.operand)) {
+                        case calcLib::Accuracy::correctlyRounded:
+                            compiledExpression::degreesInPlace<correctlyRoundedMath>(instruction.op, lhs, count);
+                            break;
+                        case calcLib::Accuracy::fast:
+                            compiledExpression::degreesInPlace<fastMath>(instruction.op, lhs, count);
+                            break;
+                        default:
+                            compiledExpression::degreesInPlace<calcLib>(instruction.op, lhs, count);
+                    }
+                    if (instruction.op != Opcode::tan){
+                        break;
+                    }
+                    for (size_t i = 0; i < count; ++i) {
+                        if (std::isinf(lhs[i])){
+                            report(i, calcLib::Status::divisionByZero);
+                        }
+                    }
+                    break;
+                case Opcode::add:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] += rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::sub:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] -= rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::mul:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] *= rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::fma:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = std::fma(lhs[i], lhs[blockRows + i], rhs[i]);
+                    }
+                    top = lhs + blockRows;
+                    break;
+                case Opcode::powInt:
+                    calcLib::powInt(lhs, rhs, count);
+                    top = lhs + blockRows;
+                    break;
+                case Opcode::polynomial:
+                    compiledExpression::horner(constants + instruction.operand + 1,
+                                               static_cast<uint32_t>(constants[instruction.operand]), lhs, count);
+                    break;
+                case Opcode::less:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::less<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::lessEqual:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::less_equal<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::greater:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::greater<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::greaterEqual:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::greater_equal<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::equal:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::equal_to<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::notEqual:
+                    std::transform(lhs, lhs + count, rhs, lhs, std::not_equal_to<>());
+                    top -= blockRows;
+                    break;
+                case Opcode::min:
+                    calcLib::min(lhs, rhs, count);
+                    top -= blockRows;
+                    break;
+                case Opcode::max:
+                    calcLib::max(lhs, rhs, count);
+                    top -= blockRows;
+                    break;
+                case Opcode::abs:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = std::abs(lhs[i]);
+                    }
+                    break;
+                case Opcode::branch: {
+                    // The condition stays below both branches until select
+                    const double *condition = top - blockRows;
+                    for (size_t i = 0; i < count; ++i) {
+                        active[blockRows + i] = active[i] & (condition[i] != 0);
+                    }
+                    active += blockRows;
+                    break;
+                }
+                case Opcode::jump: {
+                    const double *condition = top - 2 * blockRows;
+                    const uint8_t *enclosing = active - blockRows;
+                    for (size_t i = 0; i < count; ++i) {
+                        active[i] = enclosing[i] & (condition[i] == 0);
+                    }
+                    break;
+                }
+                case Opcode::select:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = lhs[i] != 0 ? lhs[blockRows + i] : rhs[i];
+                    }
+                    active -= blockRows;
+                    top = lhs + blockRows;
+                    break;
+                case Opcode::sum:
+                case Opcode::product: {
+                    // Every active row runs the whole body over its indices
+                    size_t end = instruction.operand;
+                    rowSlots.resize(code[end].operand);
+                    for (size_t i = 0; i < count; ++i) {
+                        if (!active[i]){
+                            lhs[i] = 0;
+                            continue;
+                        }
+                        for (size_t slot = 0; slot < rowSlots.size(); ++slot) {
+                            rowSlots[slot] = columns[slot][row + i];
+                        }
+                        calcLib::Status result = accumulate(at, rowSlots.data(), lhs[i], rhs[i], lhs[i], ieeeFlags);
+                        if (result != calcLib::Status::ok){
+                            report(i, result);
+                        }
+                    }
+                    top = lhs + blockRows;
+                    at = end;
+                    break;
+                }
+                case Opcode::series:
+                    for (size_t i = 0; i < count; ++i) {
+                        calcLib::Status result = compiledExpression::series(constants + instruction.operand, lhs[i],
+                                                                            rhs[i], lhs[i]);
+                        if (result != calcLib::Status::ok){
+                            report(i, result);
+                        }
+                    }
+                    top = lhs + blockRows;
+                    break;
+                case Opcode::pow:
+                case Opcode::log10:
+                    // Neither fails, so the vectorized helpers of the fast tier need no statuses
+                    if (static_cast<calcLib::Accuracy>(instruction.operand) == calcLib::Accuracy::fast){
+                        if (instruction.op == Opcode::pow){
+                            fastMath::pow(lhs, rhs, count);
+                        } else {
+                            fastMath::log(lhs, count);
+                        }
+                        top = lhs + blockRows;
+                        break;
+                    }
+                    [[fallthrough]];
+                default: {
+                    auto accuracy = static_cast<calcLib::Accuracy>(instruction.operand);
+                    for (size_t i = 0; i < count; ++i) {
+                        calcLib::Status result = compiledExpression::apply(instruction.op, lhs[i], rhs[i], lhs[i], accuracy);
+                        if (result != calcLib::Status::ok){
+                            report(i, result);
+                        }
+                    }
+                    top = lhs + blockRows;
+                }
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            outResults[row + i] = status[i] == calcLib::Status::ok ? storage[i] : NAN;
+        }
+    }
+}
+
+calcLib::Status expressionView::accumulate(size_t at, const double *slots, double lo, double hi, double &outResult,
+                                           unsigned *ieeeFlags) const {
+    using Opcode = compiledExpression::Opcode;
+    uint64_t terms;
+    calcLib::Status status = compiledExpression::indexRange(lo, hi, terms);
+    if (status != calcLib::Status::ok){
+        outResult = NAN;
+        return status;
+    }
+    bool product = code[at].op == Opcode::product;
+    size_t end = code[at].operand;
+    size_t indexSlot = code[end].operand;
+    size_t chunks = (terms + chunkTerms - 1) / chunkTerms;
+    std::vector<double> partials(chunks);
+    std::vector<calcLib::Status> statuses(chunks);
+    auto runChunks = [&](size_t firstChunk, size_t lastChunk, unsigned *flags) {
+        size_t width = static_cast<size_t>(std::min<uint64_t>(terms, chunkTerms));
+        // The slots of the enclosing code are the same for every index
+        std::vector<double> values((indexSlot + 1) * width);
+        std::vector<const double*> columns(indexSlot + 1);
+        for (size_t slot = 0; slot <= indexSlot; ++slot) {
+            std::fill(values.begin() + slot * width, values.begin() + (slot + 1) * width, slot < indexSlot ? slots[slot] : 0);
+            columns[slot] = values.data() + slot * width;
+        }
+        double *index = values.data() + indexSlot * width;
+        std::vector<double> results(width);
+        std::vector<calcLib::Status> rowStatus(width);
+        for (size_t chunk = firstChunk; chunk < lastChunk; ++chunk) {
+            uint64_t offset = chunk * chunkTerms;
+            size_t count = static_cast<size_t>(std::min<uint64_t>(terms - offset, chunkTerms));
+            for (size_t i = 0; i < count; ++i) {
+                index[i] = lo + static_cast<double>(offset + i);
+            }
+            runColumns(at + 1, end, columns.data(), count, results.data(), rowStatus.data(), flags);
+            double partial = product ? 1 : 0;
+            statuses[chunk] = calcLib::Status::ok;
+            for (size_t i = 0; i < count; ++i) {
+                if (rowStatus[i] != calcLib::Status::ok){
+                    statuses[chunk] = rowStatus[i];
+                    break;
+                }
+                partial = product ? partial * results[i] : partial + results[i];
+            }
+            partials[chunk] = partial;
+        }
+    };
+    bool split = false;
+    if (terms > parallelTerms && !loopsOnThread){
+        loopThreads &threads = loopThreads::instance();
+        auto parts = static_cast<unsigned>(std::min<size_t>(threads.size(), chunks));
+        std::vector<unsigned> flags(parts);
+        // Loops inside the body stay on the thread running the part
+        split = parts > 1 && threads.run(parts, [&](unsigned part) {
+            runChunks(chunks * part / parts, chunks * (part + 1) / parts, ieeeFlags != nullptr ? &flags[part] : nullptr);
+        });
+        if (split && ieeeFlags != nullptr){
+            for (unsigned raised : flags) {
+                *ieeeFlags |= raised;
+            }
+        }
+    }
+    if (!split){
+        runChunks(0, chunks, ieeeFlags);
+    }
+    double result = product ? 1 : 0;
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        if (statuses[chunk] != calcLib::Status::ok){
+            outResult = NAN;
+            return statuses[chunk];
+        }
+        result = product ? result * partials[chunk] : result + partials[chunk];
+    }
+    outResult = result;
+    return calcLib::Status::ok;
+}
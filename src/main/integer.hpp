@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include "calclib/scalar.hpp"
+
+/**
+ * Exact int64_t paths of %, ^ and ! shared by the double helpers of calcLib and basicExpression.
+ * Operands are floating point values, an operation takes the integer path only when they are integers
+ * that fit int64_t, and falls back to floating point when the result overflows.
+ */
+namespace calcInteger {
+
+/**
+ * @param value
+ * @param outInteger value as int64_t
+ * @return true if value is an integer in the open range (-2^63, 2^63)
+ */
+template<typename Scalar>
+bool toInteger(Scalar value, int64_t &outInteger) {
+    constexpr Scalar limit = static_cast<Scalar>(UINT64_C(1) << 63);
+    if (!(value > -limit && value < limit)){
+        return false;
+    }
+    outInteger = static_cast<int64_t>(value);
+    return static_cast<Scalar>(outInteger) == value;
+}
+
+/**
+ * Remainder with the sign of lhs, like the floating point path
+ * @return false if the operands are not integers or rhs is 0
+ */
+template<typename Scalar>
+bool mod(Scalar lhs, Scalar rhs, Scalar &outResult) {
+    int64_t dividend;
+    int64_t divisor;
+    if (!toInteger(lhs, dividend) || !toInteger(rhs, divisor) || divisor == 0){
+        return false;
+    }
+    int64_t remainder = dividend % divisor;
+    // A zero remainder keeps the sign of lhs
+    outResult = remainder == 0 ? scalarTraits<Scalar>::copysign(0, lhs) : static_cast<Scalar>(remainder);
+    return true;
+}
+
+/**
+ * base^exponent by repeated squaring
+ * @return false if the operands are not a nonzero integer base and a non-negative integer exponent,
+ * or the result overflows int64_t
+ */
+template<typename Scalar>
+bool pow(Scalar base, Scalar exponent, Scalar &outResult) {
+    int64_t factor;
+    int64_t remaining;
+    // 0^n keeps the sign of a -0 base on the floating point path
+    if (base == 0 || !toInteger(base, factor) || !toInteger(exponent, remaining) || remaining < 0){
+        return false;
+    }
+    // |base| >= 2^(bits-1), so the result cannot fit when (bits-1)*exponent >= 63. Rejecting that early
+    // keeps overflowing powers from paying for the multiplications before the floating point path.
+    uint64_t magnitude = factor < 0 ? 0 - static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+    int64_t bits = 64 - __builtin_clzll(magnitude);
+    if (remaining > 63 || (bits - 1) * remaining >= 63){
+        return false;
+    }
+    int64_t result = 1;
+    if (bits * remaining <= 63){
+        // |result| < 2^63 and so is every square needed, multiply without checks and select without branches.
+        // Unsigned, because the square after the last bit may wrap.
+        uint64_t product = 1;
+        uint64_t square = static_cast<uint64_t>(factor);
+        while (remaining > 0) {
+            product *= (remaining & 1) != 0 ? square : 1;
+            square *= square;
+            remaining >>= 1;
+        }
+        result = static_cast<int64_t>(product);
+    }
+    // Results near 2^63 are checked on every multiplication
+    while (remaining > 0) {
+        if ((remaining & 1) != 0 && __builtin_mul_overflow(result, factor, &result)){
+            return false;
+        }
+        remaining >>= 1;
+        if (remaining > 0 && __builtin_mul_overflow(factor, factor, &factor)){
+            return false;
+        }
+    }
+    outResult = static_cast<Scalar>(result);
+    return true;
+}
+
+/**
+ * Product 2*3*...*n, exact in int64_t up to 20!, continued in Scalar after the first overflow
+ * until it reaches infinity
+ * @param n non-negative integer
+ */
+template<typename Scalar>
+Scalar factorial(int64_t n) {
+    int64_t exact = 1;
+    int64_t factor = 2;
+    for (int64_t product; factor <= n && !__builtin_mul_overflow(exact, factor, &product); ++factor) {
+        exact = product;
+    }
+    Scalar result = static_cast<Scalar>(exact);
+    for (; factor <= n && result != scalarTraits<Scalar>::infinity(); ++factor) {
+        result *= static_cast<Scalar>(factor);
+    }
+    return result;
+}
+
+}
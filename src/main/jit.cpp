@@ -0,0 +1,709 @@
+#include "calclib/jit.hpp"
+
+#if CALCLIB_HAS_JIT
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "accuracy.hpp"
+
+namespace {
+    constexpr unsigned registerSlots = 14; //! Stack entries kept in xmm2..xmm15, deeper ones live in the frame
+    constexpr uint32_t maxStackSize = 4096; //! Deeper expressions stay interpreted
+    constexpr int rax = 0, rbx = 3, r13 = 13, r15 = 15; //! Frame pointer rbx, slots r15, outResult r13, ieeeFlags r14
+
+    using Opcode = compiledExpression::Opcode;
+    constexpr size_t opcodeCount = static_cast<size_t>(compiledExpression::lastOpcode) + 1;
+    constexpr size_t accuracyCount = static_cast<size_t>(calcLib::Accuracy::fast) + 1;
+    using helperTable = const void *[opcodeCount];
+
+    /**
+     * @return true if the helper of op returns calcLib::Status and writes its result through a pointer
+     */
+    bool checked(Opcode op) {
+        switch (op) {
+            case Opcode::tan:
+            case Opcode::sqrt:
+            case Opcode::mod:
+            case Opcode::log:
+            case Opcode::root:
+            case Opcode::cbrt:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Emits the handful of x86-64 instructions the translation needs
+     */
+    class assembler {
+    public:
+        std::vector<uint8_t> bytes;
+        std::vector<size_t> exitJumps; //! rel32 fields patched to the shared exit
+
+        void byte(uint8_t value) {
+            bytes.push_back(value);
+        }
+
+        void bytes32(uint32_t value) {
+            for (int i = 0; i < 4; ++i) {
+                byte(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        void bytes64(uint64_t value) {
+            bytes32(static_cast<uint32_t>(value));
+            bytes32(static_cast<uint32_t>(value >> 32));
+        }
+
+        /**
+         * SSE instruction with register operands: prefix 0F opcode, reg is destination
+         */
+        void sse(uint8_t prefix, uint8_t opcode, int reg, int rm) {
+            byte(prefix);
+            rex(0, reg, rm);
+            byte(0x0F);
+            byte(opcode);
+            byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+        }
+
+        /**
+         * SSE instruction with memory operand [base + disp]
+         */
+        void sseMemory(uint8_t prefix, uint8_t opcode, int reg, int base, int32_t disp) {
+            byte(prefix);
+            rex(0, reg, base);
+            byte(0x0F);
+            byte(opcode);
+            byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+            bytes32(static_cast<uint32_t>(disp));
+        }
+
+        /**
+         * vfmadd213sd reg, multiplier, addend: reg = multiplier * reg + addend, rounded once
+         */
+        void fmadd(int reg, int multiplier, int addend) {
+            vexFmadd(reg, multiplier, addend);
+            byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (addend & 7)));
+        }
+
+        /**
+         * vfmadd213sd with the addend in memory at [base + disp]
+         */
+        void fmaddMemory(int reg, int multiplier, int base, int32_t disp) {
+            vexFmadd(reg, multiplier, base);
+            byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+            bytes32(static_cast<uint32_t>(disp));
+        }
+
+        void movabsRax(uint64_t value) {
+            byte(0x48);
+            byte(0xB8);
+            bytes64(value);
+        }
+
+        /**
+         * movq xmm, rax
+         */
+        void movqFromRax(int xmm) {
+            byte(0x66);
+            rex(1, xmm, rax);
+            byte(0x0F);
+            byte(0x6E);
+            byte(static_cast<uint8_t>(0xC0 | (xmm & 7) << 3));
+        }
+
+        void callAbsolute(const void *function) {
+            movabsRax(reinterpret_cast<uint64_t>(function));
+            byte(0xFF);
+            byte(0xD0);
+        }
+
+        /**
+         * Jump with rel32 operand, opcode bytes are given by the caller
+         * @return position of the operand for patch()
+         */
+        size_t jump(std::initializer_list<uint8_t> opcode) {
+            for (uint8_t value : opcode) {
+                byte(value);
+            }
+            bytes32(0);
+            return bytes.size() - 4;
+        }
+
+        void jumpToExit(std::initializer_list<uint8_t> opcode) {
+            exitJumps.push_back(jump(opcode));
+        }
+
+        /**
+         * Points the jump operand at to the current position
+         */
+        void patch(size_t at) {
+            patch(at, bytes.size());
+        }
+
+        void patch(size_t at, size_t target) {
+            uint32_t relative = static_cast<uint32_t>(target - (at + 4));
+            std::memcpy(bytes.data() + at, &relative, sizeof(relative));
+        }
+
+    private:
+        /**
+         * Three byte VEX prefix of map 0F38 with W1 and 66, then the opcode of vfmadd213sd
+         */
+        void vexFmadd(int reg, int multiplier, int rm) {
+            byte(0xC4);
+            byte(static_cast<uint8_t>((~reg >> 3 & 1) << 7 | 1 << 6 | (~rm >> 3 & 1) << 5 | 0x02));
+            byte(static_cast<uint8_t>(1 << 7 | (~multiplier & 15) << 3 | 0x01));
+            byte(0xA9);
+        }
+
+        void rex(int wide, int reg, int rm) {
+            uint8_t prefix = static_cast<uint8_t>(0x40 | wide << 3 | (reg >> 3) << 2 | (rm >> 3));
+            if (prefix != 0x40){
+                byte(prefix);
+            }
+        }
+    };
+
+    constexpr uint8_t sd = 0xF2, pd = 0x66; //! Scalar double and packed double prefixes
+    constexpr uint8_t opLoad = 0x10, opStore = 0x11, opMove = 0x28, opAdd = 0x58, opMul = 0x59,
+                      opSub = 0x5C, opDiv = 0x5E, opXor = 0x57, opAnd = 0x54, opCompare = 0xC2, opUnordered = 0x2E;
+    constexpr uint8_t jz[] = {0x0F, 0x84}, jnz[] = {0x0F, 0x85}, jp[] = {0x0F, 0x8A};
+    constexpr uint8_t cmpEqual = 0, cmpLess = 1, cmpLessEqual = 2, cmpNotEqual = 4; //! Predicates of cmpsd
+
+    /**
+     * Translates bytecode, tracking where each stack entry lives
+     */
+    class translator {
+        assembler out;
+        int32_t scratchOffset; //! Frame slot receiving results of the checked helpers
+        bool hardwareFma = __builtin_cpu_supports("fma"); //! Opcode::fma is emitted inline instead of calling std::fma
+
+        static bool inRegister(uint32_t index) {
+            return index < registerSlots;
+        }
+
+        static int registerOf(uint32_t index) {
+            return static_cast<int>(2 + index);
+        }
+
+        static int32_t frameOffset(uint32_t index) {
+            return static_cast<int32_t>(8 * index);
+        }
+
+        void load(int xmm, uint32_t index) {
+            if (inRegister(index)){
+                out.sse(pd, opMove, xmm, registerOf(index));
+            } else {
+                out.sseMemory(sd, opLoad, xmm, rbx, frameOffset(index));
+            }
+        }
+
+        void store(uint32_t index, int xmm) {
+            if (inRegister(index)){
+                out.sse(pd, opMove, registerOf(index), xmm);
+            } else {
+                out.sseMemory(sd, opStore, xmm, rbx, frameOffset(index));
+            }
+        }
+
+        void arithmetic(uint8_t opcode, uint32_t lhs) {
+            if (inRegister(lhs + 1)){
+                out.sse(sd, opcode, registerOf(lhs), registerOf(lhs + 1));
+                return;
+            }
+            load(0, lhs);
+            load(1, lhs + 1);
+            out.sse(sd, opcode, 0, 1);
+            store(lhs, 0);
+        }
+
+        void constant(uint32_t index, double value) {
+            int xmm = inRegister(index) ? registerOf(index) : 0;
+            loadConstant(xmm, value);
+            if (!inRegister(index)){
+                store(index, 0);
+            }
+        }
+
+        /**
+         * Loads value into a scratch or stack register
+         */
+        void loadConstant(int xmm, double value) {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            out.movabsRax(bits);
+            out.movqFromRax(xmm);
+        }
+
+        void variable(uint32_t index, uint32_t slot) {
+            int xmm = inRegister(index) ? registerOf(index) : 0;
+            out.sseMemory(sd, opLoad, xmm, r15, static_cast<int32_t>(8 * slot));
+            if (!inRegister(index)){
+                store(index, 0);
+            }
+        }
+
+        void negate(uint32_t index) {
+            out.movabsRax(UINT64_C(1) << 63);
+            out.movqFromRax(1);
+            load(0, index);
+            out.sse(pd, opXor, 0, 1);
+            store(index, 0);
+        }
+
+        void absolute(uint32_t index) {
+            out.movabsRax(~(UINT64_C(1) << 63));
+            out.movqFromRax(1);
+            load(0, index);
+            out.sse(pd, opAnd, 0, 1);
+            store(index, 0);
+        }
+
+        /**
+         * Compares entries lhs and lhs + 1 with a cmpsd predicate, swapped for greater and greaterEqual, and turns
+         * the mask into 1 or 0
+         */
+        void compare(uint32_t lhs, uint8_t predicate, bool swapped) {
+            load(0, swapped ? lhs + 1 : lhs);
+            load(1, swapped ? lhs : lhs + 1);
+            out.sse(sd, opCompare, 0, 1);
+            out.byte(predicate);
+            loadConstant(1, 1.0);
+            out.sse(pd, opAnd, 0, 1);
+            store(lhs, 0);
+        }
+
+        /**
+         * Jumps if entry index is zero. NaN compares unordered and is true, like in compiledExpression::run.
+         * @return position of the jump operand for patch()
+         */
+        size_t jumpIfZero(uint32_t index) {
+            load(1, index);
+            out.sse(pd, opXor, 0, 0);
+            out.sse(pd, opUnordered, 1, 0); // ucomisd xmm1, xmm0
+            size_t unordered = out.jump({jp[0], jp[1]});
+            size_t zero = out.jump({jz[0], jz[1]});
+            out.patch(unordered);
+            return zero;
+        }
+
+        /**
+         * Fused multiply-add of the entries from first, the addend is read from the frame if it lives there
+         */
+        void fused(uint32_t first) {
+            if (inRegister(first + 2)){
+                out.fmadd(registerOf(first), registerOf(first + 1), registerOf(first + 2));
+                return;
+            }
+            load(0, first);
+            load(1, first + 1);
+            out.fmaddMemory(0, 1, rbx, frameOffset(first + 2));
+            store(first, 0);
+        }
+
+        /**
+         * Raises entry index to a constant integer with the multiplications of calcLib::powInt
+         */
+        void integerPower(uint32_t index, double exponent) {
+            loadConstant(1, 1.0);
+            load(0, index);
+            for (auto bits = static_cast<uint32_t>(std::abs(exponent)); bits != 0; bits >>= 1) {
+                if ((bits & 1) != 0){
+                    out.sse(sd, opMul, 1, 0);
+                }
+                if (bits > 1){
+                    out.sse(sd, opMul, 0, 0);
+                }
+            }
+            if (exponent < 0){
+                loadConstant(0, 1.0);
+                out.sse(sd, opDiv, 0, 1);
+                store(index, 0);
+            } else {
+                store(index, 1);
+            }
+        }
+
+        /**
+         * Evaluates a polynomial of entry index with the steps of compiledExpression::horner. The sum
+         * accumulates in xmm1 and the coefficients pass through xmm0, so the entry is read where it lives.
+         */
+        void polynomial(uint32_t index, const double *coefficients, uint32_t degree) {
+            loadConstant(1, coefficients[degree]);
+            for (uint32_t k = degree; k-- > 0;) {
+                if (inRegister(index)){
+                    out.sse(sd, opMul, 1, registerOf(index));
+                } else {
+                    out.sseMemory(sd, opMul, 1, rbx, frameOffset(index));
+                }
+                loadConstant(0, coefficients[k]);
+                out.sse(sd, opAdd, 1, 0);
+            }
+            store(index, 1);
+        }
+
+        void divide(uint32_t lhs) {
+            load(0, lhs);
+            load(1, lhs + 1);
+            // movq rax, xmm1; shl rax, 1 leaves zero only for ±0
+            for (uint8_t value : {0x66, 0x48, 0x0F, 0x7E, 0xC8, 0x48, 0xD1, 0xE0}) {
+                out.byte(value);
+            }
+            size_t nonZero = out.jump({jnz[0], jnz[1]});
+            raise(calcLib::Status::divisionByZero, calcLib::flagDivisionByZero);
+            out.patch(nonZero);
+            out.sse(sd, opDiv, 0, 1);
+            store(lhs, 0);
+        }
+
+        /**
+         * Returns status, or raises flag and continues when ieeeFlags is set
+         */
+        void raise(calcLib::Status status, unsigned flag) {
+            out.byte(0xB8);
+            out.bytes32(static_cast<uint32_t>(status));
+            for (uint8_t value : {0x4D, 0x85, 0xF6}) { // test r14, r14
+                out.byte(value);
+            }
+            out.jumpToExit({jz[0], jz[1]});
+            for (uint8_t value : {0x41, 0x83, 0x0E}) { // or dword [r14], flag
+                out.byte(value);
+            }
+            out.byte(static_cast<uint8_t>(flag));
+        }
+
+        /**
+         * Handles status of a checked helper in eax like calcLib::absorbStatus
+         */
+        void absorb() {
+            out.byte(0x85); // test eax, eax
+            out.byte(0xC0);
+            size_t succeeded = out.jump({jz[0], jz[1]});
+            std::vector<size_t> done;
+            for (auto [status, flag] : {std::pair{calcLib::Status::divisionByZero, calcLib::flagDivisionByZero},
+                                        std::pair{calcLib::Status::domainError, calcLib::flagInvalid}}) {
+                out.byte(0x83); // cmp eax, status
+                out.byte(0xF8);
+                out.byte(static_cast<uint8_t>(status));
+                size_t other = out.jump({jnz[0], jnz[1]});
+                raise(status, flag);
+                done.push_back(out.jump({0xE9}));
+                out.patch(other);
+            }
+            out.jumpToExit({0xE9});
+            out.patch(succeeded);
+            for (size_t at : done) {
+                out.patch(at);
+            }
+        }
+
+        /**
+         * Calls a helper with the operands starting at stack index first, live registers below are
+         * saved in the frame because the System V ABI does not preserve any xmm register
+         */
+        void call(const void *function, uint32_t first, unsigned operands, bool checked) {
+            uint32_t saved = std::min(first, registerSlots);
+            for (uint32_t i = 0; i < saved; ++i) {
+                out.sseMemory(sd, opStore, registerOf(i), rbx, frameOffset(i));
+            }
+            for (unsigned i = 0; i < operands; ++i) {
+                load(static_cast<int>(i), first + i);
+            }
+            if (checked){
+                for (uint8_t value : {0x48, 0x8D, 0xBB}) { // lea rdi, [rbx + scratch]
+                    out.byte(value);
+                }
+                out.bytes32(static_cast<uint32_t>(scratchOffset));
+            }
+            out.callAbsolute(function);
+            if (checked){
+                absorb();
+                out.sseMemory(sd, opLoad, 0, rbx, scratchOffset);
+            }
+            for (uint32_t i = 0; i < saved; ++i) {
+                out.sseMemory(sd, opLoad, registerOf(i), rbx, frameOffset(i));
+            }
+            store(first, 0);
+        }
+
+    public:
+        /**
+         * @param expression bytecode
+         * @param helpers per calcLib::Accuracy the function implementing each opcode that is not emitted inline
+         * @return machine code or empty vector if expression cannot be translated
+         */
+        std::vector<uint8_t> translate(const expressionView &expression, const helperTable *helpers) {
+            for (size_t i = 0; i < expression.codeSize; ++i) {
+                Opcode op = expression.code[i].op;
+                // Loops stay interpreted, their time goes to the body evaluated by runColumns
+                if (op > compiledExpression::lastOpcode || op == Opcode::sum || op == Opcode::product
+                    || op == Opcode::series){
+                    return {};
+                }
+                bool indexed = op == Opcode::constant || op == Opcode::variable || op == Opcode::polynomial
+                               || op == Opcode::branch || op == Opcode::jump;
+                if (!indexed && expression.code[i].operand >= accuracyCount){
+                    return {};
+                }
+                if (op == Opcode::polynomial && !(expression.constants[expression.code[i].operand] <= polynomialTerms::maxDegree)){
+                    return {};
+                }
+            }
+            uint32_t deepest;
+            if (!compiledExpression::simulate(expression.code, expression.codeSize, UINT32_MAX, deepest) || deepest > maxStackSize){
+                return {};
+            }
+
+            scratchOffset = frameOffset(deepest);
+            // Stack entries and scratch rounded to 16 bytes, plus 8 so rsp is aligned after four pushes
+            uint32_t frameSize = ((deepest + 1) * 8 + 15) / 16 * 16 + 8;
+            for (uint8_t value : {0x53, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, // push rbx, r13, r14, r15
+                                  0x48, 0x81, 0xEC}) { // sub rsp, frameSize
+                out.byte(value);
+            }
+            out.bytes32(frameSize);
+            for (uint8_t value : {0x48, 0x89, 0xE3, // mov rbx, rsp
+                                  0x49, 0x89, 0xFF, // mov r15, rdi
+                                  0x49, 0x89, 0xF5, // mov r13, rsi
+                                  0x49, 0x89, 0xD6}) { // mov r14, rdx
+                out.byte(value);
+            }
+
+            // Conditionals run like compiledExpression::run: branch pops the condition and both branches leave
+            // their value in the entry it had, so the stack is the same wherever the jumps meet
+            uint32_t depth = 0;
+            std::vector<std::vector<size_t>> jumpsTo(expression.codeSize); // Operands of the jumps to each instruction
+            for (size_t i = 0; i < expression.codeSize; ++i) {
+                for (size_t at : jumpsTo[i]) {
+                    out.patch(at);
+                }
+                const auto &instruction = expression.code[i];
+                uint32_t first = depth - compiledExpression::arity(instruction.op);
+                switch (instruction.op) {
+                    case Opcode::branch:
+                        jumpsTo[instruction.operand].push_back(jumpIfZero(depth - 1));
+                        depth--;
+                        continue;
+                    case Opcode::jump:
+                        jumpsTo[instruction.operand].push_back(out.jump({0xE9}));
+                        depth--;
+                        continue;
+                    case Opcode::select:
+                        continue;
+                    case Opcode::constant:
+                        constant(depth, expression.constants[instruction.operand]);
+                        break;
+                    case Opcode::variable:
+                        variable(depth, instruction.operand);
+                        break;
+                    case Opcode::negate:
+                        negate(first);
+                        break;
+                    case Opcode::add:
+                        arithmetic(opAdd, first);
+                        break;
+                    case Opcode::sub:
+                        arithmetic(opSub, first);
+                        break;
+                    case Opcode::mul:
+                        arithmetic(opMul, first);
+                        break;
+                    case Opcode::div:
+                        divide(first);
+                        break;
+                    case Opcode::less:
+                    case Opcode::greater:
+                        compare(first, cmpLess, instruction.op == Opcode::greater);
+                        break;
+                    case Opcode::lessEqual:
+                    case Opcode::greaterEqual:
+                        compare(first, cmpLessEqual, instruction.op == Opcode::greaterEqual);
+                        break;
+                    case Opcode::equal:
+                        compare(first, cmpEqual, false);
+                        break;
+                    case Opcode::notEqual:
+                        compare(first, cmpNotEqual, false);
+                        break;
+                    case Opcode::abs:
+                        absolute(first);
+                        break;
+                    case Opcode::fma:
+                        if (hardwareFma){
+                            fused(first);
+                        } else {
+                            call(helpers[0][static_cast<size_t>(Opcode::fma)], first, 3, false);
+                        }
+                        break;
+                    case Opcode::powInt: {
+                        // The compiler pushes the exponent right before, where it is known while translating
+                        const auto *previous = i > 0 ? &expression.code[i - 1] : nullptr;
+                        double exponent = previous != nullptr && previous->op == Opcode::constant
+                                          ? expression.constants[previous->operand] : NAN;
+                        if (std::abs(exponent) < 0x1p31 && std::trunc(exponent) == exponent){
+                            integerPower(first, exponent);
+                        } else {
+                            call(helpers[0][static_cast<size_t>(Opcode::powInt)], first, 2, false);
+                        }
+                        break;
+                    }
+                    case Opcode::polynomial: {
+                        const double *coefficients = expression.constants + instruction.operand;
+                        polynomial(first, coefficients + 1, static_cast<uint32_t>(coefficients[0]));
+                        break;
+                    }
+                    default: {
+                        // Every table holds the same helper for the operations without tiers
+                        const void *helper = helpers[instruction.operand][static_cast<size_t>(instruction.op)];
+                        call(helper, first, compiledExpression::arity(instruction.op), checked(instruction.op));
+                        break;
+                    }
+                }
+                depth = first + 1;
+            }
+
+            load(0, 0);
+            out.sseMemory(sd, opStore, 0, r13, 0);
+            out.byte(0x31); // xor eax, eax
+            out.byte(0xC0);
+            size_t exit = out.bytes.size();
+            for (size_t at : out.exitJumps) {
+                out.patch(at, exit);
+            }
+            for (uint8_t value : {0x48, 0x81, 0xC4}) { // add rsp, frameSize
+                out.byte(value);
+            }
+            out.bytes32(frameSize);
+            for (uint8_t value : {0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x5B, 0xC3}) { // pop r15, r14, r13, rbx; ret
+                out.byte(value);
+            }
+            return std::move(out.bytes);
+        }
+    };
+
+    /**
+     * Appends the function to /tmp/perf-<pid>.map read by perf report, if CALCLIB_PERF_MAP is set. A map that
+     * is a symbolic link or belongs to another user is left alone.
+     */
+    void announce(const void *code, size_t size) {
+        static std::mutex lock;
+        static std::atomic<unsigned> functions{0};
+        unsigned function = functions++;
+        const char *enabled = std::getenv("CALCLIB_PERF_MAP");
+        if (enabled == nullptr || std::strcmp(enabled, "0") == 0){
+            return;
+        }
+        char line[96];
+        int length = std::snprintf(line, sizeof(line), "%" PRIxPTR " %zx calclib_jit_%u\n",
+                                   reinterpret_cast<uintptr_t>(code), size, function);
+        char path[64];
+        std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+        std::lock_guard<std::mutex> guard(lock);
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | O_NOFOLLOW, 0600);
+        if (fd < 0){
+            return;
+        }
+        struct stat status;
+        if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_uid == geteuid()){
+            if (write(fd, line, static_cast<size_t>(length)) < 0) {}
+        }
+        close(fd);
+    }
+}
+
+std::unique_ptr<jitExpression> jitExpression::compile(const expressionView &expression) {
+    using unaryFunction = double (*)(double);
+    using binaryFunction = double (*)(double, double);
+    using ternaryFunction = double (*)(double, double, double);
+    using unaryChecked = calcLib::Status (*)(double, double&);
+    using binaryChecked = calcLib::Status (*)(double, double, double&);
+    helperTable helpers[accuracyCount] = {};
+    // tag is a null Math *, where Math is calcLib, correctlyRoundedMath or fastMath
+    auto setTier = [&helpers](calcLib::Accuracy accuracy, auto tag) {
+        using Math = std::remove_pointer_t<decltype(tag)>;
+        helperTable &table = helpers[static_cast<size_t>(accuracy)];
+        auto set = [&table](Opcode op, auto function) {
+            table[static_cast<size_t>(op)] = reinterpret_cast<const void*>(function);
+        };
+        set(Opcode::factorial, static_cast<unaryFunction>(calcLib::factorial));
+        set(Opcode::mod, static_cast<binaryChecked>(calcLib::mod));
+        set(Opcode::pow, static_cast<binaryFunction>(Math::pow));
+        set(Opcode::sin, static_cast<unaryFunction>(Math::sin));
+        set(Opcode::cos, static_cast<unaryFunction>(Math::cos));
+        set(Opcode::log10, static_cast<unaryFunction>(Math::log));
+        set(Opcode::tan, static_cast<unaryChecked>(Math::tan));
+        set(Opcode::sqrt, static_cast<unaryChecked>(Math::sqrt));
+        set(Opcode::log, static_cast<binaryChecked>(Math::log));
+        set(Opcode::root, static_cast<binaryChecked>(Math::root));
+        set(Opcode::cbrt, static_cast<unaryChecked>(Math::cbrt));
+        set(Opcode::powInt, static_cast<binaryFunction>(calcLib::powInt));
+        set(Opcode::fma, static_cast<ternaryFunction>(std::fma));
+        set(Opcode::min, static_cast<binaryFunction>(calcLib::min));
+        set(Opcode::max, static_cast<binaryFunction>(calcLib::max));
+    };
+    setTier(calcLib::Accuracy::faithful, static_cast<calcLib *>(nullptr));
+    setTier(calcLib::Accuracy::correctlyRounded, static_cast<correctlyRoundedMath *>(nullptr));
+    setTier(calcLib::Accuracy::fast, static_cast<fastMath *>(nullptr));
+
+    std::vector<uint8_t> code = translator().translate(expression, helpers);
+    if (code.empty()){
+        return nullptr;
+    }
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED){
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0){
+        munmap(memory, size);
+        return nullptr;
+    }
+    std::unique_ptr<jitExpression> native(new jitExpression());
+    native->memory = memory;
+    native->mappedSize = size;
+    native->usedSize = code.size();
+    native->entry = reinterpret_cast<entryPoint>(memory);
+    announce(memory, code.size());
+    return native;
+}
+
+jitExpression::~jitExpression() {
+    if (memory != nullptr){
+        munmap(memory, mappedSize);
+    }
+}
+
+#else
+
+std::unique_ptr<jitExpression> jitExpression::compile(const expressionView &) {
+    return nullptr;
+}
+
+jitExpression::~jitExpression() = default;
+
+#endif
+
+size_t jitExpression::codeSize() const {
+    return usedSize;
+}
+
+const void* jitExpression::code() const {
+    return memory;
+}
@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <sched.h>
+#include <signal.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "calclib/expression.hpp"
+#include "calclib/process_pool.hpp"
+
+namespace {
+    constexpr size_t minTaskBytes = 16 * 1024; //! Smallest amount of input handed to a worker at once
+    constexpr size_t maxOutstanding = 2; //! Tasks queued per worker, keeps the next one ready while it works
+    constexpr long crashCheckMs = 50; //! How often a waiting parent looks for dead workers
+    constexpr uint32_t noProgress = UINT32_MAX;
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory rings need lock-free atomics");
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomics are used as futex words");
+
+    void futexWait(std::atomic<uint32_t> &word, uint32_t expected, long timeoutMs) {
+        timespec timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000000};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futexWake(std::atomic<uint32_t> &word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    size_t alignUp(size_t size) {
+        return (size + 63) & ~size_t(63);
+    }
+}
+
+struct calcProcessPool::shared {
+    /**
+     * Lock-free single-producer/single-consumer ring living in shared memory.
+     * tail doubles as the futex word the consumer sleeps on.
+     */
+    template<typename T>
+    struct spscRing {
+        static constexpr uint32_t capacity = 16;
+        alignas(64) std::atomic<uint32_t> head{0}; //! Written by the consumer only
+        alignas(64) std::atomic<uint32_t> tail{0}; //! Written by the producer only
+        alignas(64) T slots[capacity];
+
+        bool push(const T &value) {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == capacity){
+                return false;
+            }
+            slots[t % capacity] = value;
+            tail.store(t + 1, std::memory_order_release);
+            futexWake(tail);
+            return true;
+        }
+
+        bool pop(T &outValue) {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire)){
+                return false;
+            }
+            outValue = slots[h % capacity];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    enum class TaskMode : uint32_t {
+        batch, //! Evaluate the range with the worker's calcBatch
+        serial, //! Evaluate one by one publishing progress, used after a crash
+        stop
+    };
+
+    /**
+     * Range of expressions of the current round
+     */
+    struct task {
+        uint32_t begin;
+        uint32_t end;
+        TaskMode mode;
+    };
+
+    struct channel {
+        spscRing<task> requests;
+        spscRing<uint32_t> completions; //! begin of each finished task
+        alignas(64) std::atomic<uint32_t> progress{noProgress}; //! Expression a serial task is evaluating
+    };
+
+    struct controlBlock {
+        alignas(64) std::atomic<uint32_t> completions{0}; //! Bumped after every completion, the parent sleeps on it
+        alignas(64) std::atomic<uint32_t> requests{0}; //! Bumped for every worker to restart, the supervisor sleeps on it
+        std::atomic<uint32_t> stopping{0}; //! Set by the destructor, dead workers are no longer replaced
+    };
+
+    enum WorkerState : uint32_t {
+        workerStarting, //! The supervisor forks the worker, its channel is not in use
+        workerRunning,
+        workerDead //! Reaped by the supervisor, the parent takes back its tasks and sets workerStarting
+    };
+
+    /**
+     * Worker state shared by the parent and the supervisor, outside of the channel that spawn recreates
+     */
+    struct workerStatus {
+        std::atomic<uint32_t> state{workerStarting}; //! WorkerState, futex word the parent waits on for a restart
+        std::atomic<int32_t> pid{-1};
+    };
+
+    struct worker {
+        std::vector<int> cpus; //! Cores the worker is pinned to
+        std::deque<task> outstanding; //! Tasks pushed to the worker and not completed, in ring order
+    };
+
+    const calcLib &calc;
+    calcSession session;
+    std::vector<worker> workers;
+    size_t restartCount = 0;
+    std::mutex submitLock;
+    pid_t parentPid; //! Process that forks the workers, the supervisor
+    pid_t supervisorPid = -1;
+
+    // Shared mapping: control block, channels, expression offsets, results and text, offsets instead of pointers
+    void *mapping = MAP_FAILED;
+    size_t mappingSize = 0;
+    controlBlock *control = nullptr;
+    workerStatus *statuses = nullptr;
+    channel *channels = nullptr;
+    uint64_t *offsets = nullptr; //! Expression i is text[offsets[i], offsets[i + 1])
+    batchResult *results = nullptr;
+    char *text = nullptr;
+    size_t arenaBytes;
+    size_t maxExpressions;
+
+    std::deque<task> pending; //! Tasks of the current round not handed out yet
+
+    shared(const calcLib &calc, const calcSession &session) : calc(calc), session(session), parentPid(getpid()) {
+        this->session.setScratch(nullptr);
+    }
+
+    void map(unsigned processCount) {
+        size_t controlBytes = alignUp(sizeof(controlBlock));
+        size_t statusBytes = alignUp(sizeof(workerStatus) * processCount);
+        size_t channelBytes = alignUp(sizeof(channel) * processCount);
+        size_t offsetBytes = alignUp(sizeof(uint64_t) * (maxExpressions + 1));
+        size_t resultBytes = alignUp(sizeof(batchResult) * maxExpressions);
+        mappingSize = controlBytes + statusBytes + channelBytes + offsetBytes + resultBytes + arenaBytes;
+        mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+        char *at = static_cast<char*>(mapping);
+        control = new (at) controlBlock();
+        at += controlBytes;
+        statuses = reinterpret_cast<workerStatus*>(at);
+        for (unsigned i = 0; i < processCount; ++i) {
+            new (&statuses[i]) workerStatus();
+        }
+        at += statusBytes;
+        channels = reinterpret_cast<channel*>(at);
+        at += channelBytes;
+        offsets = reinterpret_cast<uint64_t*>(at);
+        at += offsetBytes;
+        results = reinterpret_cast<batchResult*>(at);
+        text = at + resultBytes;
+    }
+
+    /**
+     * Forks worker index with fresh rings, in the supervisor. The child never returns.
+     */
+    void spawn(unsigned index) {
+        new (&channels[index]) channel();
+        pid_t pid = fork();
+        if (pid == 0){
+            workerMain(index);
+        }
+        statuses[index].pid.store(pid, std::memory_order_relaxed);
+        statuses[index].state.store(workerRunning, std::memory_order_release);
+        futexWake(statuses[index].state);
+    }
+
+    /**
+     * Forks the workers and replaces those the parent took the tasks of after they died. The supervisor has a
+     * single thread, unlike the parent by the time a worker crashes, so it can fork safely.
+     */
+    [[noreturn]] void supervisorMain() {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parentPid){
+            _exit(0);
+        }
+        parentPid = getpid();
+        while (true) {
+            uint32_t seen = control->requests.load(std::memory_order_acquire);
+            bool stopping = control->stopping.load(std::memory_order_acquire) != 0;
+            for (unsigned i = 0; i < workers.size() && !stopping; ++i) {
+                if (statuses[i].state.load(std::memory_order_acquire) == workerStarting){
+                    spawn(i);
+                }
+            }
+            int status;
+            pid_t pid = waitpid(-1, &status, WNOHANG);
+            if (pid > 0){
+                for (unsigned i = 0; i < workers.size(); ++i) {
+                    if (statuses[i].pid.load(std::memory_order_relaxed) == pid){
+                        statuses[i].state.store(workerDead, std::memory_order_release);
+                    }
+                }
+                control->completions.fetch_add(1, std::memory_order_release);
+                futexWake(control->completions);
+                continue;
+            }
+            if (pid < 0 && stopping){
+                _exit(0);
+            }
+            futexWait(control->requests, seen, crashCheckMs);
+        }
+    }
+
+    [[noreturn]] void workerMain(unsigned index) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parentPid){
+            _exit(0);
+        }
+        const worker &self = workers[index];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : self.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+        // The other workers have the other cores
+        expressionView::keepLoopsOnThread(true);
+
+        channel &own = channels[index];
+        calcBatch batch{calc, static_cast<unsigned>(self.cpus.size())};
+        std::vector<std::string_view> views;
+        task next{};
+        while (true) {
+            uint32_t seen = own.requests.tail.load(std::memory_order_acquire);
+            if (!own.requests.pop(next)){
+                // A worker restarted while the pool is destroyed misses the stop task
+                if (control->stopping.load(std::memory_order_acquire) != 0){
+                    _exit(0);
+                }
+                futexWait(own.requests.tail, seen, 1000);
+                continue;
+            }
+            if (next.mode == TaskMode::stop){
+                _exit(0);
+            }
+            if (next.mode == TaskMode::batch){
+                views.clear();
+                for (uint32_t i = next.begin; i < next.end; ++i) {
+                    views.emplace_back(text + offsets[i], offsets[i + 1] - offsets[i]);
+                }
+                batch.evaluate(views.data(), views.size(), results + next.begin, session);
+            } else {
+                for (uint32_t i = next.begin; i < next.end; ++i) {
+                    own.progress.store(i, std::memory_order_release);
+                    calcSession single = session;
+                    batchResult &result = results[i];
+                    result.status = calc.evaluate(std::string_view(text + offsets[i], offsets[i + 1] - offsets[i]),
+                                                  single, result.value);
+                    result.flags = single.flags();
+                }
+                own.progress.store(noProgress, std::memory_order_release);
+            }
+            while (!own.completions.push(next.begin)) {
+                sched_yield();
+            }
+            control->completions.fetch_add(1, std::memory_order_release);
+            futexWake(control->completions);
+        }
+    }
+
+    /**
+     * Moves finished tasks of worker index out of its outstanding list
+     * @return true if anything finished
+     */
+    bool drain(unsigned index) {
+        bool finished = false;
+        uint32_t begin;
+        while (channels[index].completions.pop(begin)) {
+            workers[index].outstanding.pop_front();
+            finished = true;
+        }
+        return finished;
+    }
+
+    /**
+     * Requeues the unfinished tasks of a worker the supervisor reaped and has it fork a replacement.
+     * A batch task that was running is evaluated again serially, a serial task skips the expression it crashed on.
+     */
+    void replace(unsigned index) {
+        drain(index);
+        worker &dead = workers[index];
+        std::deque<task> lost;
+        lost.swap(dead.outstanding);
+        if (!lost.empty()){
+            task &running = lost.front();
+            uint32_t crashed = channels[index].progress.load(std::memory_order_acquire);
+            if (running.mode == TaskMode::serial && crashed >= running.begin && crashed < running.end){
+                results[crashed] = batchResult{calcLib::Status::workerFailed, 0, 0};
+                running.begin = crashed + 1;
+                if (running.begin == running.end){
+                    lost.pop_front();
+                }
+            } else {
+                running.mode = TaskMode::serial;
+            }
+        }
+        pending.insert(pending.begin(), lost.begin(), lost.end());
+        restartCount++;
+        statuses[index].state.store(workerStarting, std::memory_order_release);
+        control->requests.fetch_add(1, std::memory_order_release);
+        futexWake(control->requests);
+    }
+
+    void checkWorkers() {
+        for (unsigned i = 0; i < workers.size(); ++i) {
+            if (statuses[i].state.load(std::memory_order_acquire) == workerDead){
+                replace(i);
+            }
+        }
+    }
+
+    /**
+     * Waits until the supervisor forked every worker that is starting
+     */
+    void waitForWorkers() {
+        for (unsigned i = 0; i < workers.size(); ++i) {
+            while (statuses[i].state.load(std::memory_order_acquire) == workerStarting) {
+                futexWait(statuses[i].state, workerStarting, crashCheckMs);
+            }
+        }
+    }
+
+    /**
+     * Evaluates expressions [0, count) of the job area
+     */
+    void runRound(uint32_t count) {
+        size_t taskBytes = std::max(minTaskBytes, static_cast<size_t>(offsets[count]) / (workers.size() * 8));
+        for (uint32_t begin = 0; begin < count;) {
+            auto end = static_cast<uint32_t>(std::upper_bound(offsets + begin + 1, offsets + count, offsets[begin] + taskBytes) - offsets);
+            end = std::min(end, count);
+            pending.push_back(task{begin, end, TaskMode::batch});
+            begin = end;
+        }
+
+        while (true) {
+            checkWorkers();
+            bool busy = !pending.empty();
+            for (unsigned i = 0; i < workers.size(); ++i) {
+                worker &w = workers[i];
+                bool available = statuses[i].state.load(std::memory_order_acquire) == workerRunning;
+                while (available && !pending.empty() && w.outstanding.size() < maxOutstanding) {
+                    channels[i].requests.push(pending.front());
+                    w.outstanding.push_back(pending.front());
+                    pending.pop_front();
+                }
+                busy |= !w.outstanding.empty();
+            }
+            if (!busy){
+                // Leave the pool complete for the next round
+                waitForWorkers();
+                return;
+            }
+            uint32_t seen = control->completions.load(std::memory_order_acquire);
+            bool finished = false;
+            for (unsigned i = 0; i < workers.size(); ++i) {
+                finished |= drain(i);
+            }
+            if (!finished){
+                futexWait(control->completions, seen, crashCheckMs);
+            }
+        }
+    }
+};
+
+calcProcessPool::calcProcessPool(const calcLib &calc, const calcSession &session, unsigned processCount,
+                                 size_t arenaBytes) : impl(std::make_unique<shared>(calc, session)) {
+    cpu_set_t allowed;
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0){
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)){
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()){
+        cpus.push_back(0);
+    }
+    if (processCount == 0){
+        processCount = static_cast<unsigned>(cpus.size());
+    }
+
+    impl->arenaBytes = std::max<size_t>(arenaBytes, 1);
+    impl->maxExpressions = std::min<size_t>(std::max<size_t>(impl->arenaBytes / 16, 1), UINT32_MAX - 1);
+    impl->map(processCount);
+    impl->workers.resize(processCount);
+    for (unsigned i = 0; i < processCount; ++i) {
+        auto &cores = impl->workers[i].cpus;
+        if (processCount <= cpus.size()){
+            cores.assign(cpus.begin() + i * cpus.size() / processCount, cpus.begin() + (i + 1) * cpus.size() / processCount);
+        } else {
+            cores.push_back(cpus[i % cpus.size()]);
+        }
+    }
+    impl->supervisorPid = fork();
+    if (impl->supervisorPid == 0){
+        impl->supervisorMain();
+    }
+    if (impl->supervisorPid < 0){
+        munmap(impl->mapping, impl->mappingSize);
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    impl->waitForWorkers();
+}
+
+calcProcessPool::~calcProcessPool() {
+    impl->control->stopping.store(1, std::memory_order_release);
+    for (unsigned i = 0; i < impl->workers.size(); ++i) {
+        if (impl->statuses[i].state.load(std::memory_order_acquire) == shared::workerRunning){
+            impl->channels[i].requests.push(shared::task{0, 0, shared::TaskMode::stop});
+        }
+    }
+    impl->control->requests.fetch_add(1, std::memory_order_release);
+    futexWake(impl->control->requests);
+    int status;
+    while (waitpid(impl->supervisorPid, &status, 0) < 0 && errno == EINTR) {}
+    munmap(impl->mapping, impl->mappingSize);
+}
+
+calcProcessPool::job::job(calcProcessPool &pool) : pool(pool.impl.get()), guard(pool.impl->submitLock) {
+    this->pool->offsets[0] = 0;
+}
+
+char* calcProcessPool::job::append(size_t length) {
+    if (count == pool->maxExpressions || length > pool->arenaBytes - pool->offsets[count]){
+        return nullptr;
+    }
+    char *at = pool->text + pool->offsets[count];
+    pool->offsets[count + 1] = pool->offsets[count] + length;
+    count++;
+    return at;
+}
+
+const batchResult* calcProcessPool::job::run() {
+    if (count != 0){
+        pool->runRound(count);
+    }
+    return pool->results;
+}
+
+void calcProcessPool::job::clear() {
+    count = 0;
+}
+
+size_t calcProcessPool::job::size() const {
+    return count;
+}
+
+void calcProcessPool::evaluate(const std::string_view *expressions, size_t count, batchResult *outResults) {
+    job batch{*this};
+    size_t done = 0;
+    while (done < count) {
+        // Copy as much of the input as fits to the shared area
+        size_t round = 0;
+        char *text;
+        while (done + round < count && (text = batch.append(expressions[done + round].size())) != nullptr) {
+            expressions[done + round].copy(text, expressions[done + round].size());
+            round++;
+        }
+        if (round == 0){
+            // Longer than the whole arena, not worth a worker
+            calcSession single = impl->session;
+            batchResult &result = outResults[done];
+            result.status = impl->calc.evaluate(expressions[done], single, result.value);
+            result.flags = single.flags();
+            done++;
+            continue;
+        }
+        const batchResult *results = batch.run();
+        std::copy(results, results + round, outResults + done);
+        batch.clear();
+        done += round;
+    }
+}
+
+std::vector<batchResult> calcProcessPool::evaluate(const std::vector<std::string_view> &expressions) {
+    std::vector<batchResult> results(expressions.size());
+    evaluate(expressions.data(), expressions.size(), results.data());
+    return results;
+}
+
+unsigned calcProcessPool::processCount() const {
+    return static_cast<unsigned>(impl->workers.size());
+}
+
+int calcProcessPool::workerPid(unsigned index) const {
+    return impl->statuses[index].pid.load(std::memory_order_relaxed);
+}
+
+size_t calcProcessPool::restarts() const {
+    return impl->restartCount;
+}
@@ -1,10 +1,8 @@
 #include <iostream>
-#include "calclib/calclib.hpp"
+#include "calclib/dsl.hpp"
 #include <random>
 #include <cstring>
 
-calcLib calc;
-
 /**
  * Generates random ints between 0 and 10000 into vector
  * @param numbers output vector
@@ -18,35 +16,68 @@ void fillRandNumbers(std::vector<double>& numbers, size_t count){
     }
 }
 
+namespace {
+    const calclib::variable<0> accumulator{"accumulator"};
+    const calclib::variable<1> number{"number"};
+    const calclib::variable<2> count{"count"};
+}
+
+/**
+ * Evaluates formula compiled once with the variables of session
+ * @param calc shared calculator
+ * @param session state of the calling thread
+ * @param formula compiled by calclib::compile
+ * @return solved value
+ */
+double evaluateFormula(const calcLib& calc, calcSession& session, const compiledExpression& formula) {
+    double result = 0;
+    calc.evaluate(formula, session, result);
+    return result;
+}
+
 /**
  * Calculates mean of numbers in vector
+ * @param calc shared calculator
+ * @param session state of the calling thread
  * @param numbers
  * @return mean of numbers
  */
-double arithmeticMean(const std::vector<double>& numbers) {
-    std::string sum_str;
-    for(auto number:numbers){
-        sum_str += std::to_string(number) + "+";
+double arithmeticMean(const calcLib& calc, calcSession& session, const std::vector<double>& numbers) {
+    compiledExpression sum;
+    calclib::compile(accumulator + number, sum);
+    compiledExpression mean;
+    calclib::compile(accumulator / count, mean);
+    session.setVariable("accumulator", 0);
+    for(auto value:numbers){
+        session.setVariable("number", value);
+        session.setVariable("accumulator", evaluateFormula(calc, session, sum));
     }
-    sum_str.pop_back(); //Remove last plus
-    return std::stod(calc.solveEquation(calc.solveEquation(sum_str) + "/" + std::to_string(numbers.size())));
+    session.setVariable("count", numbers.size());
+    return evaluateFormula(calc, session, mean);
 }
 
 /**
  * Calculates variance of numbers in vector
+ * @param calc shared calculator
+ * @param session state of the calling thread
  * @param numbers vector of doubles
  * @param mean of the same numbers as numbers
  * @return variance as double
  */
-double calculateVariance(const std::vector<double>& numbers, double mean) {
-    std::string sum_of_squares_str;
-    for(auto number:numbers){
-        sum_of_squares_str += calc.solveEquation(calc.solveEquation(std::to_string(number) + "-" + std::to_string(mean)) + "^2") + "+";
+double calculateVariance(const calcLib& calc, calcSession& session, const std::vector<double>& numbers, double mean) {
+    const calclib::variable<3> average{"mean"};
+    compiledExpression sumOfSquares;
+    calclib::compile(accumulator + calclib::pow(number - average, 2), sumOfSquares);
+    compiledExpression variance;
+    calclib::compile(accumulator / (count - 1), variance);
+    session.setVariable("accumulator", 0);
+    session.setVariable("mean", mean);
+    for(auto value:numbers){
+        session.setVariable("number", value);
+        session.setVariable("accumulator", evaluateFormula(calc, session, sumOfSquares));
     }
-    sum_of_squares_str.pop_back();
-    double variance = std::stod(calc.solveEquation(calc.solveEquation(sum_of_squares_str) + "/"
-            + calc.solveEquation(std::to_string(numbers.size()) + "-1")));
-    return variance;
+    session.setVariable("count", numbers.size());
+    return evaluateFormula(calc, session, variance);
 }
 
 /**
@@ -81,10 +112,14 @@ int main(int argc, char* argv[]) {
             std::cerr << "Either provide none with numbers on stdin or -n <count> for random numbers\n";
             return 1;
     }
-    double mean = arithmeticMean(numbers);
-    double variance = calculateVariance(numbers, mean);
-    std::string standard_deviation = calc.solveEquation("sqrt(" + std::to_string(variance) + ")");
-    std::cout << standard_deviation << "\n";
+    const calcLib calc;
+    calcSession session;
+    double mean = arithmeticMean(calc, session, numbers);
+    double variance = calculateVariance(calc, session, numbers, mean);
+    session.setVariable("accumulator", variance);
+    compiledExpression standardDeviation;
+    calclib::compile(calclib::sqrt(accumulator), standardDeviation);
+    std::cout << calc.formatResult(evaluateFormula(calc, session, standardDeviation)) << "\n";
     return 0;
 }
 
@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <memory_resource>
+#include "calclib/bignum.hpp"
+#include "calclib/double_double.hpp"
+#include "calclib/scalar.hpp"
+#include "degrees.hpp"
+#include "integer.hpp"
+
+namespace {
+    constexpr uint32_t scalarInlineStackSize = 64; //! Stack depth served without allocating, one slot is spare for unary operations
+    constexpr int scalarMaxFactorial = 1754; //! Largest n with n! finite in long double and __float128, smaller types overflow sooner
+    constexpr size_t scalarBlockBytes = 2048; //! Bytes of one stack entry of runColumns, as many as a block of the double engine
+}
+
+template<typename Scalar>
+std::string standardScalarTraits<Scalar>::format(Scalar value, int precision) {
+    std::string text(64, '\0');
+    while (true) {
+        auto [end, error] = std::to_chars(text.data(), text.data() + text.size(), value, std::chars_format::fixed, precision);
+        if (error == std::errc()){
+            text.resize(end - text.data());
+            return text;
+        }
+        text.resize(text.size() * 2);
+    }
+}
+
+template struct standardScalarTraits<float>;
+template struct standardScalarTraits<double>;
+template struct standardScalarTraits<long double>;
+
+#if defined(CALCLIB_HAS_FLOAT128)
+std::string scalarTraits<__float128>::format(__float128 value, int precision) {
+    int length = quadmath_snprintf(nullptr, 0, "%.*Qf", precision, value);
+    std::string text(std::max(length, 0) + 1, '\0');
+    quadmath_snprintf(text.data(), text.size(), "%.*Qf", precision, value);
+    text.resize(std::max(length, 0));
+    return text;
+}
+#endif
+
+template<typename Scalar>
+calcLib::Status basicExpression<Scalar>::apply(Opcode op, Scalar lhs, Scalar rhs, Scalar &outResult) {
+    using traits = scalarTraits<Scalar>;
+    using Status = calcLib::Status;
+    switch (op) {
+        case Opcode::negate:
+            outResult = -lhs;
+            break;
+        case Opcode::factorial: {
+            // double shares the table of calcLib, wider types multiply in their own precision
+            Scalar intpart;
+            if constexpr (std::is_same_v<Scalar, double>){
+                outResult = calcLib::factorial(lhs);
+            } else if (traits::modf(lhs, &intpart) != 0){
+                outResult = traits::gamma(lhs + 1);
+            } else if (lhs < 0 || lhs != lhs){
+                outResult = traits::nan();
+            } else if (lhs > scalarMaxFactorial){
+                outResult = traits::infinity();
+            } else {
+                outResult = calcInteger::factorial<Scalar>(static_cast<int64_t>(lhs));
+            }
+            break;
+        }
+        case Opcode::add:
+            outResult = lhs + rhs;
+            break;
+        case Opcode::sub:
+            outResult = lhs - rhs;
+            break;
+        case Opcode::mul:
+            outResult = lhs * rhs;
+            break;
+        case Opcode::div:
+            outResult = lhs / rhs;
+            return rhs == 0 ? Status::divisionByZero : Status::ok;
+        case Opcode::mod: {
+            if (calcInteger::mod(lhs, rhs, outResult)){
+                break;
+            }
+            if constexpr (std::is_same_v<Scalar, doubleDouble>){
+                // Keeps integers up to 2^106 exact, the quotient below would round them to 106 bits first
+                if (rhs == 0){
+                    outResult = traits::nan();
+                    return Status::divisionByZero;
+                }
+                outResult = traits::fmod(lhs, rhs);
+                break;
+            }
+            Scalar quotient;
+            if (apply(Opcode::div, lhs, rhs, quotient) != Status::ok){
+                outResult = traits::nan();
+                return Status::divisionByZero;
+            }
+            Scalar intpart;
+            traits::modf(quotient, &intpart);
+            outResult = (quotient - intpart) * rhs;
+            break;
+        }
+        case Opcode::pow:
+            if (!calcInteger::pow(lhs, rhs, outResult)){
+                outResult = traits::pow(lhs, rhs);
+            }
+            break;
+        case Opcode::sin:
+            outResult = calcDegrees::sin(lhs);
+            break;
+        case Opcode::cos:
+            outResult = calcDegrees::cos(lhs);
+            break;
+        case Opcode::tan:
+            outResult = calcDegrees::tan(lhs);
+            if (outResult == traits::infinity() || outResult == -traits::infinity()){
+                return Status::divisionByZero;
+            }
+            break;
+        case Opcode::sqrt:
+            return apply(Opcode::root, 2, lhs, outResult);
+        case Opcode::log10:
+            outResult = traits::log10(lhs);
+            break;
+        case Opcode::log:
+            return apply(Opcode::div, traits::log10(rhs), traits::log10(lhs), outResult);
+        case Opcode::root: {
+            if (rhs < 0){
+                outResult = traits::nan();
+                return Status::domainError;
+            }
+            Scalar exponent;
+            Status status = apply(Opcode::div, 1, lhs, exponent);
+            outResult = traits::pow(rhs, exponent);
+            return status;
+        }
+        case Opcode::less:
+            outResult = lhs < rhs ? 1 : 0;
+            break;
+        case Opcode::lessEqual:
+            outResult = lhs <= rhs ? 1 : 0;
+            break;
+        case Opcode::greater:
+            outResult = lhs > rhs ? 1 : 0;
+            break;
+        case Opcode::greaterEqual:
+            outResult = lhs >= rhs ? 1 : 0;
+            break;
+        case Opcode::equal:
+            outResult = lhs == rhs ? 1 : 0;
+            break;
+        case Opcode::notEqual:
+            outResult = lhs != rhs ? 1 : 0;
+            break;
+        case Opcode::min:
+            // NaN of either operand is the result, like calcLib::min
+            outResult = lhs < rhs || lhs != lhs ? lhs : rhs;
+            break;
+        case Opcode::max:
+            outResult = lhs > rhs || lhs != lhs ? lhs : rhs;
+            break;
+        case Opcode::abs:
+            outResult = traits::copysign(lhs, 1);
+            break;
+        default:
+            return Status::invalidExpression;
+    }
+    return Status::ok;
+}
+
+template<typename Scalar>
+calcLib::Status basicExpression<Scalar>::run(const Scalar *slots, Scalar &outResult, unsigned *ieeeFlags) const {
+    return run(0, code.size(), slots, outResult, ieeeFlags);
+}
+
+template<typename Scalar>
+calcLib::Status basicExpression<Scalar>::run(size_t first, size_t last, const Scalar *slots, Scalar &outResult,
+                                             unsigned *ieeeFlags) const {
+    Scalar inlineStack[scalarInlineStackSize];
+    std::unique_ptr<Scalar[]> heapStack;
+    Scalar *stack = inlineStack;
+    if (stackSize >= scalarInlineStackSize){
+        heapStack = std::make_unique<Scalar[]>(stackSize + 1);
+        stack = heapStack.get();
+    }
+    Scalar *top = stack; // One past the topmost value
+    for (size_t i = first; i < last; ++i) {
+        const Instruction &instruction = code[i];
+        switch (instruction.op) {
+            case Opcode::constant:
+                *top++ = constants[instruction.operand];
+                break;
+            case Opcode::variable:
+                *top++ = slots[instruction.operand];
+                break;
+            case Opcode::branch:
+                // See compiledExpression::Opcode, only the branch taken is evaluated
+                if (*--top == Scalar(0)){
+                    i = instruction.operand - 1;
+                }
+                break;
+            case Opcode::jump:
+                i = instruction.operand - 1;
+                break;
+            case Opcode::select:
+                break;
+            case Opcode::sum:
+            case Opcode::product: {
+                top--;
+                calcLib::Status status = calcLib::absorbStatus(accumulate(i, slots, top[-1], top[0], top[-1], ieeeFlags),
+                                                               ieeeFlags);
+                if (status != calcLib::Status::ok){
+                    return status;
+                }
+                i = instruction.operand;
+                break;
+            }
+            case Opcode::add:
+                top--;
+                top[-1] += top[0];
+                break;
+            case Opcode::sub:
+                top--;
+                top[-1] -= top[0];
+                break;
+            case Opcode::mul:
+                top--;
+                top[-1] *= top[0];
+                break;
+            default: {
+                top -= compiledExpression::arity(instruction.op);
+                calcLib::Status status = calcLib::absorbStatus(apply(instruction.op, top[0], top[1], top[0]), ieeeFlags);
+                if (status != calcLib::Status::ok){
+                    return status;
+                }
+                top++;
+            }
+        }
+    }
+    if (top != stack + 1){
+        return calcLib::Status::invalidExpression;
+    }
+    outResult = stack[0];
+    return calcLib::Status::ok;
+}
+
+template<typename Scalar>
+calcLib::Status basicExpression<Scalar>::accumulate(size_t at, const Scalar *slots, const Scalar &lo, const Scalar &hi,
+                                                    Scalar &outResult, unsigned *ieeeFlags) const {
+    size_t end = code[at].operand;
+    size_t indexSlot = code[end].operand;
+    bool product = code[at].op == Opcode::product;
+    for (const Scalar *bound : {&lo, &hi}) {
+        Scalar remainder;
+        if (apply(Opcode::mod, *bound, Scalar(1), remainder) != calcLib::Status::ok || !(remainder == Scalar(0))){
+            outResult = scalarTraits<Scalar>::nan();
+            return calcLib::Status::domainError;
+        }
+    }
+    std::vector<Scalar> extended(slots, slots + indexSlot);
+    extended.push_back(lo);
+    Scalar &index = extended.back();
+    Scalar result = product ? Scalar(1) : Scalar(0);
+    uint64_t terms = 0;
+    while (!(hi < index)) {
+        Scalar next = index + Scalar(1);
+        if (++terms > compiledExpression::maxTerms || next == index){
+            outResult = scalarTraits<Scalar>::nan();
+            return calcLib::Status::domainError;
+        }
+        Scalar value;
+        calcLib::Status status = run(at + 1, end, extended.data(), value, ieeeFlags);
+        if (status != calcLib::Status::ok){
+            outResult = scalarTraits<Scalar>::nan();
+            return status;
+        }
+        result = product ? result * value : result + value;
+        index = next;
+    }
+    outResult = result;
+    return calcLib::Status::ok;
+}
+
+template<typename Scalar>
+void basicExpression<Scalar>::runColumns(const Scalar *const *columns, size_t rows, Scalar *outResults,
+                                         calcLib::Status *outStatus, unsigned *ieeeFlags) const {
+    constexpr size_t blockRows = scalarBlockBytes / sizeof(Scalar);
+    if (code.empty()){
+        std::fill(outResults, outResults + rows, scalarTraits<Scalar>::nan());
+        std::fill(outStatus, outStatus + rows, calcLib::Status::invalidExpression);
+        return;
+    }
+    // One block of rows per stack entry
+    std::vector<Scalar> storage((stackSize + 1) * blockRows);
+    // One block of flags per open conditional, like compiledExpression::runColumns
+    size_t nesting = 0;
+    size_t open = 0;
+    for (const auto &instruction : code) {
+        if (instruction.op == Opcode::branch){
+            nesting = std::max(nesting, ++open);
+        } else if (instruction.op == Opcode::select){
+            open--;
+        }
+    }
+    std::vector<uint8_t> masks((nesting + 1) * blockRows);
+    std::fill(masks.begin(), masks.begin() + blockRows, 1);
+    // Slots of one row, for the bodies of loops
+    std::vector<Scalar> rowSlots;
+    for (size_t first = 0; first < rows; first += blockRows) {
+        size_t count = std::min(blockRows, rows - first);
+        calcLib::Status *status = outStatus + first;
+        std::fill(status, status + count, calcLib::Status::ok);
+        Scalar *top = storage.data(); // One past the topmost block
+        uint8_t *active = masks.data(); // Rows taking every open branch
+        auto report = [&](size_t i, calcLib::Status result) {
+            if (active[i]){
+                result = calcLib::absorbStatus(result, ieeeFlags);
+                if (result != calcLib::Status::ok && status[i] == calcLib::Status::ok){
+                    status[i] = result;
+                }
+            }
+        };
+        for (size_t at = 0; at < code.size(); ++at) {
+            const Instruction &instruction = code[at];
+            unsigned popped = compiledExpression::arity(instruction.op);
+            Scalar *lhs = top - popped * blockRows; // First operand, receives the result
+            Scalar *rhs = top - std::min(popped, 1u) * blockRows;
+            switch (instruction.op) {
+                case Opcode::constant:
+                    std::fill(top, top + count, constants[instruction.operand]);
+                    top += blockRows;
+                    break;
+                case Opcode::variable:
+                    std::copy(columns[instruction.operand] + first, columns[instruction.operand] + first + count, top);
+                    top += blockRows;
+                    break;
+                case Opcode::negate:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = -lhs[i];
+                    }
+                    break;
+                case Opcode::add:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] += rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::sub:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] -= rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::mul:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] *= rhs[i];
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::div:
+                    // Divide all lanes first so the loop vectorizes, then report zero divisors
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] /= rhs[i];
+                    }
+                    for (size_t i = 0; i < count; ++i) {
+                        if (rhs[i] == 0){
+                            report(i, calcLib::Status::divisionByZero);
+                        }
+                    }
+                    top -= blockRows;
+                    break;
+                case Opcode::branch: {
+                    const Scalar *condition = top - blockRows;
+                    for (size_t i = 0; i < count; ++i) {
+                        active[blockRows + i] = active[i] & (condition[i] != Scalar(0));
+                    }
+                    active += blockRows;
+                    break;
+                }
+                case Opcode::jump: {
+                    const Scalar *condition = top - 2 * blockRows;
+                    const uint8_t *enclosing = active - blockRows;
+                    for (size_t i = 0; i < count; ++i) {
+                        active[i] = enclosing[i] & (condition[i] == Scalar(0));
+                    }
+                    break;
+                }
+                case Opcode::select:
+                    for (size_t i = 0; i < count; ++i) {
+                        lhs[i] = lhs[i] != Scalar(0) ? lhs[blockRows + i] : rhs[i];
+                    }
+                    active -= blockRows;
+                    top = lhs + blockRows;
+                    break;
+                case Opcode::sum:
+                case Opcode::product:
+                    // Rows run the body one index at a time, like run
+                    rowSlots.resize(code[instruction.operand].operand);
+                    for (size_t i = 0; i < count; ++i) {
+                        if (!active[i]){
+                            lhs[i] = Scalar(0);
+                            continue;
+                        }
+                        for (size_t slot = 0; slot < rowSlots.size(); ++slot) {
+                            rowSlots[slot] = columns[slot][first + i];
+                        }
+                        calcLib::Status result = accumulate(at, rowSlots.data(), lhs[i], rhs[i], lhs[i], ieeeFlags);
+                        if (result != calcLib::Status::ok){
+                            report(i, result);
+                        }
+                    }
+                    top = lhs + blockRows;
+                    at = instruction.operand;
+                    break;
+                default:
+                    for (size_t i = 0; i < count; ++i) {
+                        calcLib::Status result = apply(instruction.op, lhs[i], rhs[i], lhs[i]);
+                        if (result != calcLib::Status::ok){
+                            report(i, result);
+                        }
+                    }
+                    top = lhs + blockRows;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            outResults[first + i] = status[i] == calcLib::Status::ok ? storage[i] : scalarTraits<Scalar>::nan();
+        }
+    }
+}
+
+template<typename Scalar>
+calcLib::Status calcLib::evaluate(const basicExpression<Scalar> &expression, calcSession &session, Scalar &outResult) const {
+    std::pmr::vector<Scalar> slots(expression.symbols.size(), session.scratch);
+    for (size_t i = 0; i < expression.symbols.size(); ++i) {
+        const std::string &name = expression.symbols[i];
+        double value;
+        if (!session.getVariable(name, value) && (name == "pi" || name == "e")){
+            slots[i] = name == "pi" ? scalarTraits<Scalar>::pi() : scalarTraits<Scalar>::e();
+            continue;
+        }
+        Status status = bindSymbol(name, session, value);
+        if (status != Status::ok){
+            return status;
+        }
+        slots[i] = static_cast<Scalar>(value);
+    }
+    Status status = expression.run(slots.data(), outResult, ieeeMode ? &session.statusFlags : nullptr);
+    if (status != Status::ok){
+        return status;
+    }
+    session.variables.find("ans")->second = static_cast<double>(outResult);
+    return Status::ok;
+}
+
+template<typename Scalar>
+std::string calcLib::formatResult(Scalar result) const {
+    std::string text = scalarTraits<Scalar>::format(result, precision);
+    if (format == ResultFormat::variable && text.find('.') != std::string::npos){
+        text.erase(text.find_last_not_of('0') + 1);
+        if (text.back() == '.'){
+            text.pop_back();
+        }
+    }
+    return text;
+}
+
+template class basicExpression<float>;
+template class basicExpression<double>;
+template class basicExpression<long double>;
+template class basicExpression<doubleDouble>;
+#if defined(CALCLIB_HAS_FLOAT128)
+template class basicExpression<__float128>;
+#endif
+// Integers have no block evaluation, their operations allocate anyway
+template calcLib::Status basicExpression<bigInteger>::run(const bigInteger *, bigInteger &, unsigned *) const;
+
+template calcLib::Status calcLib::evaluate(const basicExpression<float> &, calcSession &, float &) const;
+template calcLib::Status calcLib::evaluate(const basicExpression<double> &, calcSession &, double &) const;
+template calcLib::Status calcLib::evaluate(const basicExpression<long double> &, calcSession &, long double &) const;
+template calcLib::Status calcLib::evaluate(const basicExpression<doubleDouble> &, calcSession &, doubleDouble &) const;
+template std::string calcLib::formatResult(float) const;
+template std::string calcLib::formatResult(long double) const;
+template std::string calcLib::formatResult(doubleDouble) const;
+template std::string calcLib::formatResult(bigInteger) const;
+#if defined(CALCLIB_HAS_FLOAT128)
+template calcLib::Status calcLib::evaluate(const basicExpression<__float128> &, calcSession &, __float128 &) const;
+template std::string calcLib::formatResult(__float128) const;
+#endif
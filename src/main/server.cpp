@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "calclib/expression.hpp"
+#include "calclib/protocol.hpp"
+#include "calclib/server.hpp"
+
+namespace {
+    constexpr size_t readChunkSize = 64 * 1024;
+    constexpr size_t maxPendingOutput = 16 << 20; //! Stop reading requests of a client that does not read responses
+    constexpr size_t maxBufferedInput = calcProtocol::headerSize + calcProtocol::maxFrameSize + readChunkSize; //! Holds a whole frame
+    constexpr int maxEvents = 64;
+}
+
+struct calcServer::connection {
+    int fd;
+    calcSession session;
+    std::string input;
+    size_t inputUsed = 0; //! Bytes of input already handled
+    std::string output;
+    size_t outputWritten = 0; //! Bytes of output already sent
+    bool peerClosed = false; //! Peer will not send more requests
+    uint32_t events = 0; //! Events currently registered in epoll
+
+    size_t pendingOutput() const {
+        return output.size() - outputWritten;
+    }
+};
+
+calcServer::calcServer(const calcLib &calc, size_t cacheCapacity) : calc(calc), cache(calc, cacheCapacity) {
+}
+
+calcServer::~calcServer() {
+    for (auto &client : connections) {
+        ::close(client.first);
+    }
+    for (int fd : {listenFd, epollFd, wakeFd}) {
+        if (fd >= 0){
+            ::close(fd);
+        }
+    }
+    if (listenFd >= 0){
+        unlink(socketPath.c_str());
+    }
+}
+
+bool calcServer::listen(const std::string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)){
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+
+    struct stat info{};
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)){
+        if (info.st_uid != geteuid()){
+            errno = EACCES;
+            return false;
+        }
+        unlink(path.c_str());
+    }
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0){
+        return false;
+    }
+    // Only the owner may connect. Nobody can before listen(), so the mode is set in between instead of through the
+    // umask, which is shared by every thread of the process.
+    bool bound = bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    if (!bound || chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listenFd, SOMAXCONN) != 0){
+        int error = errno;
+        if (bound){
+            unlink(path.c_str());
+        }
+        ::close(listenFd);
+        listenFd = -1;
+        errno = error;
+        return false;
+    }
+    socketPath = path;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0){
+        return false;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    return true;
+}
+
+void calcServer::run() {
+    // A long sum of one client runs on the event loop rather than taking every core from the others
+    bool kept = expressionView::keepLoopsOnThread(true);
+    serve();
+    expressionView::keepLoopsOnThread(kept);
+}
+
+void calcServer::serve() {
+    epoll_event events[maxEvents];
+    while (true) {
+        int count = epoll_wait(epollFd, events, maxEvents, -1);
+        if (count < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd){
+                uint64_t value;
+                if (read(wakeFd, &value, sizeof(value)) < 0) {}
+                return;
+            }
+            if (fd == listenFd){
+                acceptConnections();
+                continue;
+            }
+            auto found = connections.find(fd);
+            if (found == connections.end()){
+                continue;
+            }
+            connection &client = *found->second;
+            uint32_t flags = events[i].events;
+            if (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+                if (!readInput(client)){
+                    closeConnection(client);
+                    continue;
+                }
+                processInput(client);
+            }
+            if (!writeOutput(client)){
+                closeConnection(client);
+                continue;
+            }
+            // Requests held back while the client was not reading responses
+            if (client.inputUsed < client.input.size() && client.pendingOutput() < maxPendingOutput){
+                processInput(client);
+                if (!writeOutput(client)){
+                    closeConnection(client);
+                    continue;
+                }
+            }
+            if (client.peerClosed && client.pendingOutput() == 0){
+                closeConnection(client);
+                continue;
+            }
+            updateEvents(client);
+        }
+    }
+}
+
+void calcServer::stop() {
+    uint64_t value = 1;
+    if (write(wakeFd, &value, sizeof(value)) < 0) {}
+}
+
+const expressionCache& calcServer::compiledCache() const {
+    return cache;
+}
+
+void calcServer::acceptConnections() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0){
+            return;
+        }
+        auto client = std::make_unique<connection>();
+        client->fd = fd;
+        client->events = EPOLLIN;
+        epoll_event event{};
+        event.events = client->events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        connections.emplace(fd, std::move(client));
+    }
+}
+
+void calcServer::closeConnection(connection &client) {
+    int fd = client.fd;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+}
+
+bool calcServer::readInput(connection &client) {
+    // Drop handled requests before reading more
+    client.input.erase(0, client.inputUsed);
+    client.inputUsed = 0;
+    // The rest stays in the socket buffer, so a client that does not read responses is held back by the kernel
+    while (!client.peerClosed && client.pendingOutput() < maxPendingOutput && client.input.size() < maxBufferedInput) {
+        size_t used = client.input.size();
+        size_t chunk = std::min(readChunkSize, maxBufferedInput - used);
+        client.input.resize(used + chunk);
+        ssize_t result = recv(client.fd, client.input.data() + used, chunk, 0);
+        client.input.resize(used + std::max<ssize_t>(result, 0));
+        if (result > 0){
+            continue;
+        }
+        if (result == 0){
+            client.peerClosed = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK){
+            break;
+        } else if (errno != EINTR){
+            return false;
+        }
+    }
+    return true;
+}
+
+void calcServer::processInput(connection &client) {
+    calcProtocol::frame request{};
+    size_t consumed;
+    while (client.pendingOutput() < maxPendingOutput) {
+        int result = calcProtocol::parseFrame(client.input.data() + client.inputUsed,
+                                              client.input.size() - client.inputUsed, request, consumed);
+        if (result == 0){
+            break;
+        }
+        if (result < 0 || !handleFrame(client, request.payload, static_cast<uint8_t>(request.type))){
+            // Malformed stream, answer what was handled and hang up
+            client.input.clear();
+            client.inputUsed = 0;
+            client.peerClosed = true;
+            break;
+        }
+        client.inputUsed += consumed;
+    }
+}
+
+bool calcServer::handleFrame(connection &client, std::string_view payload, uint8_t type) {
+    using calcProtocol::MessageType;
+    auto status = calcLib::Status::invalidExpression;
+    double value = 0;
+    switch (static_cast<MessageType>(type)) {
+        case MessageType::evaluate:
+        case MessageType::evaluateText: {
+            std::shared_ptr<const compiledExpression> compiled;
+            status = cache.get(payload, compiled);
+            if (status == calcLib::Status::ok){
+                status = calc.evaluate(*compiled, client.session, value);
+            }
+            if (static_cast<MessageType>(type) == MessageType::evaluateText){
+                std::string text(1, static_cast<char>(status));
+                text += status == calcLib::Status::ok ? calc.formatResult(value) : calcLib::statusMessage(status);
+                calcProtocol::appendFrame(client.output, MessageType::text, text);
+                return true;
+            }
+            break;
+        }
+        case MessageType::setVariable:
+            if (payload.size() > 8){
+                value = calcProtocol::getDouble(payload.data());
+                client.session.setVariable(std::string(payload.substr(8)), value);
+                status = calcLib::Status::ok;
+            }
+            break;
+        default:
+            return false;
+    }
+    calcProtocol::appendResult(client.output, static_cast<uint8_t>(status),
+                               static_cast<uint8_t>(client.session.flags()), value);
+    return true;
+}
+
+bool calcServer::writeOutput(connection &client) {
+    while (client.pendingOutput() > 0) {
+        ssize_t result = send(client.fd, client.output.data() + client.outputWritten, client.pendingOutput(), MSG_NOSIGNAL);
+        if (result < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.outputWritten += result;
+    }
+    client.output.clear();
+    client.outputWritten = 0;
+    return true;
+}
+
+void calcServer::updateEvents(connection &client) {
+    uint32_t events = 0;
+    if (!client.peerClosed && client.pendingOutput() < maxPendingOutput
+        && client.input.size() - client.inputUsed < maxBufferedInput){
+        events |= EPOLLIN;
+    }
+    if (client.pendingOutput() > 0){
+        events |= EPOLLOUT;
+    }
+    if (events != client.events){
+        client.events = events;
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = client.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <lib/lexertk/lexertk.hpp>
+#include "calclib/calclib.hpp"
+
+/**
+ * Lexer interface shared by calclib.cpp and the compiler. Kept out of the public headers so that
+ * users of calclib do not parse lexertk.
+ */
+
+using Token_type = lexertk::token::token_type;
+
+/**
+ * Custom token. Storing value in double for Token_type::e_number and in std::string for everything else.
+ */
+class Token{
+public:
+    Token_type type; //! The type of token
+    std::variant<double,std::string> value; //! Storing value in double for number and in std::string for everything else.
+    std::string spelling; //! Text of Token_type::e_number, converted by engines evaluating in other types than double
+    /**
+     * Constructs "Calclib" tokens from lexertk tokens.
+     * @param lexertk_token
+     * @return Token
+     */
+    static Token fromLexertk(const lexertk::token &lexertk_token);
+    /**
+     * Almost default comparator but rhs.type can be e_none and still match if value is equal.
+     * @param rhs
+     * @return
+     */
+    inline bool operator==(const Token& rhs) const;
+};
+
+using TokenList = std::pmr::list<Token>; //! Token storage allocated from calcSession scratch memory
+
+/**
+ * Function of calcLib::define, inlined by the compiler at every call
+ */
+struct userFunction {
+    std::vector<std::string> parameters;
+    TokenList body; //! Lexed once when the function is defined
+};
+
+/**
+ * Lexes string expression into Tokens
+ * @param expression input mathematical expression
+ * @param outTokens Reference to list where tokens should be stored
+ * @return Status::ok on success Status::syntaxError on error
+ */
+calcLib::Status parseEquation(std::string_view expression, TokenList &outTokens);
@@ -0,0 +1,301 @@
+#include "calclib/expression.hpp"
+#include "calclib/jit.hpp"
+#include "gtest/gtest.h"
+#include <quadmath.h>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace ::testing;
+
+// Randomized and exhaustive checks of the error bounds of calcLib::Accuracy against __float128 references.
+// Built as calclib_accuracy_test apart from calclib_test, because the samples take a few seconds.
+
+namespace {
+
+using Accuracy = calcLib::Accuracy;
+
+constexpr Accuracy tiers[] = {Accuracy::faithful, Accuracy::correctlyRounded, Accuracy::fast};
+constexpr double fastBound = 1e-12; //! Relative error of Accuracy::fast
+constexpr int samples = 100000;
+
+/**
+ * Expression in x and y compiled for one accuracy tier
+ */
+struct tieredFunction {
+    compiledExpression expression;
+
+    tieredFunction(const char *text, Accuracy accuracy) {
+        calcLib calc;
+        calc.accuracy = accuracy;
+        calc.compile(text, expression);
+    }
+
+    calcLib::Status operator()(const double *arguments, double &outResult) const {
+        double slots[2];
+        for (size_t i = 0; i < expression.symbols.size(); ++i) {
+            slots[i] = arguments[expression.symbols[i] == "x" ? 0 : 1];
+        }
+        return expression.run(slots, outResult, nullptr);
+    }
+};
+
+/**
+ * @return distance of result from exact in ulp of the double nearest to exact
+ */
+double ulpError(double result, __float128 exact) {
+    auto rounded = static_cast<double>(exact);
+    double ulp = std::ldexp(1.0, std::max(std::ilogb(rounded), DBL_MIN_EXP - 1) - 52);
+    return static_cast<double>(fabsq(static_cast<__float128>(result) - exact) / ulp);
+}
+
+double logUniform(std::mt19937_64 &generator, double lo, double hi) {
+    return std::exp(std::uniform_real_distribution<double>(std::log(lo), std::log(hi))(generator));
+}
+
+// sin, cos and tan of degrees, reduced without rounding the remainder of 360 and exact at the zeros and poles
+
+__float128 sinDegrees(double degrees) {
+    double remainder = std::fmod(degrees, 360);
+    return std::fmod(remainder, 180) == 0 ? 0 : sinq(remainder * (M_PIq / 180));
+}
+
+__float128 cosDegrees(double degrees) {
+    double remainder = std::fmod(degrees, 360);
+    return std::abs(std::fmod(remainder, 180)) == 90 ? 0 : cosq(remainder * (M_PIq / 180));
+}
+
+__float128 tanDegrees(double degrees) {
+    return sinDegrees(degrees) / cosDegrees(degrees);
+}
+
+struct functionCase {
+    const char *text; //! Expression in x and y
+    std::function<void(std::mt19937_64 &, double *)> draw; //! Random x and y
+    std::function<__float128(const double *)> exact;
+    std::function<double(const double *)> faithfulUlps; //! Bound of Accuracy::faithful
+};
+
+std::vector<functionCase> functionCases() {
+    auto angle = [](std::mt19937_64 &generator, double *arguments) {
+        // Mostly the first turns, some far ones whose reduction must stay exact
+        arguments[0] = generator() % 8 != 0 ? std::uniform_real_distribution<double>(-720, 720)(generator)
+                                            : logUniform(generator, 1e3, 1e18);
+    };
+    return {
+            {"sin(x)", angle, [](const double *a) { return sinDegrees(a[0]); }, [](const double *) { return 1.0; }},
+            {"cos(x)", angle, [](const double *a) { return cosDegrees(a[0]); }, [](const double *) { return 1.0; }},
+            {"tan(x)", angle, [](const double *a) { return tanDegrees(a[0]); }, [](const double *) { return 3.0; }},
+            {"x^y", [](std::mt19937_64 &generator, double *arguments) {
+                arguments[0] = logUniform(generator, 1e-3, 1e3);
+                arguments[1] = std::uniform_real_distribution<double>(-100, 100)(generator);
+                if (generator() % 4 == 0){
+                    // Negative bases need integer exponents
+                    arguments[0] = -arguments[0];
+                    arguments[1] = std::round(arguments[1]);
+                }
+            }, [](const double *a) { return powq(a[0], a[1]); }, [](const double *) { return 1.0; }},
+            {"sqrt(x)", [](std::mt19937_64 &generator, double *arguments) {
+                arguments[0] = logUniform(generator, 1e-300, 1e300);
+            }, [](const double *a) { return sqrtq(a[0]); }, [](const double *) { return 1.0; }},
+            {"log(x)", [](std::mt19937_64 &generator, double *arguments) {
+                // Half of them close to 1, where the logarithm is small
+                arguments[0] = generator() % 2 == 0 ? logUniform(generator, 1e-300, 1e300)
+                                                    : 1 + std::uniform_real_distribution<double>(-1e-3, 1e-3)(generator);
+            }, [](const double *a) { return log10q(a[0]); }, [](const double *) { return 2.0; }}, // glibc's bound
+            {"log(y:x)", [](std::mt19937_64 &generator, double *arguments) {
+                arguments[0] = logUniform(generator, 1e-100, 1e100);
+                arguments[1] = logUniform(generator, 1.001, 100);
+                if (generator() % 2 == 0){
+                    arguments[1] = 1 / arguments[1];
+                }
+            }, [](const double *a) { return logq(a[0]) / logq(a[1]); }, [](const double *) { return 5.0; }},
+            {"root(y:x)", [](std::mt19937_64 &generator, double *arguments) {
+                arguments[0] = logUniform(generator, 1e-100, 1e100);
+                arguments[1] = (generator() % 2 == 0 ? 1 : -1) * logUniform(generator, 0.5, 20);
+            }, [](const double *a) { return powq(a[0], 1 / static_cast<__float128>(a[1])); },
+             // The exponent 1 / degree is rounded before pow, which scales its error by ln(num) / degree
+             [](const double *a) { return 1 + std::abs(std::log(a[0]) / a[1]); }},
+    };
+}
+
+}
+
+TEST(AccuracyTest, Tiers_within_their_bounds) {
+    std::mt19937_64 generator(45);
+    for (const functionCase &function : functionCases()) {
+        tieredFunction faithful(function.text, Accuracy::faithful);
+        tieredFunction correctlyRounded(function.text, Accuracy::correctlyRounded);
+        tieredFunction fast(function.text, Accuracy::fast);
+        double worstFaithful = 0;
+        double worstFast = 0;
+        for (int i = 0; i < samples; ++i) {
+            double arguments[2];
+            function.draw(generator, arguments);
+            __float128 exact = function.exact(arguments);
+            auto expected = static_cast<double>(exact);
+            if (!std::isnormal(expected)){
+                continue;
+            }
+            double result;
+            ASSERT_EQ(correctlyRounded(arguments, result), calcLib::Status::ok) << function.text << arguments[0];
+            EXPECT_EQ(result, expected) << function.text << " at " << arguments[0] << ", " << arguments[1];
+
+            ASSERT_EQ(faithful(arguments, result), calcLib::Status::ok) << function.text << arguments[0];
+            double error = ulpError(result, exact);
+            worstFaithful = std::max(worstFaithful, error);
+            EXPECT_LE(error, function.faithfulUlps(arguments)) << function.text << " at " << arguments[0] << ", " << arguments[1];
+
+            ASSERT_EQ(fast(arguments, result), calcLib::Status::ok) << function.text << arguments[0];
+            error = static_cast<double>(fabsq((result - exact) / exact));
+            worstFast = std::max(worstFast, error);
+            EXPECT_LE(error, fastBound) << function.text << " at " << arguments[0] << ", " << arguments[1];
+        }
+        std::printf("%-10s faithful %.2f ulp, fast %.1e\n", function.text, worstFaithful, worstFast);
+    }
+}
+
+TEST(AccuracyTest, Every_integer_angle) {
+    const char *texts[] = {"sin(x)", "cos(x)", "tan(x)"};
+    for (int i = 0; i < 3; ++i) {
+        for (Accuracy accuracy : tiers) {
+            tieredFunction function(texts[i], accuracy);
+            for (int degrees = -3600; degrees <= 3600; ++degrees) {
+                double argument = degrees;
+                __float128 exact = i == 0 ? sinDegrees(argument) : i == 1 ? cosDegrees(argument) : tanDegrees(argument);
+                double result;
+                if (i == 2 && (degrees % 180 + 180) % 180 == 90){
+                    EXPECT_EQ(function(&argument, result), calcLib::Status::divisionByZero) << degrees;
+                    continue;
+                }
+                ASSERT_EQ(function(&argument, result), calcLib::Status::ok) << degrees;
+                if (exact == 0){
+                    EXPECT_EQ(result, 0) << texts[i] << " at " << degrees;
+                } else if (accuracy == Accuracy::correctlyRounded){
+                    EXPECT_EQ(result, static_cast<double>(exact)) << texts[i] << " at " << degrees;
+                } else if (accuracy == Accuracy::fast){
+                    EXPECT_LE(static_cast<double>(fabsq((result - exact) / exact)), fastBound) << texts[i] << " at " << degrees;
+                } else {
+                    EXPECT_LE(ulpError(result, exact), i == 2 ? 3 : 1) << texts[i] << " at " << degrees;
+                }
+            }
+        }
+    }
+}
+
+TEST(AccuracyTest, Exact_results_in_every_tier) {
+    std::pair<const char *, double> cases[] = {
+            {"sin(30)", 0.5}, {"cos(180)", -1}, {"tan(45)", 1}, {"2^10", 1024}, {"3^-2", 1.0 / 9}, {"(-2)^3", -8},
+            {"sqrt(16)", 4}, {"root(3:27)", 3}, {"log(1000)", 3}, {"log(2:1024)", 10}, {"2^0.5", M_SQRT2}
+    };
+    for (auto [text, expected] : cases) {
+        calcLib calc;
+        calc.accuracy = Accuracy::correctlyRounded;
+        double result;
+        ASSERT_EQ(calc.evaluate(text, result), calcLib::Status::ok) << text;
+        EXPECT_EQ(result, expected) << text;
+        calc.accuracy = Accuracy::fast;
+        ASSERT_EQ(calc.evaluate(text, result), calcLib::Status::ok) << text;
+        EXPECT_NEAR(result, expected, std::abs(expected) * fastBound) << text;
+        // The default 8 digits do not show the difference
+        EXPECT_EQ(calc.solveEquation(text), calcLib().solveEquation(text)) << text;
+    }
+}
+
+TEST(AccuracyTest, Same_statuses_in_every_tier) {
+    const char *texts[] = {"tan(90)", "tan(-270)", "root(2:-4)", "sqrt(-1)", "root(0:5)", "log(1:5)", "log(0)",
+                           "log(-1)", "0^-1", "(-8)^(1/3)", "sqrt(0)", "10^400", "2^-1080"};
+    for (const char *text : texts) {
+        calcLib calc;
+        double expected;
+        calcLib::Status status = calc.evaluate(text, expected);
+        for (Accuracy accuracy : tiers) {
+            calc.accuracy = accuracy;
+            double result;
+            EXPECT_EQ(calc.evaluate(text, result), status) << text;
+            if (status == calcLib::Status::ok){
+                EXPECT_TRUE(result == expected || (std::isnan(result) && std::isnan(expected))) << text;
+            }
+        }
+    }
+}
+
+TEST(AccuracyTest, Tier_is_kept_by_the_bytecode) {
+    calcLib calc;
+    calc.accuracy = Accuracy::fast;
+    compiledExpression expression;
+    ASSERT_EQ(calc.compile("sin(x)*x^1.5-log(x)+tan(x)", expression), calcLib::Status::ok);
+    calc.accuracy = Accuracy::faithful;
+    tieredFunction fast("sin(x)*x^1.5-log(x)+tan(x)", Accuracy::fast);
+    tieredFunction faithful("sin(x)*x^1.5-log(x)+tan(x)", Accuracy::faithful);
+
+    const size_t rows = 600;
+    std::vector<double> x(rows);
+    bool differs = false;
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = 0.37 + static_cast<double>(i) * 0.61;
+        double tiered;
+        double reference;
+        fast(&x[i], tiered);
+        faithful(&x[i], reference);
+        differs |= tiered != reference;
+    }
+    EXPECT_TRUE(differs);
+
+    const double *columns[] = {x.data()};
+    std::vector<double> results(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    expression.runColumns(columns, rows, results.data(), statuses.data(), nullptr);
+    auto native = jitExpression::compile(expression.view());
+    for (size_t i = 0; i < rows; ++i) {
+        double expected;
+        ASSERT_EQ(fast(&x[i], expected), calcLib::Status::ok);
+        EXPECT_EQ(results[i], expected) << x[i];
+        if (native){
+            double result;
+            ASSERT_EQ(native->run(&x[i], result, nullptr), calcLib::Status::ok);
+            EXPECT_EQ(result, expected) << x[i];
+        }
+    }
+}
+
+TEST(AccuracyTest, Fast_blocks_match_run) {
+    calcLib calc;
+    calc.accuracy = Accuracy::fast;
+    compiledExpression expression;
+    ASSERT_EQ(calc.compile("x^y+log(x)+x^7-x^-3", expression), calcLib::Status::ok);
+    const double special[] = {0.0, -0.0, 1.0, -1.0, 2.0, -2.0, 0.5, -0.5, 3.0, -3.0, 10.0, 1e300, -1e300,
+                              1e-300, 4e-320, -4e-320, 1.0 / 3, 710, -710, 64, 1023.5, INFINITY, -INFINITY, NAN};
+    const size_t specialCount = sizeof(special) / sizeof(special[0]);
+    std::mt19937_64 generator(45);
+    std::uniform_real_distribution<double> uniform(-40, 40);
+    std::vector<double> x;
+    std::vector<double> y;
+    for (size_t i = 0; i < specialCount; ++i) {
+        for (size_t j = 0; j < specialCount; ++j) {
+            x.push_back(special[i]);
+            y.push_back(special[j]);
+        }
+    }
+    // Whole blocks of ordinary values too, so the vectorized loops run without falling back
+    for (size_t i = 0; i < 1000; ++i) {
+        x.push_back(std::exp(uniform(generator)));
+        y.push_back(uniform(generator));
+    }
+    const double *columns[] = {x.data(), y.data()};
+    std::vector<double> results(x.size());
+    std::vector<calcLib::Status> statuses(x.size());
+    expression.runColumns(columns, x.size(), results.data(), statuses.data(), nullptr);
+    for (size_t i = 0; i < x.size(); ++i) {
+        const double slots[] = {x[i], y[i]};
+        double expected;
+        ASSERT_EQ(expression.run(slots, expected, nullptr), statuses[i]);
+        if (statuses[i] == calcLib::Status::ok){
+            EXPECT_TRUE(results[i] == expected || (std::isnan(results[i]) && std::isnan(expected)))
+                << x[i] << "^" << y[i] << ": " << results[i] << " != " << expected;
+        }
+    }
+}
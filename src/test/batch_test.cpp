@@ -0,0 +1,57 @@
+#include "calclib/batch.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+
+using namespace ::testing;
+
+TEST(CalcBatchTest, Results_in_order) {
+    const calcLib calc;
+    calcBatch batch{calc, 4};
+    std::vector<std::string> storage;
+    for (int i = 0; i < 5000; ++i) {
+        storage.push_back(i % 7 == 0 ? std::to_string(i) + "/0" : std::to_string(i) + "*2+" + std::string(i % 50, '0') + "1");
+    }
+    std::vector<std::string_view> expressions(storage.begin(), storage.end());
+    auto results = batch.evaluate(expressions);
+    ASSERT_EQ(results.size(), expressions.size());
+    for (int i = 0; i < 5000; ++i) {
+        if (i % 7 == 0) {
+            EXPECT_EQ(results[i].status, calcLib::Status::divisionByZero);
+        } else {
+            EXPECT_EQ(results[i].status, calcLib::Status::ok);
+            EXPECT_EQ(results[i].value, i * 2 + 1);
+        }
+    }
+}
+
+TEST(CalcBatchTest, Session_and_flags) {
+    calcLib calc;
+    calc.ieeeMode = true;
+    calcBatch batch{calc, 2};
+    calcSession session;
+    session.setVariable("x", 3);
+    session.setVariable("ans", 10);
+    std::vector<std::string_view> expressions{"x*ans", "1/0", "ans", "", "3+"};
+    std::vector<batchResult> results(expressions.size());
+    batch.evaluate(expressions.data(), expressions.size(), results.data(), session);
+    EXPECT_EQ(results[0].value, 30);
+    EXPECT_EQ(results[1].value, INFINITY);
+    EXPECT_EQ(results[1].flags, calcLib::flagDivisionByZero);
+    EXPECT_EQ(results[2].value, 10);
+    EXPECT_EQ(results[2].flags, 0u);
+    EXPECT_EQ(results[3].value, 10);
+    EXPECT_EQ(results[4].status, calcLib::Status::invalidExpression);
+}
+
+TEST(CalcBatchTest, Reuse) {
+    const calcLib calc;
+    calcBatch batch{calc};
+    EXPECT_GE(batch.threadCount(), 1u);
+    EXPECT_TRUE(batch.evaluate({}).empty());
+    for (int round = 0; round < 3; ++round) {
+        auto results = batch.evaluate({"2^10", "3!", "sin(90)"});
+        EXPECT_EQ(results[0].value, 1024);
+        EXPECT_EQ(results[1].value, 6);
+        EXPECT_EQ(results[2].value, 1);
+    }
+}
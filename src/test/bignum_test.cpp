@@ -0,0 +1,129 @@
+#include "calclib/bignum.hpp"
+#include "gtest/gtest.h"
+#include <chrono>
+
+using namespace ::testing;
+
+namespace {
+
+calcLib::Status evaluateExact(const char *text, std::string &outDigits) {
+    calcLib calc(calcLib::ResultFormat::variable, 6);
+    basicExpression<bigInteger> expression;
+    calcLib::Status status = calc.compile(text, expression);
+    if (status != calcLib::Status::ok){
+        return status;
+    }
+    calcSession session;
+    session.setVariable("x", 12);
+    bigInteger result;
+    status = calc.evaluate(expression, session, result);
+    if (status == calcLib::Status::ok){
+        outDigits = calc.formatResult(result);
+    }
+    return status;
+}
+
+}
+
+TEST(BignumTest, Exact_results) {
+    std::pair<const char *, const char *> cases[] = {
+            {"2^64", "18446744073709551616"},
+            {"25!", "15511210043330985984000000"},
+            {"(2^100+1)*(2^100-1)-2^200", "-1"},
+            {"10^30/(10^12)", "1000000000000000000"},
+            {"(7^40)%(10^9+7)", "339761968"},
+            {"-(7^41)%(3^20)", "-481318294"},
+            {"sqrt(10^40)", "100000000000000000000"},
+            {"root(3:x^3)", "12"},
+            {"log(10^25)", "25"},
+            {"log(3:3^90)", "90"},
+            {"sin(1530)+cos(180)+tan(-45)", "-1"},
+            {"1.5e3*2", "3000"},
+            {"(-1)^(2^70+1)", "-1"},
+            {"if(x>10:2^70:1/0)-min(x:3)+abs(-x)", "1180591620717411303433"},
+            {"(2^70+1>2^70)+(2^70=2^70+1)", "1"},
+            {"sum(i:1:x:i^3)-prod(i:1:25:i)", "-15511210043330985983993916"},
+            {"ans", "0"}
+    };
+    for (auto &[text, expected] : cases) {
+        std::string digits;
+        ASSERT_EQ(evaluateExact(text, digits), calcLib::Status::ok) << text;
+        EXPECT_EQ(digits, expected) << text;
+    }
+}
+
+TEST(BignumTest, Large_factorials_and_powers) {
+    std::string digits;
+    ASSERT_EQ(evaluateExact("200!", digits), calcLib::Status::ok);
+    EXPECT_EQ(digits.size(), 375u);
+    EXPECT_EQ(digits.substr(0, 20), "78865786736479050355");
+    EXPECT_EQ(digits.size() - 1 - digits.find_last_not_of('0'), 49u);
+    ASSERT_EQ(evaluateExact("3^5000", digits), calcLib::Status::ok);
+    EXPECT_EQ(digits.size(), 2386u);
+    EXPECT_EQ(digits.substr(0, 12), "403899762978");
+    EXPECT_EQ(digits.substr(digits.size() - 12), "998276100001");
+    // Division undoes the Karatsuba product
+    ASSERT_EQ(evaluateExact("(3^5000*7^3000)/(7^3000)-3^5000", digits), calcLib::Status::ok);
+    EXPECT_EQ(digits, "0");
+    ASSERT_EQ(evaluateExact("(1000!)/(998!)", digits), calcLib::Status::ok);
+    EXPECT_EQ(digits, "999000");
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(evaluateExact("100000!", digits), calcLib::Status::ok);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(digits.size(), 456574u);
+    EXPECT_EQ(digits.substr(0, 10), "2824229407");
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+}
+
+TEST(BignumTest, Reports_results_that_are_not_integers) {
+    std::pair<const char *, calcLib::Status> cases[] = {
+            {"7/2", calcLib::Status::domainError},
+            {"1/0", calcLib::Status::divisionByZero},
+            {"5%0", calcLib::Status::divisionByZero},
+            {"2^-1", calcLib::Status::domainError},
+            {"(-3)!", calcLib::Status::domainError},
+            {"sqrt(15)", calcLib::Status::domainError},
+            {"root(2:-4)", calcLib::Status::domainError},
+            {"sin(30)", calcLib::Status::domainError},
+            {"tan(90)", calcLib::Status::divisionByZero},
+            {"tan(270)", calcLib::Status::divisionByZero},
+            {"2*pi", calcLib::Status::domainError},
+            {"0.5*4", calcLib::Status::domainError},
+            {"10^(10^7)", calcLib::Status::domainError},
+            {"1000000!", calcLib::Status::domainError},
+            {"y+1", calcLib::Status::invalidExpression}
+    };
+    for (auto &[text, expected] : cases) {
+        std::string digits;
+        EXPECT_EQ(evaluateExact(text, digits), expected) << text;
+    }
+}
+
+TEST(BignumTest, Converts_doubles_exactly) {
+    bigInteger value;
+    ASSERT_TRUE(bigInteger::fromDouble(0x1p100, value));
+    EXPECT_EQ(value.toString(), "1267650600228229401496703205376");
+    EXPECT_EQ(value.toDouble(), 0x1p100);
+    EXPECT_FALSE(bigInteger::fromDouble(0.5, value));
+    EXPECT_EQ(bigInteger::parse("000").toString(), "0");
+    EXPECT_EQ(bigInteger::parse("12.000").toString(), "12");
+    EXPECT_FALSE(bigInteger::parse("12.5").isValid());
+    EXPECT_EQ(bigInteger::parse("125e-2").isValid(), false);
+    EXPECT_EQ(bigInteger::parse("1200e-2").toString(), "12");
+
+    calcLib calc(calcLib::ResultFormat::fixed, 2);
+    EXPECT_EQ(calc.formatResult(bigInteger(-42)), "-42.00");
+}
+
+TEST(BignumTest, User_functions) {
+    calcLib calc(calcLib::ResultFormat::variable, 6);
+    ASSERT_EQ(calc.define("cube(n)=n^3"), calcLib::Status::ok);
+    basicExpression<bigInteger> expression;
+    ASSERT_EQ(calc.compile("cube(2^30)+x", expression), calcLib::Status::ok);
+    calcSession session;
+    session.setVariable("x", 1);
+    bigInteger result;
+    ASSERT_EQ(calc.evaluate(expression, session, result), calcLib::Status::ok);
+    EXPECT_EQ(calc.formatResult(result), "1237940039285380274899124225");
+}
@@ -0,0 +1,102 @@
+#include "calclib/bundle.hpp"
+#include "gtest/gtest.h"
+#include <cstring>
+#include <unistd.h>
+
+using namespace ::testing;
+
+namespace {
+
+/**
+ * Copies bundle contents to 8 byte aligned memory
+ */
+std::vector<uint64_t> alignedCopy(const std::string &contents) {
+    std::vector<uint64_t> memory((contents.size() + 7) / 8);
+    std::memcpy(memory.data(), contents.data(), contents.size());
+    return memory;
+}
+
+}
+
+TEST(ExpressionBundleTest, Save_and_map) {
+    const calcLib calc;
+    const char *expressions[] = {"x*2+pi", "ans+1", "root(3:x)^2%7", "1/x", "sin(30)*5!", "3*x^4-x+7",
+                                 "sum(i:1:x:i^2)", "prod(k:1:3:x+k)"};
+    bundleWriter writer;
+    for (const char *expression : expressions) {
+        compiledExpression compiled;
+        ASSERT_EQ(calc.compile(expression, compiled), calcLib::Status::ok);
+        writer.add(expression, compiled);
+    }
+    std::string path = "/tmp/calclib_test-" + std::to_string(getpid()) + ".bundle";
+    ASSERT_TRUE(writer.save(path));
+
+    expressionBundle bundle;
+    ASSERT_TRUE(bundle.open(path));
+    unlink(path.c_str());
+    ASSERT_EQ(bundle.expressionCount(), 8);
+    for (double x : {8.0, -27.0, 0.0}) {
+        calcSession bundled;
+        calcSession parsed;
+        bundled.setVariable("x", x);
+        parsed.setVariable("x", x);
+        for (const char *expression : expressions) {
+            size_t index;
+            ASSERT_TRUE(bundle.find(expression, index));
+            EXPECT_EQ(bundle.name(index), expression);
+            double expected = 0;
+            double result = 0;
+            EXPECT_EQ(bundle.evaluate(calc, index, bundled, result), calc.evaluate(expression, parsed, expected));
+            EXPECT_EQ(result, expected) << expression;
+        }
+    }
+    size_t index;
+    EXPECT_FALSE(bundle.find("x*3", index));
+}
+
+TEST(ExpressionBundleTest, Session_snapshot) {
+    calcSession session;
+    session.setVariable("ans", 42);
+    session.setVariable("rate", 0.25);
+    bundleWriter writer;
+    writer.addSession(session);
+    auto memory = alignedCopy(writer.serialize());
+    expressionBundle bundle;
+    ASSERT_TRUE(bundle.open(memory.data(), writer.serialize().size()));
+    EXPECT_EQ(bundle.expressionCount(), 0);
+
+    calcSession restored;
+    bundle.restoreSession(restored);
+    const calcLib calc;
+    EXPECT_EQ(calc.solveEquation("ans+rate*4", restored), "43");
+}
+
+TEST(ExpressionBundleTest, Rejects_damaged_files) {
+    const calcLib calc;
+    compiledExpression compiled;
+    ASSERT_EQ(calc.compile("1+2*3", compiled), calcLib::Status::ok);
+    bundleWriter writer;
+    writer.add("f", compiled);
+    ASSERT_EQ(calc.compile("if(x>1:x^2+x+1:-x)", compiled), calcLib::Status::ok);
+    writer.add("g", compiled);
+    std::string contents = writer.serialize();
+    expressionBundle bundle;
+    auto memory = alignedCopy(contents);
+    EXPECT_TRUE(bundle.open(memory.data(), contents.size()));
+    EXPECT_FALSE(bundle.open(memory.data(), contents.size() - 8));
+
+    // Every single corrupted byte must either be rejected or still leave evaluable bytecode
+    for (size_t i = 0; i < contents.size(); ++i) {
+        std::string damaged = contents;
+        damaged[i] ^= 0x5a;
+        memory = alignedCopy(damaged);
+        if (bundle.open(memory.data(), damaged.size()) && bundle.expressionCount() == 2) {
+            calcSession session;
+            double result;
+            bundle.evaluate(calc, 0, session, result);
+            bundle.evaluate(calc, 1, session, result);
+        }
+    }
+    bundle.close();
+    EXPECT_FALSE(bundle.open("/nonexistent/calclib.bundle"));
+}
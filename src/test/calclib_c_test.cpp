@@ -0,0 +1,151 @@
+#include "calclib/calclib_c.h"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace ::testing;
+
+namespace {
+
+calclib_expression* compile(const calclib_context *context, const char *expression,
+                            const std::vector<const char*> &variables, int expectedStatus = CALCLIB_OK) {
+    calclib_expression *compiled = nullptr;
+    EXPECT_EQ(calclib_compile(context, expression, strlen(expression), variables.data(), variables.size(), &compiled),
+              expectedStatus);
+    return compiled;
+}
+
+}
+
+TEST(CalclibCTest, Compile_and_evaluate) {
+    calclib_context *context = calclib_create();
+    calclib_expression *expression = compile(context, "x*pi+y^2", {"x", "y"});
+    ASSERT_NE(expression, nullptr);
+    double values[] = {2, 3};
+    double result;
+    EXPECT_EQ(calclib_evaluate(context, expression, values, &result, nullptr), CALCLIB_OK);
+    EXPECT_DOUBLE_EQ(result, 2 * M_PI + 9);
+    calclib_expression_free(expression);
+
+    // Listed variables shadow constants
+    expression = compile(context, "e+1", {"e"});
+    values[0] = 1;
+    EXPECT_EQ(calclib_evaluate(context, expression, values, &result, nullptr), CALCLIB_OK);
+    EXPECT_EQ(result, 2);
+    calclib_expression_free(expression);
+
+    EXPECT_EQ(compile(context, "z+1", {"x"}, CALCLIB_INVALID_EXPRESSION), nullptr);
+    EXPECT_EQ(compile(context, "(1+2", {}, CALCLIB_SYNTAX_ERROR), nullptr);
+    EXPECT_STREQ(calclib_status_message(CALCLIB_DIVISION_BY_ZERO), "Division by zero");
+    calclib_destroy(context);
+}
+
+TEST(CalclibCTest, Batch_matches_scalar) {
+    calclib_context *context = calclib_create();
+    calclib_expression *expression = compile(context, "-a/b+root(2:a)%3*sin(b)-3!", {"a", "b"});
+    ASSERT_NE(expression, nullptr);
+    // More rows than one block of statuses
+    const size_t rows = 10000;
+    std::vector<double> a(rows);
+    std::vector<double> b(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        a[i] = static_cast<double>(i) - 100;
+        b[i] = static_cast<double>(i % 17);
+    }
+    const double *columns[] = {a.data(), b.data()};
+    std::vector<double> results(rows);
+    std::vector<unsigned char> status(rows);
+    EXPECT_EQ(calclib_evaluate_batch(context, expression, columns, rows, results.data(), status.data(), nullptr),
+              CALCLIB_DIVISION_BY_ZERO);
+    for (size_t i = 0; i < rows; ++i) {
+        double values[] = {a[i], b[i]};
+        double expected;
+        int expectedStatus = calclib_evaluate(context, expression, values, &expected, nullptr);
+        ASSERT_EQ(status[i], expectedStatus) << i;
+        if (expectedStatus == CALCLIB_OK) {
+            ASSERT_EQ(results[i], expected) << i;
+        } else {
+            ASSERT_TRUE(std::isnan(results[i])) << i;
+        }
+    }
+
+    calclib_set_ieee_mode(context, 1);
+    unsigned flags;
+    EXPECT_EQ(calclib_evaluate_batch(context, expression, columns, rows, results.data(), nullptr, &flags), CALCLIB_OK);
+    EXPECT_EQ(flags, CALCLIB_FLAG_DIVISION_BY_ZERO | CALCLIB_FLAG_INVALID);
+    EXPECT_TRUE(std::isinf(results[102]));
+    EXPECT_TRUE(std::isnan(results[0]));
+    double values[] = {a[102], b[102]};
+    double result;
+    EXPECT_EQ(calclib_evaluate(context, expression, values, &result, &flags), CALCLIB_OK);
+    EXPECT_EQ(flags, CALCLIB_FLAG_DIVISION_BY_ZERO);
+    EXPECT_EQ(result, results[102]);
+    calclib_expression_free(expression);
+    calclib_destroy(context);
+}
+
+TEST(CalclibCTest, Loops_over_folded_symbols) {
+    calclib_context *context = calclib_create();
+    // pi is folded into a constant, so the slots of x and of the indices move down
+    calclib_expression *expression = compile(context, "pi*sum(i:1:3:sin(i)*x)+prod(j:1:x:j+e)", {"x"});
+    ASSERT_NE(expression, nullptr);
+    std::vector<double> xs = {1, 2, 3, 4};
+    double expectedResults[4];
+    for (size_t row = 0; row < xs.size(); ++row) {
+        double x = xs[row];
+        double product = 1;
+        for (int j = 1; j <= x; ++j) {
+            product *= j + M_E;
+        }
+        double expected = M_PI * (std::sin(1 * M_PI / 180) * x + std::sin(2 * M_PI / 180) * x
+                                  + std::sin(3 * M_PI / 180) * x) + product;
+        double result;
+        EXPECT_EQ(calclib_evaluate(context, expression, &x, &result, nullptr), CALCLIB_OK);
+        EXPECT_NEAR(result, expected, 1e-12 * std::abs(expected)) << x;
+        expectedResults[row] = result;
+    }
+    const double *columns[] = {xs.data()};
+    double results[4];
+    EXPECT_EQ(calclib_evaluate_batch(context, expression, columns, xs.size(), results, nullptr, nullptr), CALCLIB_OK);
+    for (size_t row = 0; row < xs.size(); ++row) {
+        EXPECT_EQ(results[row], expectedResults[row]) << xs[row];
+    }
+    calclib_expression_free(expression);
+
+    expression = compile(context, "sum(i:1:3:i*x)", {"x"});
+    ASSERT_NE(expression, nullptr);
+    double x = 2;
+    double result;
+    EXPECT_EQ(calclib_evaluate(context, expression, &x, &result, nullptr), CALCLIB_OK);
+    EXPECT_EQ(result, 12);
+    calclib_expression_free(expression);
+    calclib_destroy(context);
+}
+
+TEST(CalclibCTest, Variable_limit) {
+    calclib_context *context = calclib_create();
+    std::vector<std::string> names;
+    std::string text = "0";
+    for (int i = 0; i <= CALCLIB_MAX_VARIABLES; ++i) {
+        names.push_back("v" + std::to_string(i));
+        text += "+" + names.back();
+    }
+    std::vector<const char*> variables;
+    for (const auto &name : names) {
+        variables.push_back(name.c_str());
+    }
+    EXPECT_EQ(compile(context, text.c_str(), variables, CALCLIB_INVALID_EXPRESSION), nullptr);
+
+    text.resize(text.rfind('+'));
+    calclib_expression *expression = compile(context, text.c_str(), variables);
+    ASSERT_NE(expression, nullptr);
+    std::vector<double> values(variables.size(), 1);
+    double result;
+    EXPECT_EQ(calclib_evaluate(context, expression, values.data(), &result, nullptr), CALCLIB_OK);
+    EXPECT_EQ(result, CALCLIB_MAX_VARIABLES);
+    calclib_expression_free(expression);
+    EXPECT_STREQ(calclib_status_message(CALCLIB_OUT_OF_RESOURCES), "Out of memory");
+    calclib_destroy(context);
+}
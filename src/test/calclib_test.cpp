@@ -1,5 +1,11 @@
 #include "calclib/calclib.hpp"
+#include "calclib/expression.hpp"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
 
 using namespace ::testing;
 calcLib calc{calcLib::ResultFormat::fixed, 8};
@@ -98,16 +104,454 @@ TEST(CalcLibTest, Power) {
     EXPECT_EQ(calc.solveEquation("1234^0"), "1.00000000");
 }
 
+TEST(CalcLibTest, Lowered_operations) {
+    using Opcode = compiledExpression::Opcode;
+    // Every rewrite but the contraction returns the bits of the operation written with a variable instead
+    struct lowering {
+        const char *lowered;
+        const char *generic;
+        double y;
+        Opcode op;
+    };
+    const lowering cases[] = {
+            {"x^2", "x^y", 2, Opcode::powInt}, {"x^-1", "x^y", -1, Opcode::powInt}, {"x^0", "x^y", 0, Opcode::powInt},
+            {"root(2:x)", "root(y:x)", 2, Opcode::sqrt}, {"root(3:x)", "root(y:x)", 3, Opcode::cbrt},
+            {"x/8", "x/y", 8, Opcode::mul}, {"x/0.25", "x/y", 0.25, Opcode::mul}
+    };
+    const double values[] = {0, -0.0, 1, -1, 8, -8, 0.1, 1.0 / 3, 1e-310, 1e200, -1e200, INFINITY, -INFINITY, NAN};
+    for (const auto &test : cases) {
+        compiledExpression lowered;
+        compiledExpression generic;
+        ASSERT_EQ(calc.compile(test.lowered, lowered), calcLib::Status::ok);
+        ASSERT_EQ(calc.compile(test.generic, generic), calcLib::Status::ok);
+        EXPECT_TRUE(std::any_of(lowered.code.begin(), lowered.code.end(),
+                                [&test](const auto &instruction) { return instruction.op == test.op; })) << test.lowered;
+        for (double x : values) {
+            double slots[2];
+            for (size_t i = 0; i < generic.symbols.size(); ++i) {
+                slots[i] = generic.symbols[i] == "x" ? x : test.y;
+            }
+            double expected;
+            double result;
+            EXPECT_EQ(lowered.run(&x, result, nullptr), generic.run(slots, expected, nullptr)) << test.lowered << " x=" << x;
+            EXPECT_TRUE(std::memcmp(&result, &expected, sizeof(result)) == 0 || (std::isnan(result) && std::isnan(expected)))
+                << test.lowered << " x=" << x << ": " << result << " != " << expected;
+        }
+    }
+    // The first error stays the one of the unlowered order
+    double result;
+    EXPECT_EQ(calc.evaluate("root(3:-8)", result), calcLib::Status::domainError);
+    EXPECT_EQ(calc.evaluate("root(2:-4)", result), calcLib::Status::domainError);
+    EXPECT_EQ(calc.evaluate("log(1:2)+root(3:-8)*2", result), calcLib::Status::divisionByZero);
+
+    // a*b+c rounds once
+    const std::pair<const char *, double> contracted[] = {
+            {"x*y+z", std::fma(0.1, 10, -1)}, {"x*y-z", std::fma(0.1, 10, 1)}, {"z+x*y", std::fma(0.1, 10, -1)},
+            {"z-x*y", std::fma(-0.1, 10, -1)}, {"1/z+x*y", std::fma(0.1, 10, -1)}
+    };
+    for (auto [text, expected] : contracted) {
+        compiledExpression compiled;
+        ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok);
+        EXPECT_EQ(compiled.code.back().op, Opcode::fma) << text;
+        double slots[3];
+        for (size_t i = 0; i < compiled.symbols.size(); ++i) {
+            slots[i] = compiled.symbols[i] == "x" ? 0.1 : compiled.symbols[i] == "y" ? 10 : -1;
+        }
+        ASSERT_EQ(compiled.run(slots, result, nullptr), calcLib::Status::ok);
+        EXPECT_EQ(result, expected) << text;
+    }
+    EXPECT_NE(std::fma(0.1, 10, -1), 0.1 * 10 - 1);
+    // Constants fold with the same rounding, so a literal gives the bits of a variable
+    const std::pair<const char *, double> folded[] = {
+            {"0.1*10-1", std::fma(0.1, 10, -1)}, {"-1+0.1*10", std::fma(0.1, 10, -1)}, {"1-0.1*10", std::fma(-0.1, 10, 1)},
+            {"(0.1*10)-1", std::fma(0.1, 10, -1)}, {"if(1:0.1*10:2)-1", std::fma(0.1, 10, -1)}, {"0.1*10*1-1", 0},
+            {"-(0.1*10)+1", 0}
+    };
+    for (auto [text, expected] : folded) {
+        compiledExpression compiled;
+        ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok);
+        ASSERT_EQ(compiled.code.size(), 1u) << text;
+        ASSERT_EQ(compiled.run(nullptr, result, nullptr), calcLib::Status::ok);
+        EXPECT_EQ(result, expected) << text;
+    }
+    calcLib inlined;
+    ASSERT_EQ(inlined.define("f(a)=a*10-1"), calcLib::Status::ok);
+    ASSERT_EQ(inlined.evaluate("f(0.1)", result), calcLib::Status::ok);
+    EXPECT_EQ(result, std::fma(0.1, 10, -1));
+    // Both sides can fail, so the addend stays first
+    compiledExpression kept;
+    ASSERT_EQ(calc.compile("1/z+x*(1/y)", kept), calcLib::Status::ok);
+    EXPECT_EQ(kept.code.back().op, Opcode::add);
+}
+
+TEST(CalcLibTest, Collected_polynomials) {
+    using Opcode = compiledExpression::Opcode;
+    compiledExpression compiled;
+    ASSERT_EQ(calc.compile("3*x^4+2*x^3-x+7", compiled), calcLib::Status::ok);
+    ASSERT_EQ(compiled.code.size(), 2);
+    EXPECT_EQ(compiled.code[0].op, Opcode::variable);
+    EXPECT_EQ(compiled.code[1].op, Opcode::polynomial);
+    EXPECT_EQ(compiled.constants, (std::vector<double>{4, 7, -1, 0, 2, 3}));
+
+    auto polynomials = [](const compiledExpression &expression) {
+        return std::count_if(expression.code.begin(), expression.code.end(),
+                             [](const auto &instruction) { return instruction.op == Opcode::polynomial; });
+    };
+    // Single terms, factored forms, two variables, negative, fractional and too high powers are evaluated as written
+    for (const char *text : {"x^2", "3*x^5", "(x-1)*(x+1)", "x^2+y", "x^-1+x^2", "x^2.5+x", "x^40+x", "x+1", "x^2-x^2+x"}) {
+        ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok) << text;
+        EXPECT_EQ(polynomials(compiled), 0) << text;
+    }
+    // The largest polynomial subtrees are collected, x^2 is not collected again inside 2*(x^2+x)/4
+    ASSERT_EQ(calc.compile("2*(x^2+x)/4+sin(-(x*x)+1)+y", compiled), calcLib::Status::ok);
+    EXPECT_EQ(polynomials(compiled), 2);
+
+    const char *text = "0.5*x^6-3*x^4+x^3/8-x*x+2*x-9";
+    ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok);
+    ASSERT_EQ(polynomials(compiled), 1);
+    std::vector<double> x;
+    for (double value = -4; value <= 4; value += 0.01) {
+        x.push_back(value);
+    }
+    x.insert(x.end(), {INFINITY, -INFINITY, NAN, 1e300, -0.0});
+    std::vector<double> results(x.size());
+    std::vector<calcLib::Status> statuses(x.size());
+    const double *columns[] = {x.data()};
+    compiled.runColumns(columns, x.size(), results.data(), statuses.data(), nullptr);
+    for (size_t i = 0; i < x.size(); ++i) {
+        double result;
+        ASSERT_EQ(compiled.run(&x[i], result, nullptr), calcLib::Status::ok);
+        EXPECT_TRUE(std::memcmp(&result, &results[i], sizeof(result)) == 0 || (std::isnan(result) && std::isnan(results[i])))
+            << text << " x=" << x[i];
+        long double v = x[i];
+        long double exact = 0.5L * v * v * v * v * v * v - 3 * v * v * v * v + v * v * v / 8 - v * v + 2 * v - 9;
+        if (std::abs(x[i]) <= 4){
+            EXPECT_NEAR(result, static_cast<double>(exact), 1e-13 * std::max(1.0L, std::abs(exact))) << "x=" << x[i];
+        }
+    }
+}
+
+TEST(CalcLibTest, Comparisons_and_conditionals) {
+    EXPECT_EQ(calc_default.solveEquation("1+1<3"), "1");
+    EXPECT_EQ(calc_default.solveEquation("3>2>1"), "0");
+    EXPECT_EQ(calc_default.solveEquation("2<=2"), "1");
+    EXPECT_EQ(calc_default.solveEquation("2>=3"), "0");
+    EXPECT_EQ(calc_default.solveEquation("2*3=6"), "1");
+    EXPECT_EQ(calc_default.solveEquation("2*3==6"), "1");
+    EXPECT_EQ(calc_default.solveEquation("2!=3"), "1");
+    EXPECT_EQ(calc_default.solveEquation("2<>2"), "0");
+    EXPECT_EQ(calc_default.solveEquation("if(2>1:10:20)"), "10");
+    EXPECT_EQ(calc_default.solveEquation("min(3:-2)+max(3:-2)"), "1");
+    EXPECT_EQ(calc_default.solveEquation("abs(-2.5)"), "2.5");
+    EXPECT_EQ(calc_default.solveEquation("clamp(7:0:5)+clamp(-1:0:5)"), "5");
+    EXPECT_EQ(calc_default.solveEquation("if(1:2)"), "Err");
+    EXPECT_EQ(calc_default.solveEquation("1<"), "Err");
+    EXPECT_EQ(calc_default.solveEquation("1<<2"), "Err");
+
+    // Only the branch taken is evaluated, NaN is true
+    calcSession session;
+    double result;
+    for (double x : {4.0, -4.0, 0.0}) {
+        session.setVariable("x", x);
+        ASSERT_EQ(calc_default.evaluate("if(x>0:log(x):1/0)", session, result), x > 0 ? calcLib::Status::ok : calcLib::Status::divisionByZero);
+        ASSERT_EQ(calc_default.evaluate("if(x>0:log(x):-x)", session, result), calcLib::Status::ok);
+        EXPECT_EQ(result, x > 0 ? std::log10(x) : -x);
+    }
+    calcLib calc_ieee;
+    calc_ieee.ieeeMode = true;
+    EXPECT_EQ(calc_ieee.solveEquation("if(0/0:1:2)"), "1");
+    calc_ieee.clearFlags();
+    EXPECT_EQ(calc_ieee.solveEquation("if(0:root(-1):3)+if(1:4:1/0)"), "7");
+    EXPECT_EQ(calc_ieee.flags(), 0u);
+
+    // NaN compares false but for !=, min and max propagate NaN and return rhs for equal operands
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    compiledExpression compiled;
+    ASSERT_EQ(calc_default.compile("(x<y)+2*(x=y)+4*(x!=y)", compiled), calcLib::Status::ok);
+    double slots[] = {nan, 1};
+    ASSERT_EQ(compiled.run(slots, result, nullptr), calcLib::Status::ok);
+    EXPECT_EQ(result, 4);
+    ASSERT_EQ(calc_default.compile("min(x:y)", compiled), calcLib::Status::ok);
+    ASSERT_EQ(compiled.run(slots, result, nullptr), calcLib::Status::ok);
+    EXPECT_TRUE(std::isnan(result));
+    std::swap(slots[0], slots[1]);
+    ASSERT_EQ(compiled.run(slots, result, nullptr), calcLib::Status::ok);
+    EXPECT_TRUE(std::isnan(result));
+    slots[0] = 0.0;
+    slots[1] = -0.0;
+    ASSERT_EQ(compiled.run(slots, result, nullptr), calcLib::Status::ok);
+    EXPECT_TRUE(std::signbit(result));
+
+    // Batches evaluate both branches and blend, errors of rows that do not take a branch are masked
+    const char *texts[] = {"if(x>0:log(x):-x)", "if(x<0:if(x<-1:1/(x+2):x):sqrt(x))+abs(x)", "clamp(x*x:1:if(x:4:1/x))",
+                           "2*if(x>=1:x^2+x:0)-if(x=0:1/x:x)", "if(x<0:if(x<-1:1/(x+2):x):sqrt(x))*if(x>2:root(-1):x)"};
+    std::vector<double> x;
+    for (double value = -3; value <= 3; value += 0.25) {
+        x.push_back(value);
+    }
+    x.insert(x.end(), {INFINITY, -INFINITY, nan, -0.0});
+    for (const char *text : texts) {
+        ASSERT_EQ(calc_default.compile(text, compiled), calcLib::Status::ok) << text;
+        std::vector<double> results(x.size());
+        std::vector<calcLib::Status> statuses(x.size());
+        const double *columns[] = {x.data()};
+        for (bool ieee : {false, true}) {
+            unsigned flags = 0;
+            unsigned expectedFlags = 0;
+            compiled.runColumns(columns, x.size(), results.data(), statuses.data(), ieee ? &flags : nullptr);
+            for (size_t i = 0; i < x.size(); ++i) {
+                calcLib::Status status = compiled.run(&x[i], result, ieee ? &expectedFlags : nullptr);
+                EXPECT_EQ(statuses[i], status) << text << " x=" << x[i];
+                EXPECT_TRUE(status != calcLib::Status::ok || std::memcmp(&result, &results[i], sizeof(result)) == 0
+                            || (std::isnan(result) && std::isnan(results[i])))
+                    << text << " x=" << x[i] << ": " << results[i] << " != " << result;
+            }
+            EXPECT_EQ(flags, expectedFlags) << text;
+        }
+    }
+}
+
+TEST(CalcLibTest, Sums_and_products) {
+    using Opcode = compiledExpression::Opcode;
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:100:i)"), "5050");
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:100:i^2)"), "338350");
+    EXPECT_EQ(calc_default.solveEquation("sum(k:0:10:2^k)"), "2047");
+    EXPECT_EQ(calc_default.solveEquation("prod(i:1:10:i)"), "3628800");
+    EXPECT_EQ(calc_default.solveEquation("prod(i:1:5:2)"), "32");
+    EXPECT_EQ(calc_default.solveEquation("sum(i:5:4:i)+prod(i:5:4:i)"), "1");
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:3:sum(j:1:i:i*j))"), "25");
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:2:sum(i:1:3:i))"), "12");
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:4:i/2)"), "5");
+    double result;
+    EXPECT_EQ(calc_default.evaluate("sum(i:1.5:3:i)", result), calcLib::Status::domainError);
+    EXPECT_EQ(calc_default.evaluate("sum(i:1:2^40:i)", result), calcLib::Status::domainError);
+    EXPECT_EQ(calc_default.evaluate("sum(i:0:3:1/i)", result), calcLib::Status::divisionByZero);
+    EXPECT_EQ(calc_default.solveEquation("sum(i:1:3)"), "Err");
+    EXPECT_EQ(calc_default.solveEquation("sum(1:1:3:1)"), "Err");
+
+    auto count = [](const compiledExpression &expression, Opcode op) {
+        return std::count_if(expression.code.begin(), expression.code.end(),
+                             [op](const auto &instruction) { return instruction.op == op; });
+    };
+    // Power sums and geometric series are evaluated in closed form, adding 0*sin(i) keeps the loop
+    std::pair<const char *, const char *> series[] = {
+            {"sum(i:x:n:i^3-2*i+1)", "sum(i:x:n:i^3-2*i+1+0*sin(i))"},
+            {"sum(i:x:n:3*0.5^i)", "sum(i:x:n:3*0.5^i+0*sin(i))"},
+            {"sum(i:x:n:1.25^i)", "sum(i:x:n:1.25^i+0*sin(i))"},
+            {"prod(i:x:n:1.5)", "prod(i:x:n:1.5+0*sin(i))"}
+    };
+    for (auto &[closed, loop] : series) {
+        compiledExpression closedForm;
+        compiledExpression terms;
+        ASSERT_EQ(calc_default.compile(closed, closedForm), calcLib::Status::ok) << closed;
+        ASSERT_EQ(calc_default.compile(loop, terms), calcLib::Status::ok) << loop;
+        EXPECT_EQ(count(closedForm, Opcode::series), 1) << closed;
+        EXPECT_EQ(count(closedForm, Opcode::endLoop), 0) << closed;
+        EXPECT_EQ(count(terms, Opcode::endLoop), 1) << loop;
+        for (double x : {-5.0, 0.0, 1.0, 7.0}) {
+            for (double n : {-6.0, 0.0, 3.0, 40.0}) {
+                double slots[] = {x, n};
+                double expected;
+                double result;
+                ASSERT_EQ(terms.run(slots, expected, nullptr), calcLib::Status::ok) << loop;
+                ASSERT_EQ(closedForm.run(slots, result, nullptr), calcLib::Status::ok) << closed;
+                EXPECT_NEAR(result, expected, 1e-13 * std::max(1.0, std::abs(expected))) << closed << " x=" << x << " n=" << n;
+            }
+        }
+        double slots[] = {0.5, 3};
+        double result;
+        EXPECT_EQ(closedForm.run(slots, result, nullptr), calcLib::Status::domainError) << closed;
+        EXPECT_EQ(terms.run(slots, result, nullptr), calcLib::Status::domainError) << loop;
+    }
+
+    // Bodies whose summed coefficients overflow keep the loop and add up to inf like it
+    for (const char *text : {"sum(i:1:3:(180)!*i)", "sum(i:1:3:1e308*i*10)", "sum(i:1:2:1e300*1e300*i^2)",
+                             "sum(i:1:n:1e300*1e300*i)"}) {
+        compiledExpression overflowed;
+        ASSERT_EQ(calc_default.compile(text, overflowed), calcLib::Status::ok) << text;
+        EXPECT_EQ(count(overflowed, Opcode::series), 0) << text;
+        double n = 3;
+        unsigned flags = 0;
+        ASSERT_EQ(overflowed.run(&n, result, &flags), calcLib::Status::ok) << text;
+        EXPECT_EQ(result, std::numeric_limits<double>::infinity()) << text;
+    }
+
+    // The first error in index order is reported, ieee mode adds up the IEEE results
+    compiledExpression compiled;
+    ASSERT_EQ(calc_default.compile("sum(i:1:n:1/(i-3)+sqrt(4-i))", compiled), calcLib::Status::ok);
+    double n = 2;
+    ASSERT_EQ(compiled.run(&n, result, nullptr), calcLib::Status::ok);
+    EXPECT_EQ(result, -1.5 + std::sqrt(3) + std::sqrt(2));
+    n = 5;
+    EXPECT_EQ(compiled.run(&n, result, nullptr), calcLib::Status::divisionByZero);
+    unsigned flags = 0;
+    EXPECT_EQ(compiled.run(&n, result, &flags), calcLib::Status::ok);
+    EXPECT_TRUE(std::isnan(result));
+    EXPECT_EQ(flags, calcLib::flagDivisionByZero | calcLib::flagInvalid);
+
+    // Batches run the body once per row and match run, inactive branches do not report
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const char *texts[] = {"sum(i:1:n:sin(i*x))", "sum(i:-n:n:if(i:x/i:0))+prod(j:1:3:x+j)", "sum(i:1:n:1/(i-x))",
+                           "sum(i:x:n:i^2)", "sum(i:1:n:sum(j:i:n:x^j/j))", "if(n>3:prod(k:1:n:x-k):n)"};
+    std::vector<double> xs;
+    std::vector<double> ns;
+    for (double x : {0.5, 3.0, -2.0, 4.0}) {
+        for (double value : {-1.0, 0.0, 1.0, 5.0, 20.0, 2.5, nan}) {
+            xs.push_back(x);
+            ns.push_back(value);
+        }
+    }
+    for (const char *text : texts) {
+        ASSERT_EQ(calc_default.compile(text, compiled), calcLib::Status::ok) << text;
+        ASSERT_EQ(compiled.symbols.size(), 2) << text;
+        const double *columns[] = {compiled.symbols[0] == "x" ? xs.data() : ns.data(),
+                                   compiled.symbols[0] == "x" ? ns.data() : xs.data()};
+        std::vector<double> results(xs.size());
+        std::vector<calcLib::Status> statuses(xs.size());
+        for (bool ieee : {false, true}) {
+            unsigned columnFlags = 0;
+            unsigned expectedFlags = 0;
+            compiled.runColumns(columns, xs.size(), results.data(), statuses.data(), ieee ? &columnFlags : nullptr);
+            for (size_t i = 0; i < xs.size(); ++i) {
+                double slots[] = {columns[0][i], columns[1][i]};
+                calcLib::Status status = compiled.run(slots, result, ieee ? &expectedFlags : nullptr);
+                EXPECT_EQ(statuses[i], status) << text << " x=" << xs[i] << " n=" << ns[i];
+                EXPECT_TRUE(status != calcLib::Status::ok || std::memcmp(&result, &results[i], sizeof(result)) == 0
+                            || (std::isnan(result) && std::isnan(results[i])))
+                    << text << " x=" << xs[i] << " n=" << ns[i] << ": " << results[i] << " != " << result;
+            }
+            EXPECT_EQ(columnFlags, expectedFlags) << text;
+        }
+    }
+
+    // Long sums are split into chunks whose order is fixed, so the result is the same on every run
+    ASSERT_EQ(calc_default.compile("sum(i:1:n:1/i^2)", compiled), calcLib::Status::ok);
+    n = 1e6;
+    double first;
+    ASSERT_EQ(compiled.run(&n, first, nullptr), calcLib::Status::ok);
+    EXPECT_NEAR(first, M_PI * M_PI / 6 - 1 / n, 1e-11);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(compiled.run(&n, result, nullptr), calcLib::Status::ok);
+        EXPECT_EQ(std::memcmp(&result, &first, sizeof(result)), 0);
+    }
+    // Threads of a batch evaluate the same chunks serially
+    bool kept = expressionView::keepLoopsOnThread(true);
+    ASSERT_EQ(compiled.run(&n, result, nullptr), calcLib::Status::ok);
+    EXPECT_TRUE(expressionView::keepLoopsOnThread(kept));
+    EXPECT_EQ(std::memcmp(&result, &first, sizeof(result)), 0);
+    // Loops that find the loop threads busy run alone, again with the same chunks
+    std::vector<double> concurrent(4);
+    std::vector<std::thread> callers;
+    for (double &value : concurrent) {
+        callers.emplace_back([&compiled, &n, &value] { compiled.run(&n, value, nullptr); });
+    }
+    for (auto &caller : callers) {
+        caller.join();
+    }
+    for (double value : concurrent) {
+        EXPECT_EQ(std::memcmp(&value, &first, sizeof(value)), 0);
+    }
+}
+
+TEST(CalcLibTest, User_functions) {
+    calcLib functions;
+    ASSERT_EQ(functions.define("f(x:y)=x^2+y*sin(x)"), calcLib::Status::ok);
+    ASSERT_EQ(functions.define("hyp(a:b) = sqrt(a^2+b^2)"), calcLib::Status::ok);
+    ASSERT_EQ(functions.define("twice(x)=f(x:1)*2"), calcLib::Status::ok);
+    ASSERT_EQ(functions.define("scaled(x)=x*k"), calcLib::Status::ok);
+    ASSERT_EQ(functions.define("safe(x)=if(x>0:log(x):0)"), calcLib::Status::ok);
+    EXPECT_EQ(functions.solveEquation("hyp(3:4)+1"), "6");
+    EXPECT_EQ(functions.solveEquation("twice(hyp(0:0))"), "0");
+    EXPECT_EQ(functions.solveEquation("sum(i:1:4:hyp(i:0))"), "10");
+    EXPECT_EQ(functions.solveEquation("safe(-1)"), "0");
+    EXPECT_EQ(functions.solveEquation("hyp(3:4:5)"), "Err");
+    EXPECT_EQ(functions.solveEquation("hyp(3)"), "Err");
+    EXPECT_EQ(calc_default.solveEquation("hyp(3:4)"), "Err");
+
+    // Constant arguments fold the whole body
+    compiledExpression compiled;
+    compiledExpression constant;
+    ASSERT_EQ(functions.compile("f(2:3)", compiled), calcLib::Status::ok);
+    ASSERT_EQ(functions.compile("2^2+3*sin(2)", constant), calcLib::Status::ok);
+    ASSERT_EQ(compiled.code.size(), 1);
+    EXPECT_EQ(compiled.constants, constant.constants);
+
+    // Variable arguments are inlined, names that are not parameters are variables of the caller
+    ASSERT_EQ(functions.compile("twice(x+1)+scaled(y)", compiled), calcLib::Status::ok);
+    ASSERT_EQ(functions.compile("((x+1)^2+1*sin(x+1))*2+y*k", constant), calcLib::Status::ok);
+    EXPECT_EQ(compiled.symbols, constant.symbols);
+    EXPECT_EQ(compiled.code.size(), constant.code.size());
+    std::vector<double> slots;
+    for (const auto &symbol : compiled.symbols) {
+        slots.push_back(symbol == "x" ? 0.75 : symbol == "y" ? -2 : 3);
+    }
+    double result;
+    double expected;
+    ASSERT_EQ(compiled.run(slots.data(), result, nullptr), calcLib::Status::ok);
+    ASSERT_EQ(constant.run(slots.data(), expected, nullptr), calcLib::Status::ok);
+    EXPECT_EQ(result, expected);
+
+    // A parameter hides the index of a loop around the call, loops in the body have their own indices
+    ASSERT_EQ(functions.define("total(i)=sum(j:1:3:i*j)"), calcLib::Status::ok);
+    EXPECT_EQ(functions.solveEquation("sum(j:1:2:total(j))"), "18");
+    ASSERT_EQ(functions.define("free(n)=n+i"), calcLib::Status::ok);
+    ASSERT_EQ(functions.compile("sum(i:1:2:free(i))", compiled), calcLib::Status::ok);
+    EXPECT_EQ(compiled.symbols, std::vector<std::string>{"i"});
+
+    // Redefining affects only later compilations
+    ASSERT_EQ(functions.compile("scaled(2)", compiled), calcLib::Status::ok);
+    ASSERT_EQ(functions.define("scaled(x)=x*10"), calcLib::Status::ok);
+    EXPECT_EQ(functions.solveEquation("scaled(2)"), "20");
+    EXPECT_EQ(compiled.symbols, std::vector<std::string>{"k"});
+
+    // Recursion, builtin names and malformed definitions are rejected
+    EXPECT_EQ(functions.define("g(x)=g(x-1)"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("f(x:y)=twice(x)"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.solveEquation("f(1:0)"), "1");
+    EXPECT_EQ(functions.define("sin(x)=x"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("sum(x)=x"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g(x:x)=x"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g(x)"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g(x)="), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g()=1"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g(x)=x+"), calcLib::Status::invalidExpression);
+    EXPECT_EQ(functions.define("g(x)=x)"), calcLib::Status::syntaxError);
+
+}
+
 TEST(CalcLibTest, Factorial) { 
     EXPECT_EQ(calc.solveEquation("9!"), "362880.00000000");
     EXPECT_EQ(calc.solveEquation("10!"), "3628800.00000000");
     EXPECT_EQ(calc.solveEquation("0!"), "1.00000000");
 }
 
+TEST(CalcLibTest, Exact_integers) {
+    calcLib exact;
+    double result;
+    ASSERT_EQ(exact.evaluate("(3^33)%1000", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 523);
+    ASSERT_EQ(exact.evaluate("123456789012%1000", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 12);
+    ASSERT_EQ(exact.evaluate("20!%1000000007", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 146326063);
+    ASSERT_EQ(exact.evaluate("2^62", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 4611686018427387904.0);
+    ASSERT_EQ(exact.evaluate("-9%3", result), calcLib::Status::ok);
+    EXPECT_TRUE(result == 0 && std::signbit(result));
+    // Overflow falls back to double
+    ASSERT_EQ(exact.evaluate("3^50", result), calcLib::Status::ok);
+    EXPECT_EQ(result, std::pow(3.0, 50));
+    ASSERT_EQ(exact.evaluate("25!", result), calcLib::Status::ok);
+    EXPECT_NEAR(result, 15511210043330985984000000.0, 1e10);
+}
+
 TEST(CalcLibTest, Square_root) {
     EXPECT_EQ(calc.solveEquation("root(9)"), "3.00000000");
     EXPECT_EQ(calc.solveEquation("root(21)"), "4.58257569");
-    EXPECT_EQ(calc.solveEquation("root(-21)"), "root: Undefined for argument domain");
+    EXPECT_EQ(calc.solveEquation("root(-21)"), "Undefined for argument domain");
+    // Every function reports its domain errors with the same message
+    EXPECT_EQ(calc.solveEquation("sqrt(-4)"), "Undefined for argument domain");
+    EXPECT_EQ(calc.solveEquation("sum(i:1:2.5:i)"), "Undefined for argument domain");
 }
 
 TEST(CalcLibTest, Mixed) {
@@ -150,3 +594,72 @@ TEST(CalcLibTest, Long_format_result) {
     EXPECT_EQ(calc_long_format.solveEquation("cos(13)"), "0.974370064785235");
     EXPECT_EQ(calc_long_format.solveEquation("1.4567890987654*3.34567890987654"), "4.873948563877450");
 }
+
+TEST(CalcLibTest, Status_codes) {
+    calcLib calc_status;
+    double result;
+    EXPECT_EQ(calc_status.evaluate("2*3", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 6);
+    EXPECT_EQ(calc_status.evaluate("1/0", result), calcLib::Status::divisionByZero);
+    EXPECT_EQ(calc_status.evaluate("root(-4)", result), calcLib::Status::domainError);
+    EXPECT_EQ(calc_status.evaluate("(1+2", result), calcLib::Status::syntaxError);
+    EXPECT_EQ(calc_status.evaluate("3+", result), calcLib::Status::invalidExpression);
+    EXPECT_EQ(calc_status.evaluate("*3", result), calcLib::Status::invalidExpression);
+    EXPECT_EQ(calc_status.evaluate("sin!", result), calcLib::Status::invalidExpression);
+    EXPECT_EQ(calc_status.evaluate("sin(3:+)", result), calcLib::Status::invalidExpression);
+    EXPECT_EQ(calc_status.evaluate("ans", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 6);
+}
+
+TEST(CalcLibTest, Ieee_mode) {
+    calcLib calc_ieee;
+    calc_ieee.ieeeMode = true;
+    EXPECT_EQ(calc_ieee.flags(), 0u);
+    EXPECT_EQ(calc_ieee.solveEquation("1/0"), "inf");
+    EXPECT_EQ(calc_ieee.solveEquation("-1/0"), "-inf");
+    EXPECT_EQ(calc_ieee.flags(), calcLib::flagDivisionByZero);
+    EXPECT_EQ(calc_ieee.solveEquation("tan(-90)"), "-inf");
+    EXPECT_EQ(calc_ieee.solveEquation("2+3"), "5");
+    EXPECT_EQ(calc_ieee.flags(), calcLib::flagDivisionByZero);
+    EXPECT_EQ(calc_ieee.solveEquation("root(-4)"), "nan");
+    EXPECT_EQ(calc_ieee.flags(), calcLib::flagDivisionByZero | calcLib::flagInvalid);
+    calc_ieee.clearFlags();
+    EXPECT_EQ(calc_ieee.flags(), 0u);
+    EXPECT_EQ(calc_ieee.solveEquation("3+"), "Err");
+}
+
+TEST(CalcLibTest, Sessions) {
+    const calcLib calc_shared;
+    calcSession first;
+    calcSession second;
+    EXPECT_EQ(calc_shared.solveEquation("2*3", first), "6");
+    EXPECT_EQ(calc_shared.solveEquation("ans", second), "0");
+    EXPECT_EQ(calc_shared.solveEquation("ans+1", first), "7");
+    second.setVariable("x", 4);
+    EXPECT_EQ(calc_shared.solveEquation("x*pi", second), "12.56637061");
+    EXPECT_EQ(calc_shared.solveEquation("x", first), "Err");
+    second.setVariable("pi", 3);
+    EXPECT_EQ(calc_shared.solveEquation("pi", second), "3");
+}
+
+TEST(CalcLibTest, Concurrent_sessions) {
+    const calcLib calc_shared;
+    std::vector<std::string> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i) {
+        threads.emplace_back([&, i](){
+            calcSession session;
+            session.setVariable("x", i);
+            for (int j = 0; j < 200; ++j) {
+                calc_shared.solveEquation("ans+x", session);
+            }
+            results[i] = calc_shared.solveEquation("ans", session);
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i], std::to_string(i * 200));
+    }
+}
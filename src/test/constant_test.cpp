@@ -0,0 +1,111 @@
+#include "calclib/constant.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace ::testing;
+
+static_assert(calclib::evaluate("1+2*3") == 7, "precedence");
+static_assert(calclib::evaluate("2^3^2") == 512, "power is right associative");
+static_assert(calclib::evaluate("2^3%2") == 2, "modulo binds tighter than power");
+static_assert(calclib::evaluate("2(3+4)") == 14, "implicit multiplication");
+static_assert(calclib::evaluate("5!-3!") == 114, "factorial");
+static_assert(calclib::evaluate("-2^2") == 4, "sign binds tighter than power");
+static_assert(calclib::evaluate("sqrt(16)+log(1000)+root(2:9)") == 10, "functions");
+static_assert(calclib::evaluate("1.5e3/ 3 # comment") == 500, "numbers and comments");
+static_assert(calclib::evaluate("(3^33)%1000") == 523, "exact integer modulo");
+static_assert(calclib::evaluate("1e300") == 1e300, "literals are correctly rounded");
+static_assert(calclib::evaluate("1.7976931348623157e308") == 1.7976931348623157e308, "largest double");
+static_assert(calclib::evaluate("2.2250738585072014e-308") == 2.2250738585072014e-308, "smallest normal double");
+static_assert(calclib::evaluate("4.9e-324") == 4.9e-324, "subnormal literal");
+static_assert(calclib::evaluate("if(1+1<3:clamp(7:0:5):1/0)+min(2:-1)") == 4, "conditionals skip the branch not taken");
+static_assert(calclib::evaluate("0.1*10-1") == 0x1p-54, "a sum of a product is rounded once");
+
+namespace {
+    constexpr double earthCircumference = calclib::evaluate("2*pi*6371");
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    static_assert(calclib::constant<"2*pi*6371"> == earthCircumference, "constant template");
+#endif
+}
+
+TEST(ConstantTest, Matches_runtime) {
+    calcLib calc;
+    calc.ieeeMode = false;
+    const char *expressions[] = {
+            "2*pi*6371", "1/3", "0.1+0.2", "123456789.123456789", "1e-300*1e-10", "sin(30)", "cos(60)", "tan(45)",
+            "sin(1e5)", "cos(-123.456)", "tan(-89.9)", "sqrt(2)", "root(3:27)", "root(7:1234.5)", "log(2)",
+            "log(2:1024)", "log(0.5:3)", "2^0.5", "e^pi", "10^-3", "1.0001^10000", "7%3", "-7.5%2", "20!/18!",
+            "50!", "(33%15)!", "2.5!", "(-0.5)!", "30.5!", "2pi", "(1+2)(3+4)", "(2)3", "--+-3", "e", "0,25*4", "1/*two*/2", "3 // comment",
+            "3>2>1", "2<=2", "2*3==6", "2!=3", "1<>1", "if(0:1/0:abs(-2))", "max(1:2)-clamp(5:1:3)",
+            "sum(i:1:10:1/i)", "prod(k:1:5:k+0.5)", "sum(i:1:3:sum(j:i:4:i*j))", "sum(i:2:1:1/0)", "sum(e:1:3:e)+e",
+            "sin(1e300)", "cos(1e300)", "tan(1e22)", "sin(123456789012345678)",
+            "0.1*10-1", "1-0.1*10", "(0.1*3)-0.3", "0.3+-0.1*3", "0.1*10*1-1", "-0.1*10+1", "if(1:0.1*10:2)-1"
+    };
+    for (const char *expression : expressions) {
+        double expected = 0;
+        double result = 0;
+        ASSERT_EQ(calclib::evaluate(expression, result), calc.evaluate(expression, expected)) << expression;
+        EXPECT_NEAR(result, expected, std::abs(expected) * 1e-13) << expression;
+    }
+}
+
+TEST(ConstantTest, Reports_same_errors) {
+    calcLib calc;
+    const char *expressions[] = {
+            "1/0", "5%0", "tan(90)", "root(2:-4)", "sqrt(-1)", "log(1:5)", "(1+2", "1+", "1.2.3", "1e", "sin(1:2)",
+            "foo(1)", "x+1", "2$", "1/0+)", "[1+2)", "root(0:4)",
+            "if(1:1/0:2)", "if(1/0:1:2)", "1<<2", "1:=2", "if(1:2)",
+            "sum(i:0:2:1/i)", "prod(i:1:2.5:i)", "sum(i:1:3)", "sum(i:1:3:j)"
+    };
+    for (const char *expression : expressions) {
+        double expected = 0;
+        double result = 0;
+        calcLib::Status status = calc.evaluate(expression, expected);
+        EXPECT_NE(status, calcLib::Status::ok) << expression;
+        EXPECT_EQ(calclib::evaluate(expression, result), status) << expression;
+    }
+    EXPECT_TRUE(std::isnan(calclib::evaluate("1/0")));
+}
+
+TEST(ConstantTest, Literals_match_strtod) {
+    std::vector<std::string> literals = {
+            "1e300", "1e200", "1e23", "9007199254740993", "1.7976931348623157e308", "1.7976931348623158e308",
+            "1.8e308", "2.2250738585072014e-308", "2.2250738585072011e-308", "4.9e-324", "2.4703282292062328e-324",
+            "2.4703282292062327e-324", "1e-400", "0.000000000000000000000000000001", "123456789012345678901234567890",
+            "7.038531e-26", "0.1", "000123.4500e+2", std::string(900, '1') + "e-600", "1." + std::string(800, '0') + "1"
+    };
+    std::mt19937_64 random(37);
+    for (int i = 0; i < 20000; ++i) {
+        std::string literal = std::to_string(random() % 9 + 1) + ".";
+        for (int digit = 0; digit < 16; ++digit) {
+            literal += static_cast<char>('0' + random() % 10);
+        }
+        literals.push_back(literal + "e" + std::to_string(static_cast<int>(random() % 640) - 325));
+    }
+    for (const auto &literal : literals) {
+        double expected = std::strtod(literal.c_str(), nullptr);
+        double result = calclib::evaluate(literal);
+        EXPECT_EQ(result, expected) << literal;
+    }
+}
+
+TEST(ConstantTest, Fma_matches_std) {
+    std::mt19937_64 random(41);
+    auto draw = [&random]() {
+        double mantissa = static_cast<double>(random() >> 11) * 0x1p-53 + 0.5;
+        double value = std::ldexp(mantissa, static_cast<int>(random() % 200) - 100);
+        return random() % 2 == 0 ? value : -value;
+    };
+    for (int i = 0; i < 100000; ++i) {
+        double a = draw();
+        double b = draw();
+        // Mostly addends close to -a*b, where the single rounding matters
+        double c = i % 4 == 0 ? draw() : -(a * b) * (1 + static_cast<double>(random() % 5) * 0x1p-52);
+        EXPECT_EQ(calclib::detail::fma(a, b, c), std::fma(a, b, c)) << a << " * " << b << " + " << c;
+    }
+    EXPECT_EQ(calclib::detail::fma(1e300, 1e-10, -1e290), std::fma(1e300, 1e-10, -1e290));
+    EXPECT_EQ(calclib::detail::fma(1e300, 1e10, 1), INFINITY);
+    EXPECT_EQ(calclib::detail::fma(0, 5, -0.0), std::fma(0, 5, -0.0));
+}
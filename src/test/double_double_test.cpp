@@ -0,0 +1,129 @@
+#include "calclib/double_double.hpp"
+#include "gtest/gtest.h"
+#include <vector>
+
+using namespace ::testing;
+
+namespace {
+
+calcLib::Status evaluateDoubleDouble(const char *text, doubleDouble &outResult) {
+    calcLib calc;
+    basicExpression<doubleDouble> expression;
+    calcLib::Status status = calc.compile(text, expression);
+    if (status != calcLib::Status::ok){
+        return status;
+    }
+    calcSession session;
+    return calc.evaluate(expression, session, outResult);
+}
+
+/**
+ * @return |a - b| as double
+ */
+double distance(const doubleDouble &a, const doubleDouble &b) {
+    doubleDouble difference = a - b;
+    return std::abs(difference.hi);
+}
+
+}
+
+TEST(DoubleDoubleTest, Error_free_arithmetic) {
+    // Every error of twoSum and twoProd is kept, so the double rounding errors cancel
+    doubleDouble result;
+    ASSERT_EQ(evaluateDoubleDouble("0.1+0.2-0.3", result), calcLib::Status::ok);
+    EXPECT_LT(std::abs(result.hi), 1e-32);
+    ASSERT_EQ(evaluateDoubleDouble("2^100+1-2^100", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 1);
+    ASSERT_EQ(evaluateDoubleDouble("(1/3)*3-1", result), calcLib::Status::ok);
+    EXPECT_LT(std::abs(result.hi), 1e-32);
+
+    doubleDouble sum = 0;
+    doubleDouble tenth = scalarTraits<doubleDouble>::parse("0.1");
+    for (int i = 0; i < 1000000; ++i) {
+        sum += tenth;
+    }
+    EXPECT_LT(distance(sum, 100000), 1e-20);
+}
+
+TEST(DoubleDoubleTest, Exact_remainder_of_large_integers) {
+    doubleDouble result;
+    ASSERT_EQ(evaluateDoubleDouble("(10^20+7)%97", result), calcLib::Status::ok);
+    EXPECT_EQ(result, 80);
+    ASSERT_EQ(evaluateDoubleDouble("(3*2^70+1)%(10^15+37)", result), calcLib::Status::ok);
+    EXPECT_EQ(result, doubleDouble(INT64_C(862152102864635)));
+    ASSERT_EQ(evaluateDoubleDouble("-7.5%2", result), calcLib::Status::ok);
+    EXPECT_EQ(result, -1.5);
+}
+
+TEST(DoubleDoubleTest, Builtins_to_32_digits) {
+    std::pair<const char *, const char *> cases[] = {
+            {"sin(30)", "0.5"},
+            {"cos(60)+tan(45)", "1.5"},
+            {"sqrt(2)^2", "2"},
+            {"log(1000)", "3"},
+            {"log(e:10)", "2.302585092994045684017991454684364"},
+            {"e^1", "2.718281828459045235360287471352662"},
+            {"0.5!", "0.8862269254527580136490837416705726"},
+            {"(-0.5)!", "1.772453850905516027298167483341145"},
+            {"25!", "15511210043330985984000000"},
+            {"root(3:2)^3", "2"},
+    };
+    for (auto &[text, expected] : cases) {
+        doubleDouble result;
+        ASSERT_EQ(evaluateDoubleDouble(text, result), calcLib::Status::ok) << text;
+        doubleDouble value = scalarTraits<doubleDouble>::parse(expected);
+        EXPECT_LT(distance(result, value), std::abs(value.hi) * 1e-30) << text;
+    }
+}
+
+TEST(DoubleDoubleTest, Formats_all_digits) {
+    calcLib calc(calcLib::ResultFormat::variable, 30);
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::pi()), "3.14159265358979323846264338328");
+    EXPECT_EQ(calc.formatResult(doubleDouble(1) / 3), "0.333333333333333333333333333333");
+    EXPECT_EQ(calc.formatResult(doubleDouble(-12)), "-12");
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::pow(2, 100) + 1), "1267650600228229401496703205377");
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::parse("0.0000000000000000000000000000006")),
+              "0.000000000000000000000000000001");
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::parse("99.99999999999999999999999999999")),
+              "99.99999999999999999999999999999");
+    calc.precision = 20;
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::parse("99.99999999999999999999999999999")), "100");
+    EXPECT_EQ(calc.formatResult(scalarTraits<doubleDouble>::parse("1e40")), "10000000000000000000000000000000000000000");
+}
+
+TEST(DoubleDoubleTest, Reports_same_errors) {
+    const char *expressions[] = {"1/0", "5%0", "tan(90)", "root(2:-4)", "log(1:5)", "(1+2", "1+", "y+1"};
+    for (const char *text : expressions) {
+        calcLib calc;
+        double expected;
+        calcLib::Status status = calc.evaluate(text, expected);
+        doubleDouble result;
+        EXPECT_EQ(evaluateDoubleDouble(text, result), status) << text;
+    }
+}
+
+TEST(DoubleDoubleTest, Run_columns_match_run) {
+    calcLib calc;
+    basicExpression<doubleDouble> expression;
+    ASSERT_EQ(calc.compile("a*b-1/(a-3)+a%b", expression), calcLib::Status::ok);
+    const size_t rows = 500;
+    std::vector<doubleDouble> a(rows);
+    std::vector<doubleDouble> b(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        a[i] = static_cast<int64_t>(i % 7);
+        b[i] = doubleDouble(static_cast<int64_t>(i)) / 10 + 1;
+    }
+    const doubleDouble *columns[] = {a.data(), b.data()};
+    std::vector<doubleDouble> results(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    expression.runColumns(columns, rows, results.data(), statuses.data(), nullptr);
+    for (size_t i = 0; i < rows; ++i) {
+        const doubleDouble slots[] = {a[i], b[i]};
+        doubleDouble expected;
+        calcLib::Status status = expression.run(slots, expected, nullptr);
+        ASSERT_EQ(statuses[i], status) << i;
+        if (status == calcLib::Status::ok){
+            EXPECT_EQ(results[i], expected) << i;
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#include "calclib/dsl.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstring>
+
+using namespace ::testing;
+
+namespace {
+
+const calclib::variable<0> x{"x"};
+const calclib::variable<1> y{"y"};
+
+void expectSameCode(const compiledExpression &built, const std::string &text) {
+    const calcLib calc;
+    compiledExpression parsed;
+    ASSERT_EQ(calc.compile(text, parsed), calcLib::Status::ok) << text;
+    ASSERT_EQ(built.code.size(), parsed.code.size()) << text;
+    for (size_t i = 0; i < built.code.size(); ++i) {
+        EXPECT_EQ(built.code[i].op, parsed.code[i].op) << text << " instruction " << i;
+        EXPECT_EQ(built.code[i].operand, parsed.code[i].operand) << text << " instruction " << i;
+    }
+    EXPECT_EQ(built.constants, parsed.constants) << text;
+    EXPECT_EQ(built.symbols, parsed.symbols) << text;
+    EXPECT_EQ(built.stackSize, parsed.stackSize) << text;
+}
+
+/**
+ * Compares direct evaluation of formula with the interpreter running its bytecode
+ */
+template<typename Formula>
+void expectSameResults(const Formula &formula) {
+    compiledExpression compiled;
+    calclib::compile(formula, compiled);
+    for (double a : {8.0, -27.0, 0.0, 90.0}) {
+        for (double b : {2.0, 0.0, -3.0}) {
+            const double slots[] = {a, b};
+            // Compiled symbols are numbered in order of appearance
+            double bound[2];
+            for (size_t i = 0; i < compiled.symbols.size(); ++i) {
+                bound[i] = compiled.symbols[i] == "x" ? a : b;
+            }
+            for (bool ieee : {false, true}) {
+                unsigned flags = 0;
+                unsigned expectedFlags = 0;
+                double result = -1;
+                double expected = -1;
+                EXPECT_EQ(formula.run(slots, result, ieee ? &flags : nullptr),
+                          compiled.run(bound, expected, ieee ? &expectedFlags : nullptr));
+                // Which operand NaN propagates through a commutative operation is up to the compiler
+                if (!std::isnan(expected)){
+                    EXPECT_EQ(std::memcmp(&result, &expected, sizeof(result)), 0) << result << " != " << expected;
+                }
+                EXPECT_EQ(std::isnan(result), std::isnan(expected));
+                EXPECT_EQ(flags, expectedFlags);
+            }
+        }
+    }
+}
+
+}
+
+TEST(DslTest, Emits_string_compiler_code) {
+    compiledExpression built;
+    calclib::compile(calclib::sin(x) * 2 + calclib::root(3, y), built);
+    expectSameCode(built, "sin(x)*2+root(3:y)");
+
+    // C++ precedence applies, % binds like / instead of tighter
+    calclib::compile(-x / (y - 1) % 4, built);
+    expectSameCode(built, "(-x/(y-1))%4");
+
+    calclib::compile(calclib::root(y, x) + x, built);
+    expectSameCode(built, "root(y:x)+x");
+
+    calclib::compile(calclib::pow(x, calclib::pow(y, 2)) - calclib::factorial(x), built);
+    expectSameCode(built, "x^y^2-x!");
+
+    calclib::compile(calclib::log(x) + calclib::log(2, y) * calclib::sqrt(x) + calclib::tan(calclib::cos(y)), built);
+    expectSameCode(built, "log(x)+log(2:y)*sqrt(x)+tan(cos(y))");
+
+    calclib::compile(3 * calclib::pow(x, 4) + 2 * calclib::pow(x, 3) - x + 7, built);
+    expectSameCode(built, "3*x^4+2*x^3-x+7");
+
+    // A collected product is no longer contracted, the product on the other side is
+    calclib::compile((calclib::pow(x, 2) + x) * 3 + y * x, built);
+    expectSameCode(built, "(x^2+x)*3+y*x");
+    calclib::compile(-(x * x / 4 - 1) + calclib::sin(y * x) * y, built);
+    expectSameCode(built, "-(x*x/4-1)+sin(y*x)*y");
+
+    calclib::compile(calclib::conditional(x > y, x / y, calclib::clamp(y - x, 0, 1)) + calclib::abs(x), built);
+    expectSameCode(built, "if(x>y:x/y:clamp(y-x:0:1))+abs(x)");
+    calclib::compile(x * y + calclib::conditional(x <= 1, calclib::min(x, y), calclib::max(y, 2) == x), built);
+    expectSameCode(built, "x*y+if(x<=1:min(x:y):max(y:2)=x)");
+}
+
+TEST(DslTest, Folds_constant_subtrees) {
+    compiledExpression built;
+    calclib::compile(calclib::literal{2} * 3 + calclib::sin(calclib::literal{30}) * x, built);
+    expectSameCode(built, "2*3+sin(30)*x");
+
+    // A constant product and the constant added to it fold into one rounding, like with a variable factor
+    calclib::compile(calclib::literal{0.1} * 10 - 1 + x, built);
+    expectSameCode(built, "0.1*10-1+x");
+    EXPECT_EQ((calclib::literal{0.1} * 10 - 1)(), std::fma(0.1, 10, -1));
+    calclib::compile(1 - calclib::literal{0.1} * 10 + x, built);
+    expectSameCode(built, "1-0.1*10+x");
+
+    // Failing operations stay in the code to report the error at evaluation
+    calclib::compile(calclib::literal{1} / 0 + x, built);
+    expectSameCode(built, "1/0+x");
+
+    // A conditional folds as a whole, when the branch taken is constant and the other has no variables
+    calclib::compile(calclib::conditional(calclib::literal{1} > 0, 2, x), built);
+    expectSameCode(built, "if(1>0:2:x)");
+    calclib::compile(calclib::conditional(calclib::literal{1}, 2, calclib::literal{1} / 0) + x, built);
+    expectSameCode(built, "if(1:2:1/0)+x");
+    calclib::compile(calclib::conditional(calclib::literal{1}, calclib::literal{1} / 0, 3) + x, built);
+    expectSameCode(built, "if(1:1/0:3)+x");
+}
+
+TEST(DslTest, Direct_evaluation_matches_bytecode) {
+    expectSameResults(calclib::sin(x) * 2 + calclib::root(3, y));
+    expectSameResults(x / y + calclib::tan(x));
+    expectSameResults(calclib::root(y, x) % (x - y));
+    expectSameResults(calclib::log(y, x) - calclib::factorial(y));
+    expectSameResults(calclib::pow(-x, 0.5) * calclib::sqrt(y));
+    expectSameResults(3 * calclib::pow(x, 4) + 2 * calclib::pow(x, 3) - x + 7);
+    expectSameResults((calclib::pow(x, 2) + x) * 3 + y * x);
+    expectSameResults(1 / y + (x * x - calclib::literal{1} / 3) * y);
+    expectSameResults(calclib::conditional(x > 0, calclib::log(x), 1 / y) + calclib::abs(y));
+    expectSameResults(calclib::clamp(x, y, 10) * calclib::conditional(x != y, x / y, calclib::max(x, y)));
+}
+
+TEST(DslTest, Evaluates_with_calclib) {
+    const calcLib calc;
+    calcSession session;
+    session.setVariable("x", 3);
+    session.setVariable("y", 4);
+    compiledExpression compiled;
+    calclib::compile(calclib::sqrt(x * x + y * y), compiled);
+    double result;
+    ASSERT_EQ(calc.evaluate(compiled, session, result), calcLib::Status::ok);
+    EXPECT_EQ(result, 5);
+
+    auto hypotenuse = calclib::sqrt(x * x + y * y);
+    EXPECT_EQ(hypotenuse(6, 8), 10);
+    EXPECT_TRUE(std::isinf((x / y)(1, 0)));
+}
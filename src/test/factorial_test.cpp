@@ -0,0 +1,66 @@
+#include "calclib/constant.hpp"
+#include "calclib/expression.hpp"
+#include "calclib/factorial.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <vector>
+
+using namespace ::testing;
+
+static_assert(calclib::factorials[20] == 2432902008176640000.0, "exact factorial");
+static_assert(calclib::factorials[170] == 7.257415615307999e306, "largest factorial");
+static_assert(calclib::evaluate("170!") == calclib::factorials[170], "constexpr factorial");
+
+TEST(FactorialTest, Table_is_correctly_rounded) {
+    // Values of n! rounded once, a running product in double is off from 23! on
+    EXPECT_EQ(calclib::factorials[23], 2.585201673888498e22);
+    EXPECT_EQ(calclib::factorials[100], 9.332621544394415e157);
+    calcLib calc;
+    double result;
+    ASSERT_EQ(calc.evaluate("170!", result), calcLib::Status::ok);
+    EXPECT_EQ(result, calclib::factorials[170]);
+    ASSERT_EQ(calc.evaluate("171!", result), calcLib::Status::ok);
+    EXPECT_TRUE(std::isinf(result));
+    ASSERT_EQ(calc.evaluate("(-3)!", result), calcLib::Status::ok);
+    EXPECT_TRUE(std::isnan(result));
+}
+
+TEST(FactorialTest, Gamma_of_non_integers) {
+    calcLib calc;
+    for (double x : {0.5, -0.5, 2.5, 0.001, -2.5, -7.3, 10.1, 99.99, 169.5, 170.6}) {
+        std::string expression = "(" + std::to_string(x) + ")!";
+        double result;
+        ASSERT_EQ(calc.evaluate(expression, result), calcLib::Status::ok) << x;
+        double expected = std::tgamma(std::stod(std::to_string(x)) + 1);
+        EXPECT_NEAR(result, expected, std::abs(expected) * 1e-13) << x;
+    }
+    double result;
+    ASSERT_EQ(calc.evaluate("0.5!", result), calcLib::Status::ok);
+    EXPECT_NEAR(result, std::sqrt(M_PI) / 2, 1e-15);
+    EXPECT_NEAR(calclib::evaluate("(-0.5)!"), std::sqrt(M_PI), 1e-14);
+}
+
+TEST(FactorialTest, Columns_match_scalar) {
+    calcLib calc;
+    compiledExpression expression;
+    ASSERT_EQ(calc.compile("x!", expression), calcLib::Status::ok);
+    // First blocks only hold integers in range, the last ones also fractions, negatives and overflow
+    const size_t rows = 2000;
+    std::vector<double> x(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = i < 1024 ? static_cast<double>(i % 171) : static_cast<double>(i % 400) / 2 - 20;
+    }
+    const double *columns[] = {x.data()};
+    std::vector<double> results(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    expression.runColumns(columns, rows, results.data(), statuses.data(), nullptr);
+    for (size_t i = 0; i < rows; ++i) {
+        double expected;
+        ASSERT_EQ(expression.run(&x[i], expected, nullptr), calcLib::Status::ok);
+        if (std::isnan(expected)){
+            EXPECT_TRUE(std::isnan(results[i])) << x[i];
+        } else {
+            EXPECT_EQ(results[i], expected) << x[i];
+        }
+    }
+}
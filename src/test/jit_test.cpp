@@ -0,0 +1,132 @@
+#include "calclib/jit.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace ::testing;
+
+namespace {
+
+/**
+ * Right nested sum deep enough to spill the value stack out of registers
+ */
+std::string deepExpression(const std::string &innermost) {
+    std::string text;
+    for (int i = 1; i <= 20; ++i) {
+        text += std::to_string(i) + "-(";
+    }
+    text += innermost;
+    return text + std::string(20, ')');
+}
+
+bool sameBits(double lhs, double rhs) {
+    return std::memcmp(&lhs, &rhs, sizeof(lhs)) == 0;
+}
+
+}
+
+TEST(JitTest, Matches_interpreter) {
+    if (!jitExpression::supported){
+        GTEST_SKIP() << "JIT tier is not available on this platform";
+    }
+    const calcLib calc;
+    std::vector<std::string> expressions = {
+            "x*2+pi", "-x", "x-y*3/2", "x/y", "x%y", "x^y", "sin(x)+cos(y)", "tan(x)", "sqrt(x)", "log(x)",
+            "log(y:x)", "root(3:x)", "x!+y", "x/0", "-(x*y)-(-x)", "root(y:x)%(x-y)", "x^2-x^-1+x^0", "x/4-x*y",
+            "root(2:x)+y-x*x", "3*x^4+2*x^3-x+7", "(x^2+y)*(x^3-x/8+1)", deepExpression("x*y"),
+            deepExpression("sin(x)+root(3:y)*x/y"), deepExpression("tan(x)/(y-y)"), deepExpression("x*y+x^2"),
+            deepExpression("x^3-x+y"), "if(x>y:x/y:y-x)", "min(x:y)+abs(x)-max(y:x)", "clamp(x:y:3)",
+            "(x<y)+(x<=y)*2+(x>y)*4+(x>=y)*8+(x=y)*16+(x!=y)*32", deepExpression("if(x:if(y<0:log(x):1/y):x*y)+x")
+    };
+    for (const auto &text : expressions) {
+        compiledExpression compiled;
+        ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok) << text;
+        std::unique_ptr<jitExpression> native = jitExpression::compile(compiled.view());
+        ASSERT_NE(native, nullptr) << text;
+        EXPECT_GT(native->codeSize(), 0);
+        for (double x : {8.0, -27.0, 0.0, 90.0, 2.5}) {
+            for (double y : {2.0, 0.0, -3.0}) {
+                double slots[2];
+                for (size_t i = 0; i < compiled.symbols.size(); ++i) {
+                    slots[i] = compiled.symbols[i] == "x" ? x : compiled.symbols[i] == "y" ? y : M_PI;
+                }
+                for (bool ieee : {false, true}) {
+                    unsigned expectedFlags = 0;
+                    unsigned flags = 0;
+                    double expected = -1;
+                    double result = -1;
+                    EXPECT_EQ(native->run(slots, result, ieee ? &flags : nullptr),
+                              compiled.run(slots, expected, ieee ? &expectedFlags : nullptr)) << text;
+                    EXPECT_TRUE(sameBits(result, expected)) << text << " x=" << x << " y=" << y << ": " << result << " != " << expected;
+                    EXPECT_EQ(flags, expectedFlags) << text;
+                }
+            }
+        }
+    }
+}
+
+TEST(JitTest, Promotes_hot_expressions) {
+    if (!jitExpression::supported){
+        GTEST_SKIP() << "JIT tier is not available on this platform";
+    }
+    setenv("CALCLIB_PERF_MAP", "1", 1);
+    calcLib calc;
+    calc.jitThreshold = 3;
+    calcSession session;
+    session.setVariable("x", 4);
+    compiledExpression compiled;
+    ASSERT_EQ(calc.compile("x*x+ans", compiled), calcLib::Status::ok);
+    double result = 0;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_EQ(calc.evaluate(compiled, session, result), calcLib::Status::ok);
+        EXPECT_EQ(compiled.nativeCode(0), nullptr);
+    }
+    ASSERT_EQ(calc.evaluate(compiled, session, result), calcLib::Status::ok);
+    EXPECT_EQ(result, 48);
+    const jitExpression *native = compiled.nativeCode(0);
+    ASSERT_NE(native, nullptr);
+    ASSERT_EQ(calc.evaluate(compiled, session, result), calcLib::Status::ok);
+    EXPECT_EQ(result, 64);
+
+    // Copies start interpreted
+    compiledExpression copy = compiled;
+    EXPECT_EQ(copy.nativeCode(0), nullptr);
+
+    std::ifstream map("/tmp/perf-" + std::to_string(getpid()) + ".map");
+    ASSERT_TRUE(map.is_open());
+    std::stringstream address;
+    address << std::hex << reinterpret_cast<uintptr_t>(native->code()) << ' ';
+    std::string line;
+    bool found = false;
+    while (std::getline(map, line)) {
+        found = found || line.rfind(address.str(), 0) == 0;
+    }
+    EXPECT_TRUE(found);
+    unsetenv("CALCLIB_PERF_MAP");
+}
+
+TEST(JitTest, Loops_stay_interpreted) {
+    const calcLib calc;
+    for (const char *text : {"sum(i:1:x:sin(i))", "x*prod(i:1:3:x+i)", "sum(i:1:x:i^2)"}) {
+        compiledExpression compiled;
+        ASSERT_EQ(calc.compile(text, compiled), calcLib::Status::ok) << text;
+        EXPECT_EQ(jitExpression::compile(compiled.view()), nullptr) << text;
+    }
+}
+
+TEST(JitTest, Threshold_zero_stays_interpreted) {
+    calcLib calc;
+    calc.jitThreshold = 0;
+    calcSession session;
+    compiledExpression compiled;
+    ASSERT_EQ(calc.compile("2*3", compiled), calcLib::Status::ok);
+    double result;
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(calc.evaluate(compiled, session, result), calcLib::Status::ok);
+    }
+    EXPECT_EQ(compiled.nativeCode(0), nullptr);
+}
@@ -0,0 +1,88 @@
+#include "calclib/process_pool.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <signal.h>
+
+using namespace ::testing;
+
+TEST(CalcProcessPoolTest, Results_in_order) {
+    calcLib calc;
+    calc.ieeeMode = true;
+    calcSession session;
+    session.setVariable("x", 3);
+    calcProcessPool pool{calc, session, 2};
+    std::vector<std::string> storage;
+    for (int i = 0; i < 20000; ++i) {
+        storage.push_back(i % 7 == 0 ? std::to_string(i) + "/0" : std::to_string(i) + "*x+" + std::string(i % 50, '0') + "1");
+    }
+    std::vector<std::string_view> expressions(storage.begin(), storage.end());
+    auto results = pool.evaluate(expressions);
+    ASSERT_EQ(results.size(), expressions.size());
+    for (int i = 0; i < 20000; ++i) {
+        if (i % 7 == 0) {
+            EXPECT_EQ(results[i].flags, calcLib::flagDivisionByZero);
+        } else {
+            EXPECT_EQ(results[i].status, calcLib::Status::ok);
+            EXPECT_EQ(results[i].flags, 0u);
+            EXPECT_EQ(results[i].value, i * 3 + 1);
+        }
+    }
+    EXPECT_EQ(pool.restarts(), 0);
+}
+
+TEST(CalcProcessPoolTest, Rounds) {
+    const calcLib calc;
+    calcProcessPool pool{calc, calcSession(), 1, 64};
+    std::string longExpression = "1";
+    for (int i = 0; i < 40; ++i) {
+        longExpression += "+1";
+    }
+    std::vector<std::string_view> expressions;
+    for (int i = 0; i < 100; ++i) {
+        expressions.push_back(i == 50 ? std::string_view(longExpression) : std::string_view("ans+2*3"));
+    }
+    auto results = pool.evaluate(expressions);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(results[i].status, calcLib::Status::ok);
+        EXPECT_EQ(results[i].value, i == 50 ? 41 : 6);
+    }
+}
+
+TEST(CalcProcessPoolTest, Job_in_shared_area) {
+    const calcLib calc;
+    calcProcessPool pool{calc, calcSession(), 2, 64};
+    int next = 0;
+    int checked = 0;
+    calcProcessPool::job job{pool};
+    while (checked < 100) {
+        // Written in place until the 64 byte area is full
+        std::string expression = std::to_string(next) + "*2";
+        while (char *text = job.append(expression.size())) {
+            expression.copy(text, expression.size());
+            expression = std::to_string(++next) + "*2";
+        }
+        ASSERT_GT(job.size(), 0u);
+        const batchResult *results = job.run();
+        for (size_t i = 0; i < job.size(); ++i, ++checked) {
+            EXPECT_EQ(results[i].status, calcLib::Status::ok);
+            EXPECT_EQ(results[i].value, checked * 2);
+        }
+        job.clear();
+    }
+    EXPECT_EQ(job.append(65), nullptr);
+}
+
+TEST(CalcProcessPoolTest, Worker_crash) {
+    const calcLib calc;
+    calcProcessPool pool{calc, calcSession(), 2};
+    int crashed = pool.workerPid(0);
+    kill(crashed, SIGKILL);
+    std::vector<std::string_view> expressions(50000, "2^10");
+    auto results = pool.evaluate(expressions);
+    for (const auto &result : results) {
+        ASSERT_EQ(result.status, calcLib::Status::ok);
+        ASSERT_EQ(result.value, 1024);
+    }
+    EXPECT_EQ(pool.restarts(), 1);
+    EXPECT_NE(pool.workerPid(0), crashed);
+}
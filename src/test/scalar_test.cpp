@@ -0,0 +1,131 @@
+#include "calclib/calclib.hpp"
+#include "calclib/scalar.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <cstring>
+
+using namespace ::testing;
+
+namespace {
+
+template<typename Scalar>
+calcLib::Status evaluateIn(const char *text, Scalar &outResult) {
+    calcLib calc;
+    basicExpression<Scalar> expression;
+    calcLib::Status status = calc.compile(text, expression);
+    if (status != calcLib::Status::ok){
+        return status;
+    }
+    calcSession session;
+    session.setVariable("x", 0.5);
+    return calc.evaluate(expression, session, outResult);
+}
+
+}
+
+TEST(ScalarTest, Double_engine_matches_compiled_expression) {
+    const char *expressions[] = {
+            "2*pi*6371", "1/3", "0.1+0.2", "sin(30)+cos(x)", "tan(-89.9)", "root(7:1234.5)", "log(0.5:3)",
+            "e^pi", "-7.5%2", "50!", "x^x^x", "1,5*x", "sqrt(2)*sqrt(2)", "if(x<1:max(x:0.25):1/0)+abs(-x)",
+            "sum(i:1:20:x^i/i)+prod(k:1:4:k-x)"
+    };
+    for (const char *text : expressions) {
+        calcLib calc;
+        calcSession session;
+        session.setVariable("x", 0.5);
+        double expected;
+        double result;
+        ASSERT_EQ(calc.evaluate(text, session, expected), calcLib::Status::ok) << text;
+        ASSERT_EQ(evaluateIn(text, result), calcLib::Status::ok) << text;
+        EXPECT_EQ(std::memcmp(&result, &expected, sizeof(result)), 0) << text << ": " << result << " != " << expected;
+    }
+}
+
+TEST(ScalarTest, Evaluates_in_scalar_precision) {
+    float single;
+    ASSERT_EQ(evaluateIn("1/3", single), calcLib::Status::ok);
+    EXPECT_EQ(single, 1.0f / 3);
+
+    long double extended;
+    ASSERT_EQ(evaluateIn("1/3", extended), calcLib::Status::ok);
+    EXPECT_EQ(extended, 1.0L / 3);
+    ASSERT_EQ(evaluateIn("0.1", extended), calcLib::Status::ok);
+    EXPECT_EQ(extended, 0.1L);
+    ASSERT_EQ(evaluateIn("sin(30)", extended), calcLib::Status::ok);
+    EXPECT_NEAR(static_cast<double>(extended - 0.5L), 0, 1e-18);
+
+#if defined(CALCLIB_HAS_FLOAT128)
+    __float128 quad;
+    ASSERT_EQ(evaluateIn("1/3", quad), calcLib::Status::ok);
+    EXPECT_TRUE(quad == __float128(1) / 3);
+    ASSERT_EQ(evaluateIn("2*pi", quad), calcLib::Status::ok);
+    EXPECT_TRUE(quad == 2 * M_PIq);
+    ASSERT_EQ(evaluateIn("sqrt(2)^2-2", quad), calcLib::Status::ok);
+    EXPECT_LT(static_cast<double>(fabsq(quad)), 1e-32);
+#endif
+}
+
+TEST(ScalarTest, Reports_same_errors) {
+    const char *expressions[] = {"1/0", "5%0", "tan(90)", "root(2:-4)", "log(1:5)", "(1+2", "1+", "y+1", "if(1<2:1/0:2)",
+                                 "sum(i:-2:2:1/i)", "prod(i:0.5:2:i)"};
+    for (const char *text : expressions) {
+        calcLib calc;
+        double expected;
+        calcLib::Status status = calc.evaluate(text, expected);
+        float single;
+        long double extended;
+        EXPECT_EQ(evaluateIn(text, single), status) << text;
+        EXPECT_EQ(evaluateIn(text, extended), status) << text;
+    }
+
+    calcLib calc;
+    calc.ieeeMode = true;
+    calcSession session;
+    basicExpression<float> expression;
+    ASSERT_EQ(calc.compile("1/0+root(2:-1)", expression), calcLib::Status::ok);
+    float result;
+    EXPECT_EQ(calc.evaluate(expression, session, result), calcLib::Status::ok);
+    EXPECT_TRUE(std::isnan(result));
+    EXPECT_EQ(session.flags(), calcLib::flagDivisionByZero | calcLib::flagInvalid);
+}
+
+TEST(ScalarTest, Run_columns_in_float_lanes) {
+    calcLib calc;
+    const size_t rows = 3000;
+    std::vector<float> a(rows);
+    std::vector<float> b(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        a[i] = static_cast<float>(i % 7);
+        b[i] = static_cast<float>(i) * 0.25f;
+    }
+    const float *columns[] = {a.data(), b.data()};
+    std::vector<float> results(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    for (const char *text : {"a*b-1/(a-3)+sin(b)", "if(a<3:b/(a-2):min(a:b))", "sum(i:1:a:b/(i-2))"}) {
+        basicExpression<float> expression;
+        ASSERT_EQ(calc.compile(text, expression), calcLib::Status::ok) << text;
+        expression.runColumns(columns, rows, results.data(), statuses.data(), nullptr);
+        for (size_t i = 0; i < rows; ++i) {
+            const float slots[] = {a[i], b[i]};
+            float expected;
+            calcLib::Status status = expression.run(slots, expected, nullptr);
+            ASSERT_EQ(statuses[i], status) << text << " row " << i;
+            if (status == calcLib::Status::ok){
+                EXPECT_EQ(results[i], expected) << text << " row " << i;
+            } else {
+                EXPECT_TRUE(std::isnan(results[i])) << text << " row " << i;
+            }
+        }
+    }
+}
+
+TEST(ScalarTest, Formats_all_digits) {
+    calcLib calc(calcLib::ResultFormat::variable, 25);
+    EXPECT_EQ(calc.formatResult(0.5f), "0.5");
+    EXPECT_EQ(calc.formatResult(1.0L / 4), "0.25");
+    EXPECT_EQ(calc.formatResult(1.0L / 3).substr(0, 21), "0.3333333333333333333");
+#if defined(CALCLIB_HAS_FLOAT128)
+    EXPECT_EQ(calc.formatResult(__float128(1) / 3), "0.3333333333333333333333333");
+    EXPECT_EQ(calc.formatResult(__float128(-12)), "-12");
+#endif
+}
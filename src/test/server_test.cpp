@@ -0,0 +1,237 @@
+#include "calclib/protocol.hpp"
+#include "calclib/server.hpp"
+#include "gtest/gtest.h"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ::testing;
+
+namespace {
+
+int connectTo(const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        ASSERT_GT(result, 0);
+        sent += result;
+    }
+}
+
+std::vector<calcProtocol::frame> receiveFrames(int fd, size_t count, std::string &buffer) {
+    std::vector<calcProtocol::frame> frames;
+    std::vector<size_t> offsets;
+    size_t used = 0;
+    char chunk[4096];
+    while (offsets.size() < count) {
+        calcProtocol::frame response{};
+        size_t consumed = 0;
+        if (calcProtocol::parseFrame(buffer.data() + used, buffer.size() - used, response, consumed) == 1){
+            offsets.push_back(used);
+            used += consumed;
+            continue;
+        }
+        ssize_t result = recv(fd, chunk, sizeof(chunk), 0);
+        if (result <= 0){
+            break;
+        }
+        buffer.append(chunk, result);
+    }
+    // Decode again once the buffer stopped growing so payloads point to valid memory
+    for (size_t offset : offsets) {
+        calcProtocol::frame response{};
+        size_t consumed = 0;
+        calcProtocol::parseFrame(buffer.data() + offset, buffer.size() - offset, response, consumed);
+        frames.push_back(response);
+    }
+    return frames;
+}
+
+}
+
+TEST(CalcProtocolTest, Framing) {
+    std::string buffer;
+    calcProtocol::appendResult(buffer, 3, 1, -2.5);
+    calcProtocol::appendFrame(buffer, calcProtocol::MessageType::evaluate, "1+2");
+    calcProtocol::frame decoded{};
+    size_t consumed = 0;
+    ASSERT_EQ(calcProtocol::parseFrame(buffer.data(), 4, decoded, consumed), 0);
+    ASSERT_EQ(calcProtocol::parseFrame(buffer.data(), buffer.size(), decoded, consumed), 1);
+    EXPECT_EQ(decoded.type, calcProtocol::MessageType::result);
+    ASSERT_EQ(decoded.payload.size(), calcProtocol::resultPayloadSize);
+    EXPECT_EQ(decoded.payload[0], 3);
+    EXPECT_EQ(decoded.payload[1], 1);
+    EXPECT_EQ(calcProtocol::getDouble(decoded.payload.data() + 2), -2.5);
+    ASSERT_EQ(calcProtocol::parseFrame(buffer.data() + consumed, buffer.size() - consumed, decoded, consumed), 1);
+    EXPECT_EQ(decoded.type, calcProtocol::MessageType::evaluate);
+    EXPECT_EQ(decoded.payload, "1+2");
+
+    std::string oversized(calcProtocol::headerSize, '\xff');
+    EXPECT_EQ(calcProtocol::parseFrame(oversized.data(), oversized.size(), decoded, consumed), -1);
+}
+
+TEST(ExpressionCacheTest, Lru_eviction) {
+    const calcLib calc;
+    expressionCache cache{calc, 2};
+    std::shared_ptr<const compiledExpression> compiled;
+    EXPECT_EQ(cache.get("1+1", compiled), calcLib::Status::ok);
+    EXPECT_EQ(cache.get("2+2", compiled), calcLib::Status::ok);
+    EXPECT_EQ(cache.get("1+1", compiled), calcLib::Status::ok);
+    EXPECT_EQ(cache.get("3+", compiled), calcLib::Status::invalidExpression);
+    EXPECT_EQ(compiled, nullptr);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(cache.get("3+", compiled), calcLib::Status::invalidExpression);
+    EXPECT_EQ(cache.get("1+1", compiled), calcLib::Status::ok);
+    EXPECT_EQ(cache.hits(), 3);
+    // 2+2 was least recently used
+    EXPECT_EQ(cache.get("2+2", compiled), calcLib::Status::ok);
+    EXPECT_EQ(cache.misses(), 4);
+
+    calcSession session;
+    double result;
+    EXPECT_EQ(calc.evaluate(*compiled, session, result), calcLib::Status::ok);
+    EXPECT_EQ(result, 4);
+}
+
+TEST(CalcServerTest, Pipelined_requests) {
+    using calcProtocol::MessageType;
+    const calcLib calc;
+    calcServer server{calc, 16};
+    std::string path = "/tmp/calclib_test-" + std::to_string(getpid()) + ".sock";
+    ASSERT_TRUE(server.listen(path));
+    struct stat info{};
+    ASSERT_EQ(stat(path.c_str(), &info), 0);
+    EXPECT_EQ(info.st_mode & 0777, 0600);
+    std::thread loop([&server] { server.run(); });
+
+    int fd = connectTo(path);
+    ASSERT_GE(fd, 0);
+    std::string requests;
+    calcProtocol::appendSetVariable(requests, "x", 4);
+    calcProtocol::appendFrame(requests, MessageType::evaluate, "x*2");
+    calcProtocol::appendFrame(requests, MessageType::evaluate, "ans+1");
+    calcProtocol::appendFrame(requests, MessageType::evaluateText, "1/0");
+    calcProtocol::appendFrame(requests, MessageType::evaluate, "3+");
+    calcProtocol::appendFrame(requests, MessageType::evaluateText, "x*2");
+    sendAll(fd, requests);
+    std::string buffer;
+    auto responses = receiveFrames(fd, 6, buffer);
+    ASSERT_EQ(responses.size(), 6);
+    auto status = [](const calcProtocol::frame &response) {
+        return static_cast<calcLib::Status>(response.payload[0]);
+    };
+    auto value = [](const calcProtocol::frame &response) {
+        return calcProtocol::getDouble(response.payload.data() + 2);
+    };
+    EXPECT_EQ(status(responses[0]), calcLib::Status::ok);
+    EXPECT_EQ(value(responses[0]), 4);
+    EXPECT_EQ(value(responses[1]), 8);
+    EXPECT_EQ(value(responses[2]), 9);
+    EXPECT_EQ(responses[3].type, MessageType::text);
+    EXPECT_EQ(status(responses[3]), calcLib::Status::divisionByZero);
+    EXPECT_EQ(responses[3].payload.substr(1), "Division by zero");
+    EXPECT_EQ(status(responses[4]), calcLib::Status::invalidExpression);
+    EXPECT_EQ(responses[5].payload.substr(1), "8");
+
+    // Variables belong to the connection
+    int other = connectTo(path);
+    ASSERT_GE(other, 0);
+    requests.clear();
+    calcProtocol::appendFrame(requests, MessageType::evaluate, "x*2");
+    sendAll(other, requests);
+    buffer.clear();
+    responses = receiveFrames(other, 1, buffer);
+    ASSERT_EQ(responses.size(), 1);
+    EXPECT_EQ(status(responses[0]), calcLib::Status::invalidExpression);
+    close(other);
+
+    // Unknown message closes the connection
+    requests.clear();
+    calcProtocol::appendFrame(requests, static_cast<MessageType>(0x7f), "");
+    sendAll(fd, requests);
+    char byte;
+    EXPECT_EQ(recv(fd, &byte, 1, 0), 0);
+    close(fd);
+
+    server.stop();
+    loop.join();
+    EXPECT_EQ(server.compiledCache().hits(), 2);
+    EXPECT_EQ(server.compiledCache().misses(), 4);
+}
+
+TEST(CalcServerTest, Stops_reading_clients_that_do_not_read) {
+    const calcLib calc;
+    calcServer server{calc, 16};
+    std::string path = "/tmp/calclib_test-" + std::to_string(getpid()) + ".sock";
+    ASSERT_TRUE(server.listen(path));
+    std::thread loop([&server] { server.run(); });
+
+    int fd = connectTo(path);
+    ASSERT_GE(fd, 0);
+    std::string requests;
+    while (requests.size() < 64 * 1024) {
+        calcProtocol::appendFrame(requests, calcProtocol::MessageType::evaluate, "1+1");
+    }
+    // The server stops reading once responses back up, so sending stalls after about 16 MB of responses
+    const size_t limit = size_t(256) << 20;
+    size_t sent = 0;
+    size_t offset = 0;
+    while (sent < limit) {
+        pollfd writable{fd, POLLOUT, 0};
+        if (poll(&writable, 1, 1000) == 0){
+            break;
+        }
+        ssize_t result = send(fd, requests.data() + offset, requests.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (result < 0){
+            ASSERT_TRUE(errno == EAGAIN || errno == EWOULDBLOCK) << strerror(errno);
+            continue;
+        }
+        sent += result;
+        offset = (offset + result) % requests.size();
+    }
+    EXPECT_LT(sent, size_t(16) << 20);
+    close(fd);
+
+    server.stop();
+    loop.join();
+}
+
+TEST(CalcServerTest, Keeps_sockets_of_other_users) {
+    if (geteuid() != 0){
+        GTEST_SKIP() << "Needs root to leave a socket owned by another user";
+    }
+    std::string path = "/tmp/calclib_test-" + std::to_string(getpid()) + "-other.sock";
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, path.size());
+    ASSERT_EQ(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    ASSERT_EQ(chown(path.c_str(), 65534, 65534), 0);
+
+    const calcLib calc;
+    calcServer server{calc, 16};
+    EXPECT_FALSE(server.listen(path));
+    EXPECT_EQ(errno, EACCES);
+    struct stat info{};
+    EXPECT_EQ(stat(path.c_str(), &info), 0);
+    close(fd);
+    unlink(path.c_str());
+}
@@ -0,0 +1,134 @@
+#include "calclib/constant.hpp"
+#include "calclib/expression.hpp"
+#include "gtest/gtest.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace ::testing;
+
+static_assert(calclib::evaluate("sin(150)") == 0.5, "constexpr exact sine");
+static_assert(calclib::evaluate("tan(-315)") == 1, "constexpr exact tangents");
+
+namespace {
+
+/**
+ * One argument function of x compiled by calcLib, x is slot 0
+ */
+struct degreeFunction {
+    compiledExpression expression;
+
+    explicit degreeFunction(const char *text) {
+        calcLib calc;
+        calc.compile(text, expression);
+    }
+
+    calcLib::Status operator()(double x, double &outResult) const {
+        return expression.run(&x, outResult, nullptr);
+    }
+
+    double operator()(double x) const {
+        double result;
+        expression.run(&x, result, nullptr);
+        return result;
+    }
+};
+
+}
+
+TEST(TrigTest, Exact_at_special_angles) {
+    degreeFunction sine("sin(x)");
+    degreeFunction cosine("cos(x)");
+    degreeFunction tangents("tan(x)");
+    std::pair<double, double> sines[] = {
+            {0, 0}, {30, 0.5}, {90, 1}, {150, 0.5}, {180, 0}, {210, -0.5}, {270, -1}, {330, -0.5}, {360, 0},
+            {-30, -0.5}, {-90, -1}, {-180, 0}, {750, 0.5}, {45, M_SQRT1_2}, {-225, M_SQRT1_2}, {0x1p40 * 360 + 30, 0.5}
+    };
+    for (auto [degrees, expected] : sines) {
+        EXPECT_EQ(sine(degrees), expected) << degrees;
+        EXPECT_EQ(cosine(degrees - 90), expected) << degrees;
+    }
+    // Zeros are positive, so they do not print as -0
+    EXPECT_FALSE(std::signbit(sine(180)));
+    EXPECT_FALSE(std::signbit(cosine(90)));
+    EXPECT_FALSE(std::signbit(cosine(-270)));
+
+    for (double degrees : {45.0, 225.0, -135.0, 405.0}) {
+        double result;
+        ASSERT_EQ(tangents(degrees, result), calcLib::Status::ok) << degrees;
+        EXPECT_EQ(result, 1) << degrees;
+        ASSERT_EQ(tangents(-degrees, result), calcLib::Status::ok) << degrees;
+        EXPECT_EQ(result, -1) << degrees;
+    }
+}
+
+TEST(TrigTest, Tangents_poles) {
+    degreeFunction tangents("tan(x)");
+    for (double degrees : {90.0, 270.0, -90.0, -270.0, 450.0, 90 * (0x1p47 + 1), 90 + 360 * 1e10}) {
+        double result;
+        EXPECT_EQ(tangents(degrees, result), calcLib::Status::divisionByZero) << degrees;
+    }
+
+    calcLib calc;
+    EXPECT_EQ(calc.solveEquation("tan(270)"), "Division by zero");
+    EXPECT_EQ(calc.solveEquation("tan(3*90)"), "Division by zero");
+    calc.ieeeMode = true;
+    EXPECT_EQ(calc.solveEquation("tan(90)"), "inf");
+    EXPECT_EQ(calc.solveEquation("tan(270)"), "-inf");
+    EXPECT_EQ(calc.solveEquation("tan(-270)"), "inf");
+    double folded;
+    EXPECT_EQ(calclib::evaluate("tan(270)", folded), calcLib::Status::divisionByZero);
+}
+
+TEST(TrigTest, Accurate_to_a_few_ulp) {
+    degreeFunction sine("sin(x)");
+    degreeFunction cosine("cos(x)");
+    degreeFunction tangents("tan(x)");
+    // 1e20 is exact in double and 1e20 mod 360 is 280
+    EXPECT_EQ(sine(1e20), sine(280));
+    EXPECT_EQ(cosine(-1e20), cosine(80));
+
+    std::mt19937_64 generator(44);
+    std::uniform_real_distribution<double> angles(-720, 720);
+    for (int i = 0; i < 100000; ++i) {
+        double degrees = angles(generator);
+        long double radians = static_cast<long double>(degrees) * (3.14159265358979323846264338327950288L / 180);
+        double expectedSin = static_cast<double>(std::sin(radians));
+        double expectedCos = static_cast<double>(std::cos(radians));
+        double expectedTan = static_cast<double>(std::tan(radians));
+        EXPECT_NEAR(sine(degrees), expectedSin, std::abs(expectedSin) * 3e-16 + 1e-18) << degrees;
+        EXPECT_NEAR(cosine(degrees), expectedCos, std::abs(expectedCos) * 3e-16 + 1e-18) << degrees;
+        double result;
+        ASSERT_EQ(tangents(degrees, result), calcLib::Status::ok) << degrees;
+        // Close to a pole the rounding of the reference radians dominates, it grows with the derivative 1 + tan^2
+        double referenceError = (1 + expectedTan * expectedTan) * std::abs(degrees) * 1e-21;
+        EXPECT_NEAR(result, expectedTan, std::abs(expectedTan) * 6e-16 + referenceError) << degrees;
+    }
+}
+
+TEST(TrigTest, Columns_match_scalar) {
+    calcLib calc;
+    compiledExpression expression;
+    ASSERT_EQ(calc.compile("sin(x)+cos(x)*2-tan(x)", expression), calcLib::Status::ok);
+    // First blocks only hold angles the fast reduction covers, the last ones also huge values and NaN
+    const size_t rows = 2000;
+    std::vector<double> x(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        x[i] = i < 1024 ? static_cast<double>(i) * 7.5 - 3000 : static_cast<double>(i) * 1e17 + 90;
+    }
+    x[rows - 1] = NAN;
+    const double *columns[] = {x.data()};
+    std::vector<double> results(rows);
+    std::vector<calcLib::Status> statuses(rows);
+    expression.runColumns(columns, rows, results.data(), statuses.data(), nullptr);
+    for (size_t i = 0; i < rows; ++i) {
+        double expected;
+        calcLib::Status status = expression.run(&x[i], expected, nullptr);
+        ASSERT_EQ(statuses[i], status) << x[i];
+        if (status != calcLib::Status::ok || std::isnan(expected)){
+            EXPECT_TRUE(std::isnan(results[i])) << x[i];
+        } else {
+            EXPECT_EQ(results[i], expected) << x[i];
+        }
+    }
+}